@@ -100,6 +100,7 @@
 - (unsigned short)numberOfSpeakerChannels;
 - (unsigned short)numberOfHardwareDeviceOutputChannels;
 - (double)cpuUsage;
+- (double)progressOfAddingAudioRegions;
 
 
 // Setter
@@ -110,6 +111,13 @@
 // Project specific audio settings
 
 - (void)setAmbisonicsOrder:(float)order;
+- (void)setSceneRotationYaw:(double)yaw
+                      pitch:(double)pitch
+                       roll:(double)roll
+               translationX:(double)x
+               translationY:(double)y
+               translationZ:(double)z
+                      scale:(double)scale;
 
 - (void)setDistanceBasedAttenuation:(int)type
                      centreZoneSize:(double)cRadius 
@@ -134,6 +142,8 @@
 - (void)modifyAudioRegion:(id)audioRegion;
 - (void)deleteAudioRegion:(id)audioRegion;
 - (void)deleteAllAudioRegions;
+- (void)beginEditTransaction;
+- (void)commitEditTransaction;
 
 
 // Hardware
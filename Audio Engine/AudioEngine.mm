@@ -7,6 +7,9 @@
 //
 
 #import "AudioEngine.h"
+#import "CHGlobals.h"
+#import "RandomTrajectory.h"
+#import "CircularRandomTrajectory.h"
 
 
 @interface AudioEngine ()
@@ -14,10 +17,29 @@
 // private methods
 - (void)setGainAutomation:(id)audioRegion;
 - (void)setSpatialAutomation:(id)audioRegion;
+- (BOOL)setSpatialTrajectory:(id)audioRegion;
 
 @end
 
 
+// the parameter breakpoints of a trajectory, for the audio engine
+static TrajectoryParameter trajectoryParameterWithValues(BreakpointArray *breakpoints)
+{
+	TrajectoryParameter parameter;
+	for(Breakpoint *bp in breakpoints)
+		parameter.addValue([bp time], [bp value]);
+	return parameter;
+}
+
+static TrajectoryParameter trajectoryParameterWithPositions(BreakpointArray *breakpoints)
+{
+	TrajectoryParameter parameter;
+	for(Breakpoint *bp in breakpoints)
+		parameter.addPosition([bp time], [bp x], [bp y], [bp z]);
+	return parameter;
+}
+
+
 
 
 @implementation AudioEngine
@@ -66,6 +88,13 @@ static AudioEngine *sharedAudioEngine = nil;
 	// Juce
 	initialiseJuce_GUI();
 	
+#if AUDIO_ENGINE_UNIT_TESTS
+	if (!AmbisonicsAudioEngine::runUnitTests())
+	{
+		NSLog(@"AudioEngine: at least one unit test of the audio engine failed.");
+	}
+#endif
+	
 	// instantiate ambisonicsAudioEngine
 	ambisonicsAudioEngine = new AmbisonicsAudioEngine();
 	
@@ -381,6 +410,11 @@ static AudioEngine *sharedAudioEngine = nil;
 	return ambisonicsAudioEngine->getCpuUsage();
 }
 
+- (double)progressOfAddingAudioRegions
+{
+	return ambisonicsAudioEngine->getProgressOfAddingAudioRegions();
+}
+
 
 #pragma mark -
 #pragma mark setter
@@ -397,6 +431,17 @@ static AudioEngine *sharedAudioEngine = nil;
 	ambisonicsAudioEngine->setAEPOrder(order);
 }
 
+- (void)setSceneRotationYaw:(double)yaw
+                      pitch:(double)pitch
+                       roll:(double)roll
+               translationX:(double)x
+               translationY:(double)y
+               translationZ:(double)z
+                      scale:(double)scale
+{
+	ambisonicsAudioEngine->setSceneTransform(yaw, pitch, roll, x, y, z, scale);
+}
+
 - (void)setDistanceBasedAttenuation:(int)type
                      centreZoneSize:(double)cRadius 
                      centreExponent:(double)cExponent
@@ -469,12 +514,13 @@ static AudioEngine *sharedAudioEngine = nil;
 	//NSLog(@"addAudioRegion(%d) %@", index, filePath);
 
 	
-	// add the audio region to the scheduler	
-	ambisonicsAudioEngine->addAudioRegion(index,
-										  startTime,
-										  duration,
-										  offsetInFile,
-										  [filePath UTF8String]);
+	// add the audio region to the scheduler (the audio file is opened in
+	// the background, together with the ones of the other regions)
+	ambisonicsAudioEngine->addAudioRegionAsynchronously(index,
+														startTime,
+														duration,
+														offsetInFile,
+														[filePath UTF8String]);
 	
 	
 	[self setGainAutomation:audioRegion];	
@@ -514,6 +560,16 @@ static AudioEngine *sharedAudioEngine = nil;
 	ambisonicsAudioEngine->removeAllRegions();
 }
 
+- (void)beginEditTransaction
+{
+	ambisonicsAudioEngine->beginEditTransaction();
+}
+
+- (void)commitEditTransaction
+{
+	ambisonicsAudioEngine->commitEditTransaction();
+}
+
 
 - (void)setGainAutomation:(id)audioRegion
 {
@@ -548,8 +604,19 @@ static AudioEngine *sharedAudioEngine = nil;
 
 - (void)setSpatialAutomation:(id)audioRegion
 {
+	// rotations and random trajectories are evaluated by the audio engine
+	if([self setSpatialTrajectory:audioRegion])
+		return;
+	
 	unsigned int index = [[audioRegion valueForKey:@"playbackIndex"] unsignedIntValue];
-	Array<SpacialEnvelopePoint> spacialEnvelope;
+	NSArray *breakpoints = [audioRegion valueForKey:@"playbackBreakpointArray"];
+	int numberOfPoints = (int)[breakpoints count];
+	
+	// The spacial envelope is handed over as flat arrays.
+	HeapBlock<int> positions (numberOfPoints);
+	HeapBlock<double> x (numberOfPoints);
+	HeapBlock<double> y (numberOfPoints);
+	HeapBlock<double> z (numberOfPoints);
 	
 //	NSLog(@"setSpatialAutomation for AudioRegion(%d) %@", index, [audioRegion valueForKeyPath:@"audioItem.node.name"]);
 
@@ -561,16 +628,17 @@ static AudioEngine *sharedAudioEngine = nil;
 	int sampleRate = (int)ambisonicsAudioEngine->getCurrentSampleRate();
 	double fromMsToSamples = 0.001*sampleRate;
 	unsigned long  offsetInFile = [[audioRegion valueForKeyPath:@"audioItem.offsetInFile"] unsignedLongLongValue] * fromMsToSamples;
-	for(id bp in [audioRegion valueForKey:@"playbackBreakpointArray"])
+	int i = 0;
+	for(id bp in breakpoints)
 	{
 		// Reminder from the documentation of ambisonicsAudioEngine->setSpacialEnvelopeForRegion(..):
 		//  The spacial envelope contains points. Such a point holds four values: The position
 		//  (the time information, measured in samples, starting at the beginning of the audiofile
 		//   - not at the beginning of a region with an offset) and the x, y and z coordinates.
-		spacialEnvelope.add(SpacialEnvelopePoint([[bp valueForKey:@"time"] longValue] * fromMsToSamples + offsetInFile,
-                                                 [[bp valueForKey:@"x"] floatValue] * spacialFactor,
-                                                 [[bp valueForKey:@"y"] floatValue] * spacialFactor,
-                                                 [[bp valueForKey:@"z"] floatValue] * spacialFactor));
+		positions[i] = [[bp valueForKey:@"time"] longValue] * fromMsToSamples + offsetInFile;
+		x[i] = [[bp valueForKey:@"x"] floatValue] * spacialFactor;
+		y[i] = [[bp valueForKey:@"y"] floatValue] * spacialFactor;
+		z[i] = [[bp valueForKey:@"z"] floatValue] * spacialFactor;
             // The "+ offsetInFile" is needed because the GUI wants to start with the spacial envelope at
             // the start of a region, whereas the audio engine wants it to start at the beginning of the
             // audio file.
@@ -580,12 +648,81 @@ static AudioEngine *sharedAudioEngine = nil;
 //		[[bp valueForKey:@"x"] floatValue],
 //		[[bp valueForKey:@"y"] floatValue],
 //		[[bp valueForKey:@"z"] floatValue]);
+		++i;
 	}
 	
-	ambisonicsAudioEngine->setSpacialEnvelopeForRegion(index, spacialEnvelope);
-	// The spacialEnvelope will be deleted by AudioSourceAmbipanning
+	ambisonicsAudioEngine->setSpacialEnvelopeForRegion(index, positions, x, y, z, numberOfPoints);
+	// The points are copied into a SpacialEnvelope, which is shared by all stages of the region.
 }	
 
+- (BOOL)setSpatialTrajectory:(id)audioRegion
+{
+	id trajectoryItem = [audioRegion valueForKey:@"trajectoryItem"];
+	NSArray *breakpoints = [audioRegion valueForKey:@"playbackBreakpointArray"];
+	int durationMode = [[audioRegion valueForKey:@"trajectoryDurationMode"] intValue];
+	
+	if(!trajectoryItem || ![breakpoints count] || durationMode == durationModeNotSet)
+		return NO;
+	
+	// a trajectory modulated by the parent region is only available as breakpoints
+	if([audioRegion valueForKey:@"parentRegion"] && [audioRegion valueForKeyPath:@"parentRegion.playbackBreakpointArray"])
+		return NO;
+	
+	int trajectoryType = [[trajectoryItem valueForKey:@"trajectoryType"] intValue];
+	if(trajectoryType != rotationSpeedType && trajectoryType != rotationAngleType &&
+	   trajectoryType != randomType && trajectoryType != circularRandomType)
+		return NO;
+	
+	unsigned int index = [[audioRegion valueForKey:@"playbackIndex"] unsignedIntValue];
+	Trajectory *trajectory = [trajectoryItem valueForKey:@"trajectory"];
+	BreakpointArray *parameters = [trajectory parameterBreakpointArray];
+	double originalDuration = [[trajectoryItem valueForKey:@"duration"] doubleValue];
+	SpacialTrajectory::DurationMode mode = (SpacialTrajectory::DurationMode)durationMode;
+	
+	// the first playback breakpoint is the initial position (at time 0)
+	SpatialPosition *start = [(Breakpoint *)[breakpoints objectAtIndex:0] position];
+	
+	if(trajectoryType == rotationSpeedType || trajectoryType == rotationAngleType)
+	{
+		Breakpoint *centre = [[parameters filteredBreakpointArrayUsingDescriptor:@"Center"] objectAtIndex:0];
+		BOOL speed = trajectoryType == rotationSpeedType;
+		
+		SpacialRotationTrajectory rotation(speed ? SpacialRotationTrajectory::rotationModeSpeed : SpacialRotationTrajectory::rotationModeAngle,
+										   start.x, start.y, start.z,
+										   centre.x, centre.y,
+										   trajectoryParameterWithValues([parameters filteredBreakpointArrayUsingDescriptor:speed ? @"Speed" : @"Angle"]),
+										   originalDuration,
+										   mode);
+		ambisonicsAudioEngine->setSpacialTrajectoryForRegion(index, rotation);
+	}
+	else if(trajectoryType == randomType)
+	{
+		SpacialRandomTrajectory random(start.x, start.y, start.z,
+									   trajectoryParameterWithPositions([parameters filteredBreakpointArrayUsingDescriptor:@"Point1"]),
+									   trajectoryParameterWithPositions([parameters filteredBreakpointArrayUsingDescriptor:@"Point2"]),
+									   trajectoryParameterWithValues([parameters filteredBreakpointArrayUsingDescriptor:@"MinSpeed"]),
+									   trajectoryParameterWithValues([parameters filteredBreakpointArrayUsingDescriptor:@"MaxSpeed"]),
+									   trajectoryParameterWithValues([parameters filteredBreakpointArrayUsingDescriptor:@"Stability"]),
+									   [(RandomTrajectory *)trajectory randomSeed],
+									   originalDuration,
+									   mode);
+		ambisonicsAudioEngine->setSpacialTrajectoryForRegion(index, random);
+	}
+	else
+	{
+		SpacialCircularRandomTrajectory circularRandom(start.x, start.y, start.z,
+													   trajectoryParameterWithValues([parameters filteredBreakpointArrayUsingDescriptor:@"MinSpeed"]),
+													   trajectoryParameterWithValues([parameters filteredBreakpointArrayUsingDescriptor:@"MaxSpeed"]),
+													   trajectoryParameterWithValues([parameters filteredBreakpointArrayUsingDescriptor:@"Stability"]),
+													   [(CircularRandomTrajectory *)trajectory randomSeed],
+													   originalDuration,
+													   mode);
+		ambisonicsAudioEngine->setSpacialTrajectoryForRegion(index, circularRandom);
+	}
+	
+	return YES;
+}
+
 
 #pragma mark -
 #pragma mark hardware
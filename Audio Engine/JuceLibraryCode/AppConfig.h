@@ -20,6 +20,16 @@
 // debug output of the audio engine, outcomment the next line:
 // #define AUDIO_ENGINE_DEBUG 1
 
+// The unit tests of the audio engine. If enabled, they are run each time
+// the audio engine is set up (see AmbisonicsAudioEngine::runUnitTests()),
+// which delays the start of the application. Enable this for a test run
+// only, not for the shipped configurations:
+// #define AUDIO_ENGINE_UNIT_TESTS 1
+
+// The benchmarks (they log the time they take). They are run together with
+// the unit tests, if these are enabled:
+// #define AUDIO_ENGINE_BENCHMARKS 1
+
 
 //#define  JUCE_FORCE_DEBUG
 //#define  JUCE_LOG_ASSERTIONS
@@ -0,0 +1,494 @@
+/*
+ *  AEPGainCalculator.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120814.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "AEPGainCalculator.h"
+
+#if defined (__SSE2__) || defined (__amd64__) || defined (__x86_64__)
+ #include <emmintrin.h>
+ #define AEPGAINCALCULATOR_USE_SSE 1
+#elif (defined (__ARM_NEON__) || defined (__ARM_NEON)) && defined (__aarch64__)
+ // The double precision and the division are only available on 64 bit ARM.
+ #include <arm_neon.h>
+ #define AEPGAINCALCULATOR_USE_NEON 1
+#endif
+
+
+namespace
+{
+    /* The fastApproximation mode for four speakers at a time: The same
+     operations as AEPGainCalculator::fastLog2, fastExp2 and fastPow (in
+     the same order, hence with the same rounding), with the branches
+     replaced by masks. As in the scalar version, the base is calculated in
+     double precision, since the error of a base close to 1 grows with the
+     order.
+     
+     Writes pow(base, order) * gain for the bases of the speakers
+     [0, numberOfChannels) rounded down to a multiple of 4 and returns the
+     number of gains written. The remaining ones are calculated by the
+     caller.
+     */
+    inline int calculateFastGains (double x, double y, double z,
+                                   const double* xs, const double* ys, const double* zs,
+                                   float order, float gain,
+                                   float* gains, int numberOfChannels)
+    {
+        int channel = 0;
+
+    #if AEPGAINCALCULATOR_USE_SSE
+        const __m128d vx = _mm_set1_pd (x);
+        const __m128d vy = _mm_set1_pd (y);
+        const __m128d vz = _mm_set1_pd (z);
+        const __m128d halfDouble = _mm_set1_pd (0.5);
+        const __m128 vOrder = _mm_set1_ps (order);
+        const __m128 vGain = _mm_set1_ps (gain);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 half = _mm_set1_ps (0.5f);
+        const __m128 one = _mm_set1_ps (1.0f);
+        const __m128 valueOfAZeroBase = order == 0.0f ? one : zero;
+
+        for (; channel + 4 <= numberOfChannels; channel += 4)
+        {
+            // The base, 0.5 + 0.5 * (the cosine of the angle), in [0, 1].
+            __m128d dot = _mm_add_pd (_mm_add_pd (_mm_mul_pd (vx, _mm_loadu_pd (xs + channel)),
+                                                  _mm_mul_pd (vy, _mm_loadu_pd (ys + channel))),
+                                      _mm_mul_pd (vz, _mm_loadu_pd (zs + channel)));
+            const __m128 base01 = _mm_cvtpd_ps (_mm_add_pd (halfDouble, _mm_mul_pd (halfDouble, dot)));
+            dot = _mm_add_pd (_mm_add_pd (_mm_mul_pd (vx, _mm_loadu_pd (xs + channel + 2)),
+                                          _mm_mul_pd (vy, _mm_loadu_pd (ys + channel + 2))),
+                              _mm_mul_pd (vz, _mm_loadu_pd (zs + channel + 2)));
+            const __m128 base23 = _mm_cvtpd_ps (_mm_add_pd (halfDouble, _mm_mul_pd (halfDouble, dot)));
+            const __m128 base = _mm_min_ps (one, _mm_max_ps (zero, _mm_movelh_ps (base01, base23)));
+
+            // fastLog2 (base)
+            const __m128i bits = _mm_castps_si128 (base);
+            __m128i exponent = _mm_sub_epi32 (_mm_and_si128 (_mm_srli_epi32 (bits, 23), _mm_set1_epi32 (0xff)),
+                                              _mm_set1_epi32 (127));
+            __m128 mantissa = _mm_castsi128_ps (_mm_or_si128 (_mm_and_si128 (bits, _mm_set1_epi32 (0x007fffff)),
+                                                              _mm_set1_epi32 (0x3f800000)));
+            const __m128 isLarge = _mm_cmpgt_ps (mantissa, _mm_set1_ps (1.41421356f));
+            mantissa = _mm_or_ps (_mm_and_ps (isLarge, _mm_mul_ps (mantissa, half)),
+                                  _mm_andnot_ps (isLarge, mantissa));
+            exponent = _mm_sub_epi32 (exponent, _mm_castps_si128 (isLarge)); // + 1 where the mask is set.
+            const __m128 t = _mm_div_ps (_mm_sub_ps (mantissa, one), _mm_add_ps (mantissa, one));
+            const __m128 t2 = _mm_mul_ps (t, t);
+            __m128 log2 = _mm_add_ps (_mm_set1_ps (0.577078016f), _mm_mul_ps (t2, _mm_set1_ps (0.412198583f)));
+            log2 = _mm_add_ps (_mm_set1_ps (0.961796694f), _mm_mul_ps (t2, log2));
+            log2 = _mm_add_ps (_mm_set1_ps (2.88539008f), _mm_mul_ps (t2, log2));
+            log2 = _mm_add_ps (_mm_cvtepi32_ps (exponent), _mm_mul_ps (t, log2));
+
+            // fastExp2 (order * log2)
+            const __m128 e = _mm_mul_ps (vOrder, log2);
+            const __m128 isNotTooSmall = _mm_cmpge_ps (e, _mm_set1_ps (-126.0f));
+            const __m128 clampedE = _mm_min_ps (_mm_set1_ps (127.0f), _mm_max_ps (_mm_set1_ps (-126.0f), e));
+            // floor (clampedE + 0.5), from the truncation.
+            const __m128 rounded = _mm_add_ps (clampedE, half);
+            __m128i n = _mm_cvttps_epi32 (rounded);
+            const __m128 truncationIsTooLarge = _mm_cmpgt_ps (_mm_cvtepi32_ps (n), rounded);
+            n = _mm_add_epi32 (n, _mm_castps_si128 (truncationIsTooLarge)); // - 1 where the mask is set.
+            const __m128 f = _mm_sub_ps (clampedE, _mm_cvtepi32_ps (n));
+            __m128 p = _mm_add_ps (_mm_set1_ps (0.00133335581f), _mm_mul_ps (f, _mm_set1_ps (0.000154035304f)));
+            p = _mm_add_ps (_mm_set1_ps (0.00961812911f), _mm_mul_ps (f, p));
+            p = _mm_add_ps (_mm_set1_ps (0.0555041087f), _mm_mul_ps (f, p));
+            p = _mm_add_ps (_mm_set1_ps (0.240226507f), _mm_mul_ps (f, p));
+            p = _mm_add_ps (_mm_set1_ps (0.693147181f), _mm_mul_ps (f, p));
+            p = _mm_add_ps (one, _mm_mul_ps (f, p));
+            const __m128 twoToTheN = _mm_castsi128_ps (_mm_slli_epi32 (_mm_add_epi32 (n, _mm_set1_epi32 (127)), 23));
+            __m128 power = _mm_and_ps (isNotTooSmall, _mm_mul_ps (p, twoToTheN));
+
+            // fastPow: A base of (almost) 0.
+            const __m128 isZero = _mm_cmple_ps (base, _mm_set1_ps (1.0e-30f));
+            power = _mm_or_ps (_mm_and_ps (isZero, valueOfAZeroBase), _mm_andnot_ps (isZero, power));
+
+            _mm_storeu_ps (gains + channel, _mm_mul_ps (power, vGain));
+        }
+
+    #elif AEPGAINCALCULATOR_USE_NEON
+        const float64x2_t vx = vdupq_n_f64 (x);
+        const float64x2_t vy = vdupq_n_f64 (y);
+        const float64x2_t vz = vdupq_n_f64 (z);
+        const float64x2_t halfDouble = vdupq_n_f64 (0.5);
+        const float32x4_t vOrder = vdupq_n_f32 (order);
+        const float32x4_t vGain = vdupq_n_f32 (gain);
+        const float32x4_t zero = vdupq_n_f32 (0.0f);
+        const float32x4_t half = vdupq_n_f32 (0.5f);
+        const float32x4_t one = vdupq_n_f32 (1.0f);
+        const float32x4_t valueOfAZeroBase = order == 0.0f ? one : zero;
+
+        for (; channel + 4 <= numberOfChannels; channel += 4)
+        {
+            // The base, 0.5 + 0.5 * (the cosine of the angle), in [0, 1].
+            float64x2_t dot = vaddq_f64 (vaddq_f64 (vmulq_f64 (vx, vld1q_f64 (xs + channel)),
+                                                    vmulq_f64 (vy, vld1q_f64 (ys + channel))),
+                                         vmulq_f64 (vz, vld1q_f64 (zs + channel)));
+            const float32x2_t base01 = vcvt_f32_f64 (vaddq_f64 (halfDouble, vmulq_f64 (halfDouble, dot)));
+            dot = vaddq_f64 (vaddq_f64 (vmulq_f64 (vx, vld1q_f64 (xs + channel + 2)),
+                                        vmulq_f64 (vy, vld1q_f64 (ys + channel + 2))),
+                             vmulq_f64 (vz, vld1q_f64 (zs + channel + 2)));
+            const float32x2_t base23 = vcvt_f32_f64 (vaddq_f64 (halfDouble, vmulq_f64 (halfDouble, dot)));
+            const float32x4_t base = vminq_f32 (one, vmaxq_f32 (zero, vcombine_f32 (base01, base23)));
+
+            // fastLog2 (base)
+            const uint32x4_t bits = vreinterpretq_u32_f32 (base);
+            int32x4_t exponent = vsubq_s32 (vreinterpretq_s32_u32 (vandq_u32 (vshrq_n_u32 (bits, 23), vdupq_n_u32 (0xff))),
+                                            vdupq_n_s32 (127));
+            float32x4_t mantissa = vreinterpretq_f32_u32 (vorrq_u32 (vandq_u32 (bits, vdupq_n_u32 (0x007fffff)),
+                                                                     vdupq_n_u32 (0x3f800000)));
+            const uint32x4_t isLarge = vcgtq_f32 (mantissa, vdupq_n_f32 (1.41421356f));
+            mantissa = vbslq_f32 (isLarge, vmulq_f32 (mantissa, half), mantissa);
+            exponent = vsubq_s32 (exponent, vreinterpretq_s32_u32 (isLarge)); // + 1 where the mask is set.
+            const float32x4_t t = vdivq_f32 (vsubq_f32 (mantissa, one), vaddq_f32 (mantissa, one));
+            const float32x4_t t2 = vmulq_f32 (t, t);
+            float32x4_t log2 = vaddq_f32 (vdupq_n_f32 (0.577078016f), vmulq_f32 (t2, vdupq_n_f32 (0.412198583f)));
+            log2 = vaddq_f32 (vdupq_n_f32 (0.961796694f), vmulq_f32 (t2, log2));
+            log2 = vaddq_f32 (vdupq_n_f32 (2.88539008f), vmulq_f32 (t2, log2));
+            log2 = vaddq_f32 (vcvtq_f32_s32 (exponent), vmulq_f32 (t, log2));
+
+            // fastExp2 (order * log2)
+            const float32x4_t e = vmulq_f32 (vOrder, log2);
+            const uint32x4_t isNotTooSmall = vcgeq_f32 (e, vdupq_n_f32 (-126.0f));
+            const float32x4_t clampedE = vminq_f32 (vdupq_n_f32 (127.0f), vmaxq_f32 (vdupq_n_f32 (-126.0f), e));
+            // floor (clampedE + 0.5), from the truncation.
+            const float32x4_t rounded = vaddq_f32 (clampedE, half);
+            int32x4_t n = vcvtq_s32_f32 (rounded);
+            const uint32x4_t truncationIsTooLarge = vcgtq_f32 (vcvtq_f32_s32 (n), rounded);
+            n = vaddq_s32 (n, vreinterpretq_s32_u32 (truncationIsTooLarge)); // - 1 where the mask is set.
+            const float32x4_t f = vsubq_f32 (clampedE, vcvtq_f32_s32 (n));
+            float32x4_t p = vaddq_f32 (vdupq_n_f32 (0.00133335581f), vmulq_f32 (f, vdupq_n_f32 (0.000154035304f)));
+            p = vaddq_f32 (vdupq_n_f32 (0.00961812911f), vmulq_f32 (f, p));
+            p = vaddq_f32 (vdupq_n_f32 (0.0555041087f), vmulq_f32 (f, p));
+            p = vaddq_f32 (vdupq_n_f32 (0.240226507f), vmulq_f32 (f, p));
+            p = vaddq_f32 (vdupq_n_f32 (0.693147181f), vmulq_f32 (f, p));
+            p = vaddq_f32 (one, vmulq_f32 (f, p));
+            const float32x4_t twoToTheN = vreinterpretq_f32_s32 (vshlq_n_s32 (vaddq_s32 (n, vdupq_n_s32 (127)), 23));
+            float32x4_t power = vreinterpretq_f32_u32 (vandq_u32 (isNotTooSmall, vreinterpretq_u32_f32 (vmulq_f32 (p, twoToTheN))));
+
+            // fastPow: A base of (almost) 0.
+            const uint32x4_t isZero = vcleq_f32 (base, vdupq_n_f32 (1.0e-30f));
+            power = vbslq_f32 (isZero, valueOfAZeroBase, power);
+
+            vst1q_f32 (gains + channel, vmulq_f32 (power, vGain));
+        }
+    #else
+        (void) x; (void) y; (void) z; (void) xs; (void) ys; (void) zs;
+        (void) order; (void) gain; (void) gains; (void) numberOfChannels;
+    #endif
+
+        return channel;
+    }
+}
+
+
+AEPGainCalculator::AEPGainCalculator ()
+:   numberOfSpeakers (0),
+    accuracyMode (exact),
+    maximumOrder (1.0),
+    numberOfOrderSteps (0)
+{
+}
+
+AEPGainCalculator::~AEPGainCalculator ()
+{
+}
+
+void AEPGainCalculator::setNumberOfSpeakers (int numberOfSpeakers_)
+{
+    numberOfSpeakers = numberOfSpeakers_;
+    speakerX.allocate (jmax (1, numberOfSpeakers), true);
+    speakerY.allocate (jmax (1, numberOfSpeakers), true);
+    speakerZ.allocate (jmax (1, numberOfSpeakers), true);
+}
+
+int AEPGainCalculator::getNumberOfSpeakers () const
+{
+    return numberOfSpeakers;
+}
+
+void AEPGainCalculator::setSpeakerPosition (int speakerIndex, double x, double y, double z)
+{
+    jassert (isPositiveAndBelow (speakerIndex, numberOfSpeakers));
+
+    speakerX[speakerIndex] = x;
+    speakerY[speakerIndex] = y;
+    speakerZ[speakerIndex] = z;
+}
+
+void AEPGainCalculator::setMaximumOrder (double maximumOrder_)
+{
+    maximumOrder = jmax (0.0, maximumOrder_);
+
+    if (accuracyMode == lookupTable)
+    {
+        calculateTable();
+    }
+}
+
+void AEPGainCalculator::setAccuracyMode (AccuracyMode accuracyMode_)
+{
+    if (accuracyMode_ == lookupTable)
+    {
+        calculateTable();
+    }
+    else
+    {
+        table.free();
+        numberOfOrderSteps = 0;
+    }
+
+    accuracyMode = accuracyMode_;
+}
+
+AEPGainCalculator::AccuracyMode AEPGainCalculator::getAccuracyMode () const
+{
+    return accuracyMode;
+}
+
+void AEPGainCalculator::calculateGains (double x,
+                                        double y,
+                                        double z,
+                                        double modifiedOrder,
+                                        double distanceGain,
+                                        float* gains,
+                                        int numberOfChannels) const
+{
+    jassert (numberOfChannels <= numberOfSpeakers);
+
+    const double* const xs = speakerX;
+    const double* const ys = speakerY;
+    const double* const zs = speakerZ;
+
+    if (accuracyMode == exact)
+    {
+        for (int channel = 0; channel < numberOfChannels; ++channel)
+        {
+            gains[channel] = (float) (pow(0.5 + 0.5*(x*xs[channel] + y*ys[channel] + z*zs[channel]), modifiedOrder)
+                                      * distanceGain);
+        }
+    }
+    else if (accuracyMode == fastApproximation)
+    {
+        // Four speakers at a time (if SSE or NEON is available). The
+        // vectorised version takes the same steps as the scalar one for the
+        // remaining speakers.
+        const float order = (float) modifiedOrder;
+        const float gain = (float) distanceGain;
+        int channel = calculateFastGains (x, y, z, xs, ys, zs, order, gain, gains, numberOfChannels);
+        for (; channel < numberOfChannels; ++channel)
+        {
+            const float base = jlimit (0.0f, 1.0f, (float) (0.5 + 0.5*(x*xs[channel] + y*ys[channel] + z*zs[channel])));
+            gains[channel] = fastPow (base, order) * gain;
+        }
+    }
+    else // lookupTable
+    {
+        const float order = (float) modifiedOrder;
+        const float gain = (float) distanceGain;
+        for (int channel = 0; channel < numberOfChannels; ++channel)
+        {
+            const float base = jlimit (0.0f, 1.0f, (float) (0.5 + 0.5*(x*xs[channel] + y*ys[channel] + z*zs[channel])));
+            gains[channel] = lookUp (base, order) * gain;
+        }
+    }
+}
+
+double AEPGainCalculator::power (double base, double exponent) const
+{
+    if (accuracyMode == exact)
+    {
+        return pow (base, exponent);
+    }
+    return fastPow ((float) base, (float) exponent);
+}
+
+double AEPGainCalculator::powerOfTen (double exponent) const
+{
+    if (accuracyMode == exact)
+    {
+        return pow (10.0, exponent);
+    }
+    // 10^x = 2^(x * log2(10))
+    return fastExp2 ((float) (exponent * 3.32192809488736));
+}
+
+void AEPGainCalculator::calculateTable ()
+{
+    numberOfOrderSteps = jmax (1, (int) ceil (maximumOrder * orderStepsPerUnit));
+    const int rowLength = numberOfBaseSteps + 1;
+    table.allocate (rowLength * (numberOfOrderSteps + 1), false);
+
+    for (int orderStep = 0; orderStep <= numberOfOrderSteps; ++orderStep)
+    {
+        const double order = double(orderStep) / orderStepsPerUnit;
+        float* const row = table + orderStep * rowLength;
+        for (int baseStep = 0; baseStep <= numberOfBaseSteps; ++baseStep)
+        {
+            row[baseStep] = (float) pow (double(baseStep) / numberOfBaseSteps, order);
+        }
+    }
+
+    DEB("AEPGainCalculator: Table for orders up to " + String(numberOfOrderSteps / double(orderStepsPerUnit))
+        + " calculated (" + String(rowLength * (numberOfOrderSteps + 1) * (int) sizeof(float)) + " bytes).")
+}
+
+inline float AEPGainCalculator::lookUp (float base, float order) const
+{
+    const int rowLength = numberOfBaseSteps + 1;
+
+    const float orderPosition = jlimit (0.0f, float(numberOfOrderSteps), order * orderStepsPerUnit);
+    const int orderIndex = jmin ((int) orderPosition, numberOfOrderSteps - 1);
+    const float orderFraction = orderPosition - orderIndex;
+
+    const float basePosition = base * numberOfBaseSteps;
+    const int baseIndex = jmin ((int) basePosition, numberOfBaseSteps - 1);
+    const float baseFraction = basePosition - baseIndex;
+
+    // For orders below 1, the curve is too steep close to a base of 0
+    // for a linear interpolation (in both directions, base and order).
+    if (order < 1.0f || baseIndex == 0)
+    {
+        return fastPow (base, order);
+    }
+
+    const float* const row0 = table + orderIndex * rowLength + baseIndex;
+    const float* const row1 = row0 + rowLength;
+
+    const float value0 = row0[0] + baseFraction * (row0[1] - row0[0]);
+    const float value1 = row1[0] + baseFraction * (row1[1] - row1[0]);
+    return value0 + orderFraction * (value1 - value0);
+}
+
+
+#if AUDIO_ENGINE_UNIT_TESTS
+//==============================================================================
+/**
+ Compares the gains of all accuracy modes with the ones of the exact mode,
+ for sources all around the sphere and the orders used by the
+ AudioSourceAmbipanning (including the modified ones of the center zone).
+ */
+class AEPGainCalculatorTest  : public UnitTest
+{
+public:
+    AEPGainCalculatorTest ()  : UnitTest ("AEPGainCalculator") {}
+
+    void runTest ()
+    {
+        // Covers the vectorised loop (4 speakers at a time) and the
+        // remaining speakers.
+        AEPGainCalculator calculator;
+        calculator.setNumberOfSpeakers (numberOfSpeakers);
+        Random random (120814);
+        for (int speaker = 0; speaker < numberOfSpeakers; ++speaker)
+        {
+            const double azimuth = random.nextDouble() * 360.0;
+            const double elevation = random.nextDouble() * 180.0 - 90.0;
+            getPointOnTheSphere (azimuth, elevation, speakerX[speaker], speakerY[speaker], speakerZ[speaker]);
+            calculator.setSpeakerPosition (speaker, speakerX[speaker], speakerY[speaker], speakerZ[speaker]);
+        }
+        calculator.setMaximumOrder (12.0);
+
+        beginTest ("fastApproximation");
+        expect (getLargestError (calculator, AEPGainCalculator::fastApproximation) < 1.0e-6,
+                "largest error = " + String (getLargestError (calculator, AEPGainCalculator::fastApproximation)));
+
+        beginTest ("lookupTable");
+        expect (getLargestError (calculator, AEPGainCalculator::lookupTable) < 3.0e-4,
+                "largest error = " + String (getLargestError (calculator, AEPGainCalculator::lookupTable)));
+
+        beginTest ("fastApproximation: vectorised and scalar");
+        {
+            // A calculator with a single speaker only uses the scalar code.
+            AEPGainCalculator scalarCalculator;
+            scalarCalculator.setNumberOfSpeakers (1);
+            scalarCalculator.setAccuracyMode (AEPGainCalculator::fastApproximation);
+            calculator.setAccuracyMode (AEPGainCalculator::fastApproximation);
+
+            float gains[numberOfSpeakers];
+            float scalarGain;
+            double largestDifference = 0.0;
+            for (int speaker = 0; speaker < numberOfSpeakers; ++speaker)
+            {
+                for (int orderIndex = 0; orderIndex < numberOfOrders; ++orderIndex)
+                {
+                    double x, y, z;
+                    getPointOnTheSphere (37.0 * orderIndex, 11.0 * speaker - 45.0, x, y, z);
+                    calculator.calculateGains (x, y, z, orders[orderIndex], 0.7, gains, numberOfSpeakers);
+
+                    scalarCalculator.setSpeakerPosition (0, speakerX[speaker], speakerY[speaker], speakerZ[speaker]);
+                    scalarCalculator.calculateGains (x, y, z, orders[orderIndex], 0.7, &scalarGain, 1);
+
+                    largestDifference = jmax (largestDifference, (double) fabsf (gains[speaker] - scalarGain));
+                }
+            }
+            // Identical, unless the compiler fuses a multiplication and an
+            // addition of the scalar code.
+            expect (largestDifference < 1.0e-7, "largest difference = " + String (largestDifference));
+        }
+
+        beginTest ("exact");
+        expect (getLargestError (calculator, AEPGainCalculator::exact) == 0.0);
+    }
+
+private:
+    enum
+    {
+        numberOfSpeakers = 11,
+        numberOfOrders = 10
+    };
+    static const double orders[numberOfOrders];
+    double speakerX[numberOfSpeakers];
+    double speakerY[numberOfSpeakers];
+    double speakerZ[numberOfSpeakers];
+
+    static void getPointOnTheSphere (double azimuthInDegrees, double elevationInDegrees,
+                                     double& x, double& y, double& z)
+    {
+        const double azimuth = azimuthInDegrees * double_Pi / 180.0;
+        const double elevation = elevationInDegrees * double_Pi / 180.0;
+        x = cos (elevation) * cos (azimuth);
+        y = cos (elevation) * sin (azimuth);
+        z = sin (elevation);
+    }
+
+    /** The largest absolute difference of the gains in the accuracyMode
+     from the exact formula, for sources every 10 degrees and all orders
+     (distanceGain = 1). */
+    double getLargestError (AEPGainCalculator& calculator, AEPGainCalculator::AccuracyMode accuracyMode) const
+    {
+        calculator.setAccuracyMode (accuracyMode);
+
+        float gains[numberOfSpeakers];
+        double largestError = 0.0;
+        for (int elevation = -90; elevation <= 90; elevation += 10)
+        {
+            for (int azimuth = 0; azimuth < 360; azimuth += 10)
+            {
+                double x, y, z;
+                getPointOnTheSphere (azimuth, elevation, x, y, z);
+                for (int orderIndex = 0; orderIndex < numberOfOrders; ++orderIndex)
+                {
+                    const double order = orders[orderIndex];
+                    calculator.calculateGains (x, y, z, order, 1.0, gains, numberOfSpeakers);
+                    for (int speaker = 0; speaker < numberOfSpeakers; ++speaker)
+                    {
+                        const float exactGain = (float) pow (0.5 + 0.5*(x*speakerX[speaker] + y*speakerY[speaker]
+                                                                        + z*speakerZ[speaker]), order);
+                        largestError = jmax (largestError, (double) fabsf (gains[speaker] - exactGain));
+                    }
+                }
+            }
+        }
+        return largestError;
+    }
+};
+
+const double AEPGainCalculatorTest::orders[AEPGainCalculatorTest::numberOfOrders]
+    = { 0.0, 0.05, 0.3, 1.0, 1.5, 2.0, 3.7, 5.0, 8.0, 12.0 };
+
+static AEPGainCalculatorTest aepGainCalculatorTest;
+
+#endif
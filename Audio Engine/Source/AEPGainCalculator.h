@@ -0,0 +1,225 @@
+/*
+ *  AEPGainCalculator.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120814.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __AEPGAINCALCULATOR_HEADER__
+#define __AEPGAINCALCULATOR_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+ Calculates the Ambisonics Equivalent Panning (AEP) gains of all speakers
+ for one position of a source in a single call:
+ \f[ \textrm{gain}_{n} = \left( \frac{1 + x_{\textrm{speaker}_n} \cdot x
+     + y_{\textrm{speaker}_n} \cdot y
+     + z_{\textrm{speaker}_n} \cdot z }{2} \right)^{M}
+     \cdot \textrm{distanceGain}. \f]
+ The speaker coordinates are stored as a struct of arrays (one array for
+ each coordinate), such that the loop over the speakers is a plain walk
+ through contiguous memory.
+
+ There are three accuracy modes:
+ <ul>
+ <li> exact: pow(..) in double precision. The results are identical to the
+      formula used by AudioSourceAmbipanning before this class existed.
+ <li> fastApproximation: AEPGainCalculator::fastPow, a polynomial
+      approximation of exp2 and log2 in single precision. Four speakers
+      are calculated at a time with SSE or NEON instructions, if available.
+      Measured absolute error against the exact formula (distanceGain = 1,
+      orders 0.05 to 12): below 5e-7.
+ <li> lookupTable: A table of pow(base, order) over 512 steps of the base
+      (0.5 + 0.5 * cosine of the angle between source and speaker) and
+      16 steps per unit of the order, with bilinear interpolation.
+      Measured absolute error against the exact formula (distanceGain = 1,
+      orders 1 to 12): below 3e-4. Modified orders below 1 (sources
+      inside the center zone) and the first step of the base are too steep
+      for the interpolation; fastPow is used for them.
+ </ul>
+ The distance calculations of AudioSourceAmbipanning::calculationsForAEP
+ use AEPGainCalculator::power and AEPGainCalculator::powerOfTen, which
+ are exact in the exact mode and use fastPow otherwise.
+
+ Used by AudioSourceAmbipanning.
+ */
+class JUCE_API  AEPGainCalculator
+{
+public:
+    //==============================================================================
+    /** The selectable accuracy modes. See the class description. */
+    enum AccuracyMode
+    {
+        exact = 0,
+        fastApproximation,
+        lookupTable
+    };
+
+    /** Constructor. */
+    AEPGainCalculator ();
+
+    /** Destructor. */
+    ~AEPGainCalculator ();
+
+    //==============================================================================
+    /**
+     Sets the number of speakers. The coordinates of all speakers are reset
+     and have to be set with setSpeakerPosition afterwards.
+     */
+    void setNumberOfSpeakers (int numberOfSpeakers);
+
+    /** Returns the number of speakers. */
+    int getNumberOfSpeakers () const;
+
+    /**
+     Sets the position of a speaker. The coordinates have to describe a
+     point on the unit sphere.
+     */
+    void setSpeakerPosition (int speakerIndex, double x, double y, double z);
+
+    /**
+     Sets the highest order used in calculateGains. Only needed by the
+     lookupTable mode, for which the table is recalculated.
+     */
+    void setMaximumOrder (double maximumOrder);
+
+    /**
+     Sets the accuracy mode. If the lookupTable mode is chosen, the table is
+     calculated here.
+     */
+    void setAccuracyMode (AccuracyMode accuracyMode);
+
+    /** Returns the current accuracy mode. */
+    AccuracyMode getAccuracyMode () const;
+
+    //==============================================================================
+    /**
+     Calculates the gains for all speakers.
+
+     @param x, y, z             The position of the source, projected to the
+                                unit sphere.
+     @param modifiedOrder       The order M of the approximation.
+     @param distanceGain        Applied to all gains.
+     @param gains               The destination.
+     @param numberOfChannels    The number of gains to calculate. Must not
+                                be larger than getNumberOfSpeakers().
+     */
+    void calculateGains (double x,
+                         double y,
+                         double z,
+                         double modifiedOrder,
+                         double distanceGain,
+                         float* gains,
+                         int numberOfChannels) const;
+
+    /** pow(base, exponent), evaluated according to the accuracy mode. */
+    double power (double base, double exponent) const;
+
+    /** pow(10, exponent), evaluated according to the accuracy mode. */
+    double powerOfTen (double exponent) const;
+
+    //==============================================================================
+    /** A polynomial approximation of log2(x) for x > 0.
+     Absolute error below 2e-7 for x in [0.5, 2], growing with the
+     single precision rounding of the result to 4e-6 for large exponents. */
+    static inline float fastLog2 (float x);
+
+    /** A polynomial approximation of exp2(x).
+     Relative error below 3e-7 for x in [-1, 1], growing with the single
+     precision rounding of x to 3e-6 at |x| = 120.
+     Returns 0 for x < -126. */
+    static inline float fastExp2 (float x);
+
+    /** pow(base, exponent) for base >= 0, using fastLog2 and fastExp2. */
+    static inline float fastPow (float base, float exponent);
+
+private:
+    /** Calculates the table used in the lookupTable mode. */
+    void calculateTable ();
+
+    /** Looks up pow(base, order) in the table (with bilinear interpolation). */
+    inline float lookUp (float base, float order) const;
+
+    int numberOfSpeakers;
+    HeapBlock<double> speakerX;
+    HeapBlock<double> speakerY;
+    HeapBlock<double> speakerZ;
+
+    AccuracyMode accuracyMode;
+    double maximumOrder;
+
+    enum
+    {
+        numberOfBaseSteps = 512,
+        orderStepsPerUnit = 16
+    };
+
+    /** pow(base, order) for all (numberOfBaseSteps + 1) bases of all
+     (numberOfOrderSteps + 1) orders. Row after row, one row per order. */
+    HeapBlock<float> table;
+    int numberOfOrderSteps;
+
+	JUCE_LEAK_DETECTOR (AEPGainCalculator);
+};
+
+//==============================================================================
+// The inline functions, defined here such that they can be inlined into the
+// loops of the calling code.
+
+inline float AEPGainCalculator::fastLog2 (float x)
+{
+    union { float f; uint32 i; } value;
+    value.f = x;
+
+    int exponent = (int) ((value.i >> 23) & 0xff) - 127;
+    value.i = (value.i & 0x007fffff) | 0x3f800000; // The mantissa, in [1, 2).
+    float mantissa = value.f;
+
+    // Move the mantissa to [sqrt(0.5), sqrt(2)), to keep t small.
+    if (mantissa > 1.41421356f)
+    {
+        mantissa *= 0.5f;
+        ++exponent;
+    }
+
+    // log2(m) = 2/ln(2) * atanh(t), with t = (m - 1) / (m + 1).
+    const float t = (mantissa - 1.0f) / (mantissa + 1.0f);
+    const float t2 = t * t;
+    return float(exponent) + t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078016f + t2 * 0.412198583f)));
+}
+
+inline float AEPGainCalculator::fastExp2 (float x)
+{
+    if (x < -126.0f)
+        return 0.0f;
+    if (x > 127.0f)
+        x = 127.0f;
+
+    // x = n + f, with an integer n and f in [-0.5, 0.5].
+    const int n = (int) floorf (x + 0.5f);
+    const float f = x - float(n);
+
+    // 2^f, Taylor series of exp(f * ln(2)) up to the 6th power.
+    const float p = 1.0f + f * (0.693147181f + f * (0.240226507f + f * (0.0555041087f
+                    + f * (0.00961812911f + f * (0.00133335581f + f * 0.000154035304f)))));
+
+    // 2^n, assembled in the exponent bits.
+    union { float f; uint32 i; } twoToTheN;
+    twoToTheN.i = (uint32) (n + 127) << 23;
+    return p * twoToTheN.f;
+}
+
+inline float AEPGainCalculator::fastPow (float base, float exponent)
+{
+    if (base <= 1.0e-30f)
+        return exponent == 0.0f ? 1.0f : 0.0f;
+
+    return fastExp2 (exponent * fastLog2 (base));
+}
+
+
+#endif   // __AEPGAINCALCULATOR_HEADER__
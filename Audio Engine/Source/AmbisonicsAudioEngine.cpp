@@ -633,6 +633,9 @@ bool AmbisonicsAudioEngine::bounceToDisk(String absolutePathToAudioFile,
             if (bufferingWasEnabled) {
                 audioRegionMixer.enableBuffering(false);
             }
+            // ...and don't leave the instantiation of the regions to the
+            // background thread, which might be late.
+            audioRegionMixer.enableSynchronousRegionLoading(true);
             
             // ...as well as the buffering for the audio transport source.
             // And also set the virtualNumberOfActiveOutputChannels.
@@ -696,6 +699,7 @@ bool AmbisonicsAudioEngine::bounceToDisk(String absolutePathToAudioFile,
 		
 		// Put the audioSpeakerGainAndRouting into regular mode
 		int numberOfActiveOutputChannels = audioSpeakerGainAndRouting.switchToBounceMode(false);
+		audioRegionMixer.enableSynchronousRegionLoading(false);
 		
         // Reenable the buffering.
         if (bufferingWasEnabled)
@@ -734,6 +738,129 @@ void AmbisonicsAudioEngine::cancelBounceToDisk()
     stopBounceToDisk = true;
 }
 
+bool AmbisonicsAudioEngine::bounceHOABusToDisk(String absolutePathToAudioFile,
+                                               int bitsPerSample,
+                                               int startSample,
+                                               int numberOfSamplesToRead)
+{
+    if (!audioRegionMixer.getHOARenderingState())
+    {
+        DEB("AmbisonicsAudioEngine::bounceHOABusToDisk: The HOA rendering is disabled.")
+        return false;
+    }
+    
+	File fileToWriteTo(absolutePathToAudioFile);	
+	// If this file exists, it needs to be deleted.
+	// (Otherwise the bounced audio would be appended to the existing file.)
+	fileToWriteTo.deleteFile();
+	
+	FileOutputStream* fileOutputStream = fileToWriteTo.createOutputStream();	
+	
+	if (getCurrentSampleRate() <= 0 || fileOutputStream == 0)
+	{
+        delete fileOutputStream;
+        return false;
+    }
+    
+    const int numberOfBusChannels = audioRegionMixer.getNumberOfHOABusChannels();
+    
+    // Set up the audioFormatWriter. It takes the ownership of the
+    // fileOutputStream.
+    WavAudioFormat wavAudioFormat;
+    int qualityOptionIndex = 0; // no compression.
+    ScopedPointer<AudioFormatWriter> audioFormatWriter; 
+    audioFormatWriter = wavAudioFormat.createWriterFor(fileOutputStream, 
+                                                       getCurrentSampleRate(), 
+                                                       numberOfBusChannels, 
+                                                       bitsPerSample, 
+                                                       StringPairArray(), 
+                                                       qualityOptionIndex);
+    if (audioFormatWriter == nullptr)
+    {
+        delete fileOutputStream;
+        return false;
+    }
+    
+    // Stop the playback.
+    stop(); 
+    
+    // Remember the current playhead position.
+    int currentPosition = getCurrentPosition();
+    
+    // Disconnect from the audioDeviceManager
+    audioDeviceManager.removeAudioCallback(&audioSourcePlayer);
+    
+    stopBounceToDisk = false;
+    
+    // The buffering is disabled during the bounce.
+    bool bufferingWasEnabled = audioRegionMixer.getBufferingState();
+    if (bufferingWasEnabled) {
+        audioRegionMixer.enableBuffering(false);
+    }
+    // The regions are instantiated in getNextAudioBlock, see
+    // AudioRegionMixer::enableSynchronousRegionLoading.
+    audioRegionMixer.enableSynchronousRegionLoading(true);
+    
+    // The audioRegionMixer is read directly - the bus doesn't pass the
+    // audioSpeakerGainAndRouting.
+    audioRegionMixer.enableHOABusOutput(true);
+    audioRegionMixer.prepareToPlay(SAMPLES_PER_BLOCK_FOR_BOUNCE_TO_DISK, getCurrentSampleRate());
+    audioRegionMixer.setNextReadPosition(startSample);
+    audioRegionMixer.setNextReadPositionOnAllRegions(startSample);
+    
+    AudioSampleBuffer tempBuffer (numberOfBusChannels, 
+                                  SAMPLES_PER_BLOCK_FOR_BOUNCE_TO_DISK);
+    bool success = true;	
+    while (numberOfSamplesToRead > 0)
+    {
+        const int numToDo = jmin (numberOfSamplesToRead, SAMPLES_PER_BLOCK_FOR_BOUNCE_TO_DISK);
+        
+        AudioSourceChannelInfo info;
+        info.buffer = &tempBuffer;
+        info.startSample = 0;
+        info.numSamples = numToDo;
+        
+        audioRegionMixer.getNextAudioBlock (info);
+        
+        if (! audioFormatWriter->writeFromAudioSampleBuffer (tempBuffer, 0, numToDo) || stopBounceToDisk)
+        {
+            success = false;
+            break;
+        }
+        
+        numberOfSamplesToRead -= numToDo;
+    }
+    
+    // Close the file.
+    audioFormatWriter = nullptr;
+    
+    // Delete the audio file if the bouncing process has been
+    // canceled by the user.
+    if (stopBounceToDisk)
+    {
+        fileToWriteTo.deleteFile();
+    }
+    
+    audioRegionMixer.enableHOABusOutput(false);
+    audioRegionMixer.enableSynchronousRegionLoading(false);
+    
+    // Reenable the buffering.
+    if (bufferingWasEnabled)
+    {
+        audioRegionMixer.enableBuffering(true);
+    }
+    
+    // Reconnect with the audioDeviceManager
+    audioDeviceManager.addAudioCallback(&audioSourcePlayer);
+    
+    // Reset the playhead position
+    setPosition(currentPosition);
+    
+    DEB("AmbisonicsAudioEngine::bounceHOABusToDisk: success = " + String(success));
+    
+    return success;
+}
+
 bool AmbisonicsAudioEngine::addAepChannel(int aepChannel, double gain, 
 										  bool solo, bool mute,
 										  bool activatePinkNoise, double x, 
@@ -947,14 +1074,22 @@ bool AmbisonicsAudioEngine::enableArrangerLoop(double loopStartInSeconds,
                                                double loopEndInSeconds, 
                                                double loopFadeTimeInSeconds)
 {
-	return audioTransportSource.enableArrangerLoop(loopStartInSeconds, 
-												   loopEndInSeconds,
-												   loopFadeTimeInSeconds);
+	if (! audioTransportSource.enableArrangerLoop(loopStartInSeconds, 
+												  loopEndInSeconds,
+												  loopFadeTimeInSeconds))
+	{
+		return false;
+	}
+	
+	// The regions at the loop start are kept ready for the jump back.
+	audioRegionMixer.setLoopStartPosition(roundToInt(loopStartInSeconds * getCurrentSampleRate()));
+	return true;
 }
 
 void AmbisonicsAudioEngine::disableArrangerLoop()
 {
 	audioTransportSource.disableArrangerLoop();
+	audioRegionMixer.setLoopStartPosition(-1);
 }
 
 double AmbisonicsAudioEngine::getCpuUsage ()
@@ -978,6 +1113,27 @@ bool AmbisonicsAudioEngine::addAudioRegion (const int regionID,
 				sampleRateOfTheAudioDevice);
 }
 
+bool AmbisonicsAudioEngine::addAudioRegionAsynchronously (const int regionID,
+														  const int startPosition,
+														  const int duration,
+														  const int offsetInFile,
+														  String absolutePathToAudioFile)
+{
+	int endPosition = startPosition + duration;
+	int startPositionOfAudioFileInTimeline = startPosition - offsetInFile;
+	
+	double sampleRateOfTheAudioDevice = (audioDeviceManager.getCurrentAudioDevice())->getCurrentSampleRate();
+	
+	return audioRegionMixer.addRegionAsynchronously(regionID, startPosition, endPosition,
+		        startPositionOfAudioFileInTimeline, absolutePathToAudioFile,
+				sampleRateOfTheAudioDevice);
+}
+
+double AmbisonicsAudioEngine::getProgressOfAddingAudioRegions ()
+{
+	return audioRegionMixer.getProgressOfAddingRegions();
+}
+
 bool AmbisonicsAudioEngine::modifyAudioRegion(const int regionID, 
 											  const int newStartPosition, 
 											  const int newDuration,
@@ -1000,12 +1156,31 @@ void AmbisonicsAudioEngine::removeAllRegions ()
 	audioRegionMixer.removeAllRegions();
 }
 
+void AmbisonicsAudioEngine::beginEditTransaction ()
+{
+	audioRegionMixer.beginEditTransaction();
+}
+
+void AmbisonicsAudioEngine::commitEditTransaction ()
+{
+	audioRegionMixer.commitEditTransaction();
+}
+
 bool AmbisonicsAudioEngine::setGainEnvelopeForRegion (const int regionID,
 													  Array<void*> gainEnvelope)
 {
 	return audioRegionMixer.setGainEnvelopeForRegion(regionID, gainEnvelope);
 }
 
+bool AmbisonicsAudioEngine::patchGainEnvelopeForRegion (const int regionID,
+														int startIndex,
+														int numberOfPointsToRemove,
+														const Array<AudioEnvelopePoint>& pointsToInsert)
+{
+	return audioRegionMixer.patchGainEnvelopeForRegion(regionID, startIndex, numberOfPointsToRemove,
+	                                                   pointsToInsert);
+}
+
 void AmbisonicsAudioEngine::setMasterGain(const float newGain)
 {
 	audioSpeakerGainAndRouting.setMasterGain(newGain);
@@ -1033,7 +1208,56 @@ void AmbisonicsAudioEngine::setDistanceWithHalfTheOpenCutoffFrequency (double di
 
 void AmbisonicsAudioEngine::setAEPOrder (const double order)
 {
-	AudioSourceAmbipanning::setOrder(order);
+	audioRegionMixer.setAEPOrder(order);
+}
+
+void AmbisonicsAudioEngine::setAEPGainAccuracyMode (AEPGainCalculator::AccuracyMode accuracyMode)
+{
+	audioRegionMixer.setAEPGainAccuracyMode(accuracyMode);
+}
+
+void AmbisonicsAudioEngine::setAEPActiveChannelThreshold (double thresholdInDB)
+{
+	audioRegionMixer.setAEPActiveChannelThreshold(thresholdInDB);
+}
+
+void AmbisonicsAudioEngine::enableHOARendering (bool enable, int order)
+{
+	audioRegionMixer.enableHOARendering(enable, order);
+}
+
+void AmbisonicsAudioEngine::enableHOAMaxRE (bool enable)
+{
+	audioRegionMixer.enableHOAMaxRE(enable);
+}
+
+void AmbisonicsAudioEngine::setNumberOfRenderThreads (int numberOfThreads,
+													  bool pinThreadsToCores,
+													  bool realtimePriority)
+{
+	audioRegionMixer.setNumberOfRenderThreads(numberOfThreads, pinThreadsToCores, realtimePriority);
+}
+
+void AmbisonicsAudioEngine::setRegionLookahead (double lookaheadInSeconds)
+{
+	audioRegionMixer.setRegionLookahead(lookaheadInSeconds);
+}
+
+void AmbisonicsAudioEngine::setSceneTransform (double yawInDegrees,
+											   double pitchInDegrees,
+											   double rollInDegrees,
+											   double translationX,
+											   double translationY,
+											   double translationZ,
+											   double scale)
+{
+	audioRegionMixer.setSceneTransform(SceneTransform(yawInDegrees,
+													  pitchInDegrees,
+													  rollInDegrees,
+													  translationX,
+													  translationY,
+													  translationZ,
+													  scale));
 }
 
 void AmbisonicsAudioEngine::setAEPDistanceModeTo0 ()
@@ -1068,3 +1292,84 @@ bool AmbisonicsAudioEngine::setSpacialEnvelopeForRegion (const int& regionID,
 {
 	return audioRegionMixer.setSpacialEnvelopeForRegion(regionID, spacialEnvelope);
 }
+
+bool AmbisonicsAudioEngine::setSpacialEnvelopeForRegion (const int& regionID,
+													     const int* positions,
+													     const double* x,
+													     const double* y,
+													     const double* z,
+													     int numberOfPoints,
+													     const int* interpolationModes,
+													     const double* controlPoints)
+{
+	return audioRegionMixer.setSpacialEnvelopeForRegion(regionID, positions, x, y, z, numberOfPoints,
+	                                                    interpolationModes, controlPoints);
+}
+
+bool AmbisonicsAudioEngine::setSpacialTrajectoryForRegion (const int& regionID,
+													       const SpacialTrajectory& trajectory)
+{
+	return audioRegionMixer.setSpacialTrajectoryForRegion(regionID, trajectory);
+}
+
+bool AmbisonicsAudioEngine::patchSpacialEnvelopeForRegion (const int& regionID,
+														   int startIndex,
+														   int numberOfPointsToRemove,
+														   const int* positions,
+														   const double* x,
+														   const double* y,
+														   const double* z,
+														   int numberOfPointsToInsert,
+														   const int* interpolationModes,
+														   const double* controlPoints)
+{
+	return audioRegionMixer.patchSpacialEnvelopeForRegion(regionID, startIndex, numberOfPointsToRemove,
+	                                                      positions, x, y, z, numberOfPointsToInsert,
+	                                                      interpolationModes, controlPoints);
+}
+
+void AmbisonicsAudioEngine::setEnvelopeSimplification (double spacialToleranceInMeters,
+													   double gainToleranceInDB)
+{
+	audioRegionMixer.setEnvelopeSimplification(spacialToleranceInMeters, gainToleranceInDB);
+}
+
+EnvelopeSimplificationReport AmbisonicsAudioEngine::getEnvelopeSimplificationReport ()
+{
+	return audioRegionMixer.getEnvelopeSimplificationReport();
+}
+
+SpacialPositionMailbox::Ptr AmbisonicsAudioEngine::enableLivePositionForRegion (const int regionID,
+																			   double smoothingTimeInMs)
+{
+	return audioRegionMixer.enableLivePositionForRegion(regionID, smoothingTimeInMs);
+}
+
+bool AmbisonicsAudioEngine::disableLivePositionForRegion (const int regionID)
+{
+	return audioRegionMixer.disableLivePositionForRegion(regionID);
+}
+
+bool AmbisonicsAudioEngine::setDopplerInterpolationQualityForRegion (const int regionID,
+                                                                     FractionalDelayInterpolator::Quality quality)
+{
+	return audioRegionMixer.setDopplerInterpolationQualityForRegion(regionID, quality);
+}
+
+#if AUDIO_ENGINE_UNIT_TESTS
+bool AmbisonicsAudioEngine::runUnitTests ()
+{
+	// The tests register themselves, see the end of the .cpp files.
+	UnitTestRunner unitTestRunner;
+	unitTestRunner.runAllTests(false);
+	
+	int numberOfFailures = 0;
+	for (int i = 0; i < unitTestRunner.getNumResults(); ++i)
+	{
+		numberOfFailures += unitTestRunner.getResult(i)->failures;
+	}
+	
+	DEB("AmbisonicsAudioEngine: unit tests done, failures: " + String(numberOfFailures));
+	return numberOfFailures == 0;
+}
+#endif
@@ -172,6 +172,26 @@ public:
 					  int numberOfSamplesToRead);
     
     void cancelBounceToDisk();
+    
+    /**
+     Bounces the Higher Order Ambisonics bus (instead of the speaker signals)
+     to a wav file with (order+1)^2 channels, in the AmbiX channel order and
+     normalisation (see SphericalHarmonics).
+     
+     The HOA rendering has to be enabled, see enableHOARendering.
+     Like bounceToDisk, it can be interrupted by cancelBounceToDisk.
+     
+     @param absolutePathToAudioFile	The absolute path to the audio file.
+     @param bitsPerSample			The desired bit depth.
+     @param startSample				From where the bouncing should begin
+     @param numberOfSamplesToRead	The number of samples to bounce.
+     
+     @return						True, if the operation was successful.
+     */
+    bool bounceHOABusToDisk(String absolutePathToAudioFile,
+                            int bitsPerSample,
+                            int startSample,
+                            int numberOfSamplesToRead);
 	
 	/** Adds a new AEP channel to the array of AEP channels.
 	 
@@ -404,6 +424,28 @@ public:
 					     const int offsetInFile,
 					     String absolutePathToAudioFile);
 	
+	/**
+	 Adds an audio region like addAudioRegion, but doesn't wait for the
+	 audio file to be opened. The files of the regions added in a row (e.g.
+	 when a project is loaded) are opened and prepared in parallel, in the
+	 background. A region whose file can't be read is removed again. See
+	 AudioRegionMixer::addRegionAsynchronously.
+	 
+	 The parameters are the same as the ones of addAudioRegion.
+	 */
+	bool addAudioRegionAsynchronously (const int regionID,
+									   const int startPosition,
+									   const int duration,
+									   const int offsetInFile,
+									   String absolutePathToAudioFile);
+	
+	/**
+	 Returns the progress of the regions added by
+	 addAudioRegionAsynchronously, between 0.0 and 1.0 (1.0 if there are
+	 none left to open).
+	 */
+	double getProgressOfAddingAudioRegions ();
+	
 	/**
 	 Modifies an audio region (that was originally created by addAudioRegion).
 	 
@@ -448,6 +490,19 @@ public:
 	 */
 	void removeAllRegions ();
 	
+	/**
+	 Starts an edit transaction. The following changes of the regions and
+	 their envelopes are collected and applied all at once by
+	 commitEditTransaction, in between two audio blocks. Transactions can
+	 be nested. See AudioRegionMixer::beginEditTransaction.
+	 */
+	void beginEditTransaction ();
+	
+	/**
+	 Applies the changes made since the matching beginEditTransaction.
+	 */
+	void commitEditTransaction ();
+	
 	/**
 	 Attaches a gain envelope to a region.
 
@@ -462,16 +517,24 @@ public:
 	                                pointers need to be typecasted to pointers to
 	                                AudioEnvelopePoint
 					( (AudioEnvelopePoint*)gainEnvelope[pointNumber_StartingAtZero] ).
-					The gainEnvelope and all involved AudioEnvelopePoints
-					will be deleted in
-					AudioSourceGainEnvelope::setGainEnvelope 
-					or in AudioSourceGainEnvelope::~AudioSourceGainEnvelope,
-					so you don't have to care about.
+					All involved AudioEnvelopePoints will be
+					deleted, so you don't have to care about.
 
 	 @return		 	The success of this operation.
 	 */
 	bool setGainEnvelopeForRegion (const int regionID, Array<void*> gainEnvelope);
 	
+	/**
+	 Changes a part of the gain envelope of a region, see
+	 AudioRegionMixer::patchGainEnvelopeForRegion.
+
+	 @return		 	The success of this operation.
+	 */
+	bool patchGainEnvelopeForRegion (const int regionID,
+	                                 int startIndex,
+	                                 int numberOfPointsToRemove,
+	                                 const Array<AudioEnvelopePoint>& pointsToInsert);
+	
 	/** 
 	 Sets the output gain ( the "master gain").
 
@@ -504,6 +567,85 @@ public:
 	 */
 	void setAEPOrder (const double order);
 	
+	/**
+	 Sets the accuracy of the gain calculations in AudioSourceAmbipanning.
+	 
+	 @param accuracyMode	AEPGainCalculator::exact (the default),
+							AEPGainCalculator::fastApproximation or
+							AEPGainCalculator::lookupTable. See
+							AEPGainCalculator for the errors of the
+							approximations.
+	 */
+	void setAEPGainAccuracyMode (AEPGainCalculator::AccuracyMode accuracyMode);
+	
+	/**
+	 Sets the gain threshold (in dB) below which a speaker is not processed
+	 by AudioSourceAmbipanning. The default is -96 dB.
+	 */
+	void setAEPActiveChannelThreshold (double thresholdInDB);
+	
+	/**
+	 Switches between the direct AEP panning to the speakers (the default)
+	 and the rendering via a Higher Order Ambisonics bus.
+	 See AudioRegionMixer::enableHOARendering.
+	 
+	 @param enable	true to render via the HOA bus.
+	 @param order	The order of the HOA bus.
+	 */
+	void enableHOARendering (bool enable, int order);
+	
+	/**
+	 Enables or disables the max-rE weighting of the HOA decoder.
+	 It is enabled by default.
+	 */
+	void enableHOAMaxRE (bool enable);
+	
+	/**
+	 Sets the number of threads used to render the audio regions. The
+	 output is identical for any number of threads.
+	 See AudioRegionMixer::setNumberOfRenderThreads.
+	 
+	 @param numberOfThreads		Including the audio thread. 1 (the default)
+								renders everything on the audio thread.
+	 @param pinThreadsToCores	Binds each additional thread to its own CPU core.
+	 @param realtimePriority	Runs the additional threads with realtime priority.
+	 */
+	void setNumberOfRenderThreads (int numberOfThreads,
+								   bool pinThreadsToCores,
+								   bool realtimePriority);
+	
+	/**
+	 Sets how far in front of the playhead the processing chains of the
+	 audio regions are instantiated. Regions further away only use a few
+	 bytes of memory. See AudioRegionMixer::setRegionLookahead.
+	 
+	 @param lookaheadInSeconds	0 by default: All regions are instantiated
+								when they are added.
+	 */
+	void setRegionLookahead (double lookaheadInSeconds);
+	
+	/**
+	 Rotates, moves and scales the whole scene, without changing the
+	 spacial envelopes of the regions. The panning, the doppler effect and
+	 the low pass filter all use the transformed positions. All regions
+	 fade to the new transformation within one audio block. See
+	 SceneTransform.
+	 
+	 @param yawInDegrees		Rotation around the z axis, positive to the left.
+	 @param pitchInDegrees		Rotation around the x axis, positive lifts the front.
+	 @param rollInDegrees		Rotation around the y axis, positive lifts the right side.
+	 @param translationX, translationY, translationZ	The translation (in
+							units), applied after the rotation.
+	 @param scale				The scale factor, applied before the rotation.
+	 */
+	void setSceneTransform (double yawInDegrees,
+							double pitchInDegrees,
+							double rollInDegrees,
+							double translationX,
+							double translationY,
+							double translationZ,
+							double scale);
+	
 	/**
 	 Sets the distanceMode used in AudioSourceAmbipanning to 0.	 
 	 */
@@ -562,21 +704,127 @@ public:
 	 is used.
 
 	 @param regionID		The ID of the region.
-	 @param spacialEnvelope         A spacialEnvelope is a void*-Array. The void 
-	                                pointers need to be typecasted to pointers to
-	                                SpacialEnvelopePoint
-					( (SpacialEnvelopePoint*)spacialEnvelope[pointNumber_StartingAtZero] ).
-					The spacialEnvelope and all involved
-					SpacialEnvelopePoints will be deleted in the 
-					AudioSourceAmbipanning::setSpacialEnvelope
-					or in the 
-					AudioSourceAmbipanning::~AudioSourceAmbipanning,
-					so you don't have to care about.
+	 @param spacialEnvelope         The points of the envelope. They are
+	                                copied once and then shared by all
+	                                stages of the region.
 
 	 @return		 	The success of this operation.
 	 */
 	bool setSpacialEnvelopeForRegion (const int& regionID, const Array<SpacialEnvelopePoint>& spacialEnvelope);
 	
+	/**
+	 Attaches a spacial envelope to a region, given as flat arrays of
+	 numberOfPoints elements each: The positions (in samples, starting at the
+	 beginning of the audio file) and the x, y and z coordinates.
+	 
+	 This avoids building an Array of SpacialEnvelopePoint s first: The
+	 arrays are copied into the envelope with a single allocation.
+	 
+	 @param interpolationModes	Optional, the SpacialEnvelope::InterpolationMode
+	 				of the segment that starts at each point. Linear,
+	 				if nullptr.
+	 @param controlPoints		Optional, six coordinates per point: The two
+	 				control points of its segment, if it is a
+	 				Bezier curve.
+	 
+	 @return		 	The success of this operation.
+	 */
+	bool setSpacialEnvelopeForRegion (const int& regionID,
+	                                  const int* positions,
+	                                  const double* x,
+	                                  const double* y,
+	                                  const double* z,
+	                                  int numberOfPoints,
+	                                  const int* interpolationModes = nullptr,
+	                                  const double* controlPoints = nullptr);
+	
+	/**
+	 Attaches a trajectory to a region, instead of a spacial envelope: A
+	 rotation or a random walk, described by a few parameters (see
+	 SpacialTrajectory). It is evaluated by the engine, for the duration of
+	 the region, which is much faster than handing over the points.
+	 
+	 @return		 	The success of this operation.
+	 */
+	bool setSpacialTrajectoryForRegion (const int& regionID, const SpacialTrajectory& trajectory);
+	
+	/**
+	 Changes a part of the spacial envelope of a region, without looking at
+	 the unchanged points again. See
+	 AudioRegionMixer::patchSpacialEnvelopeForRegion.
+
+	 @return		 	The success of this operation.
+	 */
+	bool patchSpacialEnvelopeForRegion (const int& regionID,
+	                                    int startIndex,
+	                                    int numberOfPointsToRemove,
+	                                    const int* positions,
+	                                    const double* x,
+	                                    const double* y,
+	                                    const double* z,
+	                                    int numberOfPointsToInsert,
+	                                    const int* interpolationModes = nullptr,
+	                                    const double* controlPoints = nullptr);
+	
+	/**
+	 Drops the points of the envelopes that are set from now on, as long as
+	 they stay within the tolerances. See
+	 AudioRegionMixer::setEnvelopeSimplification.
+
+	 @param spacialToleranceInMeters	0 disables the simplification of the
+										spacial envelopes.
+	 @param gainToleranceInDB			0 disables the simplification of the
+										gain envelopes.
+	 */
+	void setEnvelopeSimplification (double spacialToleranceInMeters,
+	                                double gainToleranceInDB);
+	
+	/** Returns how many points have been given to and kept by the
+	 envelope simplification since it has been set. */
+	EnvelopeSimplificationReport getEnvelopeSimplificationReport ();
+	
+	/**
+	 Lets a region follow a live input instead of its spacial envelope. The
+	 positions are posted to the returned mailbox, without locks. See
+	 AudioRegionMixer::enableLivePositionForRegion.
+
+	 @param regionID			The ID of the region.
+	 @param smoothingTimeInMs	The time constant of the smoothing of the
+								positions, 0 for none.
+	 @return					The mailbox, nullptr if the regionID can't be
+								found.
+	 */
+	SpacialPositionMailbox::Ptr enableLivePositionForRegion (const int regionID,
+	                                                         double smoothingTimeInMs);
+	
+	/**
+	 Returns a region to its spacial envelope.
+
+	 @return		 	The success of this operation.
+	 */
+	bool disableLivePositionForRegion (const int regionID);
+	
+	/**
+	 Sets the interpolation quality of the doppler effect of a region (from
+	 linear to a 32 tap sinc). See
+	 AudioRegionMixer::setDopplerInterpolationQualityForRegion.
+
+	 @return		 	The success of this operation.
+	 */
+	bool setDopplerInterpolationQualityForRegion (const int regionID,
+	                                              FractionalDelayInterpolator::Quality quality);
+	
+#if AUDIO_ENGINE_UNIT_TESTS
+	/**
+	 Runs the unit tests of the audio engine (and its benchmarks, if
+	 AUDIO_ENGINE_BENCHMARKS is defined in the AppConfig.h). The results are
+	 written to the log.
+
+	 @return			True, if all of them passed.
+	 */
+	static bool runUnitTests ();
+#endif
+	
 	
 private:
 	AudioDeviceManager audioDeviceManager;		///< An instance of a Juce object. 
@@ -0,0 +1,952 @@
+/*
+ *  AudioFileCache.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120830.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "AudioFileCache.h"
+
+#if ! JUCE_WINDOWS
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+
+//==============================================================================
+/**
+ A memory-mapped WAV or AIFF file and the layout of its sample data.
+ Shared by all MappedAudioFileReader s of this file.
+ */
+class AudioFileCache::MappedAudioFile  : public ReferenceCountedObject
+{
+public:
+    MappedAudioFile (const File& file_)
+    :   file (file_),
+        modificationTime (file_.getLastModificationTime()),
+        fileSize (file_.getSize()),
+        sampleData (nullptr),
+        lengthInSamples (0),
+        sampleRate (0.0),
+        numberOfChannels (0),
+        bitsPerSample (0),
+        floatingPoint (false),
+        littleEndian (true),
+        wavFile (false),
+        bytesPerFrame (0),
+        lastUsed (0),
+        mappedData (nullptr),
+        mappedSize (0)
+    {
+        if (map())
+        {
+            if (! parseWav())
+            {
+                parseAiff();
+            }
+        }
+    }
+
+    ~MappedAudioFile ()
+    {
+       #if ! JUCE_WINDOWS
+        if (mappedData != nullptr)
+        {
+            munmap (mappedData, mappedSize);
+        }
+       #endif
+    }
+
+    /** True, if the file is mapped and its sample data can be read. */
+    bool isValid () const
+    {
+        return sampleData != nullptr;
+    }
+
+    /** True, if the file on disk is still the one that has been mapped. */
+    bool isUpToDate () const
+    {
+        return file.getLastModificationTime() == modificationTime
+               && file.getSize() == fileSize;
+    }
+
+    const File file;
+    const Time modificationTime;
+    const int64 fileSize;
+
+    /** Points to the first frame of the interleaved samples. */
+    const char* sampleData;
+    int64 lengthInSamples;
+    double sampleRate;
+    int numberOfChannels;
+    int bitsPerSample;
+    bool floatingPoint;
+    bool littleEndian;
+    /** True for a WAV file, false for an AIFF or AIFC file (which might be
+     little endian as well). */
+    bool wavFile;
+    int bytesPerFrame;
+
+    /** See AudioFileCache::useCounter. */
+    int64 lastUsed;
+
+private:
+    /** Maps the whole file. The file descriptor isn't needed anymore
+     afterwards. (This JUCE version has no MemoryMappedFile.) */
+    bool map ()
+    {
+       #if JUCE_WINDOWS
+        return false;
+       #else
+        const int fileDescriptor = open (file.getFullPathName().toUTF8(), O_RDONLY);
+        if (fileDescriptor == -1)
+        {
+            return false;
+        }
+
+        struct stat fileInfo;
+        if (fstat (fileDescriptor, &fileInfo) == 0 && fileInfo.st_size > 0
+            && (uint64) fileInfo.st_size <= (uint64) std::numeric_limits<size_t>::max())
+        {
+            void* const address = mmap (nullptr, (size_t) fileInfo.st_size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+            if (address != MAP_FAILED)
+            {
+                mappedData = address;
+                mappedSize = (size_t) fileInfo.st_size;
+            }
+        }
+        close (fileDescriptor);
+        return mappedData != nullptr;
+       #endif
+    }
+
+    const char* getData () const
+    {
+        return static_cast<const char*> (mappedData);
+    }
+
+    int64 getSize () const
+    {
+        return (int64) mappedSize;
+    }
+
+    void* mappedData;
+    size_t mappedSize;
+
+    /** Sets the sampleData and the lengthInSamples, if the layout is valid. */
+    bool setSampleData (int64 dataOffset, int64 dataLength, int64 maximumLengthInSamples)
+    {
+        const int bytesPerSample = bitsPerSample / 8;
+        const bool supportedFormat = floatingPoint ? bitsPerSample == 32
+                                                   : (bitsPerSample == 8 || bitsPerSample == 16
+                                                      || bitsPerSample == 24 || bitsPerSample == 32);
+        if (! supportedFormat || numberOfChannels <= 0 || sampleRate <= 0.0
+            || dataOffset <= 0 || dataOffset > getSize())
+        {
+            return false;
+        }
+
+        bytesPerFrame = numberOfChannels * bytesPerSample;
+        dataLength = jmin (dataLength, getSize() - dataOffset);
+        lengthInSamples = jmin (dataLength / bytesPerFrame, maximumLengthInSamples);
+        sampleData = getData() + dataOffset;
+        return true;
+    }
+
+    bool parseWav ()
+    {
+        const char* const data = getData();
+        const int64 size = getSize();
+
+        if (size < 12 || memcmp (data, "RIFF", 4) != 0 || memcmp (data + 8, "WAVE", 4) != 0)
+        {
+            return false;
+        }
+
+        bool formatFound = false;
+        int64 chunkPosition = 12;
+        while (chunkPosition + 8 <= size)
+        {
+            const char* const chunk = data + chunkPosition;
+            const int64 chunkSize = ByteOrder::littleEndianInt (chunk + 4);
+            const char* const chunkData = chunk + 8;
+
+            if (memcmp (chunk, "fmt ", 4) == 0 && chunkSize >= 16 && chunkPosition + 8 + 16 <= size)
+            {
+                int formatTag = ByteOrder::littleEndianShort (chunkData);
+                if (formatTag == 0xfffe && chunkSize >= 40 && chunkPosition + 8 + 40 <= size)
+                {
+                    // WAVE_FORMAT_EXTENSIBLE: the format is the start of the sub format GUID.
+                    formatTag = ByteOrder::littleEndianShort (chunkData + 24);
+                }
+                if (formatTag != 1 && formatTag != 3)
+                {
+                    return false; // compressed
+                }
+                numberOfChannels = ByteOrder::littleEndianShort (chunkData + 2);
+                sampleRate = ByteOrder::littleEndianInt (chunkData + 4);
+                bitsPerSample = ByteOrder::littleEndianShort (chunkData + 14);
+                floatingPoint = formatTag == 3;
+                littleEndian = true;
+                wavFile = true;
+                formatFound = true;
+            }
+            else if (memcmp (chunk, "data", 4) == 0)
+            {
+                return formatFound
+                       && setSampleData (chunkPosition + 8, chunkSize, std::numeric_limits<int64>::max());
+            }
+
+            chunkPosition += 8 + chunkSize + (chunkSize & 1);
+        }
+        return false;
+    }
+
+    bool parseAiff ()
+    {
+        const char* const data = getData();
+        const int64 size = getSize();
+
+        if (size < 12 || memcmp (data, "FORM", 4) != 0
+            || (memcmp (data + 8, "AIFF", 4) != 0 && memcmp (data + 8, "AIFC", 4) != 0))
+        {
+            return false;
+        }
+        const bool isAifc = memcmp (data + 8, "AIFC", 4) == 0;
+
+        bool formatFound = false;
+        int64 numberOfFrames = 0;
+        int64 chunkPosition = 12;
+        while (chunkPosition + 8 <= size)
+        {
+            const char* const chunk = data + chunkPosition;
+            const int64 chunkSize = ByteOrder::bigEndianInt (chunk + 4);
+            const char* const chunkData = chunk + 8;
+
+            if (memcmp (chunk, "COMM", 4) == 0 && chunkSize >= 18 && chunkPosition + 8 + 18 <= size)
+            {
+                numberOfChannels = ByteOrder::bigEndianShort (chunkData);
+                numberOfFrames = ByteOrder::bigEndianInt (chunkData + 2);
+                bitsPerSample = ByteOrder::bigEndianShort (chunkData + 6);
+                sampleRate = readExtended (reinterpret_cast<const uint8*> (chunkData + 8));
+                floatingPoint = false;
+                littleEndian = false;
+                wavFile = false;
+
+                if (isAifc)
+                {
+                    if (chunkSize < 22 || chunkPosition + 8 + 22 > size)
+                    {
+                        return false;
+                    }
+                    const char* const compressionType = chunkData + 18;
+                    if (memcmp (compressionType, "sowt", 4) == 0)
+                    {
+                        littleEndian = true;
+                    }
+                    else if (memcmp (compressionType, "fl32", 4) == 0
+                             || memcmp (compressionType, "FL32", 4) == 0)
+                    {
+                        floatingPoint = true;
+                    }
+                    else if (memcmp (compressionType, "NONE", 4) != 0)
+                    {
+                        return false; // compressed
+                    }
+                }
+                formatFound = true;
+            }
+            else if (memcmp (chunk, "SSND", 4) == 0 && chunkSize >= 8 && chunkPosition + 16 <= size)
+            {
+                const int64 offset = ByteOrder::bigEndianInt (chunkData);
+                return formatFound
+                       && setSampleData (chunkPosition + 16 + offset, chunkSize - 8 - offset, numberOfFrames);
+            }
+
+            chunkPosition += 8 + chunkSize + (chunkSize & 1);
+        }
+        return false;
+    }
+
+    /** Converts the 80 bit IEEE 754 extended precision number of the
+     COMM chunk. */
+    static double readExtended (const uint8* bytes)
+    {
+        const int exponent = ((bytes[0] & 0x7f) << 8) | bytes[1];
+        uint64 mantissa = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            mantissa = (mantissa << 8) | bytes[2 + i];
+        }
+        const double value = ldexp ((double) mantissa, exponent - 16383 - 63);
+        return (bytes[0] & 0x80) != 0 ? -value : value;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (MappedAudioFile);
+};
+
+
+//==============================================================================
+/**
+ Reads the samples of a MappedAudioFile. All the data is in the shared
+ mapping, the reader itself holds no buffers.
+ */
+class AudioFileCache::MappedAudioFileReader  : public AudioFormatReader
+{
+public:
+    MappedAudioFileReader (MappedAudioFile* mappedAudioFile_)
+    :   AudioFormatReader (nullptr, mappedAudioFile_->wavFile ? "WAV file" : "AIFF file"),
+        mappedAudioFile (mappedAudioFile_)
+    {
+        sampleRate = mappedAudioFile->sampleRate;
+        bitsPerSample = mappedAudioFile->bitsPerSample;
+        lengthInSamples = mappedAudioFile->lengthInSamples;
+        numChannels = mappedAudioFile->numberOfChannels;
+        usesFloatingPointData = mappedAudioFile->floatingPoint;
+    }
+
+    ~MappedAudioFileReader ()
+    {
+        mappedAudioFile = nullptr;
+
+        AudioFileCache* const audioFileCache = AudioFileCache::getInstanceWithoutCreating();
+        if (audioFileCache != nullptr)
+        {
+            audioFileCache->evictUnusedFiles();
+        }
+    }
+
+    bool readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
+                      int64 startSampleInFile, int numSamples)
+    {
+        const int64 samplesAvailable = lengthInSamples - startSampleInFile;
+        if (samplesAvailable < numSamples)
+        {
+            for (int i = numDestChannels; --i >= 0;)
+            {
+                if (destSamples[i] != nullptr)
+                {
+                    zeromem (destSamples[i] + startOffsetInDestBuffer, sizeof (int) * numSamples);
+                }
+            }
+            numSamples = (int) samplesAvailable;
+        }
+
+        if (numSamples <= 0)
+        {
+            return true;
+        }
+
+        const char* const source = mappedAudioFile->sampleData
+                                   + startSampleInFile * mappedAudioFile->bytesPerFrame;
+        if (mappedAudioFile->littleEndian)
+        {
+            convert<AudioData::LittleEndian> (destSamples, startOffsetInDestBuffer, numDestChannels,
+                                              source, numSamples);
+        }
+        else
+        {
+            convert<AudioData::BigEndian> (destSamples, startOffsetInDestBuffer, numDestChannels,
+                                           source, numSamples);
+        }
+        return true;
+    }
+
+private:
+    template <class Endianness>
+    void convert (int** destSamples, int destOffset, int numDestChannels,
+                  const char* source, int numSamples) const
+    {
+        const int numSourceChannels = (int) numChannels;
+
+        if (usesFloatingPointData)
+        {
+            ReadHelper<AudioData::Float32, AudioData::Float32, Endianness>::read
+                (destSamples, destOffset, numDestChannels, source, numSourceChannels, numSamples);
+            return;
+        }
+
+        switch (bitsPerSample)
+        {
+            case 8:
+                // 8 bit WAV files are unsigned, 8 bit AIFF files signed
+                // (in either byte order).
+                if (mappedAudioFile->wavFile)
+                {
+                    ReadHelper<AudioData::Int32, AudioData::UInt8, Endianness>::read
+                        (destSamples, destOffset, numDestChannels, source, numSourceChannels, numSamples);
+                }
+                else
+                {
+                    ReadHelper<AudioData::Int32, AudioData::Int8, Endianness>::read
+                        (destSamples, destOffset, numDestChannels, source, numSourceChannels, numSamples);
+                }
+                break;
+            case 16:
+                ReadHelper<AudioData::Int32, AudioData::Int16, Endianness>::read
+                    (destSamples, destOffset, numDestChannels, source, numSourceChannels, numSamples);
+                break;
+            case 24:
+                ReadHelper<AudioData::Int32, AudioData::Int24, Endianness>::read
+                    (destSamples, destOffset, numDestChannels, source, numSourceChannels, numSamples);
+                break;
+            case 32:
+                ReadHelper<AudioData::Int32, AudioData::Int32, Endianness>::read
+                    (destSamples, destOffset, numDestChannels, source, numSourceChannels, numSamples);
+                break;
+            default:
+                jassertfalse;
+                break;
+        }
+    }
+
+    ReferenceCountedObjectPtr<MappedAudioFile> mappedAudioFile;
+
+    JUCE_DECLARE_NON_COPYABLE (MappedAudioFileReader);
+};
+
+
+//==============================================================================
+juce_ImplementSingleton (AudioFileCache)
+
+AudioFileCache::AudioFileCache ()
+:   maximumNumberOfUnusedFiles (16),
+    useCounter (0)
+{
+}
+
+AudioFileCache::~AudioFileCache ()
+{
+    clearSingletonInstance();
+}
+
+AudioFormatReader* AudioFileCache::createReaderFor (const File& audioFile)
+{
+    {
+        const ScopedLock sl (lock);
+
+        MappedAudioFile* const mappedAudioFile = findMappedFile (audioFile);
+        if (mappedAudioFile != nullptr)
+        {
+            mappedAudioFile->lastUsed = ++useCounter;
+            return new MappedAudioFileReader (mappedAudioFile);
+        }
+    }
+
+    // The file is mapped and its header is parsed without holding the lock,
+    // such that several files can be opened in parallel.
+    ReferenceCountedObjectPtr<MappedAudioFile> newMappedAudioFile (new MappedAudioFile (audioFile));
+    if (newMappedAudioFile->isValid())
+    {
+        const ScopedLock sl (lock);
+
+        // Another thread might have mapped the same file meanwhile.
+        MappedAudioFile* mappedAudioFile = findMappedFile (audioFile);
+        if (mappedAudioFile == nullptr)
+        {
+            mappedAudioFile = newMappedAudioFile;
+            mappedFiles.add (mappedAudioFile);
+            DEB("AudioFileCache: mapped " + audioFile.getFullPathName())
+        }
+        mappedAudioFile->lastUsed = ++useCounter;
+        return new MappedAudioFileReader (mappedAudioFile);
+    }
+
+    // Not an uncompressed WAV or AIFF file (or it couldn't be mapped).
+    DEB("AudioFileCache: " + audioFile.getFileName() + " is read without the cache.")
+    AudioFormatManager audioFormatManager;
+    audioFormatManager.registerBasicFormats();
+    return audioFormatManager.createReaderFor (audioFile);
+}
+
+int AudioFileCache::getNumberOfMappedFiles ()
+{
+    const ScopedLock sl (lock);
+    return mappedFiles.size();
+}
+
+void AudioFileCache::setMaximumNumberOfUnusedFiles (int maximumNumberOfUnusedFiles_)
+{
+    {
+        const ScopedLock sl (lock);
+        maximumNumberOfUnusedFiles = jmax (0, maximumNumberOfUnusedFiles_);
+    }
+    evictUnusedFiles();
+}
+
+void AudioFileCache::evictUnusedFiles ()
+{
+    const ScopedLock sl (lock);
+
+    // New references are only created under the lock. A file only
+    // referenced by the mappedFiles array stays unused.
+    while (true)
+    {
+        int numberOfUnusedFiles = 0;
+        int leastRecentlyUsed = -1;
+        for (int i = 0; i < mappedFiles.size(); ++i)
+        {
+            MappedAudioFile* const mappedAudioFile = mappedFiles.getUnchecked (i);
+            if (mappedAudioFile->getReferenceCount() == 1)
+            {
+                ++numberOfUnusedFiles;
+                if (leastRecentlyUsed < 0
+                    || mappedAudioFile->lastUsed < mappedFiles.getUnchecked (leastRecentlyUsed)->lastUsed)
+                {
+                    leastRecentlyUsed = i;
+                }
+            }
+        }
+
+        if (numberOfUnusedFiles <= maximumNumberOfUnusedFiles)
+        {
+            break;
+        }
+        DEB("AudioFileCache: unmapped " + mappedFiles.getUnchecked (leastRecentlyUsed)->file.getFullPathName())
+        mappedFiles.remove (leastRecentlyUsed);
+    }
+}
+
+AudioFileCache::MappedAudioFile* AudioFileCache::findMappedFile (const File& audioFile)
+{
+    for (int i = 0; i < mappedFiles.size(); ++i)
+    {
+        MappedAudioFile* const mappedAudioFile = mappedFiles.getUnchecked (i);
+        if (mappedAudioFile->file == audioFile)
+        {
+            if (mappedAudioFile->isUpToDate())
+            {
+                return mappedAudioFile;
+            }
+
+            // The file has been overwritten. The readers that still use the
+            // old mapping keep it alive.
+            mappedFiles.remove (i);
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+
+#if AUDIO_ENGINE_UNIT_TESTS
+//==============================================================================
+/**
+ An AudioFormatReader without a file, that delivers the samples it has been
+ given (in the format of AudioFormatReader::readSamples). Used by the
+ AudioFileCacheTest as the reference for the files it writes by hand.
+ */
+class ExpectedSamplesAudioFormatReader  : public AudioFormatReader
+{
+public:
+    ExpectedSamplesAudioFormatReader (int numberOfChannels, int numberOfSamples,
+                                      int bitsPerSample_, bool floatingPoint)
+        : AudioFormatReader (nullptr, "Expected samples")
+    {
+        samples.calloc (numberOfChannels * numberOfSamples);
+        sampleRate = 44100.0;
+        bitsPerSample = bitsPerSample_;
+        lengthInSamples = numberOfSamples;
+        numChannels = numberOfChannels;
+        usesFloatingPointData = floatingPoint;
+    }
+
+    /** The samples of a channel, as they have to be read. */
+    int* getChannel (int channel)
+    {
+        return samples + channel * (int) lengthInSamples;
+    }
+
+    bool readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
+                      int64 startSampleInFile, int numSamples)
+    {
+        for (int channel = 0; channel < numDestChannels; ++channel)
+        {
+            if (destSamples[channel] != nullptr)
+            {
+                int* const destination = destSamples[channel] + startOffsetInDestBuffer;
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    const int64 sample = startSampleInFile + i;
+                    destination[i] = channel < (int) numChannels && sample >= 0 && sample < lengthInSamples
+                                     ? getChannel (channel)[sample]
+                                     : 0;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    HeapBlock<int> samples;
+};
+
+//==============================================================================
+/**
+ Compares the readers of the AudioFileCache (which parse the headers and
+ convert the samples themselves) sample by sample with the ones of JUCE,
+ for files written by the WavAudioFormat and the AiffAudioFormat, and with
+ the expected samples for the variants these don't write: 32 bit integers
+ in a WAV file, WAVE_FORMAT_EXTENSIBLE, AIFC files (uncompressed, 'sowt'
+ and 'fl32') and an SSND chunk with an offset.
+ */
+class AudioFileCacheTest  : public UnitTest
+{
+public:
+    AudioFileCacheTest ()  : UnitTest ("AudioFileCache") {}
+
+    void runTest ()
+    {
+        const int bitDepths[] = { 8, 16, 24, 32 };
+
+        beginTest ("files written by the WavAudioFormat");
+        WavAudioFormat wavAudioFormat;
+        for (int i = 0; i < numElementsInArray (bitDepths); ++i)
+        {
+            testFileWrittenBy (wavAudioFormat, ".wav", bitDepths[i]);
+        }
+
+        beginTest ("files written by the AiffAudioFormat");
+        AiffAudioFormat aiffAudioFormat;
+        for (int i = 0; i < numElementsInArray (bitDepths); ++i)
+        {
+            testFileWrittenBy (aiffAudioFormat, ".aiff", bitDepths[i]);
+        }
+
+        beginTest ("WAV variants");
+        for (int i = 0; i < numElementsInArray (bitDepths); ++i)
+        {
+            testWav (bitDepths[i], false, false);
+            testWav (bitDepths[i], false, true);
+        }
+        testWav (32, true, false);
+        testWav (32, true, true);
+
+        beginTest ("AIFF variants");
+        for (int i = 0; i < numElementsInArray (bitDepths); ++i)
+        {
+            testAiff (bitDepths[i], false, nullptr, 0);
+            testAiff (bitDepths[i], false, "NONE", 0);
+            testAiff (bitDepths[i], false, "sowt", 0);
+            testAiff (bitDepths[i], false, nullptr, 6);
+        }
+        testAiff (32, true, "fl32", 0);
+        testAiff (32, true, "FL32", 4);
+
+        // Unmaps the files of the test.
+        AudioFileCache::getInstance()->setMaximumNumberOfUnusedFiles (0);
+        AudioFileCache::getInstance()->setMaximumNumberOfUnusedFiles (16);
+    }
+
+private:
+    enum
+    {
+        numberOfChannels = 2,
+        // Odd, such that an 8 bit mono file would need a pad byte.
+        numberOfSamples = 1001
+    };
+
+    //==============================================================================
+    /** Writes random samples with the format and compares the two readers. */
+    void testFileWrittenBy (AudioFormat& audioFormat, const String& suffix, int bitsPerSample)
+    {
+        const String name (audioFormat.getFormatName() + ", " + String (bitsPerSample) + " bit");
+        TemporaryFile temporaryFile (suffix);
+        {
+            FileOutputStream* const stream = temporaryFile.getFile().createOutputStream();
+            if (stream == nullptr)
+            {
+                expect (false, name + ": can't write the file.");
+                return;
+            }
+            ScopedPointer<AudioFormatWriter> writer (audioFormat.createWriterFor (stream, 44100.0, numberOfChannels,
+                                                                                  bitsPerSample, StringPairArray(), 0));
+            if (writer == nullptr)
+            {
+                delete stream;
+                expect (false, name + ": no writer.");
+                return;
+            }
+
+            Random random (120830 + bitsPerSample);
+            HeapBlock<int> samples (numberOfChannels * numberOfSamples);
+            const int* channels[numberOfChannels + 1];
+            for (int channel = 0; channel < numberOfChannels; ++channel)
+            {
+                int* const channelSamples = samples + channel * numberOfSamples;
+                for (int i = 0; i < numberOfSamples; ++i)
+                {
+                    if (writer->isFloatingPoint())
+                    {
+                        const float sample = 2.0f * random.nextFloat() - 1.0f;
+                        memcpy (channelSamples + i, &sample, sizeof (float));
+                    }
+                    else
+                    {
+                        channelSamples[i] = random.nextInt();
+                    }
+                }
+                channels[channel] = channelSamples;
+            }
+            channels[numberOfChannels] = nullptr;
+            expect (writer->write (channels, numberOfSamples), name + ": can't write the samples.");
+        }
+
+        AudioFormatManager audioFormatManager;
+        audioFormatManager.registerBasicFormats();
+        ScopedPointer<AudioFormatReader> juceReader (audioFormatManager.createReaderFor (temporaryFile.getFile()));
+        expect (juceReader != nullptr, name + ": JUCE can't read the file.");
+        if (juceReader != nullptr)
+        {
+            compareWithCachedReader (temporaryFile.getFile(), *juceReader, name);
+        }
+    }
+
+    /** Writes a WAV file by hand, with a chunk of an odd size in front of
+     the format. */
+    void testWav (int bitsPerSample, bool floatingPoint, bool extensible)
+    {
+        const String name (String ("WAV, ") + String (bitsPerSample) + (floatingPoint ? " bit float" : " bit")
+                           + (extensible ? ", extensible" : ""));
+        ExpectedSamplesAudioFormatReader expectedSamples (numberOfChannels, numberOfSamples,
+                                                          bitsPerSample, floatingPoint);
+        MemoryOutputStream samples;
+        writeSamples (samples, expectedSamples, bitsPerSample, floatingPoint, true, bitsPerSample == 8);
+
+        MemoryOutputStream file;
+        const int formatSize = extensible ? 40 : 16;
+        const int bytesPerFrame = numberOfChannels * bitsPerSample / 8;
+        file.write ("RIFF", 4);
+        file.writeInt (4 + (8 + 3 + 1) + (8 + formatSize) + 8 + (int) samples.getDataSize() + (int) (samples.getDataSize() & 1));
+        file.write ("WAVE", 4);
+        file.write ("junk", 4);
+        file.writeInt (3);
+        file.writeRepeatedByte (0, 3 + 1);
+        file.write ("fmt ", 4);
+        file.writeInt (formatSize);
+        file.writeShort ((short) (extensible ? 0xfffe : (floatingPoint ? 3 : 1)));
+        file.writeShort (numberOfChannels);
+        file.writeInt (44100);
+        file.writeInt (44100 * bytesPerFrame);
+        file.writeShort ((short) bytesPerFrame);
+        file.writeShort ((short) bitsPerSample);
+        if (extensible)
+        {
+            file.writeShort (22);
+            file.writeShort ((short) bitsPerSample);
+            file.writeInt (3); // front left and right
+            // KSDATAFORMAT_SUBTYPE_PCM or _IEEE_FLOAT
+            const uint8 subFormat[16] = { (uint8) (floatingPoint ? 3 : 1), 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                                          0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 };
+            file.write (subFormat, 16);
+        }
+        file.write ("data", 4);
+        file.writeInt ((int) samples.getDataSize());
+        file.write (samples.getData(), (int) samples.getDataSize());
+        file.writeRepeatedByte (0, (int) (samples.getDataSize() & 1));
+
+        testFile (file, ".wav", expectedSamples, name);
+    }
+
+    /** Writes an AIFF file by hand, or an AIFC file if the compressionType
+     isn't nullptr. */
+    void testAiff (int bitsPerSample, bool floatingPoint, const char* compressionType, int ssndOffset)
+    {
+        const bool isAifc = compressionType != nullptr;
+        const bool littleEndian = isAifc && memcmp (compressionType, "sowt", 4) == 0;
+        const String name (String (isAifc ? "AIFC " + String (compressionType, 4) : String ("AIFF"))
+                           + ", " + String (bitsPerSample) + " bit, SSND offset " + String (ssndOffset));
+        ExpectedSamplesAudioFormatReader expectedSamples (numberOfChannels, numberOfSamples,
+                                                          bitsPerSample, floatingPoint);
+        MemoryOutputStream samples;
+        writeSamples (samples, expectedSamples, bitsPerSample, floatingPoint, littleEndian, false);
+
+        MemoryOutputStream file;
+        // An empty pascal string (with its pad byte) as the name of the compression.
+        const int commonSize = isAifc ? 18 + 4 + 2 : 18;
+        const int soundDataSize = 8 + ssndOffset + (int) samples.getDataSize();
+        file.write ("FORM", 4);
+        file.writeIntBigEndian (4 + (isAifc ? 12 : 0) + (8 + commonSize) + 8 + soundDataSize + (soundDataSize & 1));
+        file.write (isAifc ? "AIFC" : "AIFF", 4);
+        if (isAifc)
+        {
+            file.write ("FVER", 4);
+            file.writeIntBigEndian (4);
+            file.writeIntBigEndian ((int) 0xa2805140);
+        }
+        file.write ("COMM", 4);
+        file.writeIntBigEndian (commonSize);
+        file.writeShortBigEndian (numberOfChannels);
+        file.writeIntBigEndian (numberOfSamples);
+        file.writeShortBigEndian ((short) bitsPerSample);
+        // 44100 as an 80 bit extended precision number.
+        const uint8 sampleRate[10] = { 0x40, 0x0e, 0xac, 0x44, 0, 0, 0, 0, 0, 0 };
+        file.write (sampleRate, 10);
+        if (isAifc)
+        {
+            file.write (compressionType, 4);
+            file.writeRepeatedByte (0, 2);
+        }
+        file.write ("SSND", 4);
+        file.writeIntBigEndian (soundDataSize);
+        file.writeIntBigEndian (ssndOffset);
+        file.writeIntBigEndian (0);
+        file.writeRepeatedByte (0xff, ssndOffset);
+        file.write (samples.getData(), (int) samples.getDataSize());
+        file.writeRepeatedByte (0, soundDataSize & 1);
+
+        testFile (file, isAifc ? ".aifc" : ".aiff", expectedSamples, name);
+    }
+
+    /** Writes random samples, interleaved, and keeps them as they have to be
+     read (the integers scaled to 32 bits, the floats as they are). */
+    static void writeSamples (MemoryOutputStream& stream, ExpectedSamplesAudioFormatReader& expectedSamples,
+                              int bitsPerSample, bool floatingPoint, bool littleEndian, bool unsigned8Bit)
+    {
+        Random random (120830 + bitsPerSample + (floatingPoint ? 100 : 0) + (littleEndian ? 1000 : 0));
+        for (int i = 0; i < numberOfSamples; ++i)
+        {
+            for (int channel = 0; channel < numberOfChannels; ++channel)
+            {
+                int& expectedSample = expectedSamples.getChannel (channel)[i];
+                if (floatingPoint)
+                {
+                    const float sample = 2.0f * random.nextFloat() - 1.0f;
+                    memcpy (&expectedSample, &sample, sizeof (float));
+                    if (littleEndian)
+                    {
+                        stream.writeFloat (sample);
+                    }
+                    else
+                    {
+                        stream.writeFloatBigEndian (sample);
+                    }
+                    continue;
+                }
+
+                // The full range, including the extremes.
+                const int sample = bitsPerSample == 32 ? random.nextInt()
+                                                       : random.nextInt (1 << bitsPerSample) - (1 << (bitsPerSample - 1));
+                expectedSample = (int) ((uint32) sample << (32 - bitsPerSample));
+                switch (bitsPerSample)
+                {
+                    case 8:
+                        stream.writeByte ((char) (unsigned8Bit ? sample + 128 : sample));
+                        break;
+                    case 16:
+                        if (littleEndian)
+                        {
+                            stream.writeShort ((short) sample);
+                        }
+                        else
+                        {
+                            stream.writeShortBigEndian ((short) sample);
+                        }
+                        break;
+                    case 24:
+                        for (int byte = 0; byte < 3; ++byte)
+                        {
+                            stream.writeByte ((char) (sample >> (littleEndian ? 8 * byte : 16 - 8 * byte)));
+                        }
+                        break;
+                    default:
+                        if (littleEndian)
+                        {
+                            stream.writeInt (sample);
+                        }
+                        else
+                        {
+                            stream.writeIntBigEndian (sample);
+                        }
+                        break;
+                }
+            }
+        }
+    }
+
+    /** Writes the file and compares the reader of the cache with the
+     expected samples, and with the one of JUCE, if it reads the file in
+     the same format. */
+    void testFile (const MemoryOutputStream& fileData, const String& suffix,
+                   ExpectedSamplesAudioFormatReader& expectedSamples, const String& name)
+    {
+        TemporaryFile temporaryFile (suffix);
+        if (! temporaryFile.getFile().replaceWithData (fileData.getData(), fileData.getDataSize()))
+        {
+            expect (false, name + ": can't write the file.");
+            return;
+        }
+
+        compareWithCachedReader (temporaryFile.getFile(), expectedSamples, name);
+
+        AudioFormatManager audioFormatManager;
+        audioFormatManager.registerBasicFormats();
+        ScopedPointer<AudioFormatReader> juceReader (audioFormatManager.createReaderFor (temporaryFile.getFile()));
+        if (juceReader != nullptr
+            && juceReader->usesFloatingPointData == expectedSamples.usesFloatingPointData
+            && juceReader->bitsPerSample == expectedSamples.bitsPerSample
+            && juceReader->lengthInSamples == expectedSamples.lengthInSamples)
+        {
+            compareWithCachedReader (temporaryFile.getFile(), *juceReader, name + " (JUCE)");
+        }
+    }
+
+    /** Creates a reader with the AudioFileCache, which has to map the file,
+     and compares it with the reference: the layout, all samples and
+     sections that start before the start and end after the end. */
+    void compareWithCachedReader (const File& file, AudioFormatReader& reference, const String& name)
+    {
+        AudioFileCache* const audioFileCache = AudioFileCache::getInstance();
+        const int numberOfMappedFiles = audioFileCache->getNumberOfMappedFiles();
+        ScopedPointer<AudioFormatReader> reader (audioFileCache->createReaderFor (file));
+        expect (reader != nullptr, name + ": no reader.");
+        if (reader == nullptr)
+        {
+            return;
+        }
+        expect (audioFileCache->getNumberOfMappedFiles() > numberOfMappedFiles, name + ": not mapped.");
+        expect (reader->sampleRate == reference.sampleRate
+                && reader->numChannels == reference.numChannels
+                && reader->bitsPerSample == reference.bitsPerSample
+                && reader->usesFloatingPointData == reference.usesFloatingPointData
+                && reader->lengthInSamples == reference.lengthInSamples,
+                name + ": the format differs.");
+
+        const int length = (int) reference.lengthInSamples;
+        compareSection (*reader, reference, 0, length, name);
+        compareSection (*reader, reference, 37, 100, name);
+        compareSection (*reader, reference, length - 10, 50, name);
+        compareSection (*reader, reference, length + 10, 20, name);
+        compareSection (*reader, reference, -5, 20, name);
+    }
+
+    void compareSection (AudioFormatReader& reader, AudioFormatReader& reference,
+                         int startSample, int numSamples, const String& name)
+    {
+        HeapBlock<int> samples (numberOfChannels * numSamples);
+        HeapBlock<int> referenceSamples (numberOfChannels * numSamples);
+        int* channels[numberOfChannels];
+        int* referenceChannels[numberOfChannels];
+        for (int channel = 0; channel < numberOfChannels; ++channel)
+        {
+            channels[channel] = samples + channel * numSamples;
+            referenceChannels[channel] = referenceSamples + channel * numSamples;
+        }
+        // Whatever isn't written differs.
+        memset (samples, 0x55, numberOfChannels * numSamples * sizeof (int));
+        memset (referenceSamples, 0xaa, numberOfChannels * numSamples * sizeof (int));
+
+        reader.read (channels, numberOfChannels, startSample, numSamples, false);
+        reference.read (referenceChannels, numberOfChannels, startSample, numSamples, false);
+        expect (memcmp (samples, referenceSamples, numberOfChannels * numSamples * sizeof (int)) == 0,
+                name + ": samples " + String (startSample) + " to " + String (startSample + numSamples));
+    }
+};
+
+static AudioFileCacheTest audioFileCacheTest;
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ *  AudioFileCache.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120830.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __AUDIOFILECACHE_HEADER__
+#define __AUDIOFILECACHE_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+ A process-wide cache of the audio files used by the regions.
+
+ Uncompressed WAV and AIFF files are memory-mapped once and shared by all
+ regions that play them: Twenty regions cut from the same file use one
+ mapping (and no file descriptor is kept open), and the pages the operating system
+ has read for one region are there for all the others.
+
+ The AudioFormatReader s created by createReaderFor only keep a reference
+ to the shared file, they have no state of their own apart from the file
+ layout. The cached files are reference counted. A file that isn't used by
+ any reader anymore is kept for a while (such that removing and adding a
+ region again, e.g. by an undo, doesn't map the file anew) and then
+ unmapped. See setMaximumNumberOfUnusedFiles.
+
+ Files that can't be mapped (other formats, compressed AIFC, not enough
+ address space) are read by an ordinary AudioFormatReader, as before.
+ */
+class JUCE_API  AudioFileCache  : public DeletedAtShutdown
+{
+public:
+    /** Constructor. Use getInstance() instead. */
+    AudioFileCache ();
+
+    /** Destructor. The files still used by readers stay mapped until the
+     last of these readers is deleted. */
+    ~AudioFileCache ();
+
+    juce_DeclareSingleton (AudioFileCache, false)
+
+    //==============================================================================
+    /**
+     Creates a reader for the given file. The file is mapped, if it isn't
+     already.
+
+     @return    A new reader, which the caller has to delete, or nullptr if
+                the file can't be read.
+     */
+    AudioFormatReader* createReaderFor (const File& audioFile);
+
+    /** Returns the number of files that are currently mapped. */
+    int getNumberOfMappedFiles ();
+
+    /**
+     Sets the number of files that stay mapped although no reader uses them.
+     The ones that were used least recently are unmapped first. The default
+     is 16.
+     */
+    void setMaximumNumberOfUnusedFiles (int maximumNumberOfUnusedFiles);
+
+    /** Unmaps the unused files above the limit. Called by the readers when
+     they are deleted. */
+    void evictUnusedFiles ();
+
+private:
+    class MappedAudioFile;
+    class MappedAudioFileReader;
+
+    /** Returns the cached file or nullptr. */
+    MappedAudioFile* findMappedFile (const File& audioFile);
+
+    ReferenceCountedArray<MappedAudioFile> mappedFiles;
+    int maximumNumberOfUnusedFiles;
+    /** Incremented whenever a file is used. Tells which files were used
+     least recently. */
+    int64 useCounter;
+    CriticalSection lock;
+
+    JUCE_DECLARE_NON_COPYABLE (AudioFileCache);
+};
+
+
+#endif   // __AUDIOFILECACHE_HEADER__
@@ -0,0 +1,436 @@
+/*
+ *  AudioRegionIntervalIndex.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120824.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "AudioRegionIntervalIndex.h"
+
+
+AudioRegionIntervalIndex::AudioRegionIntervalIndex ()
+:   rootNode (nullptr),
+    numberOfRegions (0),
+    random (0x2f3a1b)
+{
+}
+
+AudioRegionIntervalIndex::~AudioRegionIntervalIndex ()
+{
+    clear();
+}
+
+void AudioRegionIntervalIndex::add (AudioRegion* region, int regionID, int startPosition, int endPosition)
+{
+    Node* node = new Node();
+    node->region = region;
+    node->regionID = regionID;
+    node->startPosition = startPosition;
+    node->endPosition = endPosition;
+    node->maxEndPosition = endPosition;
+    node->priority = random.nextInt();
+    node->left = nullptr;
+    node->right = nullptr;
+
+    insert (rootNode, node);
+    ++numberOfRegions;
+}
+
+bool AudioRegionIntervalIndex::remove (int regionID, int startPosition)
+{
+    Node* node = extract (rootNode, regionID, startPosition);
+    if (node == nullptr)
+    {
+        return false;
+    }
+
+    delete node;
+    --numberOfRegions;
+    return true;
+}
+
+void AudioRegionIntervalIndex::clear ()
+{
+    deleteSubtree (rootNode);
+    rootNode = nullptr;
+    numberOfRegions = 0;
+}
+
+int AudioRegionIntervalIndex::size () const
+{
+    return numberOfRegions;
+}
+
+void AudioRegionIntervalIndex::findRegions (int startOfChunk, int endOfChunk, Array<AudioRegion*>& result) const
+{
+    findRegions (rootNode, startOfChunk, endOfChunk, result);
+}
+
+void AudioRegionIntervalIndex::getAllRegions (Array<AudioRegion*>& result) const
+{
+    result.ensureStorageAllocated (result.size() + numberOfRegions);
+    getAllRegions (rootNode, result);
+}
+
+//==============================================================================
+bool AudioRegionIntervalIndex::isBefore (int startPosition, int regionID, const Node* node)
+{
+    return startPosition < node->startPosition
+           || (startPosition == node->startPosition && regionID < node->regionID);
+}
+
+void AudioRegionIntervalIndex::update (Node* node)
+{
+    node->maxEndPosition = node->endPosition;
+    if (node->left != nullptr && node->left->maxEndPosition > node->maxEndPosition)
+    {
+        node->maxEndPosition = node->left->maxEndPosition;
+    }
+    if (node->right != nullptr && node->right->maxEndPosition > node->maxEndPosition)
+    {
+        node->maxEndPosition = node->right->maxEndPosition;
+    }
+}
+
+void AudioRegionIntervalIndex::rotateLeft (Node*& node)
+{
+    Node* newTop = node->right;
+    node->right = newTop->left;
+    newTop->left = node;
+    update (node);
+    update (newTop);
+    node = newTop;
+}
+
+void AudioRegionIntervalIndex::rotateRight (Node*& node)
+{
+    Node* newTop = node->left;
+    node->left = newTop->right;
+    newTop->right = node;
+    update (node);
+    update (newTop);
+    node = newTop;
+}
+
+void AudioRegionIntervalIndex::insert (Node*& root, Node* node)
+{
+    if (root == nullptr)
+    {
+        root = node;
+        return;
+    }
+
+    if (isBefore (node->startPosition, node->regionID, root))
+    {
+        insert (root->left, node);
+        if (root->left->priority > root->priority)
+        {
+            rotateRight (root);
+            return;
+        }
+    }
+    else
+    {
+        insert (root->right, node);
+        if (root->right->priority > root->priority)
+        {
+            rotateLeft (root);
+            return;
+        }
+    }
+    update (root);
+}
+
+AudioRegionIntervalIndex::Node* AudioRegionIntervalIndex::extract (Node*& root, int regionID, int startPosition)
+{
+    if (root == nullptr)
+    {
+        return nullptr;
+    }
+
+    Node* extractedNode;
+    if (root->regionID == regionID && root->startPosition == startPosition)
+    {
+        // Rotate the node down until it has at most one child,
+        // keeping the child with the higher priority on top.
+        if (root->left == nullptr)
+        {
+            extractedNode = root;
+            root = root->right;
+            return extractedNode;
+        }
+        if (root->right == nullptr)
+        {
+            extractedNode = root;
+            root = root->left;
+            return extractedNode;
+        }
+        if (root->left->priority > root->right->priority)
+        {
+            rotateRight (root);
+            extractedNode = extract (root->right, regionID, startPosition);
+        }
+        else
+        {
+            rotateLeft (root);
+            extractedNode = extract (root->left, regionID, startPosition);
+        }
+    }
+    else if (isBefore (startPosition, regionID, root))
+    {
+        extractedNode = extract (root->left, regionID, startPosition);
+    }
+    else
+    {
+        extractedNode = extract (root->right, regionID, startPosition);
+    }
+
+    update (root);
+    return extractedNode;
+}
+
+void AudioRegionIntervalIndex::deleteSubtree (Node* node)
+{
+    if (node != nullptr)
+    {
+        deleteSubtree (node->left);
+        deleteSubtree (node->right);
+        delete node;
+    }
+}
+
+void AudioRegionIntervalIndex::findRegions (const Node* node, int startOfChunk, int endOfChunk, Array<AudioRegion*>& result)
+{
+    // All regions in this subtree ended before the chunk.
+    if (node == nullptr || node->maxEndPosition < startOfChunk)
+    {
+        return;
+    }
+
+    findRegions (node->left, startOfChunk, endOfChunk, result);
+
+    // If this region starts after the chunk, so do all in the right subtree.
+    if (node->startPosition < endOfChunk)
+    {
+        if (node->endPosition >= startOfChunk)
+        {
+            result.add (node->region);
+        }
+        findRegions (node->right, startOfChunk, endOfChunk, result);
+    }
+}
+
+void AudioRegionIntervalIndex::getAllRegions (const Node* node, Array<AudioRegion*>& result)
+{
+    if (node != nullptr)
+    {
+        getAllRegions (node->left, result);
+        result.add (node->region);
+        getAllRegions (node->right, result);
+    }
+}
+
+#if AUDIO_ENGINE_UNIT_TESTS
+//==============================================================================
+/**
+ Compares findRegions with a search through all regions, after random adds
+ and removes. The index never dereferences the regions, the tests pass
+ their regionID + 1 as the pointer.
+ */
+class AudioRegionIntervalIndexTest  : public UnitTest
+{
+public:
+    AudioRegionIntervalIndexTest ()  : UnitTest ("AudioRegionIntervalIndex") {}
+
+    void runTest ()
+    {
+        enum { numberOfRegions = 500, numberOfChunks = 300 };
+        int startPositions[numberOfRegions];
+        int endPositions[numberOfRegions];
+        bool isInTheIndex[numberOfRegions];
+
+        AudioRegionIntervalIndex index;
+        Random random (120824);
+
+        beginTest ("add");
+        for (int i = 0; i < numberOfRegions; ++i)
+        {
+            // Few distinct start positions, to have some with the same one.
+            startPositions[i] = 1000 * random.nextInt (200);
+            endPositions[i] = startPositions[i] + random.nextInt (20000);
+            isInTheIndex[i] = true;
+            index.add (getRegion (i), i, startPositions[i], endPositions[i]);
+        }
+        expect (index.size() == numberOfRegions);
+        checkFindRegions (index, random, numberOfChunks, startPositions, endPositions, isInTheIndex, numberOfRegions);
+
+        beginTest ("remove");
+        int numberOfRemainingRegions = numberOfRegions;
+        for (int i = 0; i < numberOfRegions; i += 2)
+        {
+            expect (index.remove (i, startPositions[i]));
+            isInTheIndex[i] = false;
+            --numberOfRemainingRegions;
+        }
+        expect (! index.remove (0, startPositions[0]), "removed twice");
+        expect (! index.remove (1, startPositions[1] + 1), "wrong start position");
+        expect (index.size() == numberOfRemainingRegions);
+        checkFindRegions (index, random, numberOfChunks, startPositions, endPositions, isInTheIndex, numberOfRegions);
+
+        beginTest ("getAllRegions");
+        Array<AudioRegion*> allRegions;
+        index.getAllRegions (allRegions);
+        expect (allRegions.size() == numberOfRemainingRegions);
+        for (int i = 1; i < allRegions.size(); ++i)
+        {
+            expect (! isBefore (getRegionID (allRegions[i]), getRegionID (allRegions[i - 1]), startPositions),
+                    "not sorted");
+        }
+
+        beginTest ("clear");
+        index.clear();
+        expect (index.size() == 0);
+        Array<AudioRegion*> result;
+        index.findRegions (0, 1000000, result);
+        expect (result.size() == 0);
+    }
+
+private:
+    static AudioRegion* getRegion (int regionID)
+    {
+        return reinterpret_cast<AudioRegion*> ((pointer_sized_int) regionID + 1);
+    }
+
+    static int getRegionID (AudioRegion* region)
+    {
+        return (int) (reinterpret_cast<pointer_sized_int> (region) - 1);
+    }
+
+    static bool isBefore (int regionID, int otherRegionID, const int* startPositions)
+    {
+        return startPositions[regionID] < startPositions[otherRegionID]
+               || (startPositions[regionID] == startPositions[otherRegionID] && regionID < otherRegionID);
+    }
+
+    void checkFindRegions (const AudioRegionIntervalIndex& index,
+                           Random& random,
+                           int numberOfChunks,
+                           const int* startPositions,
+                           const int* endPositions,
+                           const bool* isInTheIndex,
+                           int numberOfRegions)
+    {
+        Array<AudioRegion*> result;
+        for (int chunk = 0; chunk < numberOfChunks; ++chunk)
+        {
+            const int startOfChunk = random.nextInt (230000) - 10000;
+            const int endOfChunk = startOfChunk + 1 + random.nextInt (2048);
+
+            int numberOfExpectedRegions = 0;
+            for (int i = 0; i < numberOfRegions; ++i)
+            {
+                if (isInTheIndex[i] && startPositions[i] < endOfChunk && endPositions[i] >= startOfChunk)
+                    ++numberOfExpectedRegions;
+            }
+
+            result.clearQuick();
+            index.findRegions (startOfChunk, endOfChunk, result);
+            expect (result.size() == numberOfExpectedRegions,
+                    "found " + String (result.size()) + " instead of " + String (numberOfExpectedRegions));
+
+            for (int i = 0; i < result.size(); ++i)
+            {
+                const int regionID = getRegionID (result[i]);
+                expect (regionID >= 0 && regionID < numberOfRegions && isInTheIndex[regionID]
+                        && startPositions[regionID] < endOfChunk && endPositions[regionID] >= startOfChunk,
+                        "region " + String (regionID) + " isn't in the chunk");
+                if (i > 0)
+                    expect (! isBefore (regionID, getRegionID (result[i - 1]), startPositions), "not sorted");
+            }
+        }
+    }
+};
+
+static AudioRegionIntervalIndexTest audioRegionIntervalIndexTest;
+
+#if AUDIO_ENGINE_BENCHMARKS
+//==============================================================================
+/**
+ The cost of finding the regions of a block, for 100 to 100000 regions, of
+ which about the same number (16) are under the playhead at any time. It
+ should hardly grow with the number of regions (a search through all of
+ them grows linearly, it's logged for comparison).
+ */
+class AudioRegionIntervalIndexBenchmark  : public UnitTest
+{
+public:
+    AudioRegionIntervalIndexBenchmark ()  : UnitTest ("AudioRegionIntervalIndex benchmark") {}
+
+    void runTest ()
+    {
+        beginTest ("region count sweep");
+
+        enum { blockSize = 512, numberOfActiveRegions = 16, numberOfBlocks = 20000 };
+        const int regionLength = 44100;
+        const int spacing = regionLength / numberOfActiveRegions;
+
+        for (int numberOfRegions = 100; numberOfRegions <= 100000; numberOfRegions *= 10)
+        {
+            AudioRegionIntervalIndex index;
+            HeapBlock<int> startPositions (numberOfRegions);
+            for (int i = 0; i < numberOfRegions; ++i)
+            {
+                startPositions[i] = i * spacing;
+                index.add (reinterpret_cast<AudioRegion*> ((pointer_sized_int) i + 1),
+                           i, startPositions[i], startPositions[i] + regionLength);
+            }
+
+            // The blocks are spread over the timeline, from the end of the
+            // first region to the start of the last one.
+            const int startOfTheFirstBlock = regionLength;
+            const int stride = jmax (1, ((numberOfRegions - 1) * spacing - regionLength) / numberOfBlocks);
+            Array<AudioRegion*> result;
+            result.ensureStorageAllocated (4 * numberOfActiveRegions);
+            int numberOfRegionsFound = 0;
+
+            const int64 indexStart = Time::getHighResolutionTicks();
+            for (int block = 0; block < numberOfBlocks; ++block)
+            {
+                const int startOfBlock = startOfTheFirstBlock + block * stride;
+                result.clearQuick();
+                index.findRegions (startOfBlock, startOfBlock + blockSize, result);
+                numberOfRegionsFound += result.size();
+            }
+            const int64 indexEnd = Time::getHighResolutionTicks();
+
+            int numberOfRegionsFoundByTheSearch = 0;
+            const int64 searchStart = Time::getHighResolutionTicks();
+            for (int block = 0; block < numberOfBlocks; ++block)
+            {
+                const int startOfBlock = startOfTheFirstBlock + block * stride;
+                for (int i = 0; i < numberOfRegions; ++i)
+                {
+                    if (startPositions[i] < startOfBlock + blockSize
+                        && startPositions[i] + regionLength >= startOfBlock)
+                        ++numberOfRegionsFoundByTheSearch;
+                }
+            }
+            const int64 searchEnd = Time::getHighResolutionTicks();
+
+            expect (numberOfRegionsFound == numberOfRegionsFoundByTheSearch);
+            logMessage (String (numberOfRegions) + " regions: "
+                        + String (1.0e9 * Time::highResolutionTicksToSeconds (indexEnd - indexStart) / numberOfBlocks, 1)
+                        + " ns per block (searching all of them: "
+                        + String (1.0e9 * Time::highResolutionTicksToSeconds (searchEnd - searchStart) / numberOfBlocks, 1)
+                        + " ns), " + String ((double) numberOfRegionsFound / numberOfBlocks, 1)
+                        + " regions per block");
+        }
+    }
+};
+
+static AudioRegionIntervalIndexBenchmark audioRegionIntervalIndexBenchmark;
+#endif
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ *  AudioRegionIntervalIndex.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120824.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __AUDIOREGIONINTERVALINDEX_HEADER__
+#define __AUDIOREGIONINTERVALINDEX_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+struct AudioRegion;
+
+//==============================================================================
+/**
+ An interval tree of the AudioRegion s, used by the AudioRegionMixer to find
+ the regions under the playhead without looking at all the others.
+
+ It's a treap (a binary search tree, balanced by random priorities), sorted
+ by the start position of the regions (and the regionID for regions with
+ the same start position). Every node also knows the largest end position
+ in its subtree, such that whole subtrees of regions that ended before the
+ playhead can be skipped.
+ <ul>
+ <li> add and remove: O(log n) (expected).
+ <li> findRegions: O((k+1) log n), for the k regions found -
+      not proportional to the number of regions that aren't under the playhead.
+ </ul>
+ The positions are copied to the nodes. If the positions of a region are
+ changed, it has to be removed (with the old start position) and added
+ again.
+ */
+class JUCE_API  AudioRegionIntervalIndex
+{
+public:
+    /** Constructor. */
+    AudioRegionIntervalIndex ();
+
+    /** Destructor. */
+    ~AudioRegionIntervalIndex ();
+
+    /**
+     Adds a region.
+
+     @param region          The region, will be returned by findRegions.
+     @param regionID        Unique ID, see AudioRegion::regionID.
+     @param startPosition   See AudioRegion::startPosition.
+     @param endPosition     See AudioRegion::endPosition.
+     */
+    void add (AudioRegion* region, int regionID, int startPosition, int endPosition);
+
+    /**
+     Removes a region.
+
+     @param regionID        The ID of the region.
+     @param startPosition   The start position it has been added with.
+
+     @return                true, if the region was found.
+     */
+    bool remove (int regionID, int startPosition);
+
+    /** Removes all regions. */
+    void clear ();
+
+    /** Returns the number of regions. */
+    int size () const;
+
+    /**
+     Finds all regions with startPosition < endOfChunk and
+     endPosition >= startOfChunk and appends them to result (sorted by their
+     start position).
+     No memory is allocated if result has enough storage allocated.
+     */
+    void findRegions (int startOfChunk, int endOfChunk, Array<AudioRegion*>& result) const;
+
+    /**
+     Appends all regions to result, sorted by their start position (and
+     regionID). O(n). Used to build an AudioRegionSnapshot.
+     */
+    void getAllRegions (Array<AudioRegion*>& result) const;
+
+private:
+    struct Node
+    {
+        AudioRegion* region;
+        int regionID;
+        int startPosition;
+        int endPosition;
+        /** The largest endPosition in the subtree of this node. */
+        int maxEndPosition;
+        int priority;
+        Node* left;
+        Node* right;
+    };
+
+    static bool isBefore (int startPosition, int regionID, const Node* node);
+    static void update (Node* node);
+    static void rotateLeft (Node*& node);
+    static void rotateRight (Node*& node);
+    static void insert (Node*& root, Node* node);
+    static Node* extract (Node*& root, int regionID, int startPosition);
+    static void deleteSubtree (Node* node);
+    static void findRegions (const Node* node, int startOfChunk, int endOfChunk, Array<AudioRegion*>& result);
+    static void getAllRegions (const Node* node, Array<AudioRegion*>& result);
+
+    Node* rootNode;
+    int numberOfRegions;
+    Random random;
+
+	JUCE_LEAK_DETECTOR (AudioRegionIntervalIndex);
+};
+
+
+#endif   // __AUDIOREGIONINTERVALINDEX_HEADER__
@@ -15,20 +15,52 @@
 
 //==============================================================================
 AudioRegionMixer::AudioRegionMixer()
-    : tempBuffer (2,0),
+    : tempBuffer (1,0),
 	  nextPlayPosition (0),
       totalLength (0),
       samplesPerBlockExpected (512),
       sampleRate (44100.0),
-      bufferingEnabled (false)
+      bufferingEnabled (false),
+      dopplerEffectEnabled (false),
+      lowPassFilterEnabled (false),
+      spacialSimplificationToleranceInMeters (0.0),
+      gainSimplificationToleranceInDB (0.0),
+      hoaBus (1,0),
+      hoaRenderingEnabled (false),
+      hoaBusOutputEnabled (false),
+      currentSnapshot (new AudioRegionSnapshot()),
+      reclaimer (audioThreadEpoch),
+      editTransactionDepth (0),
+      snapshotIsOutdated (false),
+      regionLookaheadInSeconds (0.0),
+      synchronousRegionLoading (false),
+      loopStartPosition (-1),
+      renderConfigurationVersion (0),
+      numberOfRegionsAddedAsynchronously (0),
+      numberOfRegionsChecked (0),
+      loadingThreadPool (jlimit (4, 16, 2 * SystemStats::getNumCpus()))
 {
 	DEB("AudioRegionMixer: constructor called.");
+	
+	regionLoader = new RegionLoader (*this);
 }
 
 AudioRegionMixer::~AudioRegionMixer()
 {
 	DEB("AudioRegionMixer: destructor called.");
+	regionLoader = nullptr; // Stops the thread.
+	if (editTransactionDepth != 0)
+	{
+		// Hands the sources removed during the open transaction over to
+		// the reclaimer.
+		editTransactionDepth = 1;
+		commitEditTransaction();
+	}
 	removeAllRegions();
+	
+	// The audio thread doesn't run anymore. The retired snapshots are
+	// deleted by the reclaimer.
+	delete currentSnapshot.get();
 }
 
 bool AudioRegionMixer::addRegion (const int& regionID,
@@ -46,32 +78,29 @@ bool AudioRegionMixer::addRegion (const int& regionID,
         String(startPositionOfAudioFileInTimeline));
     
 	
-	int index; // just here because findRegion needs it
-	bool foundTheRegion = findRegion(regionID, index);
-	if (foundTheRegion)
 	{
-		DEB(T("AudioRegionMixer: Didn't add the region because its regionID already exists."))
-		return false;
+		// The regionLoader might remove a region meanwhile.
+		const ScopedLock sl (regionLock);
+		if (findRegion(regionID) != nullptr)
+		{
+			DEB(T("AudioRegionMixer: Didn't add the region because its regionID already exists."))
+			return false;
+		}
 	}
 	
 	// --- begin{audio file stuff} ---
 	 File audioFile(absolutePathToAudioFile);
 	
-	 // get a format manager and set it up with the basic types (wav and aiff).
-	 AudioFormatManager audioFormatManager;
-	 audioFormatManager.registerBasicFormats();
-		// Currently, this registers the WAV and AIFF formats.
-	
-	 AudioFormatReader* audioFormatReader = audioFormatManager.createReaderFor (audioFile);
-	 // This audioFormatReader will be deleted when the audioFormatReaderSource will
-	 // be deleted
+	 // All regions of the same (WAV or AIFF) file share its memory mapping.
+	 ScopedPointer<AudioFormatReader> audioFormatReader (AudioFileCache::getInstance()->createReaderFor (audioFile));
+	 // Only used to check the file. The processing chain of the region
+	 // gets its own reader when it's instantiated.
 	// --- end{audio file stuff} ---
 	
 	// if the previous lines of code weren't successful
 	if (audioFormatReader == 0)
 	{
 		DEB("AudioRegionMixer: Didn't add region because the audio file couldn't be read.")
-		delete audioFormatReader;
 		return false;
 	}
 	// check if this input set is invalid
@@ -88,32 +117,48 @@ bool AudioRegionMixer::addRegion (const int& regionID,
 	else
 	{
 		// generate a new AudioRegion element
-		AudioRegion* audioRegionToAdd = new AudioRegion();
+		AudioRegionDescriptor* audioRegionToAdd = new AudioRegionDescriptor();
 		audioRegionToAdd->regionID = regionID;
 		audioRegionToAdd->startPosition = startPosition;
 		audioRegionToAdd->endPosition = endPosition;
 		audioRegionToAdd->startPositionOfAudioFileInTimeline = startPositionOfAudioFileInTimeline;		
-		AudioSourceAmbipanning *audioSourceAmbipanning = new AudioSourceAmbipanning (audioFormatReader,
-             sampleRateOfTheAudioDevice,
-             bufferingEnabled);		
-		audioRegionToAdd->audioSourceAmbipanning = audioSourceAmbipanning;
+		audioRegionToAdd->audioSourceAmbipanning = nullptr;
+		audioRegionToAdd->absolutePathToAudioFile = absolutePathToAudioFile;
+		audioRegionToAdd->sampleRateOfTheAudioDevice = sampleRateOfTheAudioDevice;
+		audioRegionToAdd->lengthOfAudioFile = audioFormatReader->lengthInSamples;
+		audioRegionToAdd->numberOfSetGainPoints = 0;
+		audioRegionToAdd->indexOfTheFirstSetGainPoint = 0;
+		audioRegionToAdd->numberOfSetSpacialPoints = 0;
+		audioRegionToAdd->indexOfTheFirstSetSpacialPoint = 0;
+		audioRegionToAdd->livePositionSmoothingTimeInMs = 0.0;
+		audioRegionToAdd->dopplerInterpolationQuality = FractionalDelayInterpolator::qualityDefault;
+		audioFormatReader = nullptr;
 		
-		// prepare it to be played
-		audioRegionToAdd->audioSourceAmbipanning->prepareToPlay(samplesPerBlockExpected, sampleRate);
-        
-        // This look is needed since we don't want to change the regions
-        // array the same time it could be used it the getNextAudioBlock
-        // method.
-        const ScopedLock sl (lock);
-        
-		// add the region
-		regions.add(audioRegionToAdd);
+		const ScopedLock sl (regionLock);
 		
-		// update totalLength, if needed
-		if (totalLength < endPosition )
-        {
-			totalLength = endPosition;
+		if (getLookaheadInSamples() == 0)
+		{
+			// Without the lookahead, every region is instantiated right away.
+			AudioSourceAmbipanning* audioSourceAmbipanning = createRegionChain (absolutePathToAudioFile,
+			                                                                    sampleRateOfTheAudioDevice,
+			                                                                    bufferingEnabled);
+			if (audioSourceAmbipanning == nullptr)
+			{
+				DEB("AudioRegionMixer: Didn't add region because the audio file couldn't be read.")
+				delete audioRegionToAdd;
+				return false;
+			}
+			// prepare it to be played
+			audioSourceAmbipanning->prepareToPlay(samplesPerBlockExpected, sampleRate);
+			applyRegionSettings (*audioRegionToAdd, audioSourceAmbipanning);
+			audioRegionToAdd->audioSourceAmbipanning = audioSourceAmbipanning;
+			instantiatedRegionIDs.add(regionID);
 		}
+        
+		// add the region
+		insertRegion(audioRegionToAdd);
+		publishSnapshot(Array<AudioSourceAmbipanning*>());
+		regionLoader->notify();
 		
 		return true;
 	}
@@ -121,6 +166,67 @@ bool AudioRegionMixer::addRegion (const int& regionID,
 	
 }
 
+bool AudioRegionMixer::addRegionAsynchronously (const int& regionID,
+                                                const int& startPosition, 
+                                                const int& endPosition,
+                                                const int& startPositionOfAudioFileInTimeline,
+                                                const String& absolutePathToAudioFile,
+                                                const double& sampleRateOfTheAudioDevice)
+{
+	const ScopedLock sl (regionLock);
+	
+	if (findRegion(regionID) != nullptr)
+	{
+		DEB("AudioRegionMixer: Didn't add the region because its regionID already exists.")
+		return false;
+	}
+	// The file length is checked later, see checkPendingFiles.
+	if (startPosition >= endPosition
+	    || startPosition < startPositionOfAudioFileInTimeline)
+	{
+		DEB("AudioRegionMixer: Didn't add region because the set "
+		    "(startPosition, endPosition, startPositionOfAudioFileInTimeline) "
+		    "doesn't make sense.")
+		return false;
+	}
+	
+	AudioRegionDescriptor* audioRegionToAdd = new AudioRegionDescriptor();
+	audioRegionToAdd->regionID = regionID;
+	audioRegionToAdd->startPosition = startPosition;
+	audioRegionToAdd->endPosition = endPosition;
+	audioRegionToAdd->startPositionOfAudioFileInTimeline = startPositionOfAudioFileInTimeline;
+	audioRegionToAdd->audioSourceAmbipanning = nullptr;
+	audioRegionToAdd->absolutePathToAudioFile = absolutePathToAudioFile;
+	audioRegionToAdd->sampleRateOfTheAudioDevice = sampleRateOfTheAudioDevice;
+	audioRegionToAdd->lengthOfAudioFile = -1; // Not known yet.
+	audioRegionToAdd->numberOfSetGainPoints = 0;
+	audioRegionToAdd->indexOfTheFirstSetGainPoint = 0;
+	audioRegionToAdd->numberOfSetSpacialPoints = 0;
+	audioRegionToAdd->indexOfTheFirstSetSpacialPoint = 0;
+	audioRegionToAdd->livePositionSmoothingTimeInMs = 0.0;
+	audioRegionToAdd->dopplerInterpolationQuality = FractionalDelayInterpolator::qualityDefault;
+	
+	// Without a chain, the region isn't rendered. Therefore the snapshot
+	// doesn't have to be published yet.
+	insertRegion(audioRegionToAdd);
+	regionsWithPendingFileCheck.add(regionID);
+	++numberOfRegionsAddedAsynchronously;
+	regionLoader->notify();
+	
+	return true;
+}
+
+double AudioRegionMixer::getProgressOfAddingRegions ()
+{
+	const ScopedLock sl (regionLock);
+	
+	if (numberOfRegionsAddedAsynchronously == 0)
+	{
+		return 1.0;
+	}
+	return numberOfRegionsChecked / (double) numberOfRegionsAddedAsynchronously;
+}
+
 bool AudioRegionMixer::modifyRegion (const int& regionID, 
                                      const int& newStartPosition, 
                                      const int& newEndPosition,
@@ -133,25 +239,21 @@ bool AudioRegionMixer::modifyRegion (const int& regionID,
         ", newStartPositionOfAudioFileInTimeline = " +
         String(newStartPositionOfAudioFileInTimeline));
     
+	const ScopedLock sl (regionLock);
+	
     DEB("AudioRegionMixer: regions.size() = " + String(regions.size()))
 	
-	int index;
-	bool foundTheRegion = findRegion(regionID, index);
+	AudioRegionDescriptor* audioRegionToModify = findRegion(regionID);
 	
-	if (foundTheRegion)
+	if (audioRegionToModify != nullptr)
 	{
-        // This look is needed since we don't want to change the regions
-        // array the same time it could be used it the getNextAudioBlock
-        // method.
-        const ScopedLock sl (lock);
-        
-		AudioRegion* audioRegionToModify = (AudioRegion*)regions[index];
-		
-		// check if this input set is invalid
+		// check if this input set is invalid (the file length of a region
+		// that has been added asynchronously might not be known yet)
 		if (newStartPosition >= newEndPosition
 				 || newStartPosition < newStartPositionOfAudioFileInTimeline
-				 || newEndPosition - newStartPositionOfAudioFileInTimeline 
-					> audioRegionToModify->audioSourceAmbipanning->getTotalLength())
+				 || (audioRegionToModify->lengthOfAudioFile >= 0
+				     && newEndPosition - newStartPositionOfAudioFileInTimeline 
+					    > audioRegionToModify->lengthOfAudioFile))
 		{
 			DEB("AudioRegionMixer: Didn't modify region because the set "
                 "(newStartPosition, endPosition, "
@@ -161,9 +263,14 @@ bool AudioRegionMixer::modifyRegion (const int& regionID,
 		}
 		
 		
+		// The regionIndex is sorted by the start positions.
+		regionIndex.remove(regionID, audioRegionToModify->startPosition);
 		audioRegionToModify->startPosition = newStartPosition;
 		audioRegionToModify->endPosition = newEndPosition;
 		audioRegionToModify->startPositionOfAudioFileInTimeline = newStartPositionOfAudioFileInTimeline;
+		regionIndex.add(audioRegionToModify, regionID, newStartPosition, newEndPosition);
+		publishSnapshot(Array<AudioSourceAmbipanning*>());
+		regionLoader->notify();
 		
 		// update totalLength, if needed
 		if (totalLength < newEndPosition )
@@ -185,21 +292,30 @@ bool AudioRegionMixer::removeRegion (const int regionID)
 {
 	DEB("AudioRegionMixer: removeRegion called.");
 	
-	int index;
-	bool foundTheRegion = findRegion(regionID, index);
+	const ScopedLock sl (regionLock);
+	
+	AudioRegionDescriptor* audioRegionToDelete = findRegion(regionID);
 	
-	if (foundTheRegion)
+	if (audioRegionToDelete != nullptr)
 	{
-        // This look is needed since we don't want to change the regions
-        // array the same time it could be used it the getNextAudioBlock
-        // method.
-        const ScopedLock sl (lock);
-        
-		AudioRegion* audioRegionToDelete = (AudioRegion*)regions[index];
-		delete audioRegionToDelete->audioSourceAmbipanning;
-		delete audioRegionToDelete;
+		regionIndex.remove(regionID, audioRegionToDelete->startPosition);
+		regions.remove(regionID);
+		if (regionsWithPendingFileCheck.contains(regionID))
+		{
+			regionsWithPendingFileCheck.removeValue(regionID);
+			++numberOfRegionsChecked;
+		}
 		
-		regions.remove(index);
+		// The audio thread might still be rendering this region. Its
+		// AudioSourceAmbipanning is deleted by the reclaimer.
+		Array<AudioSourceAmbipanning*> removedSources;
+		if (audioRegionToDelete->audioSourceAmbipanning != nullptr)
+		{
+			removedSources.add(audioRegionToDelete->audioSourceAmbipanning);
+			instantiatedRegionIDs.removeValue(regionID);
+		}
+		publishSnapshot(removedSources);
+		delete audioRegionToDelete;
 		
 		return true;
 	}
@@ -215,73 +331,154 @@ void AudioRegionMixer::removeAllRegions ()
 {
 	DEB("AudioRegionMixer: removeAllRegions called.");
 	
-    // This look is needed since we don't want to change the regions
-    // array the same time it could be used it the getNextAudioBlock
-    // method.
-    const ScopedLock sl (lock);
+	const ScopedLock sl (regionLock);
 	
 	// Deallocate memory...
-	for (int i = 0; i < regions.size(); i++)
+	Array<AudioSourceAmbipanning*> removedSources;
+	removedSources.ensureStorageAllocated(instantiatedRegionIDs.size());
+	for (HashMap<int, AudioRegionDescriptor*>::Iterator i (regions); i.next();)
 	{
-		AudioRegion* audioRegionToDelete = (AudioRegion*)regions[i];
-		delete audioRegionToDelete->audioSourceAmbipanning;
+		AudioRegionDescriptor* audioRegionToDelete = i.getValue();
+		if (audioRegionToDelete->audioSourceAmbipanning != nullptr)
+		{
+			removedSources.add(audioRegionToDelete->audioSourceAmbipanning);
+		}
 		delete audioRegionToDelete;
 	}
 	
-	// ... and remove the pointers.
+	// ... and remove the pointers. The AudioSourceAmbipanning s are deleted
+	// by the reclaimer, once the audio thread is done with them.
+	regionIndex.clear();
 	regions.clear();
+	instantiatedRegionIDs.clear();
+	regionsWithPendingFileCheck.clear();
+	numberOfRegionsAddedAsynchronously = 0;
+	numberOfRegionsChecked = 0;
+	publishSnapshot(removedSources);
 }
 
-bool AudioRegionMixer::setGainEnvelopeForRegion (const int regionID, Array<void*> gainEnvelope)
+void AudioRegionMixer::beginEditTransaction ()
+{
+	const ScopedLock sl (regionLock);
+	++editTransactionDepth;
+}
+
+void AudioRegionMixer::commitEditTransaction ()
 {
-	int index;
-	bool foundTheRegion = findRegion(regionID, index);
+	const ScopedLock sl (regionLock);
+	
+	if (editTransactionDepth == 0)
+	{
+		DEB("AudioRegionMixer: commitEditTransaction called without a transaction.")
+		return;
+	}
+	if (--editTransactionDepth != 0)
+	{
+		return;
+	}
 	
-	if (foundTheRegion)
+	// Everything that takes time (copying the gain envelopes, the patches
+	// and the doppler effect) is done before the lock of the audio thread
+	// is taken. The regionLock keeps the chains alive meanwhile.
+	Array<AudioSourceAmbipanning*> chainsWithNewGainEnvelope;
+	ReferenceCountedArray<GainEnvelope> newGainEnvelopes;
+	for (int i = 0; i < regionsWithChangedGainEnvelope.size(); ++i)
 	{
-		if (gainEnvelope.size() != 0)
+		const AudioRegionDescriptor* region = findRegion(regionsWithChangedGainEnvelope.getUnchecked(i));
+		if (region != nullptr && region->audioSourceAmbipanning != nullptr)
 		{
-			AudioRegion* audioRegionToModify = (AudioRegion*)regions[index];
-			
-			// if we are dealing with a non constant envelope
-			if (gainEnvelope.size() > 1)
+			GainEnvelope* newGainEnvelope = AudioSourceGainEnvelope::createGainEnvelope(region->gainEnvelope);
+			if (newGainEnvelope != nullptr)
 			{
-				// to make getNextAudioBlock(..) in AudioSourceGainEnvelope work, the first point
-				// in the envelope must be at position 0 and the last point must be at a position
-				// after the last sample of this region.
-				// If this is not the case, this code adds additional points with the same value
-				// as the closest point.
-				gainEnvelope.sort(audioEnvelopePointComparator);
-				
-				AudioEnvelopePoint* firstGainPoint = (AudioEnvelopePoint*)gainEnvelope[0];
-				if (firstGainPoint->getPosition() > 0)
-				{
-					AudioEnvelopePoint* newFirstGainPoint = new AudioEnvelopePoint(0, firstGainPoint->getValue());
-					gainEnvelope.addSorted(audioEnvelopePointComparator, newFirstGainPoint);
-				}
-				AudioEnvelopePoint* lastGainPoint = (AudioEnvelopePoint*)gainEnvelope[gainEnvelope.size()-1];
-//				int lengthOfThisRegion = audioRegionToModify->endPosition - audioRegionToModify->startPosition;
-//				if (lastGainPoint->getPosition() < lengthOfThisRegion )
-                int endOfRegionInTheAudioFile = audioRegionToModify->endPosition - audioRegionToModify->startPositionOfAudioFileInTimeline;
-				if (lastGainPoint->getPosition() < endOfRegionInTheAudioFile)
-				{
-//					AudioEnvelopePoint* newLastGainPoint = new AudioEnvelopePoint(lengthOfThisRegion,
-//																				  lastGainPoint->getValue());
-                    AudioEnvelopePoint* newLastGainPoint = new AudioEnvelopePoint(endOfRegionInTheAudioFile,
-																				  lastGainPoint->getValue());
-					gainEnvelope.addSorted(audioEnvelopePointComparator, newLastGainPoint);
-				}
-				
-				//temp: for debugging only
-				firstGainPoint = (AudioEnvelopePoint*)gainEnvelope[0];
-				DEB("AudioRegionMixer: firstGainPoint.pos = " + String(firstGainPoint->getPosition()) 
-                    + ", firstGainPoint.value = " + String(firstGainPoint->getValue()));
-                lastGainPoint = (AudioEnvelopePoint*)gainEnvelope[gainEnvelope.size()-1];
-                DEB("AudioRegionMixer: lastGainPoint.pos = " + String(lastGainPoint->getPosition()) 
-                    + ", lastGainPoint.value = " + String(lastGainPoint->getValue()));
+				chainsWithNewGainEnvelope.add(region->audioSourceAmbipanning);
+				newGainEnvelopes.add(newGainEnvelope);
 			}
+		}
+	}
+	Array<AudioSourceAmbipanning*> chainsWithNewSpacialEnvelope;
+	for (int i = 0; i < regionsWithChangedSpacialEnvelope.size(); ++i)
+	{
+		const AudioRegionDescriptor* region = findRegion(regionsWithChangedSpacialEnvelope.getUnchecked(i));
+		if (region != nullptr && region->audioSourceAmbipanning != nullptr)
+		{
+			// All changes made during the transaction, as one patch.
+			const SpacialEnvelope::Patch patch = SpacialEnvelope::findPatch(*region->audioSourceAmbipanning->getSpacialEnvelope(),
+			                                                                *region->spacialEnvelope);
+			region->audioSourceAmbipanning->prepareSpacialEnvelope(region->spacialEnvelope, &patch);
+			chainsWithNewSpacialEnvelope.add(region->audioSourceAmbipanning);
+		}
+	}
+	regionsWithChangedGainEnvelope.clearQuick();
+	regionsWithChangedSpacialEnvelope.clearQuick();
+	
+	AudioRegionSnapshot* newSnapshot = nullptr;
+	AudioRegionSnapshot* oldSnapshot = nullptr;
+	Array<AudioSourceAmbipanning*> removedSources;
+	if (snapshotIsOutdated)
+	{
+		snapshotIsOutdated = false;
+		removedSources = sourcesRemovedDuringTransaction;
+		sourcesRemovedDuringTransaction.clearQuick();
+		newSnapshot = createSnapshot();
+	}
+	
+	{
+		// The audio thread holds this lock during a whole block (and picks
+		// up the snapshot under it), so it sees either none or all of the
+		// changes below. Only the atomic exchanges of the handoffs are
+		// done under it (but see EnvelopeHandoff::update: If the audio
+		// thread retires envelopes faster than the EnvelopeReclaimer
+		// releases them, some of them follow a few blocks later).
+		const ScopedLock audioLock (lock);
+		
+		for (int i = 0; i < chainsWithNewGainEnvelope.size(); ++i)
+		{
+			chainsWithNewGainEnvelope.getUnchecked(i)->setGainEnvelope(newGainEnvelopes.getUnchecked(i));
+		}
+		for (int i = 0; i < chainsWithNewSpacialEnvelope.size(); ++i)
+		{
+			chainsWithNewSpacialEnvelope.getUnchecked(i)->postSpacialEnvelope();
+		}
+		if (newSnapshot != nullptr)
+		{
+			oldSnapshot = currentSnapshot.exchange(newSnapshot);
+		}
+	}
+	
+	if (newSnapshot != nullptr)
+	{
+		reclaimer.retire(oldSnapshot, removedSources);
+	}
+	
+	if (chainsWithNewSpacialEnvelope.size() != 0)
+	{
+		// Their gains are calculated by the regionLoader.
+		regionLoader->notify();
+	}
+}
 
-			audioRegionToModify->audioSourceAmbipanning->setGainEnvelope (gainEnvelope);
+bool AudioRegionMixer::setGainEnvelopeForRegion (const int regionID, Array<void*> gainEnvelope)
+{
+	const ScopedLock sl (regionLock);
+	
+	AudioRegionDescriptor* audioRegionToModify = findRegion(regionID);
+	
+	// The points are copied (and deleted here), such that only the
+	// changes have to be handed to the chain.
+	Array<AudioEnvelopePoint> setPoints;
+	gainEnvelope.sort(audioEnvelopePointComparator);
+	for (int i = 0; i < gainEnvelope.size(); ++i)
+	{
+		setPoints.add(*(AudioEnvelopePoint*)gainEnvelope[i]);
+		delete (AudioEnvelopePoint*)gainEnvelope[i];
+	}
+	
+	if (audioRegionToModify != nullptr)
+	{
+		if (setPoints.size() != 0)
+		{
+			simplifyGainEnvelope(setPoints);
+			attachGainEnvelope(audioRegionToModify, setPoints);
 			return true;
 		}
 		else
@@ -300,74 +497,303 @@ bool AudioRegionMixer::setGainEnvelopeForRegion (const int regionID, Array<void*
 	}
 }
 
+bool AudioRegionMixer::patchGainEnvelopeForRegion (const int regionID,
+                                                   int startIndex,
+                                                   int numberOfPointsToRemove,
+                                                   const Array<AudioEnvelopePoint>& pointsToInsert)
+{
+	const ScopedLock sl (regionLock);
+	
+	AudioRegionDescriptor* audioRegionToModify = findRegion(regionID);
+	
+	if (audioRegionToModify == nullptr)
+	{
+		DEB("AudioRegionMixer: Can't patch the gain envelope of the region "
+            "because the specified regionID can't be found.")
+		return false;
+	}
+	
+	const int numberOfSetPoints = audioRegionToModify->numberOfSetGainPoints;
+	if (startIndex < 0
+	    || numberOfPointsToRemove < 0
+	    || startIndex + numberOfPointsToRemove > numberOfSetPoints
+	    || numberOfSetPoints - numberOfPointsToRemove + pointsToInsert.size() == 0)
+	{
+		DEB("AudioRegionMixer: Can't patch the gain envelope of the region "
+            "because the range doesn't exist or no point would be left.")
+		return false;
+	}
+	
+	Array<AudioEnvelopePoint> setPoints;
+	setPoints.addArray(audioRegionToModify->gainEnvelope,
+	                   audioRegionToModify->indexOfTheFirstSetGainPoint,
+	                   numberOfSetPoints);
+	setPoints.removeRange(startIndex, numberOfPointsToRemove);
+	for (int i = 0; i < pointsToInsert.size(); ++i)
+	{
+		setPoints.insert(startIndex + i, pointsToInsert.getUnchecked(i));
+	}
+	for (int i = 1; i < setPoints.size(); ++i)
+	{
+		if (setPoints.getReference(i).getPosition() < setPoints.getReference(i - 1).getPosition())
+		{
+			DEB("AudioRegionMixer: Can't patch the gain envelope of the region "
+                "because the points wouldn't be sorted anymore.")
+			return false;
+		}
+	}
+	
+	attachGainEnvelope(audioRegionToModify, setPoints);
+	return true;
+}
+
+/** Returns true, if both gain envelopes consist of the same points. */
+static bool gainEnvelopesAreEqual (const Array<AudioEnvelopePoint>& a,
+                                   const Array<AudioEnvelopePoint>& b)
+{
+	if (a.size() != b.size())
+	{
+		return false;
+	}
+	for (int i = 0; i < a.size(); ++i)
+	{
+		AudioEnvelopePoint pointOfA (a.getUnchecked(i));
+		AudioEnvelopePoint pointOfB (b.getUnchecked(i));
+		if (pointOfA.getPosition() != pointOfB.getPosition()
+		    || pointOfA.getValue() != pointOfB.getValue())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void AudioRegionMixer::attachGainEnvelope (AudioRegionDescriptor* region,
+                                           const Array<AudioEnvelopePoint>& setPoints)
+{
+	jassert (setPoints.size() != 0);
+	
+	// to make getNextAudioBlock(..) in AudioSourceGainEnvelope work, the first point
+	// in the envelope must be at position 0 and the last point must be at a position
+	// after the last sample of this region.
+	// If this is not the case, this code adds additional points with the same value
+	// as the closest point.
+	AudioEnvelopePoint firstGainPoint (setPoints.getFirst());
+	AudioEnvelopePoint lastGainPoint (setPoints.getLast());
+	const int endOfRegionInTheAudioFile = region->endPosition - region->startPositionOfAudioFileInTimeline;
+	const bool extendAtTheStart = setPoints.size() > 1 && firstGainPoint.getPosition() > 0;
+	const bool extendAtTheEnd = setPoints.size() > 1 && lastGainPoint.getPosition() < endOfRegionInTheAudioFile;
+	
+	Array<AudioEnvelopePoint> gainEnvelope;
+	if (extendAtTheStart)
+	{
+		gainEnvelope.add(AudioEnvelopePoint(0, firstGainPoint.getValue()));
+	}
+	gainEnvelope.addArray(setPoints);
+	if (extendAtTheEnd)
+	{
+		gainEnvelope.add(AudioEnvelopePoint(endOfRegionInTheAudioFile, lastGainPoint.getValue()));
+	}
+	
+	region->numberOfSetGainPoints = setPoints.size();
+	region->indexOfTheFirstSetGainPoint = extendAtTheStart ? 1 : 0;
+	
+	// E.g. if only the spacial envelope of the region has been edited.
+	if (gainEnvelopesAreEqual(gainEnvelope, region->gainEnvelope))
+	{
+		return;
+	}
+	
+	// Kept for the instantiation of the region's chain.
+	region->gainEnvelope.swapWithArray(gainEnvelope);
+	
+	if (region->audioSourceAmbipanning != nullptr)
+	{
+		if (editTransactionDepth == 0)
+		{
+			applyGainEnvelope(*region, region->audioSourceAmbipanning);
+		}
+		else
+		{
+			// Handed to the chain by commitEditTransaction.
+			regionsWithChangedGainEnvelope.addIfNotAlreadyThere(region->regionID);
+		}
+	}
+}
+
 void AudioRegionMixer::setSpeakerPositions (const Array<SpeakerPosition>& positionOfSpeaker)
 {
+	const ScopedLock rsl (regionLock);
 	const ScopedLock sl (lock); // without this scope lock, getNextAudioBlock(..) of
 	  // AudioSourceAmbipanning might wanna set array elements outside of the size of
 	  // these arrays
 	AudioSourceAmbipanning::setPositionOfSpeakers (positionOfSpeaker);
+	hoaDecoder.setSpeakerPositions (positionOfSpeaker);
+	++renderConfigurationVersion;
 	
 	// inform all regions about the change
-	for (int i = 0; i < regions.size() && positionOfSpeaker.size(); i++)
+	if (positionOfSpeaker.size() != 0)
+	{
+		for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+		{
+			findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning->reallocateMemoryForTheArrays();
+		}
+	}
+}
+
+void AudioRegionMixer::enableHOARendering (bool enable, int order)
+{
+	const ScopedLock rsl (regionLock);
+	const ScopedLock sl (lock);
+	
+	hoaDecoder.setOrder (order);
+	AudioSourceAmbipanning::enableHOAEncoding (enable, hoaDecoder.getOrder());
+	hoaRenderingEnabled = enable;
+	++renderConfigurationVersion;
+	
+	// The number of channels of all regions has changed.
+	for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+	{
+		findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning->reallocateMemoryForTheArrays();
+	}
+}
+
+bool AudioRegionMixer::getHOARenderingState ()
+{
+	return hoaRenderingEnabled;
+}
+
+void AudioRegionMixer::enableHOAMaxRE (bool enable)
+{
+	const ScopedLock sl (lock);
+	hoaDecoder.enableMaxRE (enable);
+}
+
+void AudioRegionMixer::enableHOABusOutput (bool enable)
+{
+	const ScopedLock sl (lock);
+	hoaBusOutputEnabled = enable;
+}
+
+int AudioRegionMixer::getNumberOfHOABusChannels ()
+{
+	return hoaDecoder.getNumberOfBusChannels();
+}
+
+void AudioRegionMixer::setAEPOrder (double order)
+{
+	const ScopedLock sl (lock); // the table of the AEPGainCalculator
+	  // must not be replaced while it's used in getNextAudioBlock(..)
+	AudioSourceAmbipanning::setOrder (order);
+}
+
+void AudioRegionMixer::setAEPGainAccuracyMode (AEPGainCalculator::AccuracyMode accuracyMode)
+{
+	const ScopedLock sl (lock);
+	AudioSourceAmbipanning::setGainAccuracyMode (accuracyMode);
+}
+
+void AudioRegionMixer::setAEPActiveChannelThreshold (double thresholdInDB)
+{
+	const ScopedLock sl (lock);
+	AudioSourceAmbipanning::setActiveChannelThreshold (thresholdInDB);
+}
+
+void AudioRegionMixer::setSceneTransform (const SceneTransform& sceneTransform)
+{
+	const ScopedLock rsl (regionLock);
+	
+	// The spacial envelopes of the doppler effects and the low pass filters
+	// are transformed (and analysed) before the lock of the audio thread is
+	// taken, like in commitEditTransaction.
+	for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+	{
+		findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning->prepareSceneTransform (sceneTransform);
+	}
+	
+	const ScopedLock sl (lock);
+	AudioSourceAmbipanning::setSceneTransform (sceneTransform);
+	for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+	{
+		findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning->postSceneTransform ();
+	}
+}
+
+bool AudioRegionMixer::setSpacialEnvelopeForRegion (const int& regionID, const Array<SpacialEnvelopePoint>& spacialEnvelope)
+{
+	const int numberOfPoints = spacialEnvelope.size();
+	HeapBlock<int> positions (numberOfPoints);
+	HeapBlock<double> coordinates (3 * numberOfPoints);
+	for (int i = 0; i < numberOfPoints; ++i)
 	{
-		((AudioRegion*)regions[i])->audioSourceAmbipanning->reallocateMemoryForTheArrays();
+		SpacialEnvelopePoint point (spacialEnvelope.getUnchecked(i));
+		positions[i] = point.getPosition();
+		coordinates[i] = point.getX();
+		coordinates[numberOfPoints + i] = point.getY();
+		coordinates[2 * numberOfPoints + i] = point.getZ();
 	}
+	
+	return setSpacialEnvelopeForRegion(regionID,
+	                                   positions,
+	                                   coordinates,
+	                                   coordinates + numberOfPoints,
+	                                   coordinates + 2 * numberOfPoints,
+	                                   numberOfPoints);
 }
 
-bool AudioRegionMixer::setSpacialEnvelopeForRegion (const int& regionID, Array<SpacialEnvelopePoint> spacialEnvelope)
+bool AudioRegionMixer::setSpacialEnvelopeForRegion (const int& regionID,
+                                                    const int* positions,
+                                                    const double* x,
+                                                    const double* y,
+                                                    const double* z,
+                                                    int numberOfPoints,
+                                                    const int* interpolationModes,
+                                                    const double* controlPoints)
 {
-	int index;
-	bool foundTheRegion = findRegion(regionID, index);
+	const ScopedLock sl (regionLock);
+	
+	AudioRegionDescriptor* audioRegionToModify = findRegion(regionID);
 	
-	if (foundTheRegion)
+	if (audioRegionToModify != nullptr)
 	{
-		if (spacialEnvelope.size() != 0)
+		if (numberOfPoints != 0)
 		{
-			AudioRegion* audioRegionToModify = (AudioRegion*)regions[index];
+			// To make getNextAudioBlock(..) in AudioSourceAmbipanning work
+			// with a non constant envelope, the first point in the envelope
+			// must be at audioRegionToModify->startPosition and the last
+			// point must be at a position after the last sample of this region.
+			// If this is not the case, additional points with the same value
+			// as the closest point are added.
+			// We put the last point 2 sample-positions after the last real
+			// audio sample. (This ensures that even the position of the
+			// first sample of the next audio block will always lie in
+			// between two envelope points - even if at this position there
+			// is no real audio sample anymore.)
+			const int firstPosition = audioRegionToModify->startPosition - audioRegionToModify->startPositionOfAudioFileInTimeline;
+			const int lastPosition = audioRegionToModify->endPosition - audioRegionToModify->startPositionOfAudioFileInTimeline + 1;
 			
-			// if we are dealing with a non constant envelope
-			if (spacialEnvelope.size() > 1)
+			// Remembered for the patches.
+			int positionOfTheFirstPoint = positions[0];
+			for (int i = 1; i < numberOfPoints; ++i)
 			{
-				// to make getNextAudioBlock(..) in AudioSourceAmbipanning work,
-                // the first point in the envelope must be at 
-                // audioRegionToModify->startPosition and the last point must be at a position
-				// after the last sample of this region.
-				// If this is not the case, this code adds additional points with the same value
-				// as the closest point.
-				spacialEnvelope.sort(spacialEnvelopePointComparator);
-				
-                // First point.
-				SpacialEnvelopePoint firstSpacialPoint = spacialEnvelope.getFirst();
-				if (firstSpacialPoint.getPosition() > audioRegionToModify->startPosition - audioRegionToModify->startPositionOfAudioFileInTimeline)
-				{
-					SpacialEnvelopePoint newFirstSpacialPoint(audioRegionToModify->startPosition - audioRegionToModify->startPositionOfAudioFileInTimeline, 
-                                                              firstSpacialPoint.getX(),
-                                                              firstSpacialPoint.getY(),
-                                                              firstSpacialPoint.getZ());
-					spacialEnvelope.addSorted(spacialEnvelopePointComparator, newFirstSpacialPoint);
-				}
-                // Last point.
-				SpacialEnvelopePoint lastSpacialPoint = spacialEnvelope.getLast();
-                // We put the last point 2 sample-positions after the last real
-                // audio sample. (This ensures that even the position of the
-                // first sample of the next audio block will always lie in
-                // between two envelope points - even if at this position there
-                // is no real audio sample anymore.)
-				if (lastSpacialPoint.getPosition() < audioRegionToModify->endPosition - audioRegionToModify->startPositionOfAudioFileInTimeline + 1)
-				{
-					SpacialEnvelopePoint newLastSpacialPoint(audioRegionToModify->endPosition - audioRegionToModify->startPositionOfAudioFileInTimeline + 1,
-                                                             lastSpacialPoint.getX(),
-                                                             lastSpacialPoint.getY(),
-                                                             lastSpacialPoint.getZ());
-					spacialEnvelope.addSorted(spacialEnvelopePointComparator, newLastSpacialPoint);
-				}
-				
-				//DEBUGGING:
-				// firstGainPoint = (AudioEnvelopePoint*)gainEnvelope[0];
-				// DEB(String(firstGainPoint->getPosition()) + T(", ") + String(firstGainPoint->getValue()));
+				positionOfTheFirstPoint = jmin (positionOfTheFirstPoint, positions[i]);
 			}
+			const int first = numberOfPoints > 1 && positionOfTheFirstPoint > firstPosition ? 1 : 0;
 			
-			audioRegionToModify->audioSourceAmbipanning->setSpacialEnvelope (spacialEnvelope);
+			SpacialEnvelope* spacialEnvelope = SpacialEnvelope::createExtended(positions, x, y, z,
+			                                                                   numberOfPoints,
+			                                                                   firstPosition,
+			                                                                   lastPosition,
+			                                                                   interpolationModes,
+			                                                                   controlPoints);
+			// The copies at the start and the end stay.
+			const int numberOfCopies = spacialEnvelope->size() - numberOfPoints;
+			spacialEnvelope = simplifySpacialEnvelope(spacialEnvelope, first, first + numberOfPoints - 1);
+			
+			audioRegionToModify->numberOfSetSpacialPoints = spacialEnvelope->size() - numberOfCopies;
+			audioRegionToModify->indexOfTheFirstSetSpacialPoint = first;
+			
+			attachSpacialEnvelope(audioRegionToModify, spacialEnvelope);
 			return true;
 		}
 		else
@@ -380,76 +806,666 @@ bool AudioRegionMixer::setSpacialEnvelopeForRegion (const int& regionID, Array<S
 	}
 	else
 	{
-		DEB("AudioRegionMixer: Can't attach a gain envelope to the region "
+		DEB("AudioRegionMixer: Can't attach a spacial envelope to the region "
             "because the specified regionID can't be found.")
 		return false;
 	}	
 }
 
-void AudioRegionMixer::enableBuffering(bool enable)
+bool AudioRegionMixer::setSpacialTrajectoryForRegion (const int& regionID, const SpacialTrajectory& trajectory)
 {
-	DEB("AudioRegionMixer: enableBuffering called.");
+	const ScopedLock sl (regionLock);
+	
+	AudioRegionDescriptor* audioRegionToModify = findRegion(regionID);
 	
-	for (int i = 0; i < regions.size(); i++)
+	if (audioRegionToModify != nullptr)
 	{
-		AudioRegion* audioRegion = (AudioRegion*)regions[i];
-		audioRegion->audioSourceAmbipanning->enableBuffering(enable);
+		// The same interval as in setSpacialEnvelopeForRegion.
+		const int firstPosition = audioRegionToModify->startPosition - audioRegionToModify->startPositionOfAudioFileInTimeline;
+		const int lastPosition = audioRegionToModify->endPosition - audioRegionToModify->startPositionOfAudioFileInTimeline + 1;
+		
+		SpacialEnvelope* spacialEnvelope = trajectory.createSpacialEnvelope(firstPosition,
+		                                                                    lastPosition,
+		                                                                    audioRegionToModify->sampleRateOfTheAudioDevice);
+		spacialEnvelope = simplifySpacialEnvelope(spacialEnvelope, 0, spacialEnvelope->size() - 1);
+		audioRegionToModify->numberOfSetSpacialPoints = spacialEnvelope->size();
+		audioRegionToModify->indexOfTheFirstSetSpacialPoint = 0;
+		
+		attachSpacialEnvelope(audioRegionToModify, spacialEnvelope);
+		return true;
+	}
+	else
+	{
+		DEB("AudioRegionMixer: Can't attach a trajectory to the region "
+            "because the specified regionID can't be found.")
+		return false;
 	}
-    
-    bufferingEnabled = enable;
 }
 
-bool AudioRegionMixer::getBufferingState()
+void AudioRegionMixer::setEnvelopeSimplification (double spacialToleranceInMeters,
+                                                  double gainToleranceInDB)
 {
-    return bufferingEnabled;
+	const ScopedLock sl (regionLock);
+	
+	spacialSimplificationToleranceInMeters = jmax (0.0, spacialToleranceInMeters);
+	gainSimplificationToleranceInDB = jmax (0.0, gainToleranceInDB);
+	envelopeSimplificationReport = EnvelopeSimplificationReport();
 }
 
-void AudioRegionMixer::enableDopplerEffect (bool enable)
+EnvelopeSimplificationReport AudioRegionMixer::getEnvelopeSimplificationReport ()
 {
-    DEB("AudioRegionMixer: enableDopplerEffect called.");
-	
-	for (int i = 0; i < regions.size(); i++)
-	{
-		AudioRegion* audioRegion = (AudioRegion*)regions[i];
-		audioRegion->audioSourceAmbipanning->enableDopplerEffect(enable);
-	}
+	const ScopedLock sl (regionLock);
+	return envelopeSimplificationReport;
 }
 
-void AudioRegionMixer::enableDistanceBasedFiltering (bool enable)
+SpacialEnvelope* AudioRegionMixer::simplifySpacialEnvelope (SpacialEnvelope* spacialEnvelope,
+                                                            int firstSetPoint,
+                                                            int lastSetPoint)
 {
-    DEB("AudioRegionMixer: enableDistanceBasedFiltering called.");
-	
-	for (int i = 0; i < regions.size(); i++)
+	if (spacialSimplificationToleranceInMeters == 0.0)
 	{
-		AudioRegion* audioRegion = (AudioRegion*)regions[i];
-		audioRegion->audioSourceAmbipanning->enableLowPassFilter(enable);
+		return spacialEnvelope;
 	}
-}
-
-void AudioRegionMixer::prepareToPlay (int samplesPerBlockExpected_, double sampleRate_)
-{
-	DEB("AudioRegionMixer: prepareToPlay called.");
 	
-	samplesPerBlockExpected = samplesPerBlockExpected_;
-	sampleRate = sampleRate_;
+	const double tolerance = spacialSimplificationToleranceInMeters / SpacialPosition::getUnitScaleFactor();
+	SpacialEnvelope* simplifiedEnvelope = SpacialEnvelope::createSimplified(*spacialEnvelope, tolerance,
+	                                                                        firstSetPoint, lastSetPoint);
 	
-	for (int i = 0; i != regions.size(); ++i)
-	{		
-		((AudioRegion*)regions[i])->audioSourceAmbipanning
-		  ->prepareToPlay(samplesPerBlockExpected, sampleRate);
+	envelopeSimplificationReport.numberOfSpacialPointsGiven += spacialEnvelope->size();
+	if (simplifiedEnvelope == nullptr)
+	{
+		envelopeSimplificationReport.numberOfSpacialPointsKept += spacialEnvelope->size();
+		return spacialEnvelope;
 	}
+	envelopeSimplificationReport.numberOfSpacialPointsKept += simplifiedEnvelope->size();
+	
+	DEB("AudioRegionMixer: The spacial envelope has been simplified from "
+	    + String(spacialEnvelope->size()) + " to " + String(simplifiedEnvelope->size()) + " points.")
 	
+	delete spacialEnvelope;
+	return simplifiedEnvelope;
 }
 
-void AudioRegionMixer::prepareAllRegionsToPlay ()
+/** The gain in dB, at least -120 dB. */
+static double gainInDB (double gain)
 {
-	// DEB("AudioRegionMixer::prepareAllRegionsToPlay called.")
-	
-	for (int i = 0; i != regions.size(); ++i)
-	{		
-		((AudioRegion*)regions[i])->audioSourceAmbipanning
-        ->prepareToPlay(samplesPerBlockExpected, sampleRate);
-	}
+	return 20.0 * log10 (jmax (gain, 0.000001));
+}
+
+void AudioRegionMixer::simplifyGainEnvelope (Array<AudioEnvelopePoint>& points)
+{
+	const int numberOfPoints = points.size();
+	if (gainSimplificationToleranceInDB == 0.0)
+	{
+		return;
+	}
+	envelopeSimplificationReport.numberOfGainPointsGiven += numberOfPoints;
+	if (numberOfPoints < 3)
+	{
+		envelopeSimplificationReport.numberOfGainPointsKept += numberOfPoints;
+		return;
+	}
+	
+	// Ramer-Douglas-Peucker, as in SpacialEnvelope::createSimplified. The
+	// error is measured in dB at the positions of the points. In between,
+	// the ratio of the two (linear) gains is monotonic, so this is the
+	// highest error anywhere.
+	HeapBlock<bool> keep;
+	keep.calloc (numberOfPoints);
+	keep[0] = true;
+	keep[numberOfPoints - 1] = true;
+	
+	// Pairs of the first and the last point of the ranges still to look at.
+	Array<int> ranges;
+	ranges.add (0);
+	ranges.add (numberOfPoints - 1);
+	while (ranges.size() > 0)
+	{
+		const int last = ranges.getLast();
+		ranges.removeLast();
+		const int first = ranges.getLast();
+		ranges.removeLast();
+		
+		const AudioEnvelopePoint& firstPoint = points.getReference(first);
+		const AudioEnvelopePoint& lastPoint = points.getReference(last);
+		const double duration = lastPoint.getPosition() - firstPoint.getPosition();
+		int furthestPoint = -1;
+		double highestError = gainSimplificationToleranceInDB;
+		for (int i = first + 1; i < last; ++i)
+		{
+			const AudioEnvelopePoint& point = points.getReference(i);
+			const double t = duration > 0.0 ? (point.getPosition() - firstPoint.getPosition()) / duration : 0.0;
+			const double gain = firstPoint.getValue() + t * (lastPoint.getValue() - firstPoint.getValue());
+			const double error = std::abs (gainInDB (gain) - gainInDB (point.getValue()));
+			if (error > highestError)
+			{
+				highestError = error;
+				furthestPoint = i;
+			}
+		}
+		
+		if (furthestPoint >= 0)
+		{
+			keep[furthestPoint] = true;
+			if (furthestPoint - first > 1)
+			{
+				ranges.add (first);
+				ranges.add (furthestPoint);
+			}
+			if (last - furthestPoint > 1)
+			{
+				ranges.add (furthestPoint);
+				ranges.add (last);
+			}
+		}
+	}
+	
+	Array<AudioEnvelopePoint> keptPoints;
+	for (int i = 0; i < numberOfPoints; ++i)
+	{
+		if (keep[i])
+		{
+			keptPoints.add (points.getReference(i));
+		}
+	}
+	envelopeSimplificationReport.numberOfGainPointsKept += keptPoints.size();
+	
+	if (keptPoints.size() < numberOfPoints)
+	{
+		DEB("AudioRegionMixer: The gain envelope has been simplified from "
+		    + String(numberOfPoints) + " to " + String(keptPoints.size()) + " points.")
+		points.swapWithArray (keptPoints);
+	}
+}
+
+bool AudioRegionMixer::patchSpacialEnvelopeForRegion (const int& regionID,
+                                                      int startIndex,
+                                                      int numberOfPointsToRemove,
+                                                      const int* positions,
+                                                      const double* x,
+                                                      const double* y,
+                                                      const double* z,
+                                                      int numberOfPointsToInsert,
+                                                      const int* interpolationModes,
+                                                      const double* controlPoints)
+{
+	const ScopedLock sl (regionLock);
+	
+	AudioRegionDescriptor* audioRegionToModify = findRegion(regionID);
+	
+	if (audioRegionToModify == nullptr || audioRegionToModify->spacialEnvelope == nullptr)
+	{
+		DEB("AudioRegionMixer: Can't patch the spacial envelope of the region "
+            "because the specified regionID can't be found or it has no spacial envelope.")
+		return false;
+	}
+	
+	const int numberOfSetPoints = audioRegionToModify->numberOfSetSpacialPoints;
+	const int newNumberOfSetPoints = numberOfSetPoints - numberOfPointsToRemove + numberOfPointsToInsert;
+	if (startIndex < 0
+	    || numberOfPointsToRemove < 0
+	    || numberOfPointsToInsert < 0
+	    || startIndex + numberOfPointsToRemove > numberOfSetPoints
+	    || newNumberOfSetPoints <= 0)
+	{
+		DEB("AudioRegionMixer: Can't patch the spacial envelope of the region "
+            "because the range doesn't exist or no point would be left.")
+		return false;
+	}
+	
+	SpacialEnvelope::Patch patch;
+	int indexOfTheFirstSetPoint = 0;
+	SpacialEnvelope* patchedEnvelope = createPatchedSpacialEnvelope(*audioRegionToModify,
+	                                                                startIndex,
+	                                                                numberOfPointsToRemove,
+	                                                                positions,
+	                                                                x,
+	                                                                y,
+	                                                                z,
+	                                                                numberOfPointsToInsert,
+	                                                                interpolationModes,
+	                                                                controlPoints,
+	                                                                patch,
+	                                                                indexOfTheFirstSetPoint);
+	if (patchedEnvelope == nullptr)
+	{
+		DEB("AudioRegionMixer: Can't patch the spacial envelope of the region "
+            "because the points wouldn't be sorted anymore.")
+		return false;
+	}
+	
+	audioRegionToModify->numberOfSetSpacialPoints = newNumberOfSetPoints;
+	audioRegionToModify->indexOfTheFirstSetSpacialPoint = indexOfTheFirstSetPoint;
+	attachSpacialEnvelope(audioRegionToModify, patchedEnvelope, &patch);
+	return true;
+}
+
+SpacialEnvelope* AudioRegionMixer::createPatchedSpacialEnvelope (const AudioRegionDescriptor& region,
+                                                                 int startIndex,
+                                                                 int numberOfPointsToRemove,
+                                                                 const int* positions,
+                                                                 const double* x,
+                                                                 const double* y,
+                                                                 const double* z,
+                                                                 int numberOfPointsToInsert,
+                                                                 const int* interpolationModes,
+                                                                 const double* controlPoints,
+                                                                 SpacialEnvelope::Patch& patch,
+                                                                 int& indexOfTheFirstSetPoint)
+{
+	const SpacialEnvelope& envelope = *region.spacialEnvelope;
+	const int numberOfSetPoints = region.numberOfSetSpacialPoints;
+	const int first = region.indexOfTheFirstSetSpacialPoint;
+	const int newNumberOfSetPoints = numberOfSetPoints - numberOfPointsToRemove + numberOfPointsToInsert;
+	const bool atTheStart = startIndex == 0;
+	const bool atTheEnd = startIndex + numberOfPointsToRemove == numberOfSetPoints;
+	
+	// The first and the last point set after the patch, which are copied
+	// to the start and the end of the region (see setSpacialEnvelopeForRegion).
+	const int firstPosition = region.startPosition - region.startPositionOfAudioFileInTimeline;
+	const int lastPosition = region.endPosition - region.startPositionOfAudioFileInTimeline + 1;
+	SpacialEnvelopePoint newFirstPoint = envelope.getPoint(first + (atTheStart ? numberOfPointsToRemove : 0));
+	SpacialEnvelopePoint newLastPoint = envelope.getPoint(atTheEnd ? first + startIndex - 1 : first + numberOfSetPoints - 1);
+	if (numberOfPointsToInsert > 0)
+	{
+		const int last = numberOfPointsToInsert - 1;
+		if (atTheStart)
+		{
+			newFirstPoint = SpacialEnvelopePoint(positions[0], x[0], y[0], z[0]);
+		}
+		if (atTheEnd)
+		{
+			newLastPoint = SpacialEnvelopePoint(positions[last], x[last], y[last], z[last]);
+		}
+	}
+	const bool copyAtTheStart = newNumberOfSetPoints > 1 && newFirstPoint.getPosition() > firstPosition;
+	const bool copyAtTheEnd = newNumberOfSetPoints > 1 && newLastPoint.getPosition() < lastPosition;
+	const bool hadCopyAtTheEnd = envelope.size() - first - numberOfSetPoints == 1;
+	
+	// The copies are replaced, if the first or the last point changes (or
+	// if there are too few points for them now). The set points in between
+	// are then put into the patch again, which only happens if there are
+	// one or two of them. The segment of the last point is linear.
+	const bool replaceTheStart = atTheStart || (first == 1) != copyAtTheStart;
+	const bool replaceTheEnd = atTheEnd || hadCopyAtTheEnd != copyAtTheEnd;
+	int firstSetPointToCopy = replaceTheStart ? 0 : startIndex;
+	if (atTheEnd && numberOfPointsToInsert == 0)
+	{
+		firstSetPointToCopy = jmin (firstSetPointToCopy, startIndex - 1);
+	}
+	const int endSetPointToCopy = replaceTheEnd ? numberOfSetPoints : startIndex + numberOfPointsToRemove;
+	
+	Array<int> patchPositions;
+	Array<double> patchXs, patchYs, patchZs;
+	Array<int> patchInterpolationModes;
+	Array<double> patchControlPoints;
+	for (int i = -1; i <= numberOfSetPoints + numberOfPointsToInsert; ++i)
+	{
+		// The copy at the start, the set points in front of the inserted
+		// ones, the inserted ones, the set points after them and the copy
+		// at the end.
+		SpacialEnvelopePoint point;
+		int interpolationMode = SpacialEnvelope::interpolationModeLinear;
+		const double* controlPointsOfTheSegment = nullptr;
+		if (i == -1)
+		{
+			if (! (replaceTheStart && copyAtTheStart))
+			{
+				continue;
+			}
+			point = SpacialEnvelopePoint(firstPosition, newFirstPoint.getX(), newFirstPoint.getY(), newFirstPoint.getZ());
+		}
+		else if (i < startIndex)
+		{
+			if (i < firstSetPointToCopy)
+			{
+				continue;
+			}
+			point = envelope.getPoint(first + i);
+			interpolationMode = envelope.getInterpolationMode(first + i);
+			controlPointsOfTheSegment = envelope.getControlPoints(first + i);
+		}
+		else if (i < startIndex + numberOfPointsToInsert)
+		{
+			const int k = i - startIndex;
+			point = SpacialEnvelopePoint(positions[k], x[k], y[k], z[k]);
+			if (interpolationModes != nullptr)
+			{
+				interpolationMode = interpolationModes[k];
+				if (interpolationMode == SpacialEnvelope::interpolationModeBezier && controlPoints != nullptr)
+				{
+					controlPointsOfTheSegment = controlPoints + 6 * k;
+				}
+			}
+		}
+		else if (i < newNumberOfSetPoints)
+		{
+			const int k = i - numberOfPointsToInsert + numberOfPointsToRemove;
+			if (k >= endSetPointToCopy)
+			{
+				continue;
+			}
+			point = envelope.getPoint(first + k);
+			interpolationMode = envelope.getInterpolationMode(first + k);
+			controlPointsOfTheSegment = envelope.getControlPoints(first + k);
+		}
+		else if (i == newNumberOfSetPoints)
+		{
+			if (! (replaceTheEnd && copyAtTheEnd))
+			{
+				continue;
+			}
+			point = SpacialEnvelopePoint(lastPosition, newLastPoint.getX(), newLastPoint.getY(), newLastPoint.getZ());
+		}
+		else
+		{
+			continue;
+		}
+		
+		if (replaceTheEnd && i == newNumberOfSetPoints - 1)
+		{
+			interpolationMode = SpacialEnvelope::interpolationModeLinear;
+		}
+		patchPositions.add(point.getPosition());
+		patchXs.add(point.getX());
+		patchYs.add(point.getY());
+		patchZs.add(point.getZ());
+		patchInterpolationModes.add(interpolationMode == SpacialEnvelope::interpolationModeBezier
+		                            && controlPointsOfTheSegment == nullptr
+		                            ? (int) SpacialEnvelope::interpolationModeLinear
+		                            : interpolationMode);
+		for (int j = 0; j < 6; ++j)
+		{
+			patchControlPoints.add(controlPointsOfTheSegment != nullptr ? controlPointsOfTheSegment[j] : 0.0);
+		}
+	}
+	
+	patch.startIndex = replaceTheStart ? 0 : first + firstSetPointToCopy;
+	patch.numberOfRemovedPoints = (replaceTheEnd ? envelope.size() : first + startIndex + numberOfPointsToRemove)
+	                              - patch.startIndex;
+	patch.numberOfInsertedPoints = patchPositions.size();
+	
+	indexOfTheFirstSetPoint = copyAtTheStart ? 1 : 0;
+	return SpacialEnvelope::createPatched(envelope,
+	                                      patch.startIndex,
+	                                      patch.numberOfRemovedPoints,
+	                                      patchPositions.getRawDataPointer(),
+	                                      patchXs.getRawDataPointer(),
+	                                      patchYs.getRawDataPointer(),
+	                                      patchZs.getRawDataPointer(),
+	                                      patch.numberOfInsertedPoints,
+	                                      patchInterpolationModes.getRawDataPointer(),
+	                                      patchControlPoints.getRawDataPointer());
+}
+
+void AudioRegionMixer::attachSpacialEnvelope (AudioRegionDescriptor* region,
+                                              SpacialEnvelope* spacialEnvelope,
+                                              const SpacialEnvelope::Patch* knownPatch)
+{
+	jassert (spacialEnvelope != nullptr);
+	
+	const SpacialEnvelope::Ptr newEnvelope (spacialEnvelope);
+	const SpacialEnvelope::Ptr oldEnvelope (region->spacialEnvelope);
+	
+	// Only the changed points are looked at again.
+	SpacialEnvelope::Patch patch;
+	if (oldEnvelope != nullptr)
+	{
+		patch = knownPatch != nullptr ? *knownPatch
+		                              : SpacialEnvelope::findPatch(*oldEnvelope, *newEnvelope);
+		if (patch.isEmpty())
+		{
+			// E.g. if only the gain envelope of the region has been edited.
+			return;
+		}
+	}
+	
+	// Kept for the instantiation of the region's chain.
+	region->spacialEnvelope = newEnvelope;
+	
+	AudioSourceAmbipanning* chain = region->audioSourceAmbipanning;
+	if (chain != nullptr)
+	{
+		if (editTransactionDepth == 0)
+		{
+			if (oldEnvelope != nullptr && chain->getSpacialEnvelope() == oldEnvelope)
+			{
+				// The gains of the unchanged points are taken over from the
+				// table of the old envelope, if it's up to date.
+				SpacialGainTable::Ptr patchedTable;
+				const SpacialGainTable::Ptr table (chain->getSpacialGainTable());
+				if (table != nullptr && table->getEnvelope() == oldEnvelope.getObject())
+				{
+					patchedTable = AudioSourceAmbipanning::createPatchedSpacialGainTable(*table, newEnvelope, patch);
+				}
+				
+				chain->setSpacialEnvelope(newEnvelope, &patch);
+				
+				if (patchedTable != nullptr)
+				{
+					const ScopedLock sl (lock);
+					chain->setSpacialGainTable(patchedTable);
+					return;
+				}
+			}
+			else
+			{
+				chain->setSpacialEnvelope(newEnvelope);
+			}
+			// Its gains are calculated by the regionLoader.
+			regionLoader->notify();
+		}
+		else
+		{
+			// Handed to the chain by commitEditTransaction.
+			regionsWithChangedSpacialEnvelope.addIfNotAlreadyThere(region->regionID);
+		}
+	}
+}
+
+SpacialPositionMailbox::Ptr AudioRegionMixer::enableLivePositionForRegion (const int regionID,
+                                                                         double smoothingTimeInMs)
+{
+	const ScopedLock sl (regionLock);
+	
+	AudioRegionDescriptor* audioRegionToModify = findRegion(regionID);
+	
+	if (audioRegionToModify == nullptr)
+	{
+		DEB("AudioRegionMixer: Can't enable the live position of the region "
+            "because the specified regionID can't be found.")
+		return nullptr;
+	}
+	
+	if (audioRegionToModify->livePositionMailbox == nullptr)
+	{
+		audioRegionToModify->livePositionMailbox = new SpacialPositionMailbox();
+	}
+	audioRegionToModify->livePositionSmoothingTimeInMs = smoothingTimeInMs;
+	
+	if (audioRegionToModify->audioSourceAmbipanning != nullptr)
+	{
+		// In between two audio blocks.
+		const ScopedLock sl2 (lock);
+		audioRegionToModify->audioSourceAmbipanning->setLivePositionMailbox(audioRegionToModify->livePositionMailbox,
+		                                                                   smoothingTimeInMs);
+	}
+	return audioRegionToModify->livePositionMailbox;
+}
+
+bool AudioRegionMixer::disableLivePositionForRegion (const int regionID)
+{
+	const ScopedLock sl (regionLock);
+	
+	AudioRegionDescriptor* audioRegionToModify = findRegion(regionID);
+	
+	if (audioRegionToModify == nullptr)
+	{
+		DEB("AudioRegionMixer: Can't disable the live position of the region "
+            "because the specified regionID can't be found.")
+		return false;
+	}
+	
+	audioRegionToModify->livePositionMailbox = nullptr;
+	
+	if (audioRegionToModify->audioSourceAmbipanning != nullptr)
+	{
+		// In between two audio blocks.
+		const ScopedLock sl2 (lock);
+		audioRegionToModify->audioSourceAmbipanning->setLivePositionMailbox(nullptr, 0.0);
+	}
+	return true;
+}
+
+bool AudioRegionMixer::setDopplerInterpolationQualityForRegion (const int regionID,
+                                                                FractionalDelayInterpolator::Quality quality)
+{
+	const ScopedLock sl (regionLock);
+	
+	AudioRegionDescriptor* audioRegionToModify = findRegion(regionID);
+	
+	if (audioRegionToModify == nullptr)
+	{
+		DEB("AudioRegionMixer: Can't set the doppler interpolation quality of "
+            "the region because the specified regionID can't be found.")
+		return false;
+	}
+	
+	audioRegionToModify->dopplerInterpolationQuality = quality;
+	
+	if (audioRegionToModify->audioSourceAmbipanning != nullptr)
+	{
+		// The coefficients are calculated here, not while the audio thread
+		// waits for the lock.
+		FractionalDelayInterpolatorCache::getInstance()->getInterpolator(quality,
+		                                                                 audioRegionToModify->sampleRateOfTheAudioDevice);
+		
+		// In between two audio blocks.
+		const ScopedLock sl2 (lock);
+		audioRegionToModify->audioSourceAmbipanning->setDopplerInterpolationQuality(quality);
+	}
+	return true;
+}
+
+void AudioRegionMixer::enableBuffering(bool enable)
+{
+	DEB("AudioRegionMixer: enableBuffering called.");
+	
+	const ScopedLock sl (regionLock);
+	
+	for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+	{
+		findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning->enableBuffering(enable);
+	}
+    
+    bufferingEnabled = enable;
+}
+
+bool AudioRegionMixer::getBufferingState()
+{
+    return bufferingEnabled;
+}
+
+void AudioRegionMixer::enableDopplerEffect (bool enable)
+{
+    DEB("AudioRegionMixer: enableDopplerEffect called.");
+	
+	const ScopedLock sl (regionLock);
+	
+	for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+	{
+		findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning->enableDopplerEffect(enable);
+	}
+	
+	dopplerEffectEnabled = enable;
+}
+
+void AudioRegionMixer::enableDistanceBasedFiltering (bool enable)
+{
+    DEB("AudioRegionMixer: enableDistanceBasedFiltering called.");
+	
+	const ScopedLock sl (regionLock);
+	
+	for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+	{
+		findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning->enableLowPassFilter(enable);
+	}
+	
+	lowPassFilterEnabled = enable;
+}
+
+void AudioRegionMixer::setNumberOfRenderThreads (int numberOfThreads,
+                                                 bool pinThreadsToCores,
+                                                 bool realtimePriority)
+{
+	// The threads must not be replaced while they are rendering.
+	const ScopedLock sl (lock);
+	parallelRegionRenderer.setNumberOfThreads (numberOfThreads, pinThreadsToCores, realtimePriority);
+}
+
+void AudioRegionMixer::setRegionLookahead (double lookaheadInSeconds)
+{
+	{
+		const ScopedLock sl (regionLock);
+		regionLookaheadInSeconds = jmax (0.0, lookaheadInSeconds);
+	}
+	
+	if (lookaheadInSeconds <= 0.0)
+	{
+		// All regions are instantiated right away.
+		loadRegions();
+	}
+	regionLoader->notify();
+}
+
+void AudioRegionMixer::setLoopStartPosition (int loopStartPosition_)
+{
+	{
+		const ScopedLock sl (regionLock);
+		loopStartPosition = loopStartPosition_;
+	}
+	regionLoader->notify();
+}
+
+void AudioRegionMixer::enableSynchronousRegionLoading (bool enable)
+{
+	synchronousRegionLoading = enable;
+}
+
+int AudioRegionMixer::getNumberOfInstantiatedRegions ()
+{
+	const ScopedLock sl (regionLock);
+	return instantiatedRegionIDs.size();
+}
+
+void AudioRegionMixer::prepareToPlay (int samplesPerBlockExpected_, double sampleRate_)
+{
+	DEB("AudioRegionMixer: prepareToPlay called.");
+	
+	const ScopedLock sl (regionLock);
+	
+	samplesPerBlockExpected = samplesPerBlockExpected_;
+	sampleRate = sampleRate_;
+	
+	for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+	{		
+		findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning
+		  ->prepareToPlay(samplesPerBlockExpected, sampleRate);
+	}
+	
+}
+
+void AudioRegionMixer::prepareAllRegionsToPlay ()
+{
+	// DEB("AudioRegionMixer::prepareAllRegionsToPlay called.")
+	
+	const ScopedLock sl (regionLock);
+	
+	for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+	{		
+		findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning
+        ->prepareToPlay(samplesPerBlockExpected, sampleRate);
+	}
 	
 }
 
@@ -458,9 +1474,11 @@ void AudioRegionMixer::releaseResources()
 {
 	DEB("AudioRegionMixer: releaseResources called.");
 	
-	for (int i = regions.size(); --i >= 0;)
+	const ScopedLock sl (regionLock);
+	
+	for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
 	{		
-		((AudioRegion*)regions[i])->audioSourceAmbipanning
+		findRegion(instantiatedRegionIDs.getUnchecked(i))->audioSourceAmbipanning
 		->releaseResources();
 	}
 }
@@ -479,21 +1497,35 @@ void AudioRegionMixer::setNextReadPositionOnAllRegions (int64 newPosition)
     
 	nextPlayPosition = newPosition;
     
-    for (int i = 0; i != regions.size(); ++i)
+    // The regions at the new position are instantiated before the next
+    // block, not when the regionLoader gets to them.
+    if (getLookaheadInSamples() > 0)
+    {
+        loadRegions();
+    }
+    
+    const ScopedLock sl (regionLock);
+    
+    // All regions with startPosition < newPosition and
+    // endPosition > newPosition.
+    Array<AudioRegion*> regionsAtNewPosition;
+    regionIndex.findRegions(newPosition + 1, newPosition, regionsAtNewPosition);
+    
+    for (int i = 0; i != regionsAtNewPosition.size(); ++i)
 	{
-        AudioRegion* currentAudioRegion = (AudioRegion*)regions[i];
-        
-        if (currentAudioRegion->startPosition < newPosition &&
-            currentAudioRegion->endPosition > newPosition)
+        AudioRegion* currentAudioRegion = regionsAtNewPosition.getUnchecked(i);
+        if (currentAudioRegion->audioSourceAmbipanning == nullptr)
         {
-            int startPositionOfCurrentRegionInThisChunk = jmax(nextPlayPosition,
-                                                               currentAudioRegion->startPosition);
-            // place the "virtual reading head" to the right position in the 
-            // (multi channel) audio file.
-            currentAudioRegion->audioSourceAmbipanning
-            ->setNextReadPosition( startPositionOfCurrentRegionInThisChunk 
-                                  - currentAudioRegion->startPositionOfAudioFileInTimeline);
+            continue;
         }
+        
+        int startPositionOfCurrentRegionInThisChunk = jmax(nextPlayPosition,
+                                                           currentAudioRegion->startPosition);
+        // place the "virtual reading head" to the right position in the 
+        // (multi channel) audio file.
+        currentAudioRegion->audioSourceAmbipanning
+        ->setNextReadPosition( startPositionOfCurrentRegionInThisChunk 
+                              - currentAudioRegion->startPositionOfAudioFileInTimeline);
 	}
 }
 
@@ -508,60 +1540,134 @@ void AudioRegionMixer::getNextAudioBlock (const AudioSourceChannelInfo& info)
 		// Zero the buffer of info. Will soon add regions to it (if there are any).
 		info.clearActiveBufferRegion();
         
-        if (regions.size() != 0)
+        if (synchronousRegionLoading)
         {
-            // Below, this buffer is used as argument for the getNextAudioBlock
-            // method for regions under the playhead.
-            tempBuffer.setSize (jmax (1, info.buffer->getNumChannels()),
-                                info.buffer->getNumSamples());
-            AudioSourceChannelInfo tempInfo;
-            tempInfo.buffer = &tempBuffer;
-            tempInfo.startSample = 0;
-            
-            AudioRegion* currentAudioRegion;
-            const int startOfThisChunk = nextPlayPosition;
-            const int endOfThisChunk = nextPlayPosition + info.numSamples;
-            
-            // This lock is needed because otherwise it would be possible to
-            // change the regions array from another method while going through
-            // the following for-loop
-            const ScopedLock sl (lock);
+            // Non-realtime: The regions under the playhead are instantiated
+            // before this block is rendered.
+            loadRegions();
+        }
+        
+        // The regions themselves are not locked (they are taken from the
+        // snapshot). This lock is only held by the methods that change
+        // the speakers and the rendering settings, and by
+        // commitEditTransaction - which is why the snapshot is picked up
+        // under it.
+        const ScopedLock sl (lock);
+        
+        // Marks the beginning of the block for the reclaimer, before the
+        // snapshot is picked up (see AudioRegionReclaimer).
+        ++audioThreadEpoch;
+        const AudioRegionSnapshot* snapshot = currentSnapshot.get();
+        
+        if (snapshot->size() != 0)
+        {
+            // Below, this buffer is used as the mono scratch buffer by
+            // the regions under the playhead. They render their mono signal
+            // into it and add the panned signals directly to info.buffer.
+            tempBuffer.setSize (1, info.buffer->getNumSamples(), false, false, true);
+            
+            const AudioRegion* currentAudioRegion;
+            const int startOfThisChunk = nextPlayPosition;
+            const int endOfThisChunk = nextPlayPosition + info.numSamples;
+            
+            // The regions are added to info.buffer directly or, when the
+            // HOA rendering is enabled, to the hoaBus (which is decoded
+            // to info.buffer afterwards).
+            AudioSourceChannelInfo regionInfo;
+            int startSampleOfThisChunkInTheDestination;
+            if (hoaRenderingEnabled)
+            {
+                hoaBus.setSize (hoaDecoder.getNumberOfBusChannels(), info.numSamples, false, false, true);
+                hoaBus.clear();
+                regionInfo.buffer = &hoaBus;
+                startSampleOfThisChunkInTheDestination = 0;
+            }
+            else
+            {
+                regionInfo.buffer = info.buffer;
+                startSampleOfThisChunkInTheDestination = info.startSample;
+            }
 
-            for (int i = 0; i != regions.size(); ++i)
+            // Only the regions under the playhead are looked at.
+            Array<const AudioRegion*>& regionsInThisChunk = snapshot->regionsInThisChunk;
+            regionsInThisChunk.clearQuick();
+            snapshot->findRegions(startOfThisChunk, endOfThisChunk, regionsInThisChunk);
+            
+            // If there are several threads, the loop below only collects
+            // the regions for the parallelRegionRenderer.
+            const bool renderInParallel = parallelRegionRenderer.getNumberOfThreads() > 1;
+            Array<ParallelRegionRenderer::RegionToRender>& regionsToRender = snapshot->regionsToRender;
+            regionsToRender.clearQuick();
+            
+            for (int i = 0; i != regionsInThisChunk.size(); ++i)
             {	
-                currentAudioRegion = (AudioRegion*)regions[i];
-                if (currentAudioRegion->startPosition < endOfThisChunk 
-                    && currentAudioRegion->endPosition >= startOfThisChunk)
+                currentAudioRegion = regionsInThisChunk.getUnchecked(i);
+                
+                // Not instantiated (yet), see updateRegionChains.
+                if (currentAudioRegion->audioSourceAmbipanning == nullptr)
+                {
+                    continue;
+                }
+                
+                // the next two variables are still measured in absolute samples on the timeline
+                int startPositionOfCurrentRegionInThisChunk = jmax(startOfThisChunk,
+                                                                   currentAudioRegion->startPosition);
+                int endPositionOfCurrentRegionInThisChunk = jmin(endOfThisChunk,
+                                                                 currentAudioRegion->endPosition);
+                
+                int numberOfSamplesOfCurrentRegionInThisChunk
+                = endPositionOfCurrentRegionInThisChunk - startPositionOfCurrentRegionInThisChunk;
+                
+                // place the "virtual reading head" to the correct position in the (multi channel) audio file
+                currentAudioRegion->audioSourceAmbipanning->setNextReadPosition(
+                    startPositionOfCurrentRegionInThisChunk - currentAudioRegion->startPositionOfAudioFileInTimeline);
+                
+                // get the desired fragment of the audio file and add it
+                // to the buffer that will be returned
+                int startSampleInTheBuffer = startPositionOfCurrentRegionInThisChunk - startOfThisChunk;
+                regionInfo.startSample = startSampleOfThisChunkInTheDestination + startSampleInTheBuffer;
+                regionInfo.numSamples = numberOfSamplesOfCurrentRegionInThisChunk;
+                if (renderInParallel)
+                {
+                    ParallelRegionRenderer::RegionToRender regionToRender;
+                    regionToRender.audioSourceAmbipanning = currentAudioRegion->audioSourceAmbipanning;
+                    regionToRender.startSample = regionInfo.startSample;
+                    regionToRender.numSamples = regionInfo.numSamples;
+                    regionsToRender.add(regionToRender);
+                }
+                else
+                {
+                    currentAudioRegion->audioSourceAmbipanning->addNextAudioBlockTo(regionInfo, tempBuffer);
+                }
+            }
+            
+            if (renderInParallel)
+            {
+                parallelRegionRenderer.renderRegions(regionsToRender, *regionInfo.buffer);
+            }
+            
+            if (hoaRenderingEnabled)
+            {
+                if (hoaBusOutputEnabled)
                 {
-                    // the next two variables are still measured in absolute samples on the timeline
-                    int startPositionOfCurrentRegionInThisChunk = jmax(startOfThisChunk,
-                                                                       currentAudioRegion->startPosition);
-                    int endPositionOfCurrentRegionInThisChunk = jmin(endOfThisChunk,
-                                                                     currentAudioRegion->endPosition);
-                    
-                    int numberOfSamplesOfCurrentRegionInThisChunk
-                    = endPositionOfCurrentRegionInThisChunk - startPositionOfCurrentRegionInThisChunk;
-                    
-                    // place the "virtual reading head" to the correct position in the (multi channel) audio file
-                    currentAudioRegion->audioSourceAmbipanning->setNextReadPosition(
-                        startPositionOfCurrentRegionInThisChunk - currentAudioRegion->startPositionOfAudioFileInTimeline);
-                    
-                    // get the desired fragment of the audio file
-                    tempInfo.numSamples = numberOfSamplesOfCurrentRegionInThisChunk;
-                    currentAudioRegion->audioSourceAmbipanning->getNextAudioBlock(tempInfo);
-                    
-                    // Add it to the buffer that will be returned
-                    int startSampleInTheBuffer = startPositionOfCurrentRegionInThisChunk - startOfThisChunk;
-                    for (int chan = 0; chan < info.buffer->getNumChannels(); ++chan)
+                    // The raw bus, e.g. for the bounce of the bus.
+                    const int numberOfChannels = jmin (info.buffer->getNumChannels(), hoaBus.getNumChannels());
+                    for (int chan = 0; chan < numberOfChannels; ++chan)
                     {
-                        info.buffer->addFrom (chan, info.startSample + startSampleInTheBuffer , tempBuffer, 
-                                              chan, 0, numberOfSamplesOfCurrentRegionInThisChunk);
+                        info.buffer->copyFrom (chan, info.startSample, hoaBus, chan, 0, info.numSamples);
                     }
                 }
+                else
+                {
+                    hoaDecoder.decode (hoaBus, 0, info);
+                }
             }
             
             nextPlayPosition = endOfThisChunk;
         }
+        
+        // From here on, the snapshot might be deleted.
+        ++audioThreadEpoch;
 	}
 }
 
@@ -597,24 +1703,843 @@ bool AudioRegionMixer::isLooping() const
 	return false;
 }
 
-bool AudioRegionMixer::findRegion(const int regionID, int& index)
+AudioRegionDescriptor* AudioRegionMixer::findRegion(const int regionID)
+{
+	return regions[regionID]; // nullptr, if there is no such region.
+}
+
+void AudioRegionMixer::insertRegion (AudioRegionDescriptor* audioRegionToAdd)
+{
+	regions.set(audioRegionToAdd->regionID, audioRegionToAdd);
+	regionIndex.add(audioRegionToAdd, audioRegionToAdd->regionID,
+	                audioRegionToAdd->startPosition, audioRegionToAdd->endPosition);
+	
+	// update totalLength, if needed
+	if (totalLength < audioRegionToAdd->endPosition)
+	{
+		totalLength = audioRegionToAdd->endPosition;
+	}
+}
+
+void AudioRegionMixer::publishSnapshot (const Array<AudioSourceAmbipanning*>& removedSources)
+{
+	if (editTransactionDepth != 0)
+	{
+		// Published by commitEditTransaction. The removed sources are
+		// still used by the current snapshot.
+		snapshotIsOutdated = true;
+		sourcesRemovedDuringTransaction.addArray(removedSources);
+		return;
+	}
+	
+	AudioRegionSnapshot* oldSnapshot = currentSnapshot.exchange(createSnapshot());
+	
+	reclaimer.retire(oldSnapshot, removedSources);
+}
+
+AudioRegionSnapshot* AudioRegionMixer::createSnapshot () const
+{
+	Array<AudioRegion*> regionsSortedByStartPosition;
+	regionIndex.getAllRegions(regionsSortedByStartPosition);
+	
+	return new AudioRegionSnapshot(regionsSortedByStartPosition);
+}
+
+//==============================================================================
+AudioRegionMixer::RegionLoader::RegionLoader (AudioRegionMixer& owner_)
+:   Thread ("AudioRegionMixer region loader"),
+    owner (owner_)
+{
+    startThread (4);
+}
+
+AudioRegionMixer::RegionLoader::~RegionLoader ()
+{
+    stopThread (10000);
+}
+
+void AudioRegionMixer::RegionLoader::run ()
+{
+    while (! threadShouldExit())
+    {
+        wait (50);
+        owner.loadRegions();
+    }
+}
+
+void AudioRegionMixer::loadRegions ()
+{
+	// Without it, the regionLoader and the thread of a bounce (or of a
+	// locate) would both build chains for the same regions.
+	const ScopedLock sl (regionLoadingLock);
+	
+	checkPendingFiles();
+	updateRegionChains();
+	updateSpacialGainTables();
+}
+
+void AudioRegionMixer::checkPendingFiles ()
+{
+	// Each file is checked once, no matter how many regions use it.
+	Array<int> regionIDs;
+	StringArray absolutePathsToAudioFiles;
+	{
+		const ScopedLock sl (regionLock);
+		
+		if (regionsWithPendingFileCheck.size() == 0)
+		{
+			return;
+		}
+		regionIDs = regionsWithPendingFileCheck;
+		for (int i = 0; i < regionIDs.size(); ++i)
+		{
+			absolutePathsToAudioFiles.addIfNotAlreadyThere(findRegion(regionIDs.getUnchecked(i))->absolutePathToAudioFile);
+		}
+	}
+	
+	OwnedArray<FileCheckJob> jobs;
+	for (int i = 0; i < absolutePathsToAudioFiles.size(); ++i)
+	{
+		jobs.add(new FileCheckJob(absolutePathsToAudioFiles[i]));
+		loadingThreadPool.addJob(jobs.getLast());
+	}
+	
+	// The regions of a file are updated as soon as the file is checked.
+	for (int j = 0; j < jobs.size(); ++j)
+	{
+		const FileCheckJob* job = jobs.getUnchecked(j);
+		loadingThreadPool.waitForJobToFinish(job, -1);
+		
+		const ScopedLock sl (regionLock);
+		
+		Array<AudioSourceAmbipanning*> noRemovedSources;
+		bool regionsRemoved = false;
+		for (int i = 0; i < regionIDs.size(); ++i)
+		{
+			const int regionID = regionIDs.getUnchecked(i);
+			// The region might have been removed meanwhile.
+			if (! regionsWithPendingFileCheck.contains(regionID))
+			{
+				continue;
+			}
+			AudioRegionDescriptor* region = findRegion(regionID);
+			if (region->absolutePathToAudioFile != job->absolutePathToAudioFile)
+			{
+				continue;
+			}
+			
+			regionsWithPendingFileCheck.removeValue(regionID);
+			++numberOfRegionsChecked;
+			
+			if (job->lengthOfAudioFile < 0
+			    || region->endPosition - region->startPositionOfAudioFileInTimeline > job->lengthOfAudioFile)
+			{
+				DEB("AudioRegionMixer: Removed region " + String(regionID) + " because its "
+				    "audio file couldn't be read or is too short.")
+				// It has no chain yet.
+				regionIndex.remove(regionID, region->startPosition);
+				regions.remove(regionID);
+				delete region;
+				regionsRemoved = true;
+			}
+			else
+			{
+				region->lengthOfAudioFile = job->lengthOfAudioFile;
+			}
+		}
+		
+		if (regionsRemoved)
+		{
+			publishSnapshot(noRemovedSources);
+		}
+	}
+	
+	const ScopedLock sl (regionLock);
+	if (regionsWithPendingFileCheck.size() == 0)
+	{
+		numberOfRegionsAddedAsynchronously = 0;
+		numberOfRegionsChecked = 0;
+	}
+}
+
+void AudioRegionMixer::updateRegionChains ()
+{
+	// The regions to instantiate. Copied to the jobs, since the regionLock
+	// isn't held while the chains are built.
+	OwnedArray<ChainBuildJob> jobs;
+	int configurationVersion;
+	
+	{
+		const ScopedLock sl (regionLock);
+		
+		const int lookahead = getLookaheadInSamples();
+		const int playPosition = nextPlayPosition;
+		
+		Array<AudioRegion*> regionsToInstantiate;
+		if (lookahead == 0)
+		{
+			for (HashMap<int, AudioRegionDescriptor*>::Iterator i (regions); i.next();)
+			{
+				regionsToInstantiate.add(i.getValue());
+			}
+		}
+		else
+		{
+			// The chains of the regions behind the playhead (and far in
+			// front of it, after a jump back) are deleted - except the
+			// ones at the start of the loop.
+			Array<AudioSourceAmbipanning*> removedSources;
+			for (int i = instantiatedRegionIDs.size(); --i >= 0;)
+			{
+				AudioRegionDescriptor* region = findRegion(instantiatedRegionIDs.getUnchecked(i));
+				const bool isAtTheLoopStart = loopStartPosition >= 0
+				    && region->endPosition >= loopStartPosition
+				    && region->startPosition < loopStartPosition + lookahead;
+				if (! isAtTheLoopStart
+				    && (region->endPosition < playPosition
+				        || region->startPosition >= playPosition + 2 * lookahead))
+				{
+					removedSources.add(region->audioSourceAmbipanning);
+					region->audioSourceAmbipanning = nullptr;
+					instantiatedRegionIDs.remove(i);
+				}
+			}
+			if (removedSources.size() != 0)
+			{
+				publishSnapshot(removedSources);
+			}
+			
+			regionIndex.findRegions(playPosition, playPosition + lookahead, regionsToInstantiate);
+		}
+		const int numberOfRegionsAtThePlayhead = regionsToInstantiate.size();
+		if (lookahead != 0 && loopStartPosition >= 0)
+		{
+			Array<AudioRegion*> regionsAtTheLoopStart;
+			regionIndex.findRegions(loopStartPosition, loopStartPosition + lookahead, regionsAtTheLoopStart);
+			for (int i = 0; i < regionsAtTheLoopStart.size(); ++i)
+			{
+				regionsToInstantiate.addIfNotAlreadyThere(regionsAtTheLoopStart.getUnchecked(i));
+			}
+		}
+		
+		for (int i = 0; i < regionsToInstantiate.size(); ++i)
+		{
+			const AudioRegionDescriptor* region = static_cast<const AudioRegionDescriptor*> (regionsToInstantiate.getUnchecked(i));
+			// The regions whose files haven't been checked yet are skipped.
+			if (region->audioSourceAmbipanning == nullptr
+			    && region->lengthOfAudioFile >= 0)
+			{
+				// The ones at the start of the loop are read from there on.
+				const int readPosition = i < numberOfRegionsAtThePlayhead ? playPosition : loopStartPosition;
+				ChainBuildJob* job = new ChainBuildJob();
+				job->regionID = region->regionID;
+				job->absolutePathToAudioFile = region->absolutePathToAudioFile;
+				job->sampleRateOfTheAudioDevice = region->sampleRateOfTheAudioDevice;
+				job->readPosition = jmax(readPosition, region->startPosition)
+				                    - region->startPositionOfAudioFileInTimeline;
+				job->buffering = bufferingEnabled;
+				job->samplesPerBlock = samplesPerBlockExpected;
+				job->sampleRate = sampleRate;
+				jobs.add(job);
+			}
+		}
+		
+		configurationVersion = renderConfigurationVersion;
+	}
+	
+	if (jobs.size() == 0)
+	{
+		return;
+	}
+	
+	// Build the chains and fill their buffers in parallel, without blocking
+	// the message thread. Most of the time is spent waiting for the disk
+	// and for the buffering threads.
+	for (int i = 0; i < jobs.size(); ++i)
+	{
+		loadingThreadPool.addJob(jobs.getUnchecked(i));
+	}
+	
+	// The chains are attached in the order of the regions, each one (and
+	// all the following ones that are finished, too) as soon as it's ready.
+	Array<AudioSourceAmbipanning*> unusedChains;
+	int numberOfAttachedChains = 0;
+	int i = 0;
+	while (i < jobs.size())
+	{
+		loadingThreadPool.waitForJobToFinish(jobs.getUnchecked(i), -1);
+		
+		const ScopedLock sl (regionLock);
+		
+		do
+		{
+			ChainBuildJob* job = jobs.getUnchecked(i);
+			if (job->chain != nullptr)
+			{
+				if (attachRegionChain(*job, configurationVersion))
+				{
+					++numberOfAttachedChains;
+				}
+				else
+				{
+					unusedChains.add(job->chain);
+				}
+			}
+			++i;
+		}
+		while (i < jobs.size() && ! loadingThreadPool.contains(jobs.getUnchecked(i)));
+		
+		publishSnapshot(Array<AudioSourceAmbipanning*>());
+	}
+	
+	for (int j = 0; j < unusedChains.size(); ++j)
+	{
+		delete unusedChains.getUnchecked(j);
+	}
+	
+	DEB("AudioRegionMixer: " + String(numberOfAttachedChains) + " regions instantiated.")
+}
+
+bool AudioRegionMixer::attachRegionChain (const ChainBuildJob& job, int configurationVersion)
+{
+	// The region might have been removed (or replaced) meanwhile.
+	AudioRegionDescriptor* region = findRegion(job.regionID);
+	if (region == nullptr
+	    || region->audioSourceAmbipanning != nullptr
+	    || region->absolutePathToAudioFile != job.absolutePathToAudioFile)
+	{
+		return false;
+	}
+	
+	// The settings that have changed while the chain was built.
+	AudioSourceAmbipanning* chain = job.chain;
+	if (configurationVersion != renderConfigurationVersion)
+	{
+		chain->reallocateMemoryForTheArrays();
+	}
+	if (job.buffering != bufferingEnabled)
+	{
+		chain->enableBuffering(bufferingEnabled);
+	}
+	if (job.samplesPerBlock != samplesPerBlockExpected || job.sampleRate != sampleRate)
+	{
+		chain->prepareToPlay(samplesPerBlockExpected, sampleRate);
+	}
+	applyRegionSettings(*region, chain);
+	
+	region->audioSourceAmbipanning = chain;
+	instantiatedRegionIDs.add(region->regionID);
+	return true;
+}
+
+void AudioRegionMixer::updateSpacialGainTables ()
 {
-	bool foundTheRegion = false;
+	OwnedArray<GainTableBuildJob> jobs;
+	
+	{
+		const ScopedLock sl (regionLock);
+		
+		for (int i = 0; i < instantiatedRegionIDs.size(); ++i)
+		{
+			const AudioRegionDescriptor* region = findRegion(instantiatedRegionIDs.getUnchecked(i));
+			if (region->spacialEnvelope != nullptr
+			    && region->spacialEnvelope->size() > 1
+			    && ! region->audioSourceAmbipanning->hasSpacialGainTableFor(region->spacialEnvelope))
+			{
+				jobs.add(new GainTableBuildJob(region->regionID, region->spacialEnvelope));
+			}
+		}
+	}
+	
+	if (jobs.size() == 0)
+	{
+		return;
+	}
 	
-	// find the index of the region in the VoidArray regions
-	for (int i = 0; i < regions.size(); i++)
+	for (int i = 0; i < jobs.size(); ++i)
 	{
-		AudioRegion* audioRegionWithIndexI = (AudioRegion*)regions[i];	
-		if (audioRegionWithIndexI->regionID == regionID)	
+		loadingThreadPool.addJob(jobs.getUnchecked(i));
+	}
+	for (int i = 0; i < jobs.size(); ++i)
+	{
+		loadingThreadPool.waitForJobToFinish(jobs.getUnchecked(i), -1);
+	}
+	
+	// The envelope of a region (or the region itself) might have changed
+	// meanwhile. An outdated table is replaced in the next round (and
+	// ignored by the chain until then, see
+	// AudioSourceAmbipanning::getUsableSpacialGainTable).
+	const ScopedLock sl (regionLock);
+	const ScopedLock sl2 (lock);
+	for (int i = 0; i < jobs.size(); ++i)
+	{
+		const GainTableBuildJob* job = jobs.getUnchecked(i);
+		const AudioRegionDescriptor* region = findRegion(job->regionID);
+		if (job->table != nullptr
+		    && region != nullptr
+		    && region->audioSourceAmbipanning != nullptr
+		    && region->spacialEnvelope == job->envelope)
 		{
-			foundTheRegion = true;		
-			index = i;		
-			break;	
+			region->audioSourceAmbipanning->setSpacialGainTable(job->table);
 		}
 	}
+}
+
+AudioSourceAmbipanning* AudioRegionMixer::createRegionChain (const String& absolutePathToAudioFile,
+                                                             double sampleRateOfTheAudioDevice,
+                                                             bool enableBuffering)
+{
+	AudioFormatReader* audioFormatReader = AudioFileCache::getInstance()->createReaderFor (File (absolutePathToAudioFile));
+	if (audioFormatReader == nullptr)
+	{
+		return nullptr;
+	}
 	
-	return foundTheRegion;
+	// The audioFormatReader will be deleted by the AudioSourceGainEnvelope.
+	return new AudioSourceAmbipanning (audioFormatReader,
+	                                   sampleRateOfTheAudioDevice,
+	                                   enableBuffering);
 }
 
+void AudioRegionMixer::applyRegionSettings (const AudioRegionDescriptor& region,
+                                            AudioSourceAmbipanning* audioSourceAmbipanning)
+{
+	audioSourceAmbipanning->enableDopplerEffect(dopplerEffectEnabled);
+	audioSourceAmbipanning->setDopplerInterpolationQuality(region.dopplerInterpolationQuality);
+	audioSourceAmbipanning->enableLowPassFilter(lowPassFilterEnabled);
+	
+	if (region.gainEnvelope.size() != 0)
+	{
+		applyGainEnvelope(region, audioSourceAmbipanning);
+	}
+	
+	if (region.spacialEnvelope != nullptr)
+	{
+		audioSourceAmbipanning->setSpacialEnvelope(region.spacialEnvelope);
+	}
+	// The chain might have been built before the scene transformation was
+	// set (nothing is done, if the envelope has just been transformed).
+	audioSourceAmbipanning->prepareSceneTransform(AudioSourceAmbipanning::getSceneTransform());
+	audioSourceAmbipanning->postSceneTransform();
+	
+	if (region.livePositionMailbox != nullptr)
+	{
+		audioSourceAmbipanning->setLivePositionMailbox(region.livePositionMailbox,
+		                                               region.livePositionSmoothingTimeInMs);
+	}
+}
+
+void AudioRegionMixer::applyGainEnvelope (const AudioRegionDescriptor& region,
+                                          AudioSourceAmbipanning* audioSourceAmbipanning)
+{
+	// The points are copied by the AudioSourceGainEnvelope.
+	audioSourceAmbipanning->setGainEnvelope(region.gainEnvelope);
+}
+
+int AudioRegionMixer::getLookaheadInSamples () const
+{
+	return roundToInt (regionLookaheadInSeconds * sampleRate);
+}
+
+//==============================================================================
+AudioRegionMixer::FileCheckJob::FileCheckJob (const String& absolutePathToAudioFile_)
+:   ThreadPoolJob ("AudioRegionMixer file check"),
+    absolutePathToAudioFile (absolutePathToAudioFile_),
+    lengthOfAudioFile (-1)
+{
+}
+
+ThreadPoolJob::JobStatus AudioRegionMixer::FileCheckJob::runJob ()
+{
+    // Maps the file (see AudioFileCache), such that the chains of its
+    // regions find it there.
+    ScopedPointer<AudioFormatReader> audioFormatReader (AudioFileCache::getInstance()->createReaderFor (File (absolutePathToAudioFile)));
+    if (audioFormatReader != nullptr)
+    {
+        lengthOfAudioFile = audioFormatReader->lengthInSamples;
+    }
+    return jobHasFinished;
+}
+
+//==============================================================================
+AudioRegionMixer::ChainBuildJob::ChainBuildJob ()
+:   ThreadPoolJob ("AudioRegionMixer chain build"),
+    regionID (0),
+    sampleRateOfTheAudioDevice (44100.0),
+    readPosition (0),
+    buffering (false),
+    samplesPerBlock (512),
+    sampleRate (44100.0),
+    chain (nullptr)
+{
+}
+
+ThreadPoolJob::JobStatus AudioRegionMixer::ChainBuildJob::runJob ()
+{
+    chain = createRegionChain (absolutePathToAudioFile, sampleRateOfTheAudioDevice, buffering);
+    if (chain != nullptr)
+    {
+        chain->setNextReadPosition (readPosition);
+        // With buffering, this waits until the buffer is partly filled.
+        chain->prepareToPlay (samplesPerBlock, sampleRate);
+    }
+    return jobHasFinished;
+}
+
+//==============================================================================
+AudioRegionMixer::GainTableBuildJob::GainTableBuildJob (int regionID_,
+                                                        const SpacialEnvelope::Ptr& envelope_)
+:   ThreadPoolJob ("AudioRegionMixer gain table build"),
+    regionID (regionID_),
+    envelope (envelope_)
+{
+}
+
+ThreadPoolJob::JobStatus AudioRegionMixer::GainTableBuildJob::runJob ()
+{
+    table = AudioSourceAmbipanning::createSpacialGainTable (envelope);
+    return jobHasFinished;
+}
+
+#if AUDIO_ENGINE_UNIT_TESTS
+//==============================================================================
+/**
+ Applies random patches (inserts, removes and moves at the start, in the
+ middle and at the end, down to a single point and up again) to the spacial
+ and the gain envelope of a region, and compares them with the envelopes of
+ a second region, which are set as a whole to the same points after each
+ patch. The Patch of the spacial envelope has to cover all points that
+ have changed. The regions have no file and no chain.
+ */
+class AudioRegionMixerTest  : public UnitTest
+{
+public:
+	AudioRegionMixerTest ()  : UnitTest ("AudioRegionMixer") {}
+	
+	void runTest ()
+	{
+		AudioRegionMixer mixer;
+		Random random (120916);
+		addRegion (mixer, patchedRegionID);
+		addRegion (mixer, setRegionID);
+		
+		beginTest ("patches of the spacial envelope");
+		{
+			// The points as they have been set, like in the flat arrays of
+			// setSpacialEnvelopeForRegion.
+			Array<int> positions;
+			Array<double> xs, ys, zs;
+			Array<int> interpolationModes;
+			Array<double> controlPoints;
+			addSpacialPoints (random, -1, endOfThePositions, 1, positions, xs, ys, zs, interpolationModes, controlPoints);
+			expect (setSpacialEnvelope (mixer, patchedRegionID, positions, xs, ys, zs, interpolationModes, controlPoints));
+			
+			for (int n = 0; n < numberOfPatches; ++n)
+			{
+				int startIndex, numberOfPointsToRemove, numberOfPointsToInsert;
+				choosePatch (random, n, positions.size(), startIndex, numberOfPointsToRemove, numberOfPointsToInsert);
+				
+				Array<int> insertedPositions;
+				Array<double> insertedXs, insertedYs, insertedZs;
+				Array<int> insertedInterpolationModes;
+				Array<double> insertedControlPoints;
+				addSpacialPoints (random,
+				                  startIndex > 0 ? positions[startIndex - 1] : -1,
+				                  startIndex + numberOfPointsToRemove < positions.size()
+				                  ? positions[startIndex + numberOfPointsToRemove] : endOfThePositions,
+				                  numberOfPointsToInsert,
+				                  insertedPositions, insertedXs, insertedYs, insertedZs,
+				                  insertedInterpolationModes, insertedControlPoints);
+				numberOfPointsToInsert = insertedPositions.size();
+				if (positions.size() - numberOfPointsToRemove + numberOfPointsToInsert == 0)
+				{
+					continue;
+				}
+				const String patchName (getPatchName (n, startIndex, numberOfPointsToRemove, numberOfPointsToInsert, positions.size()));
+				
+				const AudioRegionDescriptor* patchedRegion = mixer.findRegion (patchedRegionID);
+				const SpacialEnvelope::Ptr oldEnvelope (patchedRegion->spacialEnvelope);
+				SpacialEnvelope::Patch patch;
+				int indexOfTheFirstSetPoint;
+				{
+					// The same envelope as the one of patchSpacialEnvelopeForRegion,
+					// only its Patch isn't kept there.
+					const ScopedLock sl (mixer.regionLock);
+					const SpacialEnvelope::Ptr patchedEnvelope (mixer.createPatchedSpacialEnvelope (*patchedRegion,
+					                                                                              startIndex,
+					                                                                              numberOfPointsToRemove,
+					                                                                              insertedPositions.getRawDataPointer(),
+					                                                                              insertedXs.getRawDataPointer(),
+					                                                                              insertedYs.getRawDataPointer(),
+					                                                                              insertedZs.getRawDataPointer(),
+					                                                                              numberOfPointsToInsert,
+					                                                                              insertedInterpolationModes.getRawDataPointer(),
+					                                                                              insertedControlPoints.getRawDataPointer(),
+					                                                                              patch,
+					                                                                              indexOfTheFirstSetPoint));
+				}
+				expect (mixer.patchSpacialEnvelopeForRegion (patchedRegionID,
+				                                             startIndex,
+				                                             numberOfPointsToRemove,
+				                                             insertedPositions.getRawDataPointer(),
+				                                             insertedXs.getRawDataPointer(),
+				                                             insertedYs.getRawDataPointer(),
+				                                             insertedZs.getRawDataPointer(),
+				                                             numberOfPointsToInsert,
+				                                             insertedInterpolationModes.getRawDataPointer(),
+				                                             insertedControlPoints.getRawDataPointer()),
+				        patchName + " failed.");
+				
+				positions.removeRange (startIndex, numberOfPointsToRemove);
+				xs.removeRange (startIndex, numberOfPointsToRemove);
+				ys.removeRange (startIndex, numberOfPointsToRemove);
+				zs.removeRange (startIndex, numberOfPointsToRemove);
+				interpolationModes.removeRange (startIndex, numberOfPointsToRemove);
+				controlPoints.removeRange (6 * startIndex, 6 * numberOfPointsToRemove);
+				for (int i = 0; i < numberOfPointsToInsert; ++i)
+				{
+					positions.insert (startIndex + i, insertedPositions[i]);
+					xs.insert (startIndex + i, insertedXs[i]);
+					ys.insert (startIndex + i, insertedYs[i]);
+					zs.insert (startIndex + i, insertedZs[i]);
+					interpolationModes.insert (startIndex + i, insertedInterpolationModes[i]);
+					for (int j = 0; j < 6; ++j)
+					{
+						controlPoints.insert (6 * (startIndex + i) + j, insertedControlPoints[6 * i + j]);
+					}
+				}
+				expect (setSpacialEnvelope (mixer, setRegionID, positions, xs, ys, zs, interpolationModes, controlPoints));
+				
+				const AudioRegionDescriptor* setRegion = mixer.findRegion (setRegionID);
+				const SpacialEnvelope& newEnvelope = *patchedRegion->spacialEnvelope;
+				expect (SpacialEnvelope::findPatch (*setRegion->spacialEnvelope, newEnvelope).isEmpty(),
+				        patchName + ": the envelope differs from the one set as a whole.");
+				expect (patchedRegion->numberOfSetSpacialPoints == setRegion->numberOfSetSpacialPoints
+				        && patchedRegion->indexOfTheFirstSetSpacialPoint == setRegion->indexOfTheFirstSetSpacialPoint
+				        && indexOfTheFirstSetPoint == setRegion->indexOfTheFirstSetSpacialPoint,
+				        patchName + ": the set points differ from the ones set as a whole.");
+				
+				const SpacialEnvelope::Patch change (SpacialEnvelope::findPatch (*oldEnvelope, newEnvelope));
+				expect (oldEnvelope->size() - patch.numberOfRemovedPoints + patch.numberOfInsertedPoints == newEnvelope.size()
+				        && (change.isEmpty()
+				            || (patch.startIndex <= change.startIndex
+				                && patch.startIndex + patch.numberOfRemovedPoints >= change.startIndex + change.numberOfRemovedPoints)),
+				        patchName + ": the Patch (" + String (patch.startIndex) + ", " + String (patch.numberOfRemovedPoints)
+				        + ", " + String (patch.numberOfInsertedPoints) + ") doesn't cover the change ("
+				        + String (change.startIndex) + ", " + String (change.numberOfRemovedPoints) + ", "
+				        + String (change.numberOfInsertedPoints) + ").");
+			}
+		}
+		
+		beginTest ("patches of the gain envelope");
+		{
+			Array<AudioEnvelopePoint> points;
+			addGainPoints (random, -1, endOfThePositions, 1, points);
+			expect (setGainEnvelope (mixer, patchedRegionID, points));
+			
+			for (int n = 0; n < numberOfPatches; ++n)
+			{
+				int startIndex, numberOfPointsToRemove, numberOfPointsToInsert;
+				choosePatch (random, n, points.size(), startIndex, numberOfPointsToRemove, numberOfPointsToInsert);
+				
+				Array<AudioEnvelopePoint> insertedPoints;
+				addGainPoints (random,
+				               startIndex > 0 ? points.getReference (startIndex - 1).getPosition() : -1,
+				               startIndex + numberOfPointsToRemove < points.size()
+				               ? points.getReference (startIndex + numberOfPointsToRemove).getPosition() : endOfThePositions,
+				               numberOfPointsToInsert,
+				               insertedPoints);
+				if (points.size() - numberOfPointsToRemove + insertedPoints.size() == 0)
+				{
+					continue;
+				}
+				const String patchName (getPatchName (n, startIndex, numberOfPointsToRemove, insertedPoints.size(), points.size()));
+				
+				expect (mixer.patchGainEnvelopeForRegion (patchedRegionID, startIndex, numberOfPointsToRemove, insertedPoints),
+				        patchName + " failed.");
+				
+				points.removeRange (startIndex, numberOfPointsToRemove);
+				for (int i = 0; i < insertedPoints.size(); ++i)
+				{
+					points.insert (startIndex + i, insertedPoints.getUnchecked (i));
+				}
+				expect (setGainEnvelope (mixer, setRegionID, points));
+				
+				const AudioRegionDescriptor* patchedRegion = mixer.findRegion (patchedRegionID);
+				const AudioRegionDescriptor* setRegion = mixer.findRegion (setRegionID);
+				expect (gainEnvelopesAreEqual (patchedRegion->gainEnvelope, setRegion->gainEnvelope),
+				        patchName + ": the envelope differs from the one set as a whole.");
+				expect (patchedRegion->numberOfSetGainPoints == setRegion->numberOfSetGainPoints
+				        && patchedRegion->indexOfTheFirstSetGainPoint == setRegion->indexOfTheFirstSetGainPoint,
+				        patchName + ": the set points differ from the ones set as a whole.");
+			}
+		}
+	}
+	
+private:
+	enum
+	{
+		patchedRegionID = 1,
+		setRegionID = 2,
+		numberOfPatches = 2000,
+		// The region covers the samples [startPosition, endPosition) of its
+		// file. The points lie in [0, endOfThePositions), some of them
+		// before or after the region.
+		startPosition = 1000,
+		endPosition = 50000,
+		endOfThePositions = 52000
+	};
+	
+	/** Adds a region without a file, like addRegionAsynchronously, except
+	 that its file is never checked. */
+	void addRegion (AudioRegionMixer& mixer, int regionID)
+	{
+		AudioRegionDescriptor* region = new AudioRegionDescriptor();
+		region->regionID = regionID;
+		region->startPosition = startPosition;
+		region->endPosition = endPosition;
+		region->startPositionOfAudioFileInTimeline = 0;
+		region->audioSourceAmbipanning = nullptr;
+		region->sampleRateOfTheAudioDevice = 44100.0;
+		region->lengthOfAudioFile = endPosition;
+		region->numberOfSetGainPoints = 0;
+		region->indexOfTheFirstSetGainPoint = 0;
+		region->numberOfSetSpacialPoints = 0;
+		region->indexOfTheFirstSetSpacialPoint = 0;
+		region->livePositionSmoothingTimeInMs = 0.0;
+		region->dopplerInterpolationQuality = FractionalDelayInterpolator::qualityDefault;
+		
+		const ScopedLock sl (mixer.regionLock);
+		mixer.insertRegion (region);
+	}
+	
+	/** Chooses an insert, a move or a remove (of up to three points) at the
+	 start, in the middle or at the end of the numberOfPoints. Every tenth
+	 patch removes all points but one. A move removes the points and
+	 inserts the same number of new ones, in between the same neighbours. */
+	void choosePatch (Random& random, int n, int numberOfPoints,
+	                  int& startIndex, int& numberOfPointsToRemove, int& numberOfPointsToInsert)
+	{
+		// A single point can't be removed.
+		const int kind = random.nextInt (numberOfPoints > 1 ? 3 : 2);
+		if (n % 10 == 9 && numberOfPoints > 1)
+		{
+			numberOfPointsToRemove = numberOfPoints - 1;
+			numberOfPointsToInsert = 0;
+		}
+		else if (kind == 0) // insert
+		{
+			numberOfPointsToRemove = 0;
+			numberOfPointsToInsert = 1 + random.nextInt (3);
+		}
+		else if (kind == 1) // move
+		{
+			numberOfPointsToRemove = 1 + random.nextInt (jmin (3, numberOfPoints));
+			numberOfPointsToInsert = numberOfPointsToRemove;
+		}
+		else // remove
+		{
+			numberOfPointsToRemove = 1 + random.nextInt (jmin (3, numberOfPoints - 1));
+			numberOfPointsToInsert = 0;
+		}
+		
+		const int numberOfStartIndices = numberOfPoints - numberOfPointsToRemove + 1;
+		switch (random.nextInt (3))
+		{
+			case 0:  startIndex = 0; break;
+			case 1:  startIndex = random.nextInt (numberOfStartIndices); break;
+			default: startIndex = numberOfStartIndices - 1; break;
+		}
+	}
+	
+	String getPatchName (int n, int startIndex, int numberOfPointsToRemove, int numberOfPointsToInsert,
+	                     int numberOfPoints)
+	{
+		return "patch " + String (n) + " (" + String (startIndex) + ", " + String (numberOfPointsToRemove)
+		       + ", " + String (numberOfPointsToInsert) + ") of " + String (numberOfPoints) + " points";
+	}
+	
+	/** Adds up to numberOfPositions sorted, distinct positions in between
+	 (and excluding) the previousPosition and the nextPosition. Some of them
+	 are at the ends of the region, where the copies of the envelopes are. */
+	void addPositions (Random& random, int previousPosition, int nextPosition, int numberOfPositions,
+	                   Array<int>& positions)
+	{
+		const int endsOfTheRegion[] = { 0, startPosition, endPosition, endPosition + 1 };
+		for (int i = 0; i < numberOfPositions && nextPosition - previousPosition > 1; ++i)
+		{
+			int position = previousPosition + 1 + random.nextInt (nextPosition - previousPosition - 1);
+			const int endOfTheRegion = endsOfTheRegion[random.nextInt (numElementsInArray (endsOfTheRegion))];
+			if (random.nextInt (4) == 0 && previousPosition < endOfTheRegion && endOfTheRegion < nextPosition)
+			{
+				position = endOfTheRegion;
+			}
+			positions.addIfNotAlreadyThere (position);
+		}
+		DefaultElementComparator<int> comparator;
+		positions.sort (comparator);
+	}
+	
+	void addSpacialPoints (Random& random, int previousPosition, int nextPosition, int numberOfPoints,
+	                       Array<int>& positions, Array<double>& xs, Array<double>& ys, Array<double>& zs,
+	                       Array<int>& interpolationModes, Array<double>& controlPoints)
+	{
+		addPositions (random, previousPosition, nextPosition, numberOfPoints, positions);
+		for (int i = 0; i < positions.size(); ++i)
+		{
+			xs.add (10.0 * random.nextDouble() - 5.0);
+			ys.add (10.0 * random.nextDouble() - 5.0);
+			zs.add (10.0 * random.nextDouble() - 5.0);
+			interpolationModes.add (random.nextInt (3));
+			for (int j = 0; j < 6; ++j)
+			{
+				controlPoints.add (10.0 * random.nextDouble() - 5.0);
+			}
+		}
+	}
+	
+	void addGainPoints (Random& random, int previousPosition, int nextPosition, int numberOfPoints,
+	                    Array<AudioEnvelopePoint>& points)
+	{
+		Array<int> positions;
+		addPositions (random, previousPosition, nextPosition, numberOfPoints, positions);
+		for (int i = 0; i < positions.size(); ++i)
+		{
+			points.add (AudioEnvelopePoint (positions[i], 2.0f * random.nextFloat()));
+		}
+	}
+	
+	/** Sets the points, after making the segment of the last one linear:
+	 It has none, and a patch inserting points after it doesn't give it one. */
+	bool setSpacialEnvelope (AudioRegionMixer& mixer, int regionID,
+	                         Array<int>& positions, Array<double>& xs, Array<double>& ys, Array<double>& zs,
+	                         Array<int>& interpolationModes, Array<double>& controlPoints)
+	{
+		interpolationModes.set (interpolationModes.size() - 1, SpacialEnvelope::interpolationModeLinear);
+		return mixer.setSpacialEnvelopeForRegion (regionID,
+		                                          positions.getRawDataPointer(),
+		                                          xs.getRawDataPointer(),
+		                                          ys.getRawDataPointer(),
+		                                          zs.getRawDataPointer(),
+		                                          positions.size(),
+		                                          interpolationModes.getRawDataPointer(),
+		                                          controlPoints.getRawDataPointer());
+	}
+	
+	/** setGainEnvelopeForRegion takes (and deletes) copies of the points. */
+	bool setGainEnvelope (AudioRegionMixer& mixer, int regionID, const Array<AudioEnvelopePoint>& points)
+	{
+		Array<void*> gainEnvelope;
+		for (int i = 0; i < points.size(); ++i)
+		{
+			gainEnvelope.add (new AudioEnvelopePoint (points.getUnchecked (i)));
+		}
+		return mixer.setGainEnvelopeForRegion (regionID, gainEnvelope);
+	}
+};
+
+static AudioRegionMixerTest audioRegionMixerTest;
+
+#endif
 	
-//END_JUCE_NAMESPACE
\ No newline at end of file
+//END_JUCE_NAMESPACE
@@ -12,48 +12,70 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "AudioSourceAmbipanning.h"
+#include "HOADecoder.h"
+#include "AudioRegionIntervalIndex.h"
+#include "ParallelRegionRenderer.h"
+#include "AudioRegionSnapshot.h"
+#include "AudioRegionReclaimer.h"
+#include "AudioFileCache.h"
+#include "SpacialTrajectory.h"
 
 //==============================================================================
 /**
- An AudioRegion represents a section of an audio file, that should be played at
- a certain position in time. In the GUI, the AudioRegions are represented by
- blocks in the timeline.
- AudioRegion is used exclusively by the AudioRegionMixer.
+ The AudioRegionMixer's own record of a region: The AudioRegion (which is
+ copied to the snapshots for the audio thread) and everything needed to
+ instantiate its AudioSourceAmbipanning at any time.
  */
-struct JUCE_API  AudioRegion
+struct JUCE_API  AudioRegionDescriptor  : public AudioRegion
 {
-    /** The ID of this region. 
-     Must be unique, such that the region can be modified or be deleted later.
-     */
-    int regionID;
-	
-    /** The position in time, where this region starts.
-     Specified in samples.
-     */
-    int startPosition;
-	
-    /** The position in time, where this region ends.
-     To be precise, this specifies the first sample after the end of the region. 
-     Specified in samples.
-     */
-    int endPosition;
-	
-	/** The position in the audio file, where this region starts. Specified in samples. */
-    //int startSampleInTheAudioFile;
-	
-    /** Specifies, at which sample to start in the audio file.
-     The start sample in the audio file = startPosition - startPositionOfAudioFileInTimeline.
-     It should be obvious that this value must be smaller or equal than startPosition.
-     This "strange representation" (e.g. instead of the startSampleInTheAudioFile)
-     has been chosen because it makes the calculation in the AudioRegionMixer easy. */
-    int startPositionOfAudioFileInTimeline;  // must be <= startPosition !!!
-	
-    /** This is a pointer to the positionable audio source that is actually delivering
-     the streams of audio.
-     At this stage, gain- and spacialautomation has already been applied, by the way. */
-    AudioSourceAmbipanning* audioSourceAmbipanning;	
+    String absolutePathToAudioFile;
+    double sampleRateOfTheAudioDevice;
+    /** The length of the audio file in samples. */
+    int64 lengthOfAudioFile;
+    /** Empty, if no gain envelope has been set. */
+    Array<AudioEnvelopePoint> gainEnvelope;
+    /** The number of points of the gainEnvelope as they have been set (the
+     patches refer to them), and the index of the first one: 1, if a copy of
+     it has been put at the position 0. */
+    int numberOfSetGainPoints;
+    int indexOfTheFirstSetGainPoint;
+    /** nullptr, if no spacial envelope has been set. Shared with the
+     AudioSourceAmbipanning of the region. */
+    SpacialEnvelope::Ptr spacialEnvelope;
+    /** The same as for the gainEnvelope (see
+     SpacialEnvelope::createExtended). All points of a trajectory count as
+     set points. */
+    int numberOfSetSpacialPoints;
+    int indexOfTheFirstSetSpacialPoint;
+    /** nullptr, unless the region follows a live input, see
+     AudioRegionMixer::enableLivePositionForRegion. Shared with the
+     AudioSourceAmbipanning of the region. */
+    SpacialPositionMailbox::Ptr livePositionMailbox;
+    double livePositionSmoothingTimeInMs;
+    /** See AudioRegionMixer::setDopplerInterpolationQualityForRegion. */
+    FractionalDelayInterpolator::Quality dopplerInterpolationQuality;
 };
 
+//==============================================================================
+/**
+ How much the envelopes have been simplified, see
+ AudioRegionMixer::setEnvelopeSimplification.
+ */
+struct JUCE_API  EnvelopeSimplificationReport
+{
+    EnvelopeSimplificationReport ()
+      : numberOfSpacialPointsGiven (0),
+        numberOfSpacialPointsKept (0),
+        numberOfGainPointsGiven (0),
+        numberOfGainPointsKept (0)
+    {
+    }
+    
+    int numberOfSpacialPointsGiven;
+    int numberOfSpacialPointsKept;
+    int numberOfGainPointsGiven;
+    int numberOfGainPointsKept;
+};
 
 //==============================================================================
 /**
@@ -61,6 +83,21 @@ struct JUCE_API  AudioRegion
  together.
 
  There are no such things as tracks or busses here.
+
+ The regions are edited (addRegion, modifyRegion, removeRegion,
+ removeAllRegions) on the message thread, which owns the regions and the
+ regionIndex. After every edit, an AudioRegionSnapshot is published to the
+ audio thread. The audio thread is therefore never blocked by an edit, and
+ the removed regions are deleted on the thread of the reclaimer. Several
+ edits can be grouped into one snapshot with beginEditTransaction and
+ commitEditTransaction.
+
+ If a region lookahead is set, a region is only a lightweight
+ AudioRegionDescriptor, as long as it is far away from the playhead. Its
+ AudioSourceAmbipanning (with the buffers of the gain envelope, the doppler
+ effect and the filter) is instantiated and prepared on a background
+ thread when it enters the lookahead window in front of the playhead, and
+ deleted when the playhead has passed it. See setRegionLookahead.
  */
 class JUCE_API  AudioRegionMixer  : public PositionableAudioSource
 {
@@ -101,6 +138,37 @@ public:
                     const String& absolutePathToAudioFile,
                     const double& sampleRateOfTheAudioDevice);
 
+    /**
+     Adds an audio region without waiting for its audio file.
+     
+     Used to load a project with many regions. The region is added right
+     away, but its audio file is opened and checked later, together with
+     the files of the other regions added meanwhile, on several threads
+     (see checkPendingFiles). A region whose file can't be read or doesn't
+     fit the positions is removed again. The region can be modified and its
+     envelopes can be set in the meantime. It is playable as soon as its
+     file has been checked and its processing chain is prepared.
+     
+     The parameters are the same as the ones of addRegion.
+     
+     @return					false, if the regionID already exists or the
+     						positions don't make sense.
+     */
+    bool addRegionAsynchronously (const int& regionID, 
+                                  const int& startPosition, 
+                                  const int& endPosition,
+                                  const int& startPositionOfAudioFileInTimeline, 
+                                  const String& absolutePathToAudioFile,
+                                  const double& sampleRateOfTheAudioDevice);
+    
+    /**
+     Returns the progress of the regions added by addRegionAsynchronously,
+     between 0.0 and 1.0: The number of regions whose files have been
+     checked, divided by the number of regions added since the last time
+     all files were checked. 1.0 if no region is pending.
+     */
+    double getProgressOfAddingRegions ();
+
     /**
      Modifies an audio region to the pool of audio regions.
 
@@ -135,6 +203,33 @@ public:
      Removes all audio regions.
      */	
     void removeAllRegions ();
+    
+    /**
+     Starts an edit transaction.
+     
+     Until the matching commitEditTransaction, the edits of the regions and
+     their envelopes are collected instead of being handed to the audio
+     thread one by one. A transaction can be nested in another one; only
+     the outermost commitEditTransaction publishes the edits.
+     */
+    void beginEditTransaction ();
+    
+    /**
+     Ends an edit transaction. All edits made since the outermost
+     beginEditTransaction are published at once, in between two audio
+     blocks: The audio thread either renders a block with none of them or
+     with all of them.
+     
+     The new envelopes (and the snapshot) are built before the audio
+     thread is locked, only handing them over is done under the lock.
+     
+     One limit: A chain picks up a new envelope only if the queue of the
+     envelopes it has retired has room (see EnvelopeHandoff::update). If
+     the envelopes of a chain are replaced faster than the
+     EnvelopeReclaimer releases the old ones (16 within 50 ms), that
+     chain's envelope follows a few blocks later.
+     */
+    void commitEditTransaction ();
 	
     /**
      Attaches a gain envelope to a region.
@@ -150,15 +245,30 @@ public:
                                 pointers need to be typecasted to pointers to
                                 AudioEnvelopePoint
     				( (AudioEnvelopePoint*)gainEnvelope[pointNumber_StartingAtZero] ).
-    				The gainEnvelope and all involved AudioEnvelopePoints
-    				will be deleted in
-    				AudioSourceGainEnvelope::setGainEnvelope 
-    				or in AudioSourceGainEnvelope::~AudioSourceGainEnvelope,
-    				so you don't have to care about.
+    				All involved AudioEnvelopePoints will be
+    				deleted here, so you don't have to care about.
     
      @return		 	The success of this operation.
      */
     bool setGainEnvelopeForRegion (const int regionID, Array<void*> gainEnvelope);
+    
+    /**
+     Changes a part of the gain envelope of a region: numberOfPointsToRemove
+     points from the startIndex on are replaced by the pointsToInsert. A
+     point is inserted with numberOfPointsToRemove = 0, removed without
+     pointsToInsert and moved by replacing it (or the range it has been moved
+     across).
+     
+     The indices refer to the points as they have been set with
+     setGainEnvelopeForRegion (and changed by the patches since). The points
+     have to stay sorted by their position.
+     
+     @return		 	The success of this operation.
+     */
+    bool patchGainEnvelopeForRegion (const int regionID,
+                                     int startIndex,
+                                     int numberOfPointsToRemove,
+                                     const Array<AudioEnvelopePoint>& pointsToInsert);
 
     /**
      Sets the positions of the connected speakers.
@@ -170,6 +280,73 @@ public:
      */
     void setSpeakerPositions (const Array<SpeakerPosition>& positionOfSpeaker);
     
+    /**
+     Sets the order used in AudioSourceAmbipanning.
+     
+     It is done under the lock, since the lookup table of the
+     AEPGainCalculator might be recalculated.
+     */
+    void setAEPOrder (double order);
+    
+    /**
+     Sets the accuracy of the gain calculations in AudioSourceAmbipanning.
+     See AEPGainCalculator.
+     */
+    void setAEPGainAccuracyMode (AEPGainCalculator::AccuracyMode accuracyMode);
+    
+    /**
+     Sets the gain below which a speaker is skipped in AudioSourceAmbipanning,
+     see AudioSourceAmbipanning::setActiveChannelThreshold.
+     
+     It is done under the lock, since the threshold is read by
+     getNextAudioBlock(..) and by the threads of the ParallelRegionRenderer.
+     */
+    void setAEPActiveChannelThreshold (double thresholdInDB);
+    
+    /**
+     Sets the transformation of the whole scene, see
+     AudioSourceAmbipanning::setSceneTransform.
+     
+     The transformed spacial envelopes of the doppler effects and the low
+     pass filters of all instantiated regions are prepared first. Then
+     they are handed over together with the transformation, under the
+     lock, since the transformation must not change while it's used in
+     getNextAudioBlock(..).
+     */
+    void setSceneTransform (const SceneTransform& sceneTransform);
+    
+    /**
+     Enables or disables the Higher Order Ambisonics (HOA) rendering.
+     
+     If enabled, all regions are encoded to a shared HOA bus of
+     (order+1)^2 channels, which is then decoded to the speakers by the
+     hoaDecoder. The cost per audio block is proportional to
+     regions * (order+1)^2 + (order+1)^2 * speakers instead of
+     regions * speakers. Disabled by default.
+     
+     @param enable  true for the HOA rendering, false for the direct AEP
+                    panning to the speakers.
+     @param order   The order of the bus, 0 to SphericalHarmonics::maximumOrder.
+     */
+    void enableHOARendering (bool enable, int order);
+    
+    /** Returns true, if the HOA rendering is enabled. */
+    bool getHOARenderingState ();
+    
+    /** Enables or disables the max-rE weighting of the HOADecoder. */
+    void enableHOAMaxRE (bool enable);
+    
+    /**
+     If enabled (and if the HOA rendering is enabled), the HOA bus is not
+     decoded. Instead its channels are written to the output channels
+     (as many as there are).
+     Used to bounce the HOA bus.
+     */
+    void enableHOABusOutput (bool enable);
+    
+    /** Returns the number of channels of the HOA bus. */
+    int getNumberOfHOABusChannels ();
+    
     /**
      Attaches a spacial envelope to a region. 
     
@@ -182,20 +359,157 @@ public:
      is used.
     
      @param regionID		The ID of the region.
-     @param spacialEnvelope     A spacialEnvelope is a void*-Array. The void 
-                                pointers need to be typecasted to pointers to
-                                SpacialEnvelopePoint
-    				( (SpacialEnvelopePoint*)spacialEnvelope[pointNumber_StartingAtZero] ).
-    				The spacialEnvelope and all involved
-    				SpacialEnvelopePoints will be deleted in the 
-    				AudioSourceAmbipanning::setSpacialEnvelope
-    				or in the 
-    				AudioSourceAmbipanning::~AudioSourceAmbipanning,
-    				so you don't have to care about.
+     @param spacialEnvelope     The points of the envelope. They are copied
+                                once into a SpacialEnvelope, which is then
+                                shared by all stages of the region's
+                                AudioSourceAmbipanning.
+    
+     @return		 	The success of this operation.
+     */
+    bool setSpacialEnvelopeForRegion (const int& regionID, const Array<SpacialEnvelopePoint>& spacialEnvelope);
     
+    /**
+     Attaches a spacial envelope to a region, given as flat arrays of
+     numberOfPoints elements each (the positions in samples, relative to
+     the start of the audio file, and the x, y and z coordinates).
+     
+     The arrays are copied into a single SpacialEnvelope, i.e. there is
+     only one allocation, no matter how many points there are.
+     
+     The segments are linear, unless interpolationModes are given (see
+     SpacialEnvelope::createExtended): Arcs and Bezier curves need far
+     fewer points than their linear approximation.
+     
+     See the other setSpacialEnvelopeForRegion for the details.
+     */
+    bool setSpacialEnvelopeForRegion (const int& regionID,
+                                      const int* positions,
+                                      const double* x,
+                                      const double* y,
+                                      const double* z,
+                                      int numberOfPoints,
+                                      const int* interpolationModes = nullptr,
+                                      const double* controlPoints = nullptr);
+    
+    /**
+     Attaches a trajectory (a rotation or a random walk, see
+     SpacialTrajectory) to a region. It is evaluated right away, for the
+     duration of the region, and its points become the spacial envelope of
+     the region.
+     
+     @return		 	The success of this operation.
+     */
+    bool setSpacialTrajectoryForRegion (const int& regionID, const SpacialTrajectory& trajectory);
+    
+    /**
+     Changes a part of the spacial envelope of a region: numberOfPointsToRemove
+     points from the startIndex on are replaced by numberOfPointsToInsert
+     points, given as flat arrays like in setSpacialEnvelopeForRegion. A
+     point is inserted with numberOfPointsToRemove = 0, removed with
+     numberOfPointsToInsert = 0 and moved by replacing it (or the range it
+     has been moved across).
+     
+     The indices refer to the points as they have been set with
+     setSpacialEnvelopeForRegion (and changed by the patches since). The
+     points have to stay sorted by their position.
+     
+     The unchanged points are copied in blocks (see
+     SpacialEnvelope::createPatched). The gains and the doppler effect only
+     look at the changed points, so the time this takes depends on the size
+     of the patch rather than on the size of the envelope.
+     
      @return		 	The success of this operation.
      */
-    bool setSpacialEnvelopeForRegion (const int& regionID, Array<SpacialEnvelopePoint> spacialEnvelope);
+    bool patchSpacialEnvelopeForRegion (const int& regionID,
+                                        int startIndex,
+                                        int numberOfPointsToRemove,
+                                        const int* positions,
+                                        const double* x,
+                                        const double* y,
+                                        const double* z,
+                                        int numberOfPointsToInsert,
+                                        const int* interpolationModes = nullptr,
+                                        const double* controlPoints = nullptr);
+    
+    /**
+     Enables the simplification of the envelopes given to
+     setSpacialEnvelopeForRegion, setSpacialTrajectoryForRegion and
+     setGainEnvelopeForRegion. Generated trajectories and imported files
+     often contain many (nearly) collinear points, which cost memory and
+     time on every upload and have to be crossed by the audio thread.
+     
+     The points are dropped with the Ramer-Douglas-Peucker algorithm, as
+     long as the envelope stays within the tolerance at every position in
+     time (see SpacialEnvelope::createSimplified). The first and the last
+     point and the ones at the ends of arcs and Bezier curves are always
+     kept. Patches refer to the points that have been kept.
+     
+     It is disabled by default. Setting it starts a new
+     EnvelopeSimplificationReport.
+     
+     @param spacialToleranceInMeters    The maximum distance between a
+                                        source and where it would have
+                                        been without the simplification.
+                                        It is converted to the unit of the
+                                        coordinates with the unit scale
+                                        factor of the doppler effect. 0
+                                        disables the simplification.
+     @param gainToleranceInDB           The maximum difference of the gain
+                                        in dB (gains below -120 dB count
+                                        as -120 dB). 0 disables the
+                                        simplification.
+     */
+    void setEnvelopeSimplification (double spacialToleranceInMeters,
+                                    double gainToleranceInDB);
+    
+    /** Returns how many points have been given to and kept by the
+     envelope simplification since it has been set. */
+    EnvelopeSimplificationReport getEnvelopeSimplificationReport ();
+    
+    /**
+     Lets a region follow a live input (e.g. a tracker) instead of its
+     spacial envelope.
+     
+     The positions are posted to the returned mailbox (see
+     SpacialPositionMailbox::post) by one thread, as often as they arrive.
+     This neither locks nor allocates, and the envelope isn't touched. The
+     region reads the latest position at the start of every audio block
+     and arrives there at the end of the block (see
+     AudioSourceAmbipanning::setLivePositionMailbox). The doppler effect and
+     the low pass filter follow, too.
+     
+     Calling it again for the same region only changes the smoothing, the
+     mailbox stays the same.
+     
+     @param smoothingTimeInMs   See
+                                AudioSourceAmbipanning::setLivePositionMailbox.
+     @return                    The mailbox, nullptr if the regionID can't
+                                be found.
+     */
+    SpacialPositionMailbox::Ptr enableLivePositionForRegion (const int regionID,
+                                                             double smoothingTimeInMs);
+    
+    /**
+     Returns a region to its spacial envelope, with a fade over one audio
+     block. The positions posted to its mailbox are ignored from now on.
+     
+     @return		 	The success of this operation.
+     */
+    bool disableLivePositionForRegion (const int regionID);
+    
+    /**
+     Sets how the doppler effect of a region reads its audio file in between
+     the samples. Cheap levels for distant or quiet regions leave more CPU
+     time to the others, see FractionalDelayInterpolator::Quality for the
+     cost and the aliasing of each level.
+     
+     The default is FractionalDelayInterpolator::qualityDefault. It only
+     matters if the doppler effect is enabled.
+     
+     @return		 	The success of this operation.
+     */
+    bool setDopplerInterpolationQualityForRegion (const int regionID,
+                                                  FractionalDelayInterpolator::Quality quality);
     
     /**
      Enables or disables the buffering for each individual audio region.
@@ -224,6 +538,62 @@ public:
      Disabled by default.
      */  
     void enableDistanceBasedFiltering(bool enable);
+    
+    /**
+     Sets the number of threads used to render the regions, see
+     ParallelRegionRenderer. The result doesn't depend on the number of
+     threads. By default, only the audio thread is used.
+     
+     @param numberOfThreads     Including the audio thread.
+     @param pinThreadsToCores   Binds each additional thread to its own CPU core.
+     @param realtimePriority    Runs the additional threads with realtime
+                                priority (SCHED_FIFO on Linux).
+     */
+    void setNumberOfRenderThreads (int numberOfThreads,
+                                   bool pinThreadsToCores,
+                                   bool realtimePriority);
+    
+    /**
+     Sets the lookahead window, in which the AudioSourceAmbipanning s of the
+     regions are instantiated.
+     
+     The processing chain of a region is instantiated and prepared on a
+     background thread when the region starts less than lookaheadInSeconds
+     after the playhead. It is deleted when the region lies behind the
+     playhead (or more than twice the lookahead in front of it).
+     After a locate, setNextReadPositionOnAllRegions instantiates the
+     regions at the new position before it returns. The regions at the
+     start of the loop stay instantiated (see setLoopStartPosition), such
+     that they are ready when the playhead wraps around. A region that
+     still isn't instantiated when the playhead reaches it (e.g. if the
+     playhead is moved by other means) is silent until the background
+     thread has caught up.
+     
+     @param lookaheadInSeconds  The default is 0: The chains of all regions
+                                are instantiated when they are added.
+     */
+    void setRegionLookahead (double lookaheadInSeconds);
+    
+    /**
+     Tells the mixer where the playhead jumps to at the end of the loop,
+     such that the regions there are kept instantiated, if a region
+     lookahead is set (see setRegionLookahead).
+     
+     @param loopStartPosition   In samples. -1, if the loop is off.
+     */
+    void setLoopStartPosition (int loopStartPosition);
+    
+    /**
+     If enabled, the processing chains of the regions are instantiated by
+     getNextAudioBlock itself, before the block is rendered. Needed for the
+     non-realtime rendering (bounce to disk), where no region may be silent
+     because the background thread is late.
+     */
+    void enableSynchronousRegionLoading (bool enable);
+    
+    /** Returns the number of regions whose AudioSourceAmbipanning is
+     currently instantiated. */
+    int getNumberOfInstantiatedRegions ();
 	
 
     //==============================================================================
@@ -256,6 +626,10 @@ public:
     But especially if the playhead is relocated back in time, a region
     should be aware of it since all of a sudden it has to deliver sound again.
     This is particular crucial for an AudioFormatReader.
+    
+    If a region lookahead is set, the regions at the new position are
+    instantiated first (this blocks until they are ready, see
+    setRegionLookahead).
      */
     void setNextReadPositionOnAllRegions (int64 newPosition);
 	
@@ -273,16 +647,76 @@ public:
 	
 private:
     //==============================================================================
+    /** Compares the patched envelopes with the ones set as a whole. */
+    friend class AudioRegionMixerTest;
 	
-    /** If the region with the specified regionID is found, it returns
-      * true and writes the position in the regions array to index. */
-    bool findRegion(const int regionID, int& index);
+    /** Returns the region with the specified regionID or nullptr, if there
+      * is no such region. */
+    AudioRegionDescriptor* findRegion(const int regionID);
+    
+    /** Adds the region to the regions and the regionIndex. Has to be called
+     with the regionLock held. */
+    void insertRegion (AudioRegionDescriptor* audioRegionToAdd);
+    
+    /** Returns the spacial envelope of the region with the points of
+     patchSpacialEnvelopeForRegion replaced (and its copies at the start and
+     the end adjusted), or nullptr if the points wouldn't be sorted anymore.
+     The range has to exist. The patch is set to the points that differ
+     from the region's envelope, the indexOfTheFirstSetPoint to the one of
+     the new envelope. Has to be called with the regionLock held. */
+    SpacialEnvelope* createPatchedSpacialEnvelope (const AudioRegionDescriptor& region,
+                                                   int startIndex,
+                                                   int numberOfPointsToRemove,
+                                                   const int* positions,
+                                                   const double* x,
+                                                   const double* y,
+                                                   const double* z,
+                                                   int numberOfPointsToInsert,
+                                                   const int* interpolationModes,
+                                                   const double* controlPoints,
+                                                   SpacialEnvelope::Patch& patch,
+                                                   int& indexOfTheFirstSetPoint);
+    
+    /** Makes the envelope the spacial envelope of the region and hands it to
+     its chain (or remembers it for commitEditTransaction). Has to be called
+     with the regionLock held.
+     
+     Only the part of the envelope that has changed (the patch, if it isn't
+     given it is found with SpacialEnvelope::findPatch) is analysed again.
+     Nothing happens, if the envelope hasn't changed at all. */
+    void attachSpacialEnvelope (AudioRegionDescriptor* region,
+                                SpacialEnvelope* spacialEnvelope,
+                                const SpacialEnvelope::Patch* patch = nullptr);
+    
+    /** Makes the points (the ones set, which are extended to cover the
+     region) the gain envelope of the region and hands it to its chain (or
+     remembers it for commitEditTransaction), if it has changed. Has to be
+     called with the regionLock held. */
+    void attachGainEnvelope (AudioRegionDescriptor* region,
+                             const Array<AudioEnvelopePoint>& setPoints);
+    
+    /** Returns the simplified spacial envelope (and deletes the given one)
+     or the given one, if the simplification is disabled or no point can
+     be dropped. The points from firstSetPoint to lastSetPoint have been
+     set, the others are copies (see SpacialEnvelope::createExtended). Has
+     to be called with the regionLock held. */
+    SpacialEnvelope* simplifySpacialEnvelope (SpacialEnvelope* spacialEnvelope,
+                                              int firstSetPoint,
+                                              int lastSetPoint);
+    
+    /** Drops the points of the sorted gain envelope that aren't needed. Has
+     to be called with the regionLock held. */
+    void simplifyGainEnvelope (Array<AudioEnvelopePoint>& points);
 	
-    /** The array that keeps track of the AudioRegions. The void pointers
-     have to be typecasted to AudioRegion.
-
-     (Exemplar was the 'inputs' in MixerAudioSource.) */	
-    Array<void*> regions;
+    /** Keeps track of the AudioRegions. The key is the regionID. */	
+    HashMap<int, AudioRegionDescriptor*> regions;
+    
+    /** The same regions, sorted by their position in time. Used to find the
+     regions under the playhead. */
+    AudioRegionIntervalIndex regionIndex;
+    
+    /** Renders the regions on several threads, if configured so. */
+    ParallelRegionRenderer parallelRegionRenderer;
     
     /** Specifies the next play position - the start of the next audio block.
      Set by the AudioRegionMixer::setNextReadPosition.
@@ -292,7 +726,8 @@ private:
     /** Equals the endPosition (in samples) of the last audio region. */
     int totalLength;
 
-    AudioSampleBuffer tempBuffer; ///< Used in AudioRegionMixer::getNextAudioBlock.
+    AudioSampleBuffer tempBuffer; ///< Used in AudioRegionMixer::getNextAudioBlock
+                                  ///< as mono scratch buffer for the regions.
     int samplesPerBlockExpected;  ///< Used in AudioRegionMixer::addRegion
 				  ///< (for prepareToPlay(..) of the new region).
     				  ///< Set in AudioRegionMixer::prepareToPlay.
@@ -303,15 +738,214 @@ private:
     /** Tells, if an audioSourceBuffer object is used in front of the audio file
      reader of each audio region. */
     bool bufferingEnabled;
+    /** Applied to every AudioSourceAmbipanning, when it's instantiated. */
+    bool dopplerEffectEnabled;
+    /** Applied to every AudioSourceAmbipanning, when it's instantiated. */
+    bool lowPassFilterEnabled;
 
     /** Used in AudioRegionMixer::setGainEnvelopeForRegion. */
     AudioEnvelopePointComparator audioEnvelopePointComparator; 
-
-    /** Used in AudioRegionMixer::setSpacialEnvelopeForRegion. */
-    SpacialEnvelopePointComparator spacialEnvelopePointComparator; 
     
-    /** Used for scope locking in AudioRegionMixer::setSpeakerPositions. */
+    /** See setEnvelopeSimplification. Guarded by the regionLock. */
+    double spacialSimplificationToleranceInMeters;
+    double gainSimplificationToleranceInDB;
+    EnvelopeSimplificationReport envelopeSimplificationReport;
+    
+    /** The decoder of the hoaBus. */
+    HOADecoder hoaDecoder;
+    /** The regions are added to this bus, if hoaRenderingEnabled. */
+    AudioSampleBuffer hoaBus;
+    bool hoaRenderingEnabled;
+    bool hoaBusOutputEnabled;
+    
+    /** Used for scope locking in AudioRegionMixer::setSpeakerPositions
+     and the other methods that change the rendering settings. Held by the
+     audio thread for a whole block. Not used by the region edits, except
+     by commitEditTransaction. */
     CriticalSection lock;
+    
+    /**
+     Builds a new AudioRegionSnapshot from the regionIndex, publishes it
+     to the audio thread and hands the old one (and the
+     AudioSourceAmbipanning s of the removed regions) over to the reclaimer.
+     Called after every edit of the regions, with the regionLock held.
+     During an edit transaction, this is postponed to commitEditTransaction.
+     */
+    void publishSnapshot (const Array<AudioSourceAmbipanning*>& removedSources);
+    
+    /** Builds an AudioRegionSnapshot of the regionIndex. Has to be called
+     with the regionLock held. */
+    AudioRegionSnapshot* createSnapshot () const;
+    
+    /** The regions, as used by the audio thread. Never nullptr. */
+    Atomic<AudioRegionSnapshot*> currentSnapshot;
+    /** Incremented by the audio thread at the beginning and at the end of
+     each block, see AudioRegionReclaimer. */
+    Atomic<int> audioThreadEpoch;
+    /** Deletes the old snapshots and the removed regions. */
+    AudioRegionReclaimer reclaimer;
+    
+    /** The nesting depth of the open edit transactions, see
+     beginEditTransaction. While it's not 0, publishSnapshot only takes
+     note of the edits. */
+    int editTransactionDepth;
+    /** Set by publishSnapshot during a transaction. */
+    bool snapshotIsOutdated;
+    /** The sources handed to publishSnapshot during a transaction. */
+    Array<AudioSourceAmbipanning*> sourcesRemovedDuringTransaction;
+    /** The instantiated regions whose envelopes have been set during a
+     transaction. The envelopes are handed to their chains on commit. */
+    Array<int> regionsWithChangedGainEnvelope;
+    Array<int> regionsWithChangedSpacialEnvelope;
+    
+    //==============================================================================
+    /** Calls AudioRegionMixer::loadRegions periodically and whenever it's
+     notified. */
+    class RegionLoader  : public Thread
+    {
+    public:
+        RegionLoader (AudioRegionMixer& owner);
+        ~RegionLoader ();
+        void run ();
+        
+    private:
+        AudioRegionMixer& owner;
+    };
+    
+    /** Opens an audio file on the loadingThreadPool and gets its length. */
+    class FileCheckJob  : public ThreadPoolJob
+    {
+    public:
+        FileCheckJob (const String& absolutePathToAudioFile);
+        JobStatus runJob ();
+        
+        const String absolutePathToAudioFile;
+        /** -1, if the file can't be read. */
+        int64 lengthOfAudioFile;
+    };
+    
+    /** Builds and prepares the processing chain of a region on the
+     loadingThreadPool. */
+    class ChainBuildJob  : public ThreadPoolJob
+    {
+    public:
+        ChainBuildJob ();
+        JobStatus runJob ();
+        
+        int regionID;
+        String absolutePathToAudioFile;
+        double sampleRateOfTheAudioDevice;
+        int readPosition;
+        bool buffering;
+        int samplesPerBlock;
+        double sampleRate;
+        /** The result, nullptr if the file can't be read. */
+        AudioSourceAmbipanning* chain;
+    };
+    
+    /** Calculates the SpacialGainTable of a spacial envelope on the
+     loadingThreadPool. */
+    class GainTableBuildJob  : public ThreadPoolJob
+    {
+    public:
+        GainTableBuildJob (int regionID, const SpacialEnvelope::Ptr& envelope);
+        JobStatus runJob ();
+        
+        const int regionID;
+        const SpacialEnvelope::Ptr envelope;
+        /** The result, nullptr if the settings of the panning have changed
+         meanwhile. */
+        SpacialGainTable::Ptr table;
+    };
+    
+    /**
+     Checks the audio files of the regions added by addRegionAsynchronously,
+     each file once and several files in parallel. Removes the regions
+     whose file can't be read or doesn't fit. Called by the regionLoader
+     (or by getNextAudioBlock, if the synchronous region loading is
+     enabled).
+     */
+    void checkPendingFiles ();
+    
+    /**
+     Calls checkPendingFiles, updateRegionChains and
+     updateSpacialGainTables with the regionLoadingLock held. Called by the
+     regionLoader, by getNextAudioBlock (if the synchronous region loading
+     is enabled) and after a locate - one at a time, such that the chain of
+     a region isn't built twice.
+     */
+    void loadRegions ();
+    
+    /**
+     Instantiates the AudioSourceAmbipanning s of the regions in the
+     lookahead window (and in the one at the loopStartPosition) and
+     deletes the ones of the regions behind the playhead. The chains are built and prepared in parallel on the
+     loadingThreadPool, without holding the regionLock, and each one is
+     published as soon as it's ready. Called by the regionLoader (or by
+     getNextAudioBlock, if the synchronous region loading is enabled).
+     */
+    void updateRegionChains ();
+    
+    /** Attaches the chain of the finished job to its region, if the region
+     still needs it. Has to be called with the regionLock held.
+     @return    false, if the chain isn't needed anymore. */
+    bool attachRegionChain (const ChainBuildJob& job, int configurationVersion);
+    
+    /**
+     Calculates the gains at the points of the spacial envelopes of the
+     instantiated regions whose chains don't have an up to date
+     SpacialGainTable (because the envelope or the settings of the panning
+     have changed) on the loadingThreadPool, and hands the tables to the
+     chains. Until then, the chains calculate the gains themselves. Called
+     by the regionLoader (or by getNextAudioBlock, if the synchronous
+     region loading is enabled).
+     */
+    void updateSpacialGainTables ();
+    
+    /** Creates the processing chain of the region (without the settings of
+     the mixer, see applyRegionSettings). nullptr, if the file can't be
+     read. */
+    static AudioSourceAmbipanning* createRegionChain (const String& absolutePathToAudioFile,
+                                                      double sampleRateOfTheAudioDevice,
+                                                      bool enableBuffering);
+    
+    /** Applies the envelopes of the region and the settings of the mixer to
+     a newly instantiated chain. Has to be called with the regionLock held. */
+    void applyRegionSettings (const AudioRegionDescriptor& region,
+                              AudioSourceAmbipanning* audioSourceAmbipanning);
+    
+    /** Hands a copy of the gain envelope of the region to its chain. */
+    static void applyGainEnvelope (const AudioRegionDescriptor& region,
+                                   AudioSourceAmbipanning* audioSourceAmbipanning);
+    
+    /** The lookahead in samples, 0 if disabled. */
+    int getLookaheadInSamples () const;
+    
+    /** Held by every method that reads or changes the regions, and while the
+     regionLoader attaches or detaches a chain. Never by the audio thread. */
+    CriticalSection regionLock;
+    /** Held by loadRegions. Taken before the regionLock. */
+    CriticalSection regionLoadingLock;
+    double regionLookaheadInSeconds;
+    bool synchronousRegionLoading;
+    /** See setLoopStartPosition. */
+    int loopStartPosition;
+    /** Incremented whenever the speakers or the HOA rendering change, such
+     that a chain built meanwhile can be updated. */
+    int renderConfigurationVersion;
+    /** The regions whose chains are instantiated. */
+    Array<int> instantiatedRegionIDs;
+    /** The regions added by addRegionAsynchronously whose files haven't been
+     checked yet. Their lengthOfAudioFile is -1. */
+    Array<int> regionsWithPendingFileCheck;
+    /** For getProgressOfAddingRegions. Reset when no region is pending. */
+    int numberOfRegionsAddedAsynchronously;
+    int numberOfRegionsChecked;
+    /** Opens the files and prepares the chains. Most of the time is spent
+     waiting for the disk (and for the buffering threads), so there are
+     more threads than cores. */
+    ThreadPool loadingThreadPool;
+    ScopedPointer<RegionLoader> regionLoader;
 	
 	JUCE_LEAK_DETECTOR (AudioRegionMixer);
 };
@@ -0,0 +1,92 @@
+/*
+ *  AudioRegionReclaimer.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120829.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "AudioRegionReclaimer.h"
+
+
+AudioRegionReclaimer::AudioRegionReclaimer (const Atomic<int>& audioThreadEpoch_)
+:   Thread ("AudioRegionReclaimer"),
+    audioThreadEpoch (audioThreadEpoch_)
+{
+    startThread (3);
+}
+
+AudioRegionReclaimer::~AudioRegionReclaimer ()
+{
+    stopThread (2000);
+
+    for (int i = 0; i < retiredObjects.size(); ++i)
+    {
+        deleteObjects (retiredObjects.getUnchecked (i));
+    }
+    retiredObjects.clear();
+}
+
+void AudioRegionReclaimer::retire (AudioRegionSnapshot* oldSnapshot,
+                                   const Array<AudioSourceAmbipanning*>& removedSources)
+{
+    RetiredObjects* objects = new RetiredObjects();
+    objects->snapshot = oldSnapshot;
+    objects->sources = removedSources;
+    objects->epoch = audioThreadEpoch.get();
+
+    const ScopedLock sl (retiredObjectsLock);
+    retiredObjects.add (objects);
+    notify();
+}
+
+void AudioRegionReclaimer::run ()
+{
+    while (! threadShouldExit())
+    {
+        wait (50);
+        deleteRetiredObjects();
+    }
+}
+
+void AudioRegionReclaimer::deleteRetiredObjects ()
+{
+    const int currentEpoch = audioThreadEpoch.get();
+
+    Array<RetiredObjects*> objectsToDelete;
+    {
+        const ScopedLock sl (retiredObjectsLock);
+        while (retiredObjects.size() != 0)
+        {
+            RetiredObjects* objects = retiredObjects.getUnchecked (0);
+            const bool audioThreadIsDone = (objects->epoch % 2) == 0
+                                           || objects->epoch != currentEpoch;
+            if (! audioThreadIsDone)
+            {
+                // The later ones have been retired during the same block.
+                break;
+            }
+            objectsToDelete.add (objects);
+            retiredObjects.remove (0);
+        }
+    }
+
+    // Deleting an AudioSourceAmbipanning might take a while (files are
+    // closed, buffering threads are notified), so it's done outside of
+    // the lock.
+    for (int i = 0; i < objectsToDelete.size(); ++i)
+    {
+        deleteObjects (objectsToDelete.getUnchecked (i));
+    }
+}
+
+void AudioRegionReclaimer::deleteObjects (RetiredObjects* objects)
+{
+    delete objects->snapshot;
+    for (int i = 0; i < objects->sources.size(); ++i)
+    {
+        delete objects->sources.getUnchecked (i);
+    }
+    delete objects;
+}
@@ -0,0 +1,92 @@
+/*
+ *  AudioRegionReclaimer.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120829.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __AUDIOREGIONRECLAIMER_HEADER__
+#define __AUDIOREGIONRECLAIMER_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AudioRegionSnapshot.h"
+
+//==============================================================================
+/**
+ Deletes the AudioRegionSnapshot s and the AudioSourceAmbipanning s that
+ the AudioRegionMixer doesn't need anymore, on a background thread, once
+ the audio thread is done with them.
+
+ The audio thread increments the audioThreadEpoch at the beginning and at
+ the end of each audio block (before it picks up the current snapshot and
+ after it's done with it). The epoch is odd while a block is rendered.
+ When an object is retired (after the new snapshot has been published),
+ the epoch is read:
+ <ul>
+ <li> If it's even, the audio thread isn't rendering. The next block will
+      use the new snapshot, so the object can be deleted.
+ <li> If it's odd, the audio thread might still use the old snapshot. The
+      object can be deleted as soon as the epoch has changed.
+ </ul>
+ The audio thread never waits for anything here.
+ */
+class JUCE_API  AudioRegionReclaimer  : public Thread
+{
+public:
+    /**
+     Constructor. Starts the background thread.
+
+     @param audioThreadEpoch    Incremented by the audio thread, see the
+                                class description.
+     */
+    explicit AudioRegionReclaimer (const Atomic<int>& audioThreadEpoch);
+
+    /**
+     Destructor. Stops the background thread and deletes all retired
+     objects - the audio thread must not use them anymore.
+     */
+    ~AudioRegionReclaimer ();
+
+    /**
+     Hands over objects that have to be deleted. Has to be called after the
+     new snapshot has been published.
+
+     @param oldSnapshot      The snapshot that has been replaced, may be
+                             nullptr.
+     @param removedSources   The AudioSourceAmbipanning s of removed regions.
+     */
+    void retire (AudioRegionSnapshot* oldSnapshot,
+                 const Array<AudioSourceAmbipanning*>& removedSources);
+
+    /** Implements the Thread method. */
+    void run ();
+
+private:
+    struct RetiredObjects
+    {
+        AudioRegionSnapshot* snapshot;
+        Array<AudioSourceAmbipanning*> sources;
+        /** The audioThreadEpoch when they were retired. */
+        int epoch;
+    };
+
+    /** Deletes all retired objects the audio thread is done with. */
+    void deleteRetiredObjects ();
+
+    static void deleteObjects (RetiredObjects* retiredObjects);
+
+    const Atomic<int>& audioThreadEpoch;
+
+    /** In the order of retirement. */
+    Array<RetiredObjects*> retiredObjects;
+    /** Used between the thread that calls retire and the background thread,
+     never by the audio thread. */
+    CriticalSection retiredObjectsLock;
+
+	JUCE_LEAK_DETECTOR (AudioRegionReclaimer);
+};
+
+
+#endif   // __AUDIOREGIONRECLAIMER_HEADER__
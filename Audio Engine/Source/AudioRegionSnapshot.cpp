@@ -0,0 +1,93 @@
+/*
+ *  AudioRegionSnapshot.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120829.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "AudioRegionSnapshot.h"
+
+
+AudioRegionSnapshot::AudioRegionSnapshot ()
+:   numberOfRegions (0)
+{
+}
+
+AudioRegionSnapshot::AudioRegionSnapshot (const Array<AudioRegion*>& regionsSortedByStartPosition)
+:   numberOfRegions (regionsSortedByStartPosition.size())
+{
+    regions.allocate (jmax (1, numberOfRegions), false);
+    maxEndPositions.allocate (jmax (1, numberOfRegions), false);
+
+    for (int i = 0; i < numberOfRegions; ++i)
+    {
+        regions[i] = *regionsSortedByStartPosition.getUnchecked (i);
+    }
+    if (numberOfRegions > 0)
+    {
+        calculateMaxEndPositions (0, numberOfRegions);
+    }
+
+    regionsInThisChunk.ensureStorageAllocated (numberOfRegions);
+    regionsToRender.ensureStorageAllocated (numberOfRegions);
+}
+
+AudioRegionSnapshot::~AudioRegionSnapshot ()
+{
+}
+
+int AudioRegionSnapshot::size () const
+{
+    return numberOfRegions;
+}
+
+void AudioRegionSnapshot::findRegions (int startOfChunk, int endOfChunk, Array<const AudioRegion*>& result) const
+{
+    findRegions (0, numberOfRegions, startOfChunk, endOfChunk, result);
+}
+
+int AudioRegionSnapshot::calculateMaxEndPositions (int begin, int end)
+{
+    const int middle = (begin + end) / 2;
+    int maxEndPosition = regions[middle].endPosition;
+    if (begin < middle)
+    {
+        maxEndPosition = jmax (maxEndPosition, calculateMaxEndPositions (begin, middle));
+    }
+    if (middle + 1 < end)
+    {
+        maxEndPosition = jmax (maxEndPosition, calculateMaxEndPositions (middle + 1, end));
+    }
+    maxEndPositions[middle] = maxEndPosition;
+    return maxEndPosition;
+}
+
+void AudioRegionSnapshot::findRegions (int begin, int end, int startOfChunk, int endOfChunk, Array<const AudioRegion*>& result) const
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    // All regions in this range ended before the chunk.
+    const int middle = (begin + end) / 2;
+    if (maxEndPositions[middle] < startOfChunk)
+    {
+        return;
+    }
+
+    findRegions (begin, middle, startOfChunk, endOfChunk, result);
+
+    // If this region starts after the chunk, so do all after it.
+    const AudioRegion& region = regions[middle];
+    if (region.startPosition < endOfChunk)
+    {
+        if (region.endPosition >= startOfChunk)
+        {
+            result.add (&region);
+        }
+        findRegions (middle + 1, end, startOfChunk, endOfChunk, result);
+    }
+}
@@ -0,0 +1,132 @@
+/*
+ *  AudioRegionSnapshot.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120829.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __AUDIOREGIONSNAPSHOT_HEADER__
+#define __AUDIOREGIONSNAPSHOT_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AudioSourceAmbipanning.h"
+#include "ParallelRegionRenderer.h"
+
+//==============================================================================
+/**
+ An AudioRegion represents a section of an audio file, that should be played at
+ a certain position in time. In the GUI, the AudioRegions are represented by
+ blocks in the timeline.
+ AudioRegion is used exclusively by the AudioRegionMixer (and the
+ AudioRegionSnapshot, which holds copies of them).
+ */
+struct JUCE_API  AudioRegion
+{
+    /** The ID of this region. 
+     Must be unique, such that the region can be modified or be deleted later.
+     */
+    int regionID;
+	
+    /** The position in time, where this region starts.
+     Specified in samples.
+     */
+    int startPosition;
+	
+    /** The position in time, where this region ends.
+     To be precise, this specifies the first sample after the end of the region. 
+     Specified in samples.
+     */
+    int endPosition;
+	
+	/** The position in the audio file, where this region starts. Specified in samples. */
+    //int startSampleInTheAudioFile;
+	
+    /** Specifies, at which sample to start in the audio file.
+     The start sample in the audio file = startPosition - startPositionOfAudioFileInTimeline.
+     It should be obvious that this value must be smaller or equal than startPosition.
+     This "strange representation" (e.g. instead of the startSampleInTheAudioFile)
+     has been chosen because it makes the calculation in the AudioRegionMixer easy. */
+    int startPositionOfAudioFileInTimeline;  // must be <= startPosition !!!
+	
+    /** This is a pointer to the positionable audio source that is actually delivering
+     the streams of audio.
+     At this stage, gain- and spacialautomation has already been applied, by the way.
+     nullptr, as long as the AudioRegionMixer hasn't instantiated it (see
+     AudioRegionMixer::setRegionLookahead). */
+    AudioSourceAmbipanning* audioSourceAmbipanning;	
+};
+
+
+//==============================================================================
+/**
+ An immutable copy of all AudioRegion s of the AudioRegionMixer, as seen by
+ the audio thread.
+
+ The AudioRegionMixer builds a new snapshot after every edit and publishes
+ it with an atomic pointer swap. The audio thread picks up the current
+ snapshot at the start of each audio block, such that the regions can be
+ edited without locking the audio thread out. The old snapshot (and the
+ AudioSourceAmbipanning s of removed regions) are deleted by the
+ AudioRegionReclaimer, once the audio thread doesn't use them anymore.
+
+ The regions are stored sorted by their start position. They form an
+ implicit balanced binary tree (the middle element of a range is the root
+ of the range), where each element knows the largest end position of its
+ subtree - like in the AudioRegionIntervalIndex, which the snapshots are
+ built from. Building a snapshot is O(n), findRegions is O((k+1) log n).
+ */
+class JUCE_API  AudioRegionSnapshot
+{
+public:
+    /** Constructor. Creates an empty snapshot. */
+    AudioRegionSnapshot ();
+
+    /**
+     Constructor.
+
+     @param regionsSortedByStartPosition    The regions are copied. See
+                                            AudioRegionIntervalIndex::getAllRegions.
+     */
+    explicit AudioRegionSnapshot (const Array<AudioRegion*>& regionsSortedByStartPosition);
+
+    /** Destructor. The AudioSourceAmbipanning s of the regions are not deleted. */
+    ~AudioRegionSnapshot ();
+
+    /** Returns the number of regions. */
+    int size () const;
+
+    /**
+     Finds all regions with startPosition < endOfChunk and
+     endPosition >= startOfChunk and appends them to result (sorted by their
+     start position). Like AudioRegionIntervalIndex::findRegions.
+     */
+    void findRegions (int startOfChunk, int endOfChunk, Array<const AudioRegion*>& result) const;
+
+    /** Scratch space for the audio thread, used in
+     AudioRegionMixer::getNextAudioBlock. Storage for size() elements is
+     allocated in the constructor, such that the audio thread doesn't have
+     to allocate memory. (A snapshot is only used by one audio thread at a
+     time.) */
+    mutable Array<const AudioRegion*> regionsInThisChunk;
+    /** See regionsInThisChunk. */
+    mutable Array<ParallelRegionRenderer::RegionToRender> regionsToRender;
+
+private:
+    /** Calculates the maxEndPositions of the range [begin, end) and
+     returns the largest one. */
+    int calculateMaxEndPositions (int begin, int end);
+
+    void findRegions (int begin, int end, int startOfChunk, int endOfChunk, Array<const AudioRegion*>& result) const;
+
+    int numberOfRegions;
+    HeapBlock<AudioRegion> regions;
+    /** The largest endPosition in the subtree of each element. */
+    HeapBlock<int> maxEndPositions;
+
+	JUCE_LEAK_DETECTOR (AudioRegionSnapshot);
+};
+
+
+#endif   // __AUDIOREGIONSNAPSHOT_HEADER__
@@ -95,15 +95,7 @@ double SpeakerPosition::getZ ()
 AudioSourceAmbipanning::AudioSourceAmbipanning (AudioFormatReader* const audioFormatReader,
 												double sampleRateOfTheAudioDevice,
                                                 bool enableBuffering)
-    : monoBuffer (1,0),
-      nextPlayPosition (-1),
-      audioBlockEndPosition (-2),
-      previousSpacialPoint (nullptr),
-	  nextSpacialPoint (nullptr),
-	  nextSpacialPointIndex (1),
-	  newSpacialEnvelopeSet (false),
-	  numberOfSpeakersChanged (false),
-      audioSourceGainEnvelope (audioFormatReader, 
+    : audioSourceGainEnvelope (audioFormatReader, 
                                sampleRateOfTheAudioDevice, 
                                enableBuffering),
       dopplerEffectEnabled (false),
@@ -116,7 +108,24 @@ AudioSourceAmbipanning::AudioSourceAmbipanning (AudioFormatReader* const audioFo
                                                 sampleRateOfTheAudioDevice),
       appropriateAudioSource (&audioSourceGainEnvelope),
       sampleRate (sampleRateOfTheAudioDevice),
-      samplesPerBlockExpected(512)
+      samplesPerBlockExpected(512),
+      monoBuffer (1,0),
+	  newSpacialEnvelopeSet (false),
+	  transformedSpacialEnvelopePrepared (false),
+	  numberOfSpeakersChanged (false),
+	  sceneTransformVersionInUse (sceneTransformVersion),
+      nextPlayPosition (-1),
+      audioBlockEndPosition (-2),
+	  livePositionSmoothingTimeInMs (0.0),
+	  livePositionActive (false),
+	  numberOfChannelFactors (0),
+	  numberOfActiveChannels (0),
+	  recordGainSegments (false),
+	  gainSegmentStorage (nullptr),
+	  numberOfGainSegments (0),
+	  postedGainSegmentCapacity (0),
+	  numberOfRecordedChannels (0),
+	  preparedMonoBuffer (1, 0)
 {
 	DEB("AudioSourceAmbipanning: constructor called.");
     
@@ -127,19 +136,22 @@ AudioSourceAmbipanning::AudioSourceAmbipanning (AudioFormatReader* const audioFo
     // enableLowPassFilter(true);
 	
 	// Define an initial spacial envelope.
-	// It is also neccessary to set up the newSpacialEnvelope,
-	// because the reallocateMemoryForTheArrays() function sets
-	// newSpacialEnvelopeSet = true. (Which leads to the use
-	// of newSpacialEnvelope in getNextAudioBlock(..)).
-	newSpacialEnvelope.add(new SpacialEnvelopePoint(0,      // time (in samples)
-                                                0.0,      // x
-                                                0.0,      // y
-                                                0.0));	// z);
-	spacialEnvelope.addCopiesOf(newSpacialEnvelope);
+	// It is picked up right away, because the reallocateMemoryForTheArrays()
+	// function sets numberOfSpeakersChanged = true. (Which leads to the use
+	// of spacialEnvelope in getNextAudioBlock(..)).
+	newSpacialEnvelope = new SpacialEnvelope(0.0,      // x
+                                             0.0,      // y
+                                             0.0);     // z
+	spacialEnvelopeHandoff.post(newSpacialEnvelope.getObject());
+	spacialEnvelopeHandoff.update();
+	spacialEnvelope = spacialEnvelopeHandoff.get();
+	// The doppler effect and the low pass filter start at the origin, too,
+	// untransformed (see prepareSceneTransform).
+	newTransformedSpacialEnvelope = newSpacialEnvelope;
 	
 	constantSpacialPosition = true;
 	reallocateMemoryForTheArrays();
-	  // this will also set newSpacialEnvelopeSet = true;
+	  // this will also set numberOfSpeakersChanged = true;
 }
 
 AudioSourceAmbipanning::~AudioSourceAmbipanning()
@@ -157,6 +169,11 @@ void AudioSourceAmbipanning::prepareToPlay (int samplesPerBlockExpected_, double
                                                            sampleRate_);
     sampleRate = sampleRate_;
     samplesPerBlockExpected = samplesPerBlockExpected_;
+    
+    // Not needed if the regions are rendered serially, but it avoids
+    // memory allocation in prepareNextAudioBlock.
+    preparedMonoBuffer.setSize (1, samplesPerBlockExpected, false, false, true);
+    reserveGainSegments (*newSpacialEnvelope);
 }
 
 /** Implementation of the AudioSource method. */
@@ -174,10 +191,6 @@ void AudioSourceAmbipanning::getNextAudioBlock (const AudioSourceChannelInfo& in
     // DEB("AudioSourceAmbipanning::getNextAudioBlock: nextPlayPosition = " + String(nextPlayPosition))
     // DEB("AudioSourceAmbipanning::getNextAudioBlock: info.numSamples = " + String(info.numSamples))
     
-	audioBlockEndPosition = nextPlayPosition + info.numSamples; // used here and in setNextReadPosition.
-								    // It referes to the first sample after
-								    // the current audio block.
-	
 	// only the first channel of info will be filled with audio.
 	// (Since only mono sources are allowed.)
 	monoBuffer.setDataToReferTo(info.buffer->getArrayOfChannels(), 1, info.buffer->getNumSamples());
@@ -185,66 +198,171 @@ void AudioSourceAmbipanning::getNextAudioBlock (const AudioSourceChannelInfo& in
 	monoInfo.numSamples = info.numSamples;
 	monoInfo.buffer = &monoBuffer;
 	
+	updateLivePosition (info.numSamples);
     appropriateAudioSource->getNextAudioBlock(monoInfo);
 	  // the gain envelope and maybe the dopplerfx and maybe the low pass filter
       // are now applied.
 	
-	// copy the samples of the first channel (with index 0) to the other channels
-	for (int chan = 1; chan < info.buffer->getNumChannels(); ++chan)
+	// The mono signal is read from the first channel and the panned signals
+	// are written back to all channels (the first channel last).
+	panMonoSignal (info, info.buffer->getSampleData (0, info.startSample), false);
+	
+	// Channels without a speaker are silent.
+	for (int channel = numberOfChannelFactors; channel < info.buffer->getNumChannels(); ++channel)
+	{
+		info.buffer->clear (channel, info.startSample, info.numSamples);
+	}
+}
+
+void AudioSourceAmbipanning::addNextAudioBlockTo (const AudioSourceChannelInfo& info,
+                                                  AudioSampleBuffer& monoScratchBuffer)
+{
+	jassert (monoScratchBuffer.getNumSamples() >= info.numSamples);
+	
+	// The mono signal is rendered to the scratch buffer. The destination
+	// buffer isn't touched until the panned signals are added to it.
+	renderMonoSignal (monoScratchBuffer, info.numSamples);
+	
+	panMonoSignal (info, monoScratchBuffer.getSampleData (0), true);
+}
+
+void AudioSourceAmbipanning::prepareNextAudioBlock (const AudioSourceChannelInfo& info)
+{
+	if (info.numSamples > preparedMonoBuffer.getNumSamples())
+	{
+		// The block is larger than announced in prepareToPlay, this
+		// allocates memory.
+		jassertfalse;
+		preparedMonoBuffer.setSize (1, info.numSamples, false, false, true);
+	}
+	renderMonoSignal (preparedMonoBuffer, info.numSamples);
+	
+	// A larger storage has been posted by setSpacialEnvelope (or
+	// prepareToPlay). The old one is released by the EnvelopeReclaimer.
+	if (gainSegmentStorageHandoff.update())
+	{
+		gainSegmentStorage = gainSegmentStorageHandoff.get();
+	}
+	
+	// panMonoSignal goes through the spacial envelope as usual, but the
+	// segments are only recorded.
+	numberOfGainSegments = 0;
+	numberOfRecordedChannels = 0;
+	recordGainSegments = true;
+	panMonoSignal (info, preparedMonoBuffer.getSampleData (0), true);
+	recordGainSegments = false;
+}
+
+void AudioSourceAmbipanning::addPreparedAudioBlockTo (const AudioSourceChannelInfo& info,
+                                                      int firstChannel,
+                                                      int endChannel) const
+{
+	const float* monoSamples = preparedMonoBuffer.getSampleData (0);
+	const GainSegmentStorage& storage = *gainSegmentStorage;
+	endChannel = jmin (endChannel, numberOfRecordedChannels);
+	
+	// The same calls of GainRampKernels::addWithRamp as in
+	// applyChannelFactors, restricted to the given channels.
+	for (int i = 0; i < numberOfGainSegments; ++i)
 	{
-		info.buffer->copyFrom(chan, info.startSample, *info.buffer, 0, info.startSample, info.numSamples);
+		const GainSegment& segment = storage.segments[i];
+		const float* startFactors = storage.factors + 2 * i * storage.numberOfChannels;
+		const float* factorDeltas = segment.hasRamp ? startFactors + storage.numberOfChannels : nullptr;
+		
+		for (int channel = firstChannel; channel < endChannel; ++channel)
+		{
+			const float startFactor = startFactors[channel];
+			const float endFactor = factorDeltas != nullptr ? startFactor + segment.numSamples * factorDeltas[channel] : startFactor;
+			if (isChannelActive (startFactor, endFactor))
+			{
+				const float delta = factorDeltas != nullptr ? factorDeltas[channel] : 0.0f;
+				GainRampKernels::addWithRamp (info.buffer->getSampleData (channel, info.startSample + segment.offset),
+				                              monoSamples + segment.offset, segment.numSamples,
+				                              startFactor, delta);
+			}
+		}
 	}
-	  // all channels are filled with the same mono signal - the mono source with
-	  // the gain envelope applied.
+}
+
+inline void AudioSourceAmbipanning::renderMonoSignal (AudioSampleBuffer& monoDestination, int numSamples)
+{
+	monoBuffer.setDataToReferTo(monoDestination.getArrayOfChannels(), 1, monoDestination.getNumSamples());
+	monoInfo.startSample = 0;
+	monoInfo.numSamples = numSamples;
+	monoInfo.buffer = &monoBuffer;
+	
+	updateLivePosition (numSamples);
+    appropriateAudioSource->getNextAudioBlock(monoInfo);
+	  // the gain envelope and maybe the dopplerfx and maybe the low pass filter
+      // are now applied.
+}
+
+void AudioSourceAmbipanning::panMonoSignal (const AudioSourceChannelInfo& info,
+                                            const float* monoSamples,
+                                            bool addToDestination)
+{
+	audioBlockEndPosition = nextPlayPosition + info.numSamples; // used here and in setNextReadPosition.
+								    // It referes to the first sample after
+								    // the current audio block.
 	
+	// The gain factor arrays hold numberOfChannelFactors elements.
+	const int numberOfChannels = jmin (info.buffer->getNumChannels(), numberOfChannelFactors);
+	
+
+	const bool sceneTransformChanged = sceneTransformVersionInUse != sceneTransformVersion;
+
+	// A new spacial envelope has been set with setSpacialEnvelope(..). The
+	// old one is released by the EnvelopeReclaimer, not here.
+	if (spacialEnvelopeHandoff.update())
+	{
+		spacialEnvelope = spacialEnvelopeHandoff.get();
+		newSpacialEnvelopeSet = true;
+	}
+
+	// A live input overrides the spacial envelope (and a new one, which is
+	// faded in when the live input ends).
+	if (livePositionActive)
+	{
+		panToLivePosition (info, monoSamples, numberOfChannels, addToDestination);
+		return;
+	}
 
 	// This will be executed when a new spacial envelope has been set with 
-    // setSpacialEnvelope(..) or when the number of speakers has changed.
+    // setSpacialEnvelope(..), when the number of speakers has changed or
+    // when a new scene transform has been set.
     // We will apply a fade from the old spacialEnvelope (from the currentPosition,
     // with the corresponding array channelFactorAtPreviousPoint) to the new one
     // (to the currentPosition + info.numSamples, with the corresponding array
     // channelFactor).
-	if (newSpacialEnvelopeSet || numberOfSpeakersChanged)
+	if (newSpacialEnvelopeSet || numberOfSpeakersChanged || sceneTransformChanged)
 	{
-		if (newSpacialEnvelopeSet)
+		if (newSpacialEnvelopeSet || sceneTransformChanged)
 		{
-			channelFactorAtPreviousPoint = channelFactorAtNextPoint;
+			copyChannelFactors (channelFactorAtPreviousPoint, channelFactorAtNextPoint);
                 // This is the channelFactor for the current position.
                 // Used in the 
-                // info.buffer->applyGainRamp(..) a couple of lines below to 
+                // GainRampKernels::multiplyWithRamp(..) a couple of lines below to 
                 // generate a smooth transition from the current spacial value 
                 // to the spacial value of the new envelope.
-            spacialEnvelope.clear();
-            spacialEnvelope.addCopiesOf(newSpacialEnvelope);
 		}
+		sceneTransformVersionInUse = sceneTransformVersion;
 		
-		if (spacialEnvelope.size() == 1) 
+		if (spacialEnvelope->size() == 1) 
             // by the way: size() == 0 can't be, this was
 			// checked in setGainEnvelope(..)
 		{
 			constantSpacialPosition = true;
-			nextSpacialPoint = spacialEnvelope[0];
-			double x = nextSpacialPoint->getX();
-			double y = nextSpacialPoint->getY();
-			double z = nextSpacialPoint->getZ();
+			double x = spacialEnvelope->getX(0);
+			double y = spacialEnvelope->getY(0);
+			double z = spacialEnvelope->getZ(0);
 			double r; // radius, will be calculated in calculationsForAEP(..)
 			double distanceGain; // will be calculated in calculationsForAEP(..)
 			double modifiedOrder; // will be calculated in calculationsForAEP(..)
 			calculationsForAEP(x, y, z, r, distanceGain, modifiedOrder);
 			
-			double xs, ys, zs; // speaker coordinates, used in the upcoming for-loop
-			double factor;  // used in the upcoming for-loop. Only here to 
-			                // make the code more readable.
-			for (int channel = 0; channel < info.buffer->getNumChannels(); channel++) 
-			{
-				xs = positionOfSpeaker[channel].getX();
-				ys = positionOfSpeaker[channel].getY();
-				zs = positionOfSpeaker[channel].getZ();
-				
-				// The ambipanning calculation
-				factor = pow(0.5 + 0.5*(x*xs + y*ys + z*zs), modifiedOrder) * distanceGain;
-				channelFactor.set(channel, factor);
-			}
+			// The ambipanning calculation
+			calculateChannelFactors(x, y, z, modifiedOrder, distanceGain,
+									channelFactor, numberOfChannels);
 		}
 		
 		// if the envelope contains more than 1 point
@@ -252,30 +370,33 @@ void AudioSourceAmbipanning::getNextAudioBlock (const AudioSourceChannelInfo& in
 		{
 			constantSpacialPosition = false;
             
-            // Set up the variables for the
-            // next call of getNextAudioBlock(..)
-            nextSpacialPointIndex = 1;
-			prepareForNewPosition(nextPlayPosition,
-                                  &nextSpacialPointIndex);
-            channelFactor = channelFactorAtNextPoint;
+            // Set up the variables for the next call of getNextAudioBlock(..):
+            // The fade ends at the first sample of the next audio block,
+            // where the regular case continues (positionOfNextPoint ==
+            // audioBlockEndPosition).
+			prepareForNewPosition(audioBlockEndPosition);
+            copyChannelFactors (channelFactor, channelFactorAtNextPoint);
                 // The channelFactor is used a couple of lines below
-                // for the applyGainRamp(...). 
+                // for the gain ramp. 
 		}
 		
 		// finally, the start and end values are prepared and the fading 
         // can be calculated.
-		for (int channel = 0; channel < info.buffer->getNumChannels(); ++channel)
+		if (info.numSamples > 0)
 		{
-			info.buffer->applyGainRamp(channel, 
-									   info.startSample, 
-									   info.numSamples, 
-									   channelFactorAtPreviousPoint[channel], 
-									   channelFactor[channel]);
+			const float oneOverNumSamples = 1.0f / info.numSamples;
+			for (int channel = 0; channel < numberOfChannels; ++channel)
+			{
+				channelFactorDelta[channel] = (channelFactor[channel] - channelFactorAtPreviousPoint[channel]) * oneOverNumSamples;
+			}
+			applyChannelFactors (info, monoSamples, 0, info.numSamples,
+								 channelFactorAtPreviousPoint, channelFactorDelta,
+								 numberOfChannels, addToDestination);
 		}
 		newSpacialEnvelopeSet = false;
 		numberOfSpeakersChanged = false;
         
-        channelFactorAtNextPoint = channelFactor;
+        copyChannelFactors (channelFactorAtNextPoint, channelFactor);
             // It now corresponds to the first sample of the next audio block.
 	}
 	
@@ -285,29 +406,24 @@ void AudioSourceAmbipanning::getNextAudioBlock (const AudioSourceChannelInfo& in
 		// If there is only one point in the spacial envelope
 		if (constantSpacialPosition)
 		{
-			for (int channel = 0; channel < info.buffer->getNumChannels(); ++channel)
-			{
-				info.buffer->applyGain(channel, info.startSample, info.numSamples, channelFactor[channel]);
-				  // arguments
-				  //    channel = channel
-				  //    startSample = info.startSample
-				  //    numSamples = info.numSamples
-				  //    gain = channelFactor[channel]
-			}
+			applyChannelFactors (info, monoSamples, 0, info.numSamples,
+								 channelFactor, nullptr,
+								 numberOfChannels, addToDestination);
 		}
 		
 		// If there are multiple points in the spacial envelope
 		else
 		{		
 			currentPosition = nextPlayPosition;
+			const SpacialEnvelope& envelope = *spacialEnvelope;
+			// If there is a table, the gains at the points don't have to
+			// be calculated.
+			const SpacialGainTable* gainTable = getUsableSpacialGainTable();
 
             positionOfPreviousPoint = positionOfNextPoint;
             // We want the array channelFactorAtPreviousPoint to correspond
             // to the first sample of this audio block.
-            channelFactorAtPreviousPoint = channelFactorAtNextPoint;
-            // positionOfPreviousPoint == currentPosition.
-            // Therefore we can set
-            channelFactor = channelFactorAtPreviousPoint;
+            copyChannelFactors (channelFactorAtPreviousPoint, channelFactorAtNextPoint);
             
             if (currentPosition != positionOfPreviousPoint)
             {
@@ -315,152 +431,106 @@ void AudioSourceAmbipanning::getNextAudioBlock (const AudioSourceChannelInfo& in
                     "points in the spacial envelope.) currentPosition != "
                     "positionOfPreviousPoint !!! FIX IT!!!")
             }
-			
-			for (int channel = 0; channel < info.buffer->getNumChannels(); ++channel) 
-			{
-				// Point sample (an Array<float*>) to the first sample in the audio block.
-				sample.set(channel, info.buffer->getSampleData(channel, info.startSample)); 
-				  // First argument: channelNumber = channel
-				  // Second argument: sampleOffset = info.startSample
-			}				
             
             // Go through all spacial points lying in this audio block.
 			while (true)
 			{
-                // positionOfPreviousPoint == currentPosition and
-                // channelFactor == channelFactorAtPreviousPoint.
+                // positionOfPreviousPoint == currentPosition.
                 
 				// If the next spacial point is outside of the current audio block
 				// (audioBlockEndPosition is the position of to the first sample
 				//  after the current block)
-				if (nextSpacialPoint->getPosition() >= audioBlockEndPosition )
+				const int previous = spacialEnvelopeCursor.getPreviousIndex();
+				const int next = spacialEnvelopeCursor.getNextIndex();
+				bool nextSpacialPointIsOutsideOfThisBlock = envelope.getPosition(next) >= audioBlockEndPosition;
+				
+				// The gains of the table are linear in between the points. In a
+				// curved segment, the gains at the end of the block are
+				// calculated from the coordinates on the curve instead.
+				if (gainTable != nullptr
+				    && (! nextSpacialPointIsOutsideOfThisBlock || envelope.isLinear(previous)))
 				{
-                    // The array channelFactorAtNextPoint should correspond
-                    // to the first sample of the next audio block. We have
-                    // to figure out its values.
-                    // ------------------------------------------------------
-                    positionOfNextPoint = audioBlockEndPosition;
-                    // First we need to determine the coordinates at that
-                    // moment in time.
-                    double relativePositionBetweenTheSpacialPoints
-                        = double(positionOfNextPoint - previousSpacialPoint->getPosition())/double(nextSpacialPoint->getPosition() - previousSpacialPoint->getPosition());
-                    double x = previousSpacialPoint->getX() + relativePositionBetweenTheSpacialPoints * (nextSpacialPoint->getX() - previousSpacialPoint->getX());
-                    double y = previousSpacialPoint->getY() + relativePositionBetweenTheSpacialPoints * (nextSpacialPoint->getY() - previousSpacialPoint->getY());
-                    double z = previousSpacialPoint->getZ() + relativePositionBetweenTheSpacialPoints * (nextSpacialPoint->getZ() - previousSpacialPoint->getZ());
-                    // Now we can calculate r, the distanceGain as well as the
-                    // modifiedOrder for this next point.
-                    double r; // radius, will be calculated in calculationsForAEP(..)
-					double distanceGain; // will be calculated in calculationsForAEP(..)
-					double modifiedOrder; // will be calculated in calculationsForAEP(..)	
-					calculationsForAEP(x, y, z, r, distanceGain, modifiedOrder);
-                    // Finally we can determine the channelFactorAtNextPoint
-                    // (as well as the channelFactorDelta).
-                    double distance = positionOfNextPoint - positionOfPreviousPoint;
-                    double xs, ys, zs; // speaker coordinates, used in the upcoming for-loop
-					double factor;  // used in the upcoming for-loop
-					for (int channel = 0; channel < info.buffer->getNumChannels(); channel++) 
+					if (nextSpacialPointIsOutsideOfThisBlock)
 					{
-						// calculate the values of the float-array channelFactorAtNextSpacialPoint
-                        SpeakerPosition& posOfSpeaker = positionOfSpeaker.getReference(channel);
-						xs = posOfSpeaker.getX();
-						ys = posOfSpeaker.getY();
-						zs = posOfSpeaker.getZ();
-						factor = pow(0.5 + 0.5*(x*xs + y*ys + z*zs), modifiedOrder) * distanceGain;
-						channelFactorAtNextPoint.set(channel, factor);
-						
-						// calculate the values of the float-array channelFactorDelta
-						channelFactorDelta.set(channel, 
-                                               (channelFactorAtNextPoint[channel] 
-                                                - channelFactorAtPreviousPoint[channel])/distance);
+						// The gains at the first sample of the next audio block.
+						positionOfNextPoint = audioBlockEndPosition;
+						gainTable->interpolateGains(previous, positionOfNextPoint, channelFactorAtNextPoint);
 					}
-
-                    // The main task of this method:
-                    // Fill the samples.
-					while (currentPosition != audioBlockEndPosition) // Step through the samples
+					else
 					{
-						for (int channel = 0; channel < info.buffer->getNumChannels(); channel++) // Step through the channels
-						{
-							*sample[channel] *= channelFactor[channel];
-							sample.set(channel, sample[channel] + 1);
-                                // Point to the next sample.
-							channelFactor.set(channel, channelFactor[channel] + channelFactorDelta[channel]);
-						}
-                        ++currentPosition;
+						positionOfNextPoint = envelope.getPosition(next);
+						copyChannelFactors (channelFactorAtNextPoint, gainTable->getGains(next));
 					}
-					break;
 				}
-				
-				// if the next gain point is inside the current audio block
 				else
 				{
-                    // Reminder:
-                    // positionOfPreviousPoint == currentPosition
-                    // channelFactor == channelFactorAtPreviousPoint;
-                    
-                    // The array channelFactorAtNextPoint should correspond
-                    // to the position of the nextSpacialPoint. We have
-                    // to figure out its values.
-                    // ------------------------------------------------------
-                    positionOfNextPoint = nextSpacialPoint->getPosition();
-                    // First we need to determine the coordinates at that
-                    // moment in time.
-                    double x = nextSpacialPoint->getX();
-                    double y = nextSpacialPoint->getY();
-                    double z = nextSpacialPoint->getZ();
+					double x, y, z;
+					if (nextSpacialPointIsOutsideOfThisBlock)
+					{
+                        // The array channelFactorAtNextPoint should correspond
+                        // to the first sample of the next audio block. We have
+                        // to figure out its values.
+                        // ------------------------------------------------------
+                        positionOfNextPoint = audioBlockEndPosition;
+                        // First we need to determine the coordinates at that
+                        // moment in time (on the line, the arc or the curve).
+                        envelope.getCoordinatesAt(previous, positionOfNextPoint, x, y, z);
+					}
+					// if the next spacial point is inside the current audio block
+					else
+					{
+                        // The array channelFactorAtNextPoint should correspond
+                        // to the position of the nextSpacialPoint.
+                        positionOfNextPoint = envelope.getPosition(next);
+                        x = envelope.getX(next);
+                        y = envelope.getY(next);
+                        z = envelope.getZ(next);
+					}
+					
                     // Now we can calculate r, the distanceGain as well as the
                     // modifiedOrder for this next point.
                     double r; // radius, will be calculated in calculationsForAEP(..)
 					double distanceGain; // will be calculated in calculationsForAEP(..)
 					double modifiedOrder; // will be calculated in calculationsForAEP(..)	
 					calculationsForAEP(x, y, z, r, distanceGain, modifiedOrder);
-                    // Finally we determine the channelFactorAtNextPoint
-                    // (as well as the channelFactorDelta).
-                    double distance = positionOfNextPoint - positionOfPreviousPoint;
-                    double xs, ys, zs; // speaker coordinates, used in the upcoming for-loop
-					double factor;  // used in the upcoming for-loop
-					for (int channel = 0; channel < info.buffer->getNumChannels(); channel++) 
-					{
-						// calculate the values of the float-array channelFactorAtNextSpacialPoint
-                        SpeakerPosition& posOfSpeaker = positionOfSpeaker.getReference(channel);
-						xs = posOfSpeaker.getX();
-						ys = posOfSpeaker.getY();
-						zs = posOfSpeaker.getZ();
-						factor = pow(0.5 + 0.5*(x*xs + y*ys + z*zs), modifiedOrder) * distanceGain;
-						channelFactorAtNextPoint.set(channel, factor);
-						
-						// calculate the values of the float-array channelFactorDelta
-						channelFactorDelta.set(channel, 
-                                               (channelFactorAtNextPoint[channel] 
-                                                - channelFactorAtPreviousPoint[channel])/distance);
-					}
-
-                    
-					// Apply the gain envelope up to the sample before the nextSpacialPoint
-					while (currentPosition < positionOfNextPoint)
-					{
-						for (int channel = 0; channel < info.buffer->getNumChannels(); channel++) 
-						{
-							*sample[channel] *= channelFactor[channel];
-							sample.set(channel, sample[channel] + 1);
-							channelFactor.set(channel, channelFactor[channel] + channelFactorDelta[channel]);
-						}
-                        currentPosition++;
-					}
-					// currentPosition == positionOfNextPoint;
-                    
-				    // currentPosition tells you the next sample to apply the gain to.
-					
-                    // Set the spacial points.
-					previousSpacialPoint = nextSpacialPoint;
-					nextSpacialPointIndex++;
-					nextSpacialPoint = spacialEnvelope[nextSpacialPointIndex];
-                    
-                    // Set the channelFactorAtPreviousPoint and the channelFactor
-                    // array.
-                    positionOfPreviousPoint = positionOfNextPoint; // = currentPosition
-                    channelFactorAtPreviousPoint = channelFactorAtNextPoint;
-                    channelFactor = channelFactorAtPreviousPoint;
+                    // Finally we can determine the channelFactorAtNextPoint.
+					calculateChannelFactors(x, y, z, modifiedOrder, distanceGain,
+											channelFactorAtNextPoint, numberOfChannels);
 				}
+				
+                // The channelFactorDelta. Counted from the currentPosition
+                // (== positionOfPreviousPoint, see above) and never beyond the
+                // end of this audio block.
+                const int numberOfSamplesInThisSegment = jlimit (0, audioBlockEndPosition - currentPosition,
+                                                                 positionOfNextPoint - currentPosition);
+                const float oneOverDistance = numberOfSamplesInThisSegment > 0 ? 1.0f / numberOfSamplesInThisSegment : 0.0f;
+				for (int channel = 0; channel < numberOfChannels; channel++) 
+				{
+					// calculate the values of the float-array channelFactorDelta
+					channelFactorDelta[channel] = (channelFactorAtNextPoint[channel] - channelFactorAtPreviousPoint[channel]) * oneOverDistance;
+				}
+				
+                // The main task of this method:
+                // Apply the gain ramps up to the sample before the next point.
+				applyChannelFactors (info, monoSamples,
+									 currentPosition - nextPlayPosition,
+									 numberOfSamplesInThisSegment,
+									 channelFactorAtPreviousPoint, channelFactorDelta,
+									 numberOfChannels, addToDestination);
+                currentPosition = positionOfNextPoint;
+			    // currentPosition tells you the next sample to apply the gain to.
+				
+				if (nextSpacialPointIsOutsideOfThisBlock)
+				{
+					break;
+				}
+				
+                // Go to the next spacial point.
+				spacialEnvelopeCursor.moveToNextPoint(envelope);
+                
+                // Set the channelFactorAtPreviousPoint.
+                positionOfPreviousPoint = positionOfNextPoint; // = currentPosition
+                copyChannelFactors (channelFactorAtPreviousPoint, channelFactorAtNextPoint);
 			}			
 		}
 	}	
@@ -472,8 +542,8 @@ void AudioSourceAmbipanning::setNextReadPosition (int64 newPosition)
     // DEB("AudioSourceAmbipanning.setNextReadPosition: newPosition = " + String(newPosition))
     
 	// if the newPosition is not at the expected position, right after the end
-	// of the last audio block
-	if (audioBlockEndPosition != newPosition && !constantSpacialPosition)
+	// of the last audio block (a live position just continues)
+	if (audioBlockEndPosition != newPosition && !constantSpacialPosition && !livePositionActive)
 	{
 		DEB("AudioSourceAmbipanning.setNextReadPosition: newPosition = "
             + String(newPosition))
@@ -482,9 +552,7 @@ void AudioSourceAmbipanning::setNextReadPosition (int64 newPosition)
 		
 		// figure out between which audioEnvelopePoints we are right now
 		// and set up all variables needed by getNextAudioBlock(..)
-		nextSpacialPointIndex = 1;
-        prepareForNewPosition(nextPlayPosition,
-                              &nextSpacialPointIndex);;	
+        prepareForNewPosition(newPosition);
 	}
 	
 	nextPlayPosition = newPosition;
@@ -549,34 +617,30 @@ void AudioSourceAmbipanning::enableDopplerEffect (bool enable)
     enableLowPassFilter(lowPassFilterEnabled);
 }
 
-void AudioSourceAmbipanning::setGainEnvelope (Array<void*> newGainEnvelope)
+void AudioSourceAmbipanning::setDopplerInterpolationQuality (FractionalDelayInterpolator::Quality quality)
+{
+    audioSourceDopplerEffect.setInterpolationQuality(quality);
+}
+
+void AudioSourceAmbipanning::setGainEnvelope (const Array<AudioEnvelopePoint>& newGainEnvelope)
 {
 	audioSourceGainEnvelope.setGainEnvelope(newGainEnvelope);
 }
 
-void AudioSourceAmbipanning::setSpacialEnvelope(const Array<SpacialEnvelopePoint>& newSpacialEnvelope_)
+void AudioSourceAmbipanning::setGainEnvelope (GainEnvelope* newGainEnvelope)
+{
+	audioSourceGainEnvelope.setGainEnvelope(newGainEnvelope);
+}
+
+void AudioSourceAmbipanning::setSpacialEnvelope(const SpacialEnvelope::Ptr& newSpacialEnvelope_,
+                                                const SpacialEnvelope::Patch* patch)
 {
 	DEB("AudioSourceAmbipanning: setSpacialEnvelope called")
 	
-	if (newSpacialEnvelope_.size() != 0)
+	if (newSpacialEnvelope_ != nullptr)
 	{			
-		// Copy the elements from the Array newSpacialEnvelope_ to the
-        // OwnedArray newSpacialEnvelope.
-        newSpacialEnvelope.clear();
-        for (int i=0; i!=newSpacialEnvelope_.size(); ++i)
-        {
-            newSpacialEnvelope.add(new SpacialEnvelopePoint(newSpacialEnvelope_[i]));
-        }
-        
-		newSpacialEnvelopeSet = true; // when set, the spacial value 
-		// is faded from the old spacial envelope to the new one, in 
-		// the interval of one audio block in the getNextAudioBlock(..).
-        
-        // Let the doppler effect audio source also know about the new
-        // spacial envelope.
-        audioSourceDopplerEffect.setSpacialEnvelope(newSpacialEnvelope_);
-        audioSourceLowPassFilter.setSpacialEnvelope(newSpacialEnvelope_);
-        audioSourceLowPassFilterAndDopplerEffect.setSpacialEnvelope(newSpacialEnvelope_);
+		prepareSpacialEnvelope(newSpacialEnvelope_, patch);
+		postSpacialEnvelope();
 	}
 	else
 	{
@@ -584,20 +648,348 @@ void AudioSourceAmbipanning::setSpacialEnvelope(const Array<SpacialEnvelopePoint
 	}
 }
 
+void AudioSourceAmbipanning::prepareSpacialEnvelope (const SpacialEnvelope::Ptr& newSpacialEnvelope_,
+                                                     const SpacialEnvelope::Patch* patch)
+{
+	jassert (newSpacialEnvelope_ != nullptr);
+	
+	// The envelope is shared, not copied.
+	newSpacialEnvelope = newSpacialEnvelope_;
+	
+	// Before the envelope, such that the audio thread picks up the
+	// storage for its segments no later than the envelope itself.
+	reserveGainSegments (*newSpacialEnvelope);
+	
+	// The closest points of the doppler effect.
+	prepareTransformedSpacialEnvelope(getSceneTransform(), patch);
+}
+
+void AudioSourceAmbipanning::postSpacialEnvelope ()
+{
+	// Hand it over to the audio thread, the spacial value is faded from
+	// the old spacial envelope to the new one, in the interval of one
+	// audio block in the getNextAudioBlock(..).
+	spacialEnvelopeHandoff.post(newSpacialEnvelope.getObject());
+	
+	// Let the doppler effect audio source also know about the new
+	// spacial envelope.
+	postTransformedSpacialEnvelope();
+}
+
+void AudioSourceAmbipanning::prepareSceneTransform (const SceneTransform& newSceneTransform)
+{
+	if (newSceneTransform != stageSceneTransform)
+	{
+		prepareTransformedSpacialEnvelope(newSceneTransform, nullptr);
+	}
+}
+
+void AudioSourceAmbipanning::postSceneTransform ()
+{
+	if (transformedSpacialEnvelopePrepared)
+	{
+		postTransformedSpacialEnvelope();
+	}
+}
+
+void AudioSourceAmbipanning::prepareTransformedSpacialEnvelope (const SceneTransform& newSceneTransform,
+                                                                const SpacialEnvelope::Patch* patch)
+{
+	SpacialEnvelope* transformedSpacialEnvelope = nullptr;
+	if (newSceneTransform.isIdentity())
+	{
+		newTransformedSpacialEnvelope = newSpacialEnvelope;
+	}
+	else
+	{
+		// The points that haven't changed are already transformed, if the
+		// transformation is still the same.
+		if (patch != nullptr && newSceneTransform == stageSceneTransform)
+		{
+			transformedSpacialEnvelope = SpacialEnvelope::createTransformed(*newSpacialEnvelope,
+			                                                                newSceneTransform,
+			                                                                *newTransformedSpacialEnvelope,
+			                                                                *patch);
+		}
+		if (transformedSpacialEnvelope == nullptr)
+		{
+			transformedSpacialEnvelope = SpacialEnvelope::createTransformed(*newSpacialEnvelope,
+			                                                                newSceneTransform);
+		}
+		newTransformedSpacialEnvelope = transformedSpacialEnvelope;
+	}
+	
+	// The patch only applies to the envelope transformed the same way.
+	if (newSceneTransform != stageSceneTransform)
+	{
+		patch = nullptr;
+		stageSceneTransform = newSceneTransform;
+	}
+	audioSourceDopplerEffect.prepareSpacialEnvelope(newTransformedSpacialEnvelope, patch);
+	transformedSpacialEnvelopePrepared = true;
+}
+
+void AudioSourceAmbipanning::postTransformedSpacialEnvelope ()
+{
+	audioSourceDopplerEffect.postSpacialEnvelope();
+	audioSourceLowPassFilter.setSpacialEnvelope(newTransformedSpacialEnvelope);
+	audioSourceLowPassFilterAndDopplerEffect.setSpacialEnvelope(newTransformedSpacialEnvelope);
+	transformedSpacialEnvelopePrepared = false;
+}
+
+void AudioSourceAmbipanning::setLivePositionMailbox (const SpacialPositionMailbox::Ptr& mailbox,
+                                                     double smoothingTimeInMs)
+{
+	if (mailbox != nullptr)
+	{
+		// No memory allocation in the doppler effect later on.
+		audioSourceDopplerEffect.prepareForLivePositions();
+	}
+	
+	livePositionMailbox = mailbox;
+	livePositionSmoothingTimeInMs = jmax (0.0, smoothingTimeInMs);
+}
+
+inline void AudioSourceAmbipanning::updateLivePosition (int numSamples)
+{
+	if (livePositionMailbox != nullptr)
+	{
+		double x, y, z;
+		if (! livePositionMailbox->read (x, y, z))
+		{
+			// Nothing has been posted yet.
+			return;
+		}
+		
+		if (! livePositionActive || livePositionSmoothingTimeInMs == 0.0)
+		{
+			livePosition = SpacialPosition (x, y, z);
+		}
+		else
+		{
+			// A one pole low pass filter, evaluated once per block.
+			const double smoothingTimeInSamples = livePositionSmoothingTimeInMs * 0.001 * sampleRate;
+			const double factor = 1.0 - exp (-numSamples / smoothingTimeInSamples);
+			livePosition.x += factor * (x - livePosition.x);
+			livePosition.y += factor * (y - livePosition.y);
+			livePosition.z += factor * (z - livePosition.z);
+		}
+		livePositionActive = true;
+		
+		// The panning transforms the livePosition itself, the other stages
+		// get it in the transformed scene, like their spacial envelope.
+		// The sceneTransform is only changed under the lock of the
+		// AudioRegionMixer, which is held here.
+		SpacialPosition transformedLivePosition (livePosition);
+		sceneTransform.apply (transformedLivePosition.x, transformedLivePosition.y, transformedLivePosition.z);
+		audioSourceDopplerEffect.setLivePosition (transformedLivePosition);
+		audioSourceLowPassFilter.setLivePosition (transformedLivePosition);
+		audioSourceLowPassFilterAndDopplerEffect.setLivePosition (transformedLivePosition);
+	}
+	else if (livePositionActive)
+	{
+		// Back to the spacial envelope, with a fade.
+		livePositionActive = false;
+		newSpacialEnvelopeSet = true;
+		audioSourceDopplerEffect.endLivePositions();
+		audioSourceLowPassFilter.endLivePositions();
+		audioSourceLowPassFilterAndDopplerEffect.endLivePositions();
+	}
+}
+
+inline void AudioSourceAmbipanning::panToLivePosition (const AudioSourceChannelInfo& info,
+                                                       const float* monoSamples,
+                                                       int numberOfChannels,
+                                                       bool addToDestination)
+{
+	// The gains at the start of this block are the ones at the end of the
+	// previous block (after a change of the speakers, the arrays have been
+	// reallocated and the gains fade in).
+	if (! numberOfSpeakersChanged)
+	{
+		copyChannelFactors (channelFactorAtPreviousPoint, channelFactorAtNextPoint);
+	}
+	numberOfSpeakersChanged = false;
+	sceneTransformVersionInUse = sceneTransformVersion;
+	
+	// The gains at the first sample of the next block.
+	double x = livePosition.x;
+	double y = livePosition.y;
+	double z = livePosition.z;
+	double r; // radius, will be calculated in calculationsForAEP(..)
+	double distanceGain; // will be calculated in calculationsForAEP(..)
+	double modifiedOrder; // will be calculated in calculationsForAEP(..)
+	calculationsForAEP(x, y, z, r, distanceGain, modifiedOrder);
+	calculateChannelFactors(x, y, z, modifiedOrder, distanceGain,
+	                        channelFactorAtNextPoint, numberOfChannels);
+	positionOfNextPoint = audioBlockEndPosition;
+	
+	if (info.numSamples > 0)
+	{
+		const float oneOverNumSamples = 1.0f / info.numSamples;
+		for (int channel = 0; channel < numberOfChannels; ++channel)
+		{
+			channelFactorDelta[channel] = (channelFactorAtNextPoint[channel] - channelFactorAtPreviousPoint[channel]) * oneOverNumSamples;
+		}
+		applyChannelFactors (info, monoSamples, 0, info.numSamples,
+		                     channelFactorAtPreviousPoint, channelFactorDelta,
+		                     numberOfChannels, addToDestination);
+	}
+}
+
+SpacialGainTable* AudioSourceAmbipanning::createSpacialGainTable (const SpacialEnvelope::Ptr& envelope)
+{
+	if (envelope == nullptr || envelope->size() < 2)
+	{
+		return nullptr;
+	}
+	
+	SpacialGainTable* table;
+	{
+		const ScopedLock sl (spacialGainSettingsLock);
+		
+		const int numberOfChannels = hoaEncodingEnabled
+		                             ? SphericalHarmonics::getNumberOfChannels(hoaOrder)
+		                             : positionOfSpeaker.size();
+		table = new SpacialGainTable (envelope, numberOfChannels, spacialGainSettingsVersion);
+	}
+	
+	if (! calculateSpacialGains(*table, 0, envelope->size()))
+	{
+		// It would be outdated anyway.
+		delete table;
+		return nullptr;
+	}
+	table->calculateDeltas();
+	
+	return table;
+}
+
+SpacialGainTable* AudioSourceAmbipanning::createPatchedSpacialGainTable (const SpacialGainTable& table,
+                                                                         const SpacialEnvelope::Ptr& envelope,
+                                                                         const SpacialEnvelope::Patch& patch)
+{
+	if (envelope == nullptr || envelope->size() < 2)
+	{
+		return nullptr;
+	}
+	
+	const SpacialEnvelope& oldEnvelope = *table.getEnvelope();
+	jassert (envelope->size() == oldEnvelope.size() - patch.numberOfRemovedPoints + patch.numberOfInsertedPoints);
+	
+	SpacialGainTable* patchedTable;
+	{
+		const ScopedLock sl (spacialGainSettingsLock);
+		
+		if (table.getSettingsVersion() != spacialGainSettingsVersion)
+		{
+			return nullptr;
+		}
+		patchedTable = new SpacialGainTable (envelope, table.getNumberOfChannels(), spacialGainSettingsVersion);
+	}
+	
+	// The unchanged points keep their gains (and their deltas, except the
+	// one in front of the patch).
+	const int endOfThePatch = patch.startIndex + patch.numberOfRemovedPoints;
+	patchedTable->copyPoints(table, 0, 0, patch.startIndex);
+	patchedTable->copyPoints(table, endOfThePatch,
+	                         patch.startIndex + patch.numberOfInsertedPoints,
+	                         oldEnvelope.size() - endOfThePatch);
+	
+	if (! calculateSpacialGains(*patchedTable, patch.startIndex, patch.numberOfInsertedPoints))
+	{
+		delete patchedTable;
+		return nullptr;
+	}
+	patchedTable->calculateDeltas(patch.startIndex - 1, patch.numberOfInsertedPoints + 1);
+	
+	return patchedTable;
+}
+
+bool AudioSourceAmbipanning::calculateSpacialGains (SpacialGainTable& table,
+                                                    int firstPointIndex,
+                                                    int numberOfPoints)
+{
+	const SpacialEnvelope& envelope = *table.getEnvelope();
+	
+	for (int i = firstPointIndex; i < firstPointIndex + numberOfPoints; ++i)
+	{
+		// The lock is only held for one point at a time, such that the
+		// setters (which might be called with the lock of the audio
+		// thread held) never have to wait long.
+		const ScopedLock sl (spacialGainSettingsLock);
+		
+		if (table.getSettingsVersion() != spacialGainSettingsVersion)
+		{
+			return false;
+		}
+		
+		double x = envelope.getX(i);
+		double y = envelope.getY(i);
+		double z = envelope.getZ(i);
+		double r; // radius, will be calculated in calculationsForAEP(..)
+		double distanceGain; // will be calculated in calculationsForAEP(..)
+		double modifiedOrder; // will be calculated in calculationsForAEP(..)
+		calculationsForAEP(x, y, z, r, distanceGain, modifiedOrder);
+		calculateChannelFactors(x, y, z, modifiedOrder, distanceGain,
+		                        table.getGains(i), table.getNumberOfChannels());
+	}
+	return true;
+}
+
+bool AudioSourceAmbipanning::hasSpacialGainTableFor (const SpacialEnvelope::Ptr& envelope) const
+{
+	return spacialGainTable != nullptr
+	       && spacialGainTable->getEnvelope() == envelope.getObject()
+	       && spacialGainTable->getSettingsVersion() == spacialGainSettingsVersion;
+}
+
+void AudioSourceAmbipanning::setSpacialGainTable (const SpacialGainTable::Ptr& spacialGainTable_)
+{
+	spacialGainTable = spacialGainTable_;
+}
+
+inline const SpacialGainTable* AudioSourceAmbipanning::getUsableSpacialGainTable () const
+{
+	const SpacialGainTable* table = spacialGainTable.getObject();
+	if (table != nullptr
+	    && table->getEnvelope() == spacialEnvelope
+	    && table->getSettingsVersion() == spacialGainSettingsVersion
+	    && table->getNumberOfChannels() == numberOfChannelFactors)
+	{
+		return table;
+	}
+	return nullptr;
+}
+
 void AudioSourceAmbipanning::reallocateMemoryForTheArrays ()
 {
-    channelFactorAtPreviousPoint.clear();
-    channelFactorAtNextPoint.clear();
-    channelFactor.clear();
-    channelFactorDelta.clear();
+    if (hoaEncodingEnabled)
+    {
+        numberOfChannelFactors = SphericalHarmonics::getNumberOfChannels(hoaOrder);
+    }
+    else
+    {
+        numberOfChannelFactors = positionOfSpeaker.size();
+    }
     
-    int indexToInsertAt = 0;
-    double newElement = 0.0;
-    int numberOfTimesToInsertIt = positionOfSpeaker.size();
-    channelFactorAtPreviousPoint.insertMultiple(indexToInsertAt, newElement,numberOfTimesToInsertIt);
-    channelFactorAtNextPoint.insertMultiple(indexToInsertAt, newElement,numberOfTimesToInsertIt);
-    channelFactor.insertMultiple(indexToInsertAt, newElement,numberOfTimesToInsertIt);
-    channelFactorDelta.insertMultiple(indexToInsertAt, newElement,numberOfTimesToInsertIt);		
+    // All factors are set to zero.
+    channelFactorAtPreviousPoint.allocate (numberOfChannelFactors, true);
+    channelFactorAtNextPoint.allocate (numberOfChannelFactors, true);
+    channelFactor.allocate (numberOfChannelFactors, true);
+    channelFactorDelta.allocate (numberOfChannelFactors, true);
+    activeChannels.allocate (jmax (1, numberOfChannelFactors), true);
+    numberOfActiveChannels = 0;
+    // The recorded gain segments use numberOfChannelFactors too. The audio
+    // thread doesn't render this source now, hence the storage can be
+    // picked up right away.
+    postedGainSegmentCapacity = 0;
+    reserveGainSegments (*newSpacialEnvelope);
+    if (gainSegmentStorageHandoff.update())
+    {
+        gainSegmentStorage = gainSegmentStorageHandoff.get();
+    }
+    numberOfGainSegments = 0;
 	
 	numberOfSpeakersChanged = true; // This will trigger the section in
 		// getNextAudioBlock() which will fill the Factor-Arrays with
@@ -609,17 +1001,74 @@ void AudioSourceAmbipanning::reallocateMemoryForTheArrays ()
 //  See "Prata - C++ primer", p.583
 void AudioSourceAmbipanning::setOrder(double order_)
 {
+	const ScopedLock sl (spacialGainSettingsLock);
+	++spacialGainSettingsVersion;
+	
 	order = order_;
+	aepGainCalculator.setMaximumOrder(order);
 }
 
 void AudioSourceAmbipanning::setPositionOfSpeakers(const Array<SpeakerPosition>& positionOfSpeaker_)
 {
+	const ScopedLock sl (spacialGainSettingsLock);
+	++spacialGainSettingsVersion;
+	
     // Copy the array.
 	positionOfSpeaker = positionOfSpeaker_;
+	
+	// The aepGainCalculator holds its own copy of the coordinates.
+	aepGainCalculator.setNumberOfSpeakers(positionOfSpeaker.size());
+	for (int i = 0; i < positionOfSpeaker.size(); ++i)
+	{
+		SpeakerPosition& posOfSpeaker = positionOfSpeaker.getReference(i);
+		aepGainCalculator.setSpeakerPosition(i, posOfSpeaker.getX(), posOfSpeaker.getY(), posOfSpeaker.getZ());
+	}
+}
+
+void AudioSourceAmbipanning::setGainAccuracyMode(AEPGainCalculator::AccuracyMode accuracyMode)
+{
+	const ScopedLock sl (spacialGainSettingsLock);
+	++spacialGainSettingsVersion;
+	
+	aepGainCalculator.setMaximumOrder(order);
+	aepGainCalculator.setAccuracyMode(accuracyMode);
+}
+
+void AudioSourceAmbipanning::enableHOAEncoding(bool enable, int hoaOrder_)
+{
+	const ScopedLock sl (spacialGainSettingsLock);
+	++spacialGainSettingsVersion;
+	
+	hoaEncodingEnabled = enable;
+	hoaOrder = jlimit(0, (int) SphericalHarmonics::maximumOrder, hoaOrder_);
+}
+
+void AudioSourceAmbipanning::setSceneTransform(const SceneTransform& sceneTransform_)
+{
+	const ScopedLock sl (spacialGainSettingsLock);
+	++spacialGainSettingsVersion;
+	
+	sceneTransform = sceneTransform_;
+	++sceneTransformVersion;
+}
+
+SceneTransform AudioSourceAmbipanning::getSceneTransform()
+{
+	const ScopedLock sl (spacialGainSettingsLock);
+	return sceneTransform;
+}
+
+void AudioSourceAmbipanning::setActiveChannelThreshold(double thresholdInDB)
+{
+	const ScopedLock sl (spacialGainSettingsLock);
+	activeChannelThreshold = (float) pow(10.0, 0.05 * thresholdInDB);
 }
 
 void AudioSourceAmbipanning::setDistanceModeTo0()
 {
+	const ScopedLock sl (spacialGainSettingsLock);
+	++spacialGainSettingsVersion;
+	
 	distanceMode = 0;
 }
 
@@ -628,6 +1077,9 @@ void AudioSourceAmbipanning::setDistanceModeTo1(double centerRadius_,
 												double centerAttenuationInDB_,
 												double dBFalloffPerUnit_)
 {
+	const ScopedLock sl (spacialGainSettingsLock);
+	++spacialGainSettingsVersion;
+	
 	distanceMode = 1;
 	
 	centerRadius = centerRadius_;
@@ -643,6 +1095,9 @@ void AudioSourceAmbipanning::setDistanceModeTo2(double centerRadius_,
 												double centerAttenuationInDB_,
 												double outsideCenterExponent_)
 {
+	const ScopedLock sl (spacialGainSettingsLock);
+	++spacialGainSettingsVersion;
+	
 	distanceMode = 2;
 	
 	centerRadius = centerRadius_;
@@ -653,33 +1108,33 @@ void AudioSourceAmbipanning::setDistanceModeTo2(double centerRadius_,
 	outsideCenterExponent = outsideCenterExponent_;
 }
 
-inline void AudioSourceAmbipanning::prepareForNewPosition(int newPosition,
-                                                          int * nextSpacialPointIndex_)
+inline void AudioSourceAmbipanning::prepareForNewPosition(int newPosition)
 {
     if (!constantSpacialPosition)
     { 
         // Figure out between which spacialEnvelopePoints we are right now
         // and set up all variables needed by getNextAudioBlock(..).
-        nextSpacialPointIndex = 1; // since the first spacialEnvelopePoint has to be at position 0.
-        while (spacialEnvelope[nextSpacialPointIndex]->getPosition() <= newPosition)
-        {
-            (*nextSpacialPointIndex_)++;
-        }
+        const SpacialEnvelope& envelope = *spacialEnvelope;
+        spacialEnvelopeCursor.seek(envelope, newPosition);
         
-        previousSpacialPoint = spacialEnvelope[*nextSpacialPointIndex_ - 1];
-        nextSpacialPoint = spacialEnvelope[*nextSpacialPointIndex_];
+        const int previous = spacialEnvelopeCursor.getPreviousIndex();
         
         // The array channelFactorAtNextPoint should correspond
         // to the newPosition. We have to figure out its values.
         // -----------------------------------------------------
         positionOfNextPoint = newPosition;
+        
+        const SpacialGainTable* gainTable = getUsableSpacialGainTable();
+        if (gainTable != nullptr && envelope.isLinear(previous))
+        {
+            gainTable->interpolateGains(previous, positionOfNextPoint, channelFactorAtNextPoint);
+            return;
+        }
+        
         // First we need to determine the coordinates at that
-        // moment in time.
-        double relativePositionBetweenTheSpacialPoints
-        = double(positionOfNextPoint - previousSpacialPoint->getPosition())/double(nextSpacialPoint->getPosition() - previousSpacialPoint->getPosition());
-        double x = previousSpacialPoint->getX() + relativePositionBetweenTheSpacialPoints * (nextSpacialPoint->getX() - previousSpacialPoint->getX());
-        double y = previousSpacialPoint->getY() + relativePositionBetweenTheSpacialPoints * (nextSpacialPoint->getY() - previousSpacialPoint->getY());
-        double z = previousSpacialPoint->getZ() + relativePositionBetweenTheSpacialPoints * (nextSpacialPoint->getZ() - previousSpacialPoint->getZ());
+        // moment in time (on the line, the arc or the curve).
+        double x, y, z;
+        envelope.getCoordinatesAt(previous, positionOfNextPoint, x, y, z);
         // Now we can calculate r, the distanceGain as well as the
         // modifiedOrder for this next point.
         double r; // radius, will be calculated in calculationsForAEP(..)
@@ -687,23 +1142,209 @@ inline void AudioSourceAmbipanning::prepareForNewPosition(int newPosition,
         double modifiedOrder; // will be calculated in calculationsForAEP(..)	
         calculationsForAEP(x, y, z, r, distanceGain, modifiedOrder);
         // Finally we can determine the channelFactorAtNextPoint.
-        double xs, ys, zs; // speaker coordinates, used in the upcoming for-loop
-        double factor;  // used in the upcoming for-loop
-        for (int channel = 0; channel < positionOfSpeaker.size(); channel++) 
+        calculateChannelFactors(x, y, z, modifiedOrder, distanceGain,
+                                channelFactorAtNextPoint, numberOfChannelFactors);
+    }
+}
+
+inline void AudioSourceAmbipanning::applyChannelFactors (const AudioSourceChannelInfo& info,
+                                                         const float* monoSamples,
+                                                         int offset,
+                                                         int numSamples,
+                                                         const float* startFactors,
+                                                         const float* factorDeltas,
+                                                         int numberOfChannels,
+                                                         bool addToDestination)
+{
+    if (recordGainSegments)
+    {
+        recordGainSegment (offset, numSamples, startFactors, factorDeltas, numberOfChannels);
+        return;
+    }
+    
+    updateActiveChannels (numSamples, startFactors, factorDeltas, numberOfChannels);
+    
+    // One channel after the other, such that the samples of a
+    // channel are processed contiguously.
+    const float* source = monoSamples + offset;
+    if (addToDestination)
+    {
+        // Only the active channels are touched.
+        for (int i = 0; i < numberOfActiveChannels; ++i)
+        {
+            const int channel = activeChannels[i];
+            const float delta = factorDeltas != nullptr ? factorDeltas[channel] : 0.0f;
+            GainRampKernels::addWithRamp (info.buffer->getSampleData (channel, info.startSample + offset),
+                                          source, numSamples,
+                                          startFactors[channel], delta);
+        }
+    }
+    else
+    {
+        // In the replacing mode, the monoSamples are part of the first channel.
+        // Therefore it has to be the last one to be overwritten.
+        // The inactive channels are cleared.
+        int i = numberOfActiveChannels - 1;
+        for (int channel = numberOfChannels - 1; channel >= 0; --channel)
+        {
+            float* destination = info.buffer->getSampleData (channel, info.startSample + offset);
+            if (i >= 0 && activeChannels[i] == channel)
+            {
+                const float delta = factorDeltas != nullptr ? factorDeltas[channel] : 0.0f;
+                GainRampKernels::copyWithRamp (destination, source, numSamples,
+                                               startFactors[channel], delta);
+                --i;
+            }
+            else
+            {
+                zeromem (destination, sizeof (float) * numSamples);
+            }
+        }
+    }
+}
+
+inline void AudioSourceAmbipanning::updateActiveChannels (int numSamples,
+                                                          const float* startFactors,
+                                                          const float* factorDeltas,
+                                                          int numberOfChannels)
+{
+    // A channel is active if its gain is above the threshold at the start
+    // or at the end of the segment. Hence a channel that enters or leaves
+    // the list is faded in or out completely (down to the threshold)
+    // while it is in the list.
+    numberOfActiveChannels = 0;
+    for (int channel = 0; channel < numberOfChannels; ++channel)
+    {
+        const float startFactor = startFactors[channel];
+        const float endFactor = factorDeltas != nullptr ? startFactor + numSamples * factorDeltas[channel] : startFactor;
+        if (isChannelActive (startFactor, endFactor))
+        {
+            activeChannels[numberOfActiveChannels] = channel;
+            ++numberOfActiveChannels;
+        }
+    }
+}
+
+inline bool AudioSourceAmbipanning::isChannelActive (float startFactor, float endFactor)
+{
+    return fabsf (startFactor) > activeChannelThreshold || fabsf (endFactor) > activeChannelThreshold;
+}
+
+inline void AudioSourceAmbipanning::recordGainSegment (int offset,
+                                                       int numSamples,
+                                                       const float* startFactors,
+                                                       const float* factorDeltas,
+                                                       int numberOfChannels)
+{
+    GainSegmentStorage& storage = *gainSegmentStorage;
+    if (numberOfGainSegments >= storage.capacity || numberOfChannels > storage.numberOfChannels)
+    {
+        // Only happens if the block is larger than announced in
+        // prepareToPlay (or the storage for a new number of speakers
+        // couldn't be picked up yet). The segment is dropped rather than
+        // allocating memory on the audio thread.
+        jassertfalse;
+        return;
+    }
+    
+    float* const recordedFactors = storage.factors + 2 * numberOfGainSegments * storage.numberOfChannels;
+    memcpy (recordedFactors, startFactors, sizeof (float) * numberOfChannels);
+    if (factorDeltas != nullptr)
+    {
+        memcpy (recordedFactors + storage.numberOfChannels, factorDeltas, sizeof (float) * numberOfChannels);
+    }
+    
+    GainSegment& segment = storage.segments[numberOfGainSegments];
+    segment.offset = offset;
+    segment.numSamples = numSamples;
+    segment.hasRamp = factorDeltas != nullptr;
+    ++numberOfGainSegments;
+    numberOfRecordedChannels = numberOfChannels;
+}
+
+void AudioSourceAmbipanning::reserveGainSegments (const SpacialEnvelope& envelope)
+{
+    const int numberOfSegments = getMaximumNumberOfGainSegments (envelope, samplesPerBlockExpected);
+    if (numberOfSegments <= postedGainSegmentCapacity)
+    {
+        return;
+    }
+    
+    // Room to spare, such that slightly denser envelopes don't need a
+    // new one.
+    postedGainSegmentCapacity = jmax (8, 2 * numberOfSegments);
+    gainSegmentStorageHandoff.post (new GainSegmentStorage (postedGainSegmentCapacity, numberOfChannelFactors));
+}
+
+int AudioSourceAmbipanning::getMaximumNumberOfGainSegments (const SpacialEnvelope& envelope, int blockSize)
+{
+    // The most points within blockSize samples (a sliding window over the
+    // sorted positions). A block is split at each of them, the one at its
+    // start included: One segment more than points. A fade is a single
+    // segment.
+    const int* positions = envelope.getPositions();
+    int maximumNumberOfPoints = 0;
+    int first = 0;
+    for (int last = 0; last < envelope.size(); ++last)
+    {
+        while (positions[last] - positions[first] >= blockSize)
+        {
+            ++first;
+        }
+        maximumNumberOfPoints = jmax (maximumNumberOfPoints, last - first + 1);
+    }
+    return maximumNumberOfPoints + 1;
+}
+
+inline void AudioSourceAmbipanning::calculateChannelFactors (double x,
+                                                             double y,
+                                                             double z,
+                                                             double modifiedOrder,
+                                                             double distanceGain,
+                                                             float* factors,
+                                                             int numberOfChannels)
+{
+    if (! hoaEncodingEnabled)
+    {
+        aepGainCalculator.calculateGains(x, y, z, modifiedOrder, distanceGain, factors,
+                                         jmin (numberOfChannels, aepGainCalculator.getNumberOfSpeakers()));
+    }
+    else
+    {
+        float coefficients[(SphericalHarmonics::maximumOrder + 1) * (SphericalHarmonics::maximumOrder + 1)];
+        SphericalHarmonics::calculate(hoaOrder, x, y, z, coefficients);
+        
+        // Inside the center zone, the modifiedOrder decreases towards 0.
+        // The same is done here by fading out the higher degrees, one
+        // after the other.
+        const double effectiveOrder = order > 0.0 ? hoaOrder * modifiedOrder / order : hoaOrder;
+        const int numberOfCoefficients = jmin (numberOfChannels, SphericalHarmonics::getNumberOfChannels(hoaOrder));
+        for (int degree = 0; degree <= hoaOrder; ++degree)
         {
-            // calculate the values of the float-array channelFactorAtNextSpacialPoint
-            SpeakerPosition& posOfSpeaker = positionOfSpeaker.getReference(channel);
-            xs = posOfSpeaker.getX();
-            ys = posOfSpeaker.getY();
-            zs = posOfSpeaker.getZ();
-            factor = pow(0.5 + 0.5*(x*xs + y*ys + z*zs), modifiedOrder) * distanceGain;
-            channelFactorAtNextPoint.set(channel, factor);
-        } 
+            const float weight = (float) (distanceGain * jlimit (0.0, 1.0, effectiveOrder - degree + 1.0));
+            const int endOfThisDegree = jmin (numberOfCoefficients, (degree + 1) * (degree + 1));
+            for (int acn = degree * degree; acn < endOfThisDegree; ++acn)
+            {
+                factors[acn] = weight * coefficients[acn];
+            }
+        }
+        for (int channel = numberOfCoefficients; channel < numberOfChannels; ++channel)
+        {
+            factors[channel] = 0.0f;
+        }
     }
 }
 
+inline void AudioSourceAmbipanning::copyChannelFactors (float* destination, const float* source)
+{
+    memcpy (destination, source, sizeof (float) * numberOfChannelFactors);
+}
+
 inline void AudioSourceAmbipanning::calculationsForAEP (double& x, double& y, double &z, double& r, double& distanceGain, double& modifiedOrder)
 {
+	// The position in the transformed scene.
+	sceneTransform.apply(x, y, z);
+	
 	r = sqrt(x*x + y*y + z*z); // radius, i.e. the distance of (x,y,z) to (0,0,0)
 	
 	// Normalize x, y and z, such that they describe the projection to 
@@ -730,7 +1371,7 @@ inline void AudioSourceAmbipanning::calculationsForAEP (double& x, double& y, do
 		}
 		else if (distanceMode == 1 || distanceMode == 2)
 		{
-			distanceGain = pow(r * oneOverCenterRadius, centerExponent) * 
+			distanceGain = aepGainCalculator.power(r * oneOverCenterRadius, centerExponent) * 
                             oneMinusCenterAttenuation + centerAttenuation;
             // Temp
             // distanceGain = 1.0;
@@ -751,7 +1392,7 @@ inline void AudioSourceAmbipanning::calculationsForAEP (double& x, double& y, do
 		// distanceMode 1: exponential decrease
 		else if (distanceMode == 1)
 		{
-			distanceGain = pow( 10.0, (r - centerRadius)*10.0*dBFalloffPerUnit*0.05);
+			distanceGain = aepGainCalculator.powerOfTen((r - centerRadius)*10.0*dBFalloffPerUnit*0.05);
 			//distanceGain = pow( 10.0, (r - centerRadius)*dBFalloffPerUnit*0.05);
 			// in the max external it is: pow(10, (dist - x->s_center_size) * x->s_source[idx]->dbunit * 0.05);
             // in the max external: unit = 10. Here: unit = 1. Therefore we
@@ -760,7 +1401,7 @@ inline void AudioSourceAmbipanning::calculationsForAEP (double& x, double& y, do
 		// distanceMode 2: inverse proportional decrease
 		else if (distanceMode == 2)
 		{
-			distanceGain = pow(10.0*(r - centerRadius) + 1.0, -outsideCenterExponent);
+			distanceGain = aepGainCalculator.power(10.0*(r - centerRadius) + 1.0, -outsideCenterExponent);
 			//distanceGain = pow((r - centerRadius) + 1.0, -outsideCenterExponent);
 			// in the max external it is: pow((dist + x->s_center_size3), -x->s_source[idx]->dist_att);
             // in the max external: unit = 10. Here: unit = 1. Therefore we
@@ -775,6 +1416,14 @@ inline void AudioSourceAmbipanning::calculationsForAEP (double& x, double& y, do
 double AudioSourceAmbipanning::order = 1.0;
 //int AudioSourceAmbipanning::numberOfSpeakers = 1;
 Array<SpeakerPosition> AudioSourceAmbipanning::positionOfSpeaker;
+AEPGainCalculator AudioSourceAmbipanning::aepGainCalculator;
+bool AudioSourceAmbipanning::hoaEncodingEnabled = false;
+int AudioSourceAmbipanning::hoaOrder = 1;
+float AudioSourceAmbipanning::activeChannelThreshold = 1.58489319e-5f; // -96 dB
+SceneTransform AudioSourceAmbipanning::sceneTransform;
+int AudioSourceAmbipanning::sceneTransformVersion = 0;
+int AudioSourceAmbipanning::spacialGainSettingsVersion = 0;
+CriticalSection AudioSourceAmbipanning::spacialGainSettingsLock;
 	
 int AudioSourceAmbipanning::distanceMode = 1;
 double AudioSourceAmbipanning::centerRadius = 1.0;
@@ -784,3 +1433,355 @@ double AudioSourceAmbipanning::centerAttenuation = 0.5;
 double AudioSourceAmbipanning::oneMinusCenterAttenuation = 1.0 - AudioSourceAmbipanning::centerAttenuation;
 double AudioSourceAmbipanning::dBFalloffPerUnit = -3.0; // dB
 double AudioSourceAmbipanning::outsideCenterExponent = 1.0;
+
+
+#if AUDIO_ENGINE_UNIT_TESTS
+//==============================================================================
+/**
+ An AudioFormatReader without a file, that delivers a constant signal of
+ 1.0 in one channel. Used by the AudioSourceAmbipanningTest.
+ */
+class ConstantAudioFormatReader  : public AudioFormatReader
+{
+public:
+    ConstantAudioFormatReader (double sampleRate_, int64 lengthInSamples_)
+        : AudioFormatReader (nullptr, "Constant")
+    {
+        sampleRate = sampleRate_;
+        bitsPerSample = 32;
+        lengthInSamples = lengthInSamples_;
+        numChannels = 1;
+        usesFloatingPointData = true;
+    }
+
+    bool readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
+                      int64 /*startSampleInFile*/, int numSamples)
+    {
+        for (int channel = 0; channel < numDestChannels; ++channel)
+        {
+            if (destSamples[channel] != nullptr)
+            {
+                float* destination = reinterpret_cast<float*> (destSamples[channel]) + startOffsetInDestBuffer;
+                for (int i = 0; i < numSamples; ++i)
+                    destination[i] = 1.0f;
+            }
+        }
+        return true;
+    }
+};
+
+//==============================================================================
+/**
+ An AudioFormatReader without a file, that delivers a sine of 441 Hz (100
+ samples per period at 44.1 kHz) in one channel. Used by the
+ AudioSourceAmbipanningTest, where the delay of the doppler effect has to
+ be audible.
+ */
+class SineAudioFormatReader  : public AudioFormatReader
+{
+public:
+    SineAudioFormatReader (double sampleRate_, int64 lengthInSamples_)
+        : AudioFormatReader (nullptr, "Sine")
+    {
+        sampleRate = sampleRate_;
+        bitsPerSample = 32;
+        lengthInSamples = lengthInSamples_;
+        numChannels = 1;
+        usesFloatingPointData = true;
+    }
+
+    bool readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
+                      int64 startSampleInFile, int numSamples)
+    {
+        for (int channel = 0; channel < numDestChannels; ++channel)
+        {
+            if (destSamples[channel] != nullptr)
+            {
+                float* destination = reinterpret_cast<float*> (destSamples[channel]) + startOffsetInDestBuffer;
+                for (int i = 0; i < numSamples; ++i)
+                    destination[i] = (float) sin (2.0 * double_Pi * 441.0 * (startSampleInFile + i) / sampleRate);
+            }
+        }
+        return true;
+    }
+};
+
+//==============================================================================
+/**
+ Renders a constant signal along a spacial envelope, such that the output
+ channels contain the gains themselves.
+ */
+class AudioSourceAmbipanningTest  : public UnitTest
+{
+public:
+    AudioSourceAmbipanningTest ()  : UnitTest ("AudioSourceAmbipanning") {}
+
+    void runTest ()
+    {
+        Array<SpeakerPosition> speakers;
+        speakers.add (SpeakerPosition (1.0, 0.0, 0.0));
+        speakers.add (SpeakerPosition (0.0, 1.0, 0.0));
+        speakers.add (SpeakerPosition (-1.0, 0.0, 0.0));
+        speakers.add (SpeakerPosition (0.0, -1.0, 0.0));
+        AudioSourceAmbipanning::setPositionOfSpeakers (speakers);
+
+        testTheBlocksAfterAFade();
+        testTheSceneTransformOfTheStages();
+
+        AudioSourceAmbipanning::setPositionOfSpeakers (Array<SpeakerPosition>());
+    }
+
+private:
+    enum
+    {
+        numberOfSpeakers = 4,
+        blockSize = 64,
+        numberOfBlocks = 24,
+        sentinel = 12345
+    };
+
+    /** A source moving from the first speaker to the third one, in between
+     the samples 100 and 1000. Like the ones of the AudioRegionMixer, the
+     envelope ends after the last sample. */
+    static SpacialEnvelope* createMovingEnvelope ()
+    {
+        Array<SpacialEnvelopePoint> points;
+        points.add (SpacialEnvelopePoint (0, 1.0, 0.0, 0.0));
+        points.add (SpacialEnvelopePoint (100, 1.0, 0.0, 0.0));
+        points.add (SpacialEnvelopePoint (1000, -1.0, 0.0, 0.0));
+        points.add (SpacialEnvelopePoint (numberOfBlocks * blockSize + 1, -1.0, 0.0, 0.0));
+        return new SpacialEnvelope (points);
+    }
+
+    /** The envelope of createMovingEnvelope, moved away from the origin. */
+    static SpacialEnvelope* createDistantMovingEnvelope ()
+    {
+        Array<SpacialEnvelopePoint> points;
+        points.add (SpacialEnvelopePoint (0, 3.0, 1.0, 0.0));
+        points.add (SpacialEnvelopePoint (100, 3.0, 1.0, 0.0));
+        points.add (SpacialEnvelopePoint (1000, -3.0, 1.0, 0.5));
+        points.add (SpacialEnvelopePoint (numberOfBlocks * blockSize + 1, -3.0, 1.0, 0.5));
+        return new SpacialEnvelope (points);
+    }
+
+    /** Creates a source, that renders a sine through the doppler effect and
+     the low pass filter. */
+    static AudioSourceAmbipanning* createSineSource ()
+    {
+        AudioSourceAmbipanning* source = new AudioSourceAmbipanning (new SineAudioFormatReader (44100.0, numberOfBlocks * blockSize),
+                                                                     44100.0, false);
+        source->enableDopplerEffect (true);
+        source->enableLowPassFilter (true);
+        source->prepareToPlay (blockSize, 44100.0);
+        return source;
+    }
+
+    /** Returns the largest difference of two outputs of render. */
+    static float getMaximumDifference (const AudioSampleBuffer& a, const AudioSampleBuffer& b)
+    {
+        float maximumDifference = 0.0f;
+        for (int channel = 0; channel < numberOfSpeakers; ++channel)
+        {
+            const float* samplesOfA = a.getSampleData (channel);
+            const float* samplesOfB = b.getSampleData (channel);
+            for (int i = 0; i < numberOfBlocks * blockSize; ++i)
+                maximumDifference = jmax (maximumDifference, fabsf (samplesOfA[i] - samplesOfB[i]));
+        }
+        return maximumDifference;
+    }
+
+    /** Renders the blocks one after the other into the middle of a buffer,
+     whose first and last blockSize samples are set to the sentinel. Returns
+     false if any of them has been overwritten. The gains are appended to
+     the output, numberOfBlocks * blockSize samples per speaker. */
+    static bool render (AudioSourceAmbipanning& source, AudioSampleBuffer& output)
+    {
+        AudioSampleBuffer buffer (numberOfSpeakers, 3 * blockSize);
+        AudioSourceChannelInfo info;
+        info.buffer = &buffer;
+        info.startSample = blockSize;
+        info.numSamples = blockSize;
+
+        bool sentinelsAreIntact = true;
+        for (int block = 0; block < numberOfBlocks; ++block)
+        {
+            for (int channel = 0; channel < numberOfSpeakers; ++channel)
+            {
+                float* samples = buffer.getSampleData (channel);
+                for (int i = 0; i < 3 * blockSize; ++i)
+                    samples[i] = (float) sentinel;
+            }
+
+            source.setNextReadPosition (block * blockSize);
+            source.getNextAudioBlock (info);
+
+            for (int channel = 0; channel < numberOfSpeakers; ++channel)
+            {
+                const float* samples = buffer.getSampleData (channel);
+                for (int i = 0; i < blockSize; ++i)
+                {
+                    sentinelsAreIntact = sentinelsAreIntact
+                        && samples[i] == (float) sentinel
+                        && samples[2 * blockSize + i] == (float) sentinel;
+                }
+                output.copyFrom (channel, block * blockSize, buffer, channel, blockSize, blockSize);
+            }
+        }
+        return sentinelsAreIntact;
+    }
+
+    /** The first block after setSpacialEnvelope fades to the new envelope.
+     The following ones have to continue exactly at the end of the fade and
+     mustn't write beyond the block. */
+    void testTheBlocksAfterAFade ()
+    {
+        beginTest ("blocks after a fade");
+
+        AudioSourceAmbipanning source (new ConstantAudioFormatReader (44100.0, numberOfBlocks * blockSize),
+                                       44100.0, false);
+        source.prepareToPlay (blockSize, 44100.0);
+        source.setSpacialEnvelope (createMovingEnvelope());
+
+        AudioSampleBuffer gains (numberOfSpeakers, numberOfBlocks * blockSize);
+        expect (render (source, gains), "Samples outside of the audio block have been overwritten.");
+
+        // The source at the position of the third speaker, as a reference
+        // for the gains after the movement.
+        AudioSourceAmbipanning referenceSource (new ConstantAudioFormatReader (44100.0, numberOfBlocks * blockSize),
+                                                44100.0, false);
+        referenceSource.prepareToPlay (blockSize, 44100.0);
+        referenceSource.setSpacialEnvelope (new SpacialEnvelope (-1.0, 0.0, 0.0));
+        AudioSampleBuffer referenceGains (numberOfSpeakers, numberOfBlocks * blockSize);
+        render (referenceSource, referenceGains);
+
+        // The gains are ramped linearly in between the block boundaries
+        // and the points of the envelope. From the end of the fade on, the
+        // step from the last sample of a block to the first one of the
+        // next one has to fit to the steps next to it. (A segment length
+        // mixed up with the one of the fade leads to a jump.)
+        for (int block = 1; block < numberOfBlocks; ++block)
+        {
+            const int i = block * blockSize;
+            float stepAcrossTheBoundary = 0.0f;
+            float stepsNextToIt = 0.0f;
+            for (int channel = 0; channel < numberOfSpeakers; ++channel)
+            {
+                const float* samples = gains.getSampleData (channel);
+                stepAcrossTheBoundary = jmax (stepAcrossTheBoundary, fabsf (samples[i] - samples[i - 1]));
+                stepsNextToIt = jmax (stepsNextToIt, fabsf (samples[i - 1] - samples[i - 2]),
+                                      fabsf (samples[i + 1] - samples[i]));
+            }
+            expect (stepAcrossTheBoundary <= 2.0f * stepsNextToIt + 1.0e-5f,
+                    "Jump at the start of block " + String (block));
+        }
+
+        // Where the movement has ended, the gains are the ones of the
+        // constant position.
+        const int lastSample = numberOfBlocks * blockSize - 1;
+        for (int channel = 0; channel < numberOfSpeakers; ++channel)
+        {
+            expect (fabsf (gains.getSampleData (channel)[lastSample]
+                           - referenceGains.getSampleData (channel)[lastSample]) < 1.0e-4f,
+                    "channel " + String (channel));
+        }
+    }
+
+    /** A source in a transformed scene has to sound like one without a
+     transformation, whose envelope (or live position) has been transformed
+     by hand: Not only the panning, but also the delay of the doppler
+     effect and the cutoff frequency of the low pass filter depend on the
+     transformed positions. */
+    void testTheSceneTransformOfTheStages ()
+    {
+        beginTest ("scene transform of the doppler effect and the low pass filter");
+
+        // Delays of a few ms per unit, instead of seconds, and no
+        // attenuation with the distance, which would make the sources of
+        // the transformed scene inaudible.
+        const double unitScaleFactor = SpacialPosition::getUnitScaleFactor();
+        SpacialPosition::setUnitScaleFactor (1.0);
+        AudioSourceAmbipanning::setDistanceModeTo0();
+
+        const SceneTransform sceneTransform (90.0, 10.0, 0.0, 0.5, 4.0, 0.0, 2.0);
+        const SpacialEnvelope::Ptr envelope (createDistantMovingEnvelope());
+        const SpacialEnvelope::Ptr transformedEnvelope (SpacialEnvelope::createTransformed (*envelope, sceneTransform));
+        const SpacialPositionMailbox::Ptr mailbox (new SpacialPositionMailbox());
+        mailbox->post (1.0, 2.0, 0.5);
+        double x = 1.0, y = 2.0, z = 0.5;
+        sceneTransform.apply (x, y, z);
+        const SpacialPositionMailbox::Ptr transformedMailbox (new SpacialPositionMailbox());
+        transformedMailbox->post (x, y, z);
+
+        // Only the changed points of a patched envelope are transformed.
+        const int positions[2] = { 400, 500 };
+        const double xs[2] = { 1.0, 0.0 }, ys[2] = { 2.0, 2.5 }, zs[2] = { 0.0, 1.0 };
+        const SpacialEnvelope::Ptr patchedEnvelope (SpacialEnvelope::createPatched (*envelope, 2, 0, positions, xs, ys, zs, 2));
+        const SpacialEnvelope::Patch patch = SpacialEnvelope::findPatch (*envelope, *patchedEnvelope);
+        const SpacialEnvelope::Ptr transformedPatchedEnvelope (SpacialEnvelope::createTransformed (*patchedEnvelope, sceneTransform,
+                                                                                                  *transformedEnvelope, patch));
+        const SpacialEnvelope::Ptr completelyTransformedPatchedEnvelope (SpacialEnvelope::createTransformed (*patchedEnvelope, sceneTransform));
+        expect (transformedPatchedEnvelope != nullptr
+                && SpacialEnvelope::findPatch (*transformedPatchedEnvelope, *completelyTransformedPatchedEnvelope).isEmpty(),
+                "patched envelope");
+
+        AudioSampleBuffer output (numberOfSpeakers, numberOfBlocks * blockSize);
+        AudioSampleBuffer referenceOutput (numberOfSpeakers, numberOfBlocks * blockSize);
+        AudioSampleBuffer untransformedOutput (numberOfSpeakers, numberOfBlocks * blockSize);
+
+        // The transformation is set after the envelope, like the
+        // AudioRegionMixer does it.
+        {
+            ScopedPointer<AudioSourceAmbipanning> source (createSineSource());
+            source->setSpacialEnvelope (envelope);
+            AudioSourceAmbipanning::setSceneTransform (sceneTransform);
+            source->prepareSceneTransform (sceneTransform);
+            source->postSceneTransform();
+            expect (render (*source, output), "Samples outside of the audio block have been overwritten.");
+        }
+        AudioSourceAmbipanning::setSceneTransform (SceneTransform());
+        {
+            ScopedPointer<AudioSourceAmbipanning> source (createSineSource());
+            source->setSpacialEnvelope (transformedEnvelope);
+            render (*source, referenceOutput);
+        }
+        expect (getMaximumDifference (output, referenceOutput) < 1.0e-4f,
+                "spacial envelope: " + String (getMaximumDifference (output, referenceOutput)));
+
+        // Only the panning follows the transformation of the scene.
+        {
+            ScopedPointer<AudioSourceAmbipanning> source (createSineSource());
+            source->setSpacialEnvelope (envelope);
+            AudioSourceAmbipanning::setSceneTransform (sceneTransform);
+            render (*source, untransformedOutput);
+            AudioSourceAmbipanning::setSceneTransform (SceneTransform());
+        }
+        expect (getMaximumDifference (untransformedOutput, referenceOutput) > 0.1f,
+                "The doppler effect doesn't make a difference.");
+
+        // The same with live positions.
+        {
+            ScopedPointer<AudioSourceAmbipanning> source (createSineSource());
+            source->setLivePositionMailbox (mailbox, 0.0);
+            AudioSourceAmbipanning::setSceneTransform (sceneTransform);
+            source->prepareSceneTransform (sceneTransform);
+            source->postSceneTransform();
+            render (*source, output);
+        }
+        AudioSourceAmbipanning::setSceneTransform (SceneTransform());
+        {
+            ScopedPointer<AudioSourceAmbipanning> source (createSineSource());
+            source->setLivePositionMailbox (transformedMailbox, 0.0);
+            render (*source, referenceOutput);
+        }
+        expect (getMaximumDifference (output, referenceOutput) < 1.0e-4f,
+                "live position: " + String (getMaximumDifference (output, referenceOutput)));
+
+        SpacialPosition::setUnitScaleFactor (unitScaleFactor);
+        // The defaults.
+        AudioSourceAmbipanning::setDistanceModeTo1 (1.0, 1.0, 20.0 * log10 (0.5), -3.0);
+    }
+};
+
+static AudioSourceAmbipanningTest audioSourceAmbipanningTest;
+
+#endif
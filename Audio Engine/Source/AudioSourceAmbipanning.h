@@ -12,9 +12,18 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "SpacialEnvelopePoint.h"
+#include "SpacialEnvelope.h"
+#include "EnvelopeCursor.h"
+#include "SpacialGainTable.h"
 #include "AudioSourceGainEnvelope.h"
 #include "AudioSourceDopplerEffect.h"
 #include "AudioSourceLowPassFilter.h"
+#include "GainRampKernels.h"
+#include "AEPGainCalculator.h"
+#include "SphericalHarmonics.h"
+#include "SceneTransform.h"
+#include "SpacialPositionMailbox.h"
+#include "EnvelopeHandoff.h"
 
 //==============================================================================
 /**
@@ -141,6 +150,21 @@ private:
  sample. Instead they are linearly approximated.
  Points for this linearisation are: The first sample of every audio block
  as well as every point in the spacial envelope.
+ 
+ The gains at the points of the spacial envelope can also be calculated
+ in advance, off the audio thread (see createSpacialGainTable). As long as
+ the SpacialGainTable fits the envelope and the current settings, the
+ audio thread only reads the gains from it and ramps between them - the
+ gains at the start of a block are interpolated linearly between the
+ points, too. Otherwise (e.g. right after the speakers have changed) they
+ are calculated on the audio thread, as before.
+ 
+ Instead of the spacial envelope, the source can follow a live input (see
+ setLivePositionMailbox). The position is then read from the mailbox once
+ per block, smoothed, and the gains are ramped from the start of the block
+ to the position at its end - the same way as from one point of the
+ envelope to the next. The doppler effect and the low pass filter get the
+ same position.
  */
 class JUCE_API  AudioSourceAmbipanning  : public PositionableAudioSource
 {
@@ -163,8 +187,55 @@ public:
     /** Implementation of the AudioSource method. */
     void releaseResources ();
 	
-    /** Implementation of the AudioSource method. */
+    /** Implementation of the AudioSource method.
+     
+     The mono signal is rendered to the first channel of info.buffer and
+     the panned signals replace the content of all channels.
+     */
     void getNextAudioBlock (const AudioSourceChannelInfo& info);
+    
+    /**
+     Renders the next audio block and adds the panned signals to the
+     channels of info.buffer (instead of replacing them).
+     
+     Unlike getNextAudioBlock, no channel receives a copy of the mono
+     signal. The mono signal is rendered to the monoScratchBuffer, and each
+     channel of info.buffer is visited only once, when the panned signal is
+     added to it. This is the method used by the AudioRegionMixer.
+     
+     @param info                The destination. The signal is added to
+                                info.numSamples samples of all channels,
+                                starting at info.startSample.
+     @param monoScratchBuffer   Its first channel is overwritten with the
+                                mono signal. It must hold at least
+                                info.numSamples samples. It can be shared by
+                                all regions of a mixer.
+     */
+    void addNextAudioBlockTo (const AudioSourceChannelInfo& info,
+                              AudioSampleBuffer& monoScratchBuffer);
+    
+    /**
+     addNextAudioBlockTo, split in two halves, such that several regions
+     can be rendered in parallel (see ParallelRegionRenderer).
+     
+     This first half renders the mono signal to a buffer of this instance
+     and records the gain ramps for the channels of info.buffer. info.buffer
+     isn't touched. No memory is allocated, as long as info.numSamples
+     doesn't exceed the samplesPerBlockExpected passed to prepareToPlay.
+     */
+    void prepareNextAudioBlock (const AudioSourceChannelInfo& info);
+    
+    /**
+     The second half of addNextAudioBlockTo: Adds the audio block prepared
+     by prepareNextAudioBlock (called with the same info) to the channels
+     firstChannel to endChannel - 1 of info.buffer.
+     
+     The result is bit-identical to addNextAudioBlockTo. It can be called
+     for different channel ranges at the same time.
+     */
+    void addPreparedAudioBlockTo (const AudioSourceChannelInfo& info,
+                                  int firstChannel,
+                                  int endChannel) const;
 	
     //==============================================================================
     /** Implements the PositionableAudioSource method. */
@@ -203,29 +274,146 @@ public:
      */    
     void enableDopplerEffect (bool enable);
     
+    /**
+     Sets the interpolation quality of the doppler effect, see
+     AudioSourceDopplerEffect::setInterpolationQuality.
+     */
+    void setDopplerInterpolationQuality (FractionalDelayInterpolator::Quality quality);
+    
 	/** 
-	 @param newGainEnvelope		It will be deleted in the setGainEnvelope(..) of
-								AudioSourceGainEnvelope or in the destructor of
-								AudioSourceGainEnvelope, so you don't have to
-								care about.
+	 @param newGainEnvelope		The points are copied by the setGainEnvelope(..)
+								of the AudioSourceGainEnvelope.
 	 */
-	void setGainEnvelope (Array<void*> newGainEnvelope);
+	void setGainEnvelope (const Array<AudioEnvelopePoint>& newGainEnvelope);
+	
+	/**
+	 Hands a gain envelope created with
+	 AudioSourceGainEnvelope::createGainEnvelope over to the audio thread.
+	 */
+	void setGainEnvelope (GainEnvelope* newGainEnvelope);
 
 	/**
 	 Sets a new spacial envelope which determines the location in space of the
      sound source in relation to the time.
      
-     @param newSpacialEnvelope  This array defines the movement of the sound
+     @param newSpacialEnvelope  This envelope defines the movement of the sound
                                 source over time in space. If it only contains
                                 one point, this one defines the fix position at
                                 every arbitrary moment in time. It it contains
-                                multiple points they must be ordered according
-                                to their position (in time). The first point
+                                multiple points, the first point
                                 has to be at the (sample) position 0 according
                                 to the audio file and the last point must be
                                 at the sample lengthOfTheAudioFile.
+                                It isn't copied, but shared with the doppler
+                                effect and the low pass filter (unless a
+                                scene transformation is set, see
+                                setSceneTransform).
+     @param patch               How the newSpacialEnvelope differs from the
+                                one set before (see getSpacialEnvelope), if
+                                known. The doppler effect then only
+                                analyses the changed points.
+	 */
+	void setSpacialEnvelope (const SpacialEnvelope::Ptr& newSpacialEnvelope,
+	                         const SpacialEnvelope::Patch* patch = nullptr);
+	
+	/**
+	 setSpacialEnvelope, split in two, such that several envelopes can be
+	 handed over at once (see AudioRegionMixer::commitEditTransaction): This
+	 does all the work of the doppler effect and the allocations, but the
+	 audio thread keeps the old envelope until postSpacialEnvelope.
+	 */
+	void prepareSpacialEnvelope (const SpacialEnvelope::Ptr& newSpacialEnvelope,
+	                             const SpacialEnvelope::Patch* patch = nullptr);
+	
+	/**
+	 The second half of setSpacialEnvelope: Hands the envelope prepared last
+	 over to the audio thread (and to the doppler effect and the low pass
+	 filter). Only takes the time of a few atomic exchanges.
+	 */
+	void postSpacialEnvelope ();
+	
+	/**
+	 Prepares the doppler effect and the low pass filter for a new scene
+	 transformation (see setSceneTransform): Transforms the spacial
+	 envelope and analyses it for the doppler effect. Nothing is done, if
+	 they already use this transformation.
+	 */
+	void prepareSceneTransform (const SceneTransform& newSceneTransform);
+	
+	/**
+	 Hands the envelope transformed by prepareSceneTransform over to the
+	 doppler effect and the low pass filter, if there is one. Call it
+	 together with setSceneTransform, under the same lock as
+	 getNextAudioBlock(..).
+	 */
+	void postSceneTransform ();
+	
+	/** Returns the spacial envelope set last (which might not be in use by
+	 getNextAudioBlock yet). */
+	const SpacialEnvelope::Ptr& getSpacialEnvelope () const		{ return newSpacialEnvelope; }
+	
+	/**
+	 Calculates the gains of all channels at every point of the envelope,
+	 with the current settings of the panning. Slow, call it on a
+	 background thread. It can be called while the settings are changed.
+	 
+	 @return	A new table, or nullptr if the envelope contains a single
+				point only or the settings have changed during the
+				calculation.
+	 */
+	static SpacialGainTable* createSpacialGainTable (const SpacialEnvelope::Ptr& envelope);
+	
+	/**
+	 Creates the table of a patched envelope from the table of the envelope
+	 it has been derived from: The gains of the unchanged points are copied,
+	 only the ones of the inserted points are calculated. Fast enough to be
+	 called on the message thread for a small patch.
+	 
+	 @return	A new table, or nullptr if the table is outdated (the
+				settings have changed) or the envelope contains a
+				single point only.
+	 */
+	static SpacialGainTable* createPatchedSpacialGainTable (const SpacialGainTable& table,
+	                                                        const SpacialEnvelope::Ptr& envelope,
+	                                                        const SpacialEnvelope::Patch& patch);
+	
+	/**
+	 Returns true if the SpacialGainTable handed to this instance belongs
+	 to the envelope and is up to date with the settings of the panning.
+	 */
+	bool hasSpacialGainTableFor (const SpacialEnvelope::Ptr& envelope) const;
+	
+	/**
+	 Hands a table created by createSpacialGainTable to this instance. It
+	 is only used while it fits the spacial envelope in use and the
+	 settings. Must not be called while getNextAudioBlock is running.
 	 */
-	void setSpacialEnvelope (const Array<SpacialEnvelopePoint>& newSpacialEnvelope);
+	void setSpacialGainTable (const SpacialGainTable::Ptr& spacialGainTable);
+	
+	/** Returns the table handed to this instance last, nullptr if there is
+	 none. */
+	const SpacialGainTable::Ptr& getSpacialGainTable () const	{ return spacialGainTable; }
+	
+	/**
+	 Lets the source follow the positions posted to a mailbox (e.g. by a
+	 tracker) instead of the spacial envelope, from the first position
+	 posted on. With nullptr, the source returns to the spacial envelope,
+	 with a fade over one block. Must not be called while getNextAudioBlock
+	 is running.
+	 
+	 The mailbox is read at the start of every block, and the source
+	 arrives at the (smoothed) position at the end of the block, so a
+	 position takes effect within one block. Nothing is allocated on the
+	 audio thread.
+	 
+	 @param mailbox             Shared with the one who posts the positions.
+	 @param smoothingTimeInMs   The time constant of a one pole low pass
+	                            filter on the positions, against the jitter
+	                            of the input. With 0, the source follows the
+	                            input directly.
+	 */
+	void setLivePositionMailbox (const SpacialPositionMailbox::Ptr& mailbox,
+	                             double smoothingTimeInMs);
 	
 	/**
 	 This is the place where the size/memory space for all arrays of this class is
@@ -243,6 +431,68 @@ public:
 	 Sets the positions of the speakers.
 	 */
 	static void setPositionOfSpeakers(const Array<SpeakerPosition>& positionOfSpeaker_);
+	
+	/**
+	 Chooses how the gains are calculated: Exact (the default), with a fast
+	 approximation of pow(..) or with a lookup table.
+	 See AEPGainCalculator for the accuracy of each mode.
+	 */
+	static void setGainAccuracyMode(AEPGainCalculator::AccuracyMode accuracyMode);
+	
+	/**
+	 Sets the gain below which a speaker is considered to be silent.
+	 
+	 Speakers whose gains are below the threshold at both ends of a segment
+	 are skipped (and cleared in getNextAudioBlock). This saves a lot of work
+	 at high orders, where most of the speakers receive (almost) nothing.
+	 The default is -96 dB.
+	 
+	 Call it through AudioRegionMixer::setAEPActiveChannelThreshold, which
+	 holds the lock of the audio callback.
+	 
+	 @param thresholdInDB	The threshold in dB. Use a very low value (e.g.
+							-1000) to process all speakers.
+	 */
+	static void setActiveChannelThreshold(double thresholdInDB);
+	
+	/**
+	 Switches between the direct panning to the speakers (AEP, the default)
+	 and the encoding to a Higher Order Ambisonics bus.
+	 
+	 If the HOA encoding is enabled, the channels of the buffers passed to
+	 getNextAudioBlock and addNextAudioBlockTo are the (hoaOrder+1)^2
+	 channels of the bus (see SphericalHarmonics) instead of the speakers.
+	 The distanceGain applies to all channels, and inside the center zone
+	 the higher degrees are faded out, like the modifiedOrder does it in
+	 the AEP panning.
+	 
+	 reallocateMemoryForTheArrays has to be called on all instances
+	 afterwards.
+	 */
+	static void enableHOAEncoding(bool enable, int hoaOrder);
+	
+	/**
+	 Sets the transformation of the whole scene. It is applied to every
+	 position of the spacial envelopes before the panning is calculated,
+	 such that the envelopes themselves don't have to be changed to
+	 rotate, move or scale the scene.
+	 
+	 Every instance fades to the new transformation within the next
+	 audio block (the same way as to a new spacial envelope).
+	 
+	 The doppler effect and the low pass filter of every instance use a
+	 transformed copy of its spacial envelope, which has to be prepared and
+	 handed over with prepareSceneTransform and postSceneTransform (see
+	 AudioRegionMixer::setSceneTransform). The live positions are
+	 transformed before they are handed to them. Since an arc is evaluated
+	 around the origin of the transformed scene there, the delay and the
+	 cutoff frequency follow a slightly different distance course than the
+	 panning along an arc, if the scene is translated.
+	 */
+	static void setSceneTransform(const SceneTransform& sceneTransform);
+	
+	/** Returns a copy of the transformation set with setSceneTransform. */
+	static SceneTransform getSceneTransform();
 
 	/** 
 	 Sets the distanceMode to 0. In this mode, distanceGain := 1, modifiedOrder := order.
@@ -291,42 +541,186 @@ public:
 	
 private:
 	/**
-	 It figures out the following parameters given the newPosition and
-     the nextSpacialPointIndex:
-     - nextSpacialPointIndex (if it was specified too low)
-     - previousSpacialPoint
-     - nextSpacialPoint
+	 It figures out the following parameters given the newPosition:
+     - spacialEnvelopeCursor (placed with a binary search, since this is
+       called after a jump only)
      - positionOfNextPoint
      - channelFactorAtNextPoint
      
-     Ensure the *nextSpacialPointIndex_ is really the next one seen from the
-     newPosition, or set it to 1 if there is doubt.
-     
      @param newPosition             The position in time (in samples) of interest.
-     @param nextSpacialPointIndex_  Will be modified.
-     This must be lower or equal to the index of
-     the next spacial point in the envelope.
-     If the value is lower, then it will be
-     increased until it is this index.
 	 */
-	inline void prepareForNewPosition (int newPosition,
-                                       int * nextSpacialPointIndex_);
+	inline void prepareForNewPosition (int newPosition);
+	
+	/**
+	 Reads the livePositionMailbox and hands the smoothed position to the
+	 doppler effect and the low pass filters. Called at the start of every
+	 block, before the mono signal is rendered.
+	 */
+	inline void updateLivePosition (int numSamples);
+	
+	/**
+	 Transforms the newSpacialEnvelope (or, with a patch and the same
+	 transformation as before, only its changed points) for the doppler
+	 effect and the low pass filter, and prepares the doppler effect.
+	 */
+	void prepareTransformedSpacialEnvelope (const SceneTransform& newSceneTransform,
+	                                        const SpacialEnvelope::Patch* patch);
+	
+	/** Hands the newTransformedSpacialEnvelope over to the doppler effect
+	 and the low pass filter. */
+	void postTransformedSpacialEnvelope ();
+	
+	/**
+	 Used by panMonoSignal instead of the spacial envelope, while the
+	 source follows the live positions: Ramps the gains to the ones at the
+	 livePosition.
+	 */
+	inline void panToLivePosition (const AudioSourceChannelInfo& info,
+	                               const float* monoSamples,
+	                               int numberOfChannels,
+	                               bool addToDestination);
+	
+	/** Returns the spacialGainTable, if it can be used for the
+	 spacialEnvelope, otherwise nullptr. */
+	inline const SpacialGainTable* getUsableSpacialGainTable () const;
+	
+	/** Calculates the gains of numberOfPoints points of the table's
+	 envelope, from the firstPointIndex on. Used by createSpacialGainTable
+	 and createPatchedSpacialGainTable.
+	 @return	false, if the settings have changed meanwhile. */
+	static bool calculateSpacialGains (SpacialGainTable& table,
+	                                   int firstPointIndex,
+	                                   int numberOfPoints);
+	
+	/**
+	 Does the panning of a block, after the mono signal has been rendered.
+	 Used by getNextAudioBlock and by addNextAudioBlockTo.
+	 
+	 @param info                The destination.
+	 @param monoSamples         The mono signal of this block. Points to the
+	                            sample that corresponds to info.startSample.
+	 @param addToDestination    If true, the panned signals are added to
+	                            info.buffer, otherwise they replace its content.
+	 */
+	void panMonoSignal (const AudioSourceChannelInfo& info,
+	                    const float* monoSamples,
+	                    bool addToDestination);
+	
+	/**
+	 Applies linear gain ramps to a segment of the mono signal and writes
+	 (or adds) the result to the first numberOfChannels channels of
+	 info.buffer.
+	 
+	 @param offset          The position of the segment, relative to the
+	                        start of the block.
+	 @param factorDeltas    The gain increment per sample for each channel.
+	                        If it's nullptr, the gains are constant.
+	 */
+	inline void applyChannelFactors (const AudioSourceChannelInfo& info,
+	                                 const float* monoSamples,
+	                                 int offset,
+	                                 int numSamples,
+	                                 const float* startFactors,
+	                                 const float* factorDeltas,
+	                                 int numberOfChannels,
+	                                 bool addToDestination);
+	
+	/**
+	 Renders the mono signal (with the gain envelope and maybe the
+	 doppler effect and the low pass filter) to the first channel of the
+	 monoDestination.
+	 */
+	inline void renderMonoSignal (AudioSampleBuffer& monoDestination, int numSamples);
+	
+	/**
+	 Used by prepareNextAudioBlock instead of applying the factors in
+	 applyChannelFactors: Stores the segment for addPreparedAudioBlockTo.
+	 Only uses the preallocated gainSegmentStorage.
+	 */
+	inline void recordGainSegment (int offset,
+	                               int numSamples,
+	                               const float* startFactors,
+	                               const float* factorDeltas,
+	                               int numberOfChannels);
+	
+	/**
+	 Makes sure the gain segments of a block of samplesPerBlockExpected
+	 samples fit in the gainSegmentStorage: Posts a larger one, if the
+	 spacial envelope needs more segments than the one posted last (or if
+	 reallocateMemoryForTheArrays has reset its capacity). Called by the
+	 thread that sets the envelopes.
+	 */
+	void reserveGainSegments (const SpacialEnvelope& envelope);
+	
+	/** The most segments panMonoSignal splits a block of blockSize
+	 samples into, for this envelope. */
+	static int getMaximumNumberOfGainSegments (const SpacialEnvelope& envelope, int blockSize);
+	
+	/** The criterion of updateActiveChannels, see there. */
+	static inline bool isChannelActive (float startFactor, float endFactor);
+	
+	/**
+	 Builds the list of activeChannels for a segment of numSamples samples,
+	 given the gains at its start and their increments per sample.
+	 */
+	inline void updateActiveChannels (int numSamples,
+	                                  const float* startFactors,
+	                                  const float* factorDeltas,
+	                                  int numberOfChannels);
+	
+	/**
+	 Calculates the gain factors of all channels for a source at (x, y, z),
+	 which has to be projected to the unit sphere: The AEP gains of the
+	 speakers or, if hoaEncodingEnabled, the HOA encoding gains.
+	 */
+	static inline void calculateChannelFactors (double x,
+	                                            double y,
+	                                            double z,
+	                                            double modifiedOrder,
+	                                            double distanceGain,
+	                                            float* factors,
+	                                            int numberOfChannels);
+	
+	/**
+	 Copies the numberOfChannelFactors gain factors from source to destination.
+	 */
+	inline void copyChannelFactors (float* destination, const float* source);
 	
 	/**
 	 Calculates the distanceGain and the modifiedOrder,
 	 according to the chosen AudioSourceAmbipanning::distanceMode.
+     The sceneTransform is applied to x, y and z first.
      r is also calculated and x, y, and z are normalised, such that they 
      describe the projection to the unit sphere.
 	 */
-	inline void calculationsForAEP (double& x, 
-                                    double& y, 
-                                    double& z, 
-                                    double& r,
-									double& distanceGain, 
-                                    double& modifiedOrder);
+	static inline void calculationsForAEP (double& x, 
+                                           double& y, 
+                                           double& z, 
+                                           double& r,
+                                           double& distanceGain, 
+                                           double& modifiedOrder);
 	
 	static double order;
 	static Array<SpeakerPosition> positionOfSpeaker;	
+	/** Calculates the gains of all speakers, given the position of the source.
+	 Holds a copy of the speaker coordinates. */
+	static AEPGainCalculator aepGainCalculator;
+	/** See enableHOAEncoding. */
+	static bool hoaEncodingEnabled;
+	static int hoaOrder;
+	/** See setActiveChannelThreshold. A gain factor, not in dB. */
+	static float activeChannelThreshold;
+	/** See setSceneTransform. */
+	static SceneTransform sceneTransform;
+	/** Incremented by setSceneTransform. Every instance compares it to its
+	 sceneTransformVersionInUse, to start the fade to the new transformation. */
+	static int sceneTransformVersion;
+	/** Incremented by every setter that changes the gains, such that the
+	 SpacialGainTable s calculated before can be recognised. */
+	static int spacialGainSettingsVersion;
+	/** Held by the setters that change the gains, and by
+	 createSpacialGainTable while it calculates the gains of a point. */
+	static CriticalSection spacialGainSettingsLock;
 	// for the distance calculations
 	static int distanceMode;		///< Determines which algorithm is chosen to 
                                     ///< calculate the 
@@ -369,22 +763,38 @@ private:
 	AudioSourceChannelInfo monoInfo;  // used in getNextAudioBlock(..).
 	AudioSampleBuffer monoBuffer;  // used in getNextAudioBlock(..).
 	
-    /** Holds the SpacialEnvelopePoints which define the
-     position / movement of the audio source in space over time.
-     
-     It is assumed by the code that the SpacialEnvelopePoints are
-     ordered in this array according to their position in time.
+	/** Hands the envelopes set with AudioSourceAmbipanning::setSpacialEnvelope
+	 over to the audio thread, without locks. The envelopes the audio thread
+	 doesn't use anymore are released by the EnvelopeReclaimer. */
+	EnvelopeHandoff<SpacialEnvelope> spacialEnvelopeHandoff;
+    /** Defines the position / movement of the audio source in space over
+     time. Never nullptr. Only used by the audio thread, it is the one in
+     the spacialEnvelopeHandoff.
      */
-	OwnedArray<SpacialEnvelopePoint> spacialEnvelope;
+	SpacialEnvelope* spacialEnvelope;
 
-	/** This is used by AudioSourceAmbipanning::setSpacialEnvelope and
-	 by AudioSourceAmbipanning::getNextAudioBlock when a new envelope is engaged.
+	/** The latest envelope set with AudioSourceAmbipanning::setSpacialEnvelope.
+	 Only used by the thread that sets the envelopes.
 	 */
-	OwnedArray<SpacialEnvelopePoint> newSpacialEnvelope;
+	SpacialEnvelope::Ptr newSpacialEnvelope;
 
-	SpacialEnvelopePointComparator spacialEnvelopePointComparator;
+	/** Set on the audio thread if the next block fades to the
+	 spacialEnvelope. */
 	bool newSpacialEnvelopeSet;
+	
+	/** The newSpacialEnvelope, transformed with the stageSceneTransform, for
+	 the doppler effect and the low pass filter. The same envelope, if the
+	 transformation is the identity. Only used by the thread that sets the
+	 envelopes.
+	 */
+	SpacialEnvelope::Ptr newTransformedSpacialEnvelope;
+	/** The transformation of the newTransformedSpacialEnvelope. */
+	SceneTransform stageSceneTransform;
+	/** True from prepareSceneTransform until postSceneTransform. */
+	bool transformedSpacialEnvelopePrepared;
+	
 	bool numberOfSpeakersChanged;
+	int sceneTransformVersionInUse;
 	bool constantSpacialPosition;
 	
 	int volatile nextPlayPosition;
@@ -398,28 +808,94 @@ private:
 	                            // in the previously processed audio block) + 1
 	                            // in samples, relative to the start of the audio
 	                            // file.
-	SpacialEnvelopePoint * previousSpacialPoint;
-	SpacialEnvelopePoint * nextSpacialPoint;
-	int nextSpacialPointIndex;
+	/** Points to the segment of the spacialEnvelope the playhead is in. */
+	EnvelopeCursor spacialEnvelopeCursor;
+	/** See setSpacialGainTable. */
+	SpacialGainTable::Ptr spacialGainTable;
+	
+	/** See setLivePositionMailbox. */
+	SpacialPositionMailbox::Ptr livePositionMailbox;
+	double livePositionSmoothingTimeInMs;
+	/** True from the first position read from the livePositionMailbox on,
+	 until the mailbox is removed. */
+	bool livePositionActive;
+	/** The smoothed position at the end of the current block. */
+	SpacialPosition livePosition;
     
     /* To save ressources, the AEP calculations are not done on every
      sample. Instead they are linearly approximated.
      Points for this linearisation are: The first sample of every audio block
      as well as each point in the spacial envelope.
      */
+    /* The gain factors are stored contiguously, one float per channel, such
+     that the GainRampKernels can work through one channel after the other.
+     Their size is numberOfChannelFactors, set in reallocateMemoryForTheArrays.
+     */
     /** A "Point" is eather a point of the spacial envelope or the point in time
      of the first sample in an audio block. */
-	Array<double> channelFactorAtPreviousPoint;
+	HeapBlock<float> channelFactorAtPreviousPoint;
     int positionOfPreviousPoint; /* The position in time. */
     /** A "Point" is eather a point of the spacial envelope or the point in time
      of the first sample in an audio block. */
-	Array<double> channelFactorAtNextPoint;
+	HeapBlock<float> channelFactorAtNextPoint;
     int positionOfNextPoint; /* The position in time. */
-	Array<double> channelFactor;
-	Array<double> channelFactorDelta;
-	Array<float*> sample;
+	HeapBlock<float> channelFactor;
+	HeapBlock<float> channelFactorDelta;
+	int numberOfChannelFactors;
+	/** The indices of the channels whose gains are above the
+	 activeChannelThreshold in the current segment, in ascending order.
+	 Set in updateActiveChannels. */
+	HeapBlock<int> activeChannels;
+	int numberOfActiveChannels;
 	int numberOfRemainingSamples;
 	
+	/** A segment with a linear gain ramp, recorded by
+	 prepareNextAudioBlock. */
+	struct GainSegment
+	{
+		int offset;
+		int numSamples;
+		bool hasRamp;
+	};
+	/** The gain segments recorded by prepareNextAudioBlock. Allocated by
+	 the thread that sets the envelopes and replaced (through the
+	 gainSegmentStorageHandoff) when a spacial envelope has more points in
+	 a block than the current one can hold, such that the audio thread
+	 never allocates. */
+	class GainSegmentStorage  : public ReferenceCountedObject
+	{
+	public:
+		GainSegmentStorage (int capacity_, int numberOfChannels_)
+		  : segments (capacity_),
+		    factors (2 * capacity_ * jmax (1, numberOfChannels_)),
+		    capacity (capacity_),
+		    numberOfChannels (numberOfChannels_)
+		{
+		}
+		
+		HeapBlock<GainSegment> segments;
+		/** For each of the segments: numberOfChannels start factors,
+		 followed by numberOfChannels deltas. */
+		HeapBlock<float> factors;
+		const int capacity; ///< In segments.
+		const int numberOfChannels;
+		
+		JUCE_DECLARE_NON_COPYABLE (GainSegmentStorage);
+	};
+	/** If true, applyChannelFactors calls recordGainSegment. */
+	bool recordGainSegments;
+	EnvelopeHandoff<GainSegmentStorage> gainSegmentStorageHandoff;
+	/** Never nullptr. Only used by the audio thread, it is the one in the
+	 gainSegmentStorageHandoff. */
+	GainSegmentStorage* gainSegmentStorage;
+	int numberOfGainSegments;
+	/** The capacity of the storage posted last. Only used by the thread
+	 that sets the envelopes. */
+	int postedGainSegmentCapacity;
+	int numberOfRecordedChannels;
+	/** The mono signal rendered by prepareNextAudioBlock. */
+	AudioSampleBuffer preparedMonoBuffer;
+	
 	CriticalSection callbackLock;
 	
 	JUCE_LEAK_DETECTOR (AudioSourceAmbipanning);
@@ -21,11 +21,13 @@ double SpacialPosition::unitScaleFactor = 1000.0;
 AudioSourceDopplerEffect::AudioSourceDopplerEffect (AudioSourceGainEnvelope& audioSourceGainEnvelope_, double sampleRate_)
   : audioSourceGainEnvelope (audioSourceGainEnvelope_),
     sampleRate (sampleRate_),
+    highestSlope (0.0),
+    lowestSlope (0.0),
     newSpacialEnvelopeSet (false),
-    previousSpacialPoint (),
-    nextSpacialPoint (),
+    livePositionEnabled (false),
     currentSpacialPosition (),
-    sourceBuffer(1,0)
+    sourceBuffer(1,0),
+    interpolationQuality (FractionalDelayInterpolator::qualityDefault)
 {
 	// DEB("AudioSourceDopplerEffect: constructor called.");
     
@@ -33,25 +35,15 @@ AudioSourceDopplerEffect::AudioSourceDopplerEffect (AudioSourceGainEnvelope& aud
     oneOverSampleRate = 1/sampleRate_;
     
     // Define an initial spacial envelope.
-	newSpacialEnvelope.add(new SpacialEnvelopePoint(0,      // time (in samples)
-                                                    0,      // x
-                                                    0,      // y
-                                                    0));	// z);
-	spacialEnvelope.addCopiesOf(newSpacialEnvelope);
+	newSpacialEnvelope = new SpacialEnvelope(0.0,      // x
+                                             0.0,      // y
+                                             0.0);     // z
+	spacialEnvelopeHandoff.post(newSpacialEnvelope.getObject());
+	spacialEnvelopeHandoff.update();
+	spacialEnvelope = spacialEnvelopeHandoff.get();
 	constantSpacialPosition = true;
     
-    // This is quite crappy, since every time a new instance is created, the
-    // static array valuesOfH will be recalculated.
-    // But I couldn't figure out a more elegant solution...
-    recalculateH(sampleRate_);
-    
-    // // Temp
-    // DEB("AudioSourceDopplerEffect constructor: ")
-    // for (double k = -halfTheInterpolationOrder; k < halfTheInterpolationOrder + 1.0; k += 0.1)
-    // {
-    //     DEB("h(" + String(k) + ") = " + String(h(k)))
-    // }
-    
+    updateInterpolator();
 }
 
 AudioSourceDopplerEffect::~AudioSourceDopplerEffect()
@@ -62,7 +54,11 @@ AudioSourceDopplerEffect::~AudioSourceDopplerEffect()
 /** Implementation of the AudioSource method. */
 void AudioSourceDopplerEffect::prepareToPlay (int samplesPerBlockExpected_, double sampleRate_)
 {
-    sampleRate = sampleRate_;
+    if (sampleRate != sampleRate_)
+    {
+        sampleRate = sampleRate_;
+        updateInterpolator();
+    }
     oneOverSampleRate = 1/sampleRate_;
     samplesPerBlockExpected = samplesPerBlockExpected_;
     
@@ -93,15 +89,13 @@ void AudioSourceDopplerEffect::setNextReadPosition (int64 newPosition)
 		// DEB("AudioSourceDopplerEffect.setNextReadPosition: expected newPosition: " 
 		// 	+ String(audioBlockEndPosition))
 		
-        if (!constantSpacialPosition)
+        // In between live positions, the delay just continues.
+        if (!constantSpacialPosition && !livePositionEnabled)
         {
             // Figure out between which audioEnvelopePoints we are right now
             // and set up all variables needed by getNextAudioBlock(..)
-            nextSpacialPointIndex = 1;
-            prepareForNewPosition(newPosition, 
-                                  &nextSpacialPointIndex,
-                                  &previousSpacialPoint,
-                                  &nextSpacialPoint,
+            spacialEnvelopeCursor.seek(*spacialEnvelope, newPosition);
+            prepareForNewPosition(newPosition,
                                   &currentSpacialPosition);
         }
 	}
@@ -110,7 +104,7 @@ void AudioSourceDopplerEffect::setNextReadPosition (int64 newPosition)
     
     // Set the nextPlayPosition for the audioSourceGainEnvelope
     // --------------------------------------------------------
-    if (constantSpacialPosition)
+    if (constantSpacialPosition && !livePositionEnabled)
     { 
         audioSourceGainEnvelope.setNextReadPosition(nextPlayPosition - constantSpacialPositionDelayTimeInSamples);
         // If the argument (nextPlayPosition - 
@@ -140,12 +134,58 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
     // Note:
     // Thanks to the previous call of getNextAudioBlock or setNextReadPosition()
     // we can be asured that
-    // - nextSpacialPointIndex
-    // - previousSpacialPoint
-    // - nextSpacialPoint
+    // - spacialEnvelopeCursor
     // - currentSpacialPosition
     // correspond to the audioBlockStartPosition (of the current audio block).
     
+    // A new spacial envelope has been set with setSpacialEnvelope(..). The
+    // old one is released by the EnvelopeReclaimer, not here.
+    if (spacialEnvelopeHandoff.update())
+    {
+        spacialEnvelope = spacialEnvelopeHandoff.get();
+        newSpacialEnvelopeSet = true;
+    }
+    
+    if (livePositionEnabled)
+    {
+        // Ramp the delay from the first sample of this audio block to the
+        // live position at the first sample of the next audio block. The
+        // spacial envelope (and a new one) is ignored until endLivePositions.
+        const double delayAtTheStart = currentSpacialPosition.getDelay()*sampleRate; // measured in samples
+        const double maximumChange = maximumLiveDelaySlope * info.numSamples;
+        const double delayAtTheEnd = jlimit (delayAtTheStart - maximumChange,
+                                             delayAtTheStart + maximumChange,
+                                             livePosition.getDelay()*sampleRate);
+        
+        int sampleOffsetCausedByDelay = ceil(delayAtTheStart);
+        const int audioBlockStartPositionInclDelay = audioBlockStartPosition - sampleOffsetCausedByDelay;
+        const double audioBlockStartPositionRemainder = double(sampleOffsetCausedByDelay) - delayAtTheStart; // in [0, 1[. unit: samples.
+        sampleOffsetCausedByDelay = ceil(delayAtTheEnd);
+        const int audioBlockEndPositionInclDelay = audioBlockEndPosition - sampleOffsetCausedByDelay;
+        const double audioBlockEndPositionRemainder = double(sampleOffsetCausedByDelay) - delayAtTheEnd; // in [0, 1[. unit: samples.
+        
+        renderDelayRamp (info,
+                         audioBlockStartPositionInclDelay, audioBlockStartPositionRemainder,
+                         audioBlockEndPositionInclDelay, audioBlockEndPositionRemainder);
+        
+        // Only the distance matters here. If the delay has been limited, a
+        // position with the limited delay is kept for the next block.
+        const double delayOfTheLivePosition = livePosition.getDelay()*sampleRate;
+        if (delayAtTheEnd == delayOfTheLivePosition)
+        {
+            currentSpacialPosition = livePosition;
+        }
+        else if (delayOfTheLivePosition > 0.0)
+        {
+            currentSpacialPosition = livePosition * (delayAtTheEnd / delayOfTheLivePosition);
+        }
+        else
+        {
+            currentSpacialPosition = currentSpacialPosition * (delayAtTheEnd / delayAtTheStart);
+        }
+        return;
+    }
+    
     if (newSpacialEnvelopeSet)
     {
         // Apply a ramp from the first sample of this audio block
@@ -153,9 +193,6 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
         // to the last sample of this audio block with the delay time
         // from the new spacial envelope.
         
-        spacialEnvelope.clear();
-        spacialEnvelope.addCopiesOf(newSpacialEnvelope);
-        
         // For the first sample (from the old spacial envelope).
         int sampleOffsetCausedByDelay = ceil(currentSpacialPosition.getDelay()*sampleRate);
         int audioBlockStartPositionInclDelay = audioBlockStartPosition - sampleOffsetCausedByDelay;
@@ -165,12 +202,14 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
         int audioBlockEndPositionInclDelay;
         double audioBlockEndPositionRemainder; // will be in [0, 1[. unit: samples.
         
-        if (spacialEnvelope.size() == 1)
+        if (spacialEnvelope->size() == 1)
         {
-            nextSpacialPoint = spacialEnvelope[0];
-            
             //            delayOnLastSample = nextSpacialPoint->getDistanceDelay();
-            double delayOfNewEnvelope = SpacialPosition(*nextSpacialPoint).getDelay()*sampleRate; // measured in samples
+            // Kept for the next fade (or live position).
+            currentSpacialPosition = SpacialPosition(spacialEnvelope->getX(0),
+                                                     spacialEnvelope->getY(0),
+                                                     spacialEnvelope->getZ(0));
+            double delayOfNewEnvelope = currentSpacialPosition.getDelay()*sampleRate; // measured in samples
             sampleOffsetCausedByDelay = ceil(delayOfNewEnvelope);
             audioBlockEndPositionInclDelay = audioBlockEndPosition - sampleOffsetCausedByDelay;
             audioBlockEndPositionRemainder = 0.0;
@@ -183,11 +222,8 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
             constantSpacialPosition = false;
             // We need to figure out the delay time on the last sample
             // (= the first sample of the next audio block)
-            nextSpacialPointIndex = 1;
+            spacialEnvelopeCursor.seek(*spacialEnvelope, audioBlockEndPosition);
             prepareForNewPosition(audioBlockEndPosition,
-                                  &nextSpacialPointIndex,
-                                  &previousSpacialPoint,
-                                  &nextSpacialPoint,
                                   &currentSpacialPosition);
                 // deltaSpacialPosition = The difference between
                 // two adjacent samples AFTER this audio block. I.e. the
@@ -201,148 +237,9 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
             audioBlockEndPositionRemainder = double(sampleOffsetCausedByDelay) - currentSpacialPosition.getDelay()*sampleRate; // in [0, 1[. unit: samples.
         }
         
-        // Figure out the lowest and highest sample positions needed.
-        // ----------------------------------------------------------
-        // (such that we can request a corresponding audio block from the
-        //  audioSourceGainEnvelope.)
-        // These values are absolute ones (according to the corresponding
-        // audio file)
-        
-        // These two soon will specify the block that will be requested.
-        int lowestPositionToRequest = INT_MAX;
-        int highestPositionToRequest = INT_MIN;
-        // If you are interested in a higher resolution (below the sample
-        // resolution) of the borders of this block:
-        double lowestPositionRemainder;  // This value will be in [0, 1[. unit: samples.
-        double highestPositionRemainder; // This value will be in [-1, 0[. unit: samples.
-        
-        // Remark: The reason why not everything is calculated in seconds:
-        // Precision issues which resulted in crackles (samples in between
-        // blocks with a value of 0).
-        
-        if (audioBlockStartPositionInclDelay < lowestPositionToRequest)
-        {
-            lowestPositionToRequest = audioBlockStartPositionInclDelay;
-            lowestPositionRemainder = audioBlockStartPositionRemainder;
-        }
-        if (audioBlockStartPositionInclDelay > highestPositionToRequest)
-        {
-            highestPositionToRequest = audioBlockStartPositionInclDelay;
-            highestPositionRemainder = audioBlockStartPositionRemainder;
-        }
-        
-        if (audioBlockEndPositionInclDelay < lowestPositionToRequest)
-        {
-            lowestPositionToRequest = audioBlockEndPositionInclDelay;
-            lowestPositionRemainder = sampleOffsetCausedByDelay - currentSpacialPosition.getDelay()*sampleRate;
-        }
-        if (audioBlockEndPositionInclDelay > highestPositionToRequest)
-        {
-            highestPositionToRequest = audioBlockEndPositionInclDelay;
-            highestPositionRemainder = sampleOffsetCausedByDelay - currentSpacialPosition.getDelay()*sampleRate;
-        }
-        
-        // We have to add 1 to the highestPositionToRequest since the
-        // exact value in seconds will be a little higher than 
-        // highestPositionToRequest*oneOverSampleRate and we would like
-        // to have this position in the audioblock we will request.
-        highestPositionToRequest++;
-        // The remainder needs to be changed accordingly.
-        highestPositionRemainder = highestPositionRemainder - 1.0;
-        // This value will now be in [-1, 0[. unit: samples.
-      
-        
-        // Fill the sourceBuffer with samples
-        // ----------------------------------
-        
-        int numberOfSamplesForAudioBlock = highestPositionToRequest - lowestPositionToRequest + 1;
-        // Why "+1"?
-        // Example: h=2, l=0  =>  numberOfSamples must be 3 (0,1 and 2).
-        
-        // We also need to take into account some additional samples on both
-        // sides to be able to do interpolation.
-        numberOfSamplesForAudioBlock = numberOfSamplesForAudioBlock + 2*halfTheInterpolationOrder;
-        
-        // The sourceInfo.buffer needs to be big enough.
-        // This has been ensured in the method setSpacialEnvelope.
-        // But if the info.numSamples is much bigger than
-        // the samplesPerBlockExpected, we need to allocate more memory.
-        // Remark: Memory allocation is something we don't like in the
-        // audio thread. But this one here seems necessary.
-        if (sourceInfo.buffer->getNumSamples() < numberOfSamplesForAudioBlock)
-        {
-            DEB("AudioSourceDopplerEffect: Crap, MEMORY ALLOCATION in the "
-                "getNextAudioBlock during the transition from an old "
-                "to a new spacial envelope!!!"
-                "sourceInfo.buffer->getNumSamples() = " 
-                + String(sourceInfo.buffer->getNumSamples()))
-            
-            bool keepExistingContent = false;
-            sourceInfo.buffer->setSize(1, 
-                                       numberOfSamplesForAudioBlock, 
-                                       keepExistingContent);
-        }
-        
-        // Request the audio block from audioSourceGainEnvelope
-        audioSourceGainEnvelope.setNextReadPosition(lowestPositionToRequest - halfTheInterpolationOrder);
-        sourceInfo.startSample = 0;
-        sourceInfo.numSamples = numberOfSamplesForAudioBlock;
-        audioSourceGainEnvelope.getNextAudioBlock(sourceInfo);
-        
-        
-        // Do the actual work (fill that info buffer)
-        // ==========================================
-        // For every sample in the AudioSampleBuffer info, figure out the
-        // (delayed) position in the audio file.
-        
-        float * sampleOfSource = sourceInfo.buffer->getSampleData(0);
-        // Since we have requested some additional samples on both borders
-        // for the sake of interpolation, we need to set the pointer
-        // to the first requested sample.
-        sampleOfSource += halfTheInterpolationOrder;
-        
-        float * sampleOfDestination = info.buffer->getSampleData(0);
-        // Maybe there is an offset for the source buffer, so take care
-        // of that:
-        sampleOfDestination += info.startSample;        
-        
-        // It can happen that 0 samples are requested.
-        if (info.numSamples != 0)
-        {
-            // Take care of the first sample of the block
-            int startSampleInSource = audioBlockStartPositionInclDelay - lowestPositionToRequest;
-            sampleOfSource += startSampleInSource;
-            double interSampleRemainder = audioBlockStartPositionRemainder; // In [0, 1[. Unit: Samples.
-            
-            // THE ACTUAL INTERPOLATION
-            // \/  \/  \/  \/  \/  \/  \/
-            *sampleOfDestination = interpolate(sampleOfSource, interSampleRemainder);
-            
-            
-            // The distance between two sample positions in the source:
-            double sampleOffsetBetweenNeighbours = (double(audioBlockEndPositionInclDelay) + audioBlockEndPositionRemainder - (double(audioBlockStartPositionInclDelay) + audioBlockStartPositionRemainder))/double(info.numSamples);
-            
-            // Take care of the remaining samples.
-            for (int i = 1; i != info.numSamples; i++)
-            {
-                // Go to the next sample in the destination.
-                sampleOfDestination++;
-                
-                // Figure out the fraction of samples we have to move in 
-                // the source.
-                interSampleRemainder += sampleOffsetBetweenNeighbours;
-                int sampleOffset = floor(interSampleRemainder);
-                // Be aware that e.g. floor(-1.5) = -2
-                interSampleRemainder = interSampleRemainder - double(sampleOffset);
-                
-                // Go to the next sample in the source.
-                sampleOfSource += sampleOffset;
-                
-                // THE ACTUAL INTERPOLATION
-                // \/  \/  \/  \/  \/  \/  \/
-                *sampleOfDestination = interpolate(sampleOfSource, interSampleRemainder);
-            }
-        }
+        renderDelayRamp (info,
+                         audioBlockStartPositionInclDelay, audioBlockStartPositionRemainder,
+                         audioBlockEndPositionInclDelay, audioBlockEndPositionRemainder);
         
         newSpacialEnvelopeSet = false;
     }
@@ -395,18 +292,16 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
             // Precision issues which resulted in crackles (samples in between
             // blocks with a value of 0).
             
-            bool envelopePointsInThisBlock = nextSpacialPoint->getPosition() < audioBlockEndPosition ? true : false;
+            const SpacialEnvelope& envelope = *spacialEnvelope;
+            bool envelopePointsInThisBlock = envelope.getPosition(spacialEnvelopeCursor.getNextIndex()) < audioBlockEndPosition ? true : false;
             
             // Figure out the positions in time (incl. delay) of all spacial
             // points contained in this block - if any.
             if (envelopePointsInThisBlock)
             {
-                while (nextSpacialPoint->getPosition() < audioBlockEndPosition)
+                while (envelope.getPosition(spacialEnvelopeCursor.getNextIndex()) < audioBlockEndPosition)
                 {
-                    prepareForNewPosition(nextSpacialPoint->getPosition(),
-                                          &nextSpacialPointIndex,
-                                          &previousSpacialPoint,
-                                          &nextSpacialPoint,
+                    prepareForNewPosition(envelope.getPosition(spacialEnvelopeCursor.getNextIndex()),
                                           &currentSpacialPosition);
                         // This will set the nextSpacialPoint to
                         // the previousSpacialPoint!
@@ -414,7 +309,7 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
                         // It will also set currentSpacialPosition which
                         // corresponds to the (newly set) previousSpacialPoint.
                     sampleOffsetCausedByDelay = ceil(currentSpacialPosition.getDelay()*sampleRate);
-                    int positionOfCurrentSpacialPoint = previousSpacialPoint->getPosition()
+                    int positionOfCurrentSpacialPoint = envelope.getPosition(spacialEnvelopeCursor.getPreviousIndex())
                     - sampleOffsetCausedByDelay;
                     if (positionOfCurrentSpacialPoint < lowestPositionToRequest)
                     {
@@ -435,9 +330,6 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
             // Figure out the position (incl. delay) of audioBlockEndPosition
             // (the first sample of the next audio block):
             prepareForNewPosition(audioBlockEndPosition, 
-                                  &nextSpacialPointIndex,
-                                  &previousSpacialPoint,
-                                  &nextSpacialPoint,
                                   &currentSpacialPosition);
                 // To set the currentSpacialPosition
             sampleOffsetCausedByDelay = ceil(currentSpacialPosition.getDelay()*sampleRate);
@@ -485,7 +377,7 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
             
             // We also need to take into account some additional samples on both
             // sides to be able to do interpolation.
-            numberOfSamplesForAudioBlock = numberOfSamplesForAudioBlock + 2*halfTheInterpolationOrder;
+            numberOfSamplesForAudioBlock = numberOfSamplesForAudioBlock + 2*interpolator->getHalfTheNumberOfTaps();
             
             // The sourceInfo.buffer needs to be big enough.
             // This has been ensured in the method setSpacialEnvelope.
@@ -506,7 +398,7 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
                                            keepExistingContent);
             }
            
-            audioSourceGainEnvelope.setNextReadPosition(lowestPositionToRequest - halfTheInterpolationOrder);
+            audioSourceGainEnvelope.setNextReadPosition(lowestPositionToRequest - interpolator->getHalfTheNumberOfTaps());
             sourceInfo.startSample = 0;
             sourceInfo.numSamples = numberOfSamplesForAudioBlock;
             audioSourceGainEnvelope.getNextAudioBlock(sourceInfo);
@@ -518,11 +410,11 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
             // For every sample in the AudioSampleBuffer info, figure out the
             // (delayed) position in the audio file.
             
-            float * sampleOfSource = sourceInfo.buffer->getSampleData(0);
+            const float * sampleOfSource = sourceInfo.buffer->getSampleData(0);
             // Since we have requested some additional samples on both borders
             // for the sake of interpolation, we need to set the pointer
             // to the first requested sample.
-            sampleOfSource += halfTheInterpolationOrder;
+            sampleOfSource += interpolator->getHalfTheNumberOfTaps();
             
             float * sampleOfDestination = info.buffer->getSampleData(0);
             // Maybe there is an offset for the source buffer, so take care
@@ -542,34 +434,16 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
                     sampleOfSource += startSampleInSource;
                     double interSampleRemainder = audioBlockStartPositionRemainder; // In [0, 1[. Unit: Samples.
                     
-                    // THE ACTUAL INTERPOLATION
-                    // \/  \/  \/  \/  \/  \/  \/
-                    *sampleOfDestination = interpolate(sampleOfSource, interSampleRemainder);
-                    
-                    
                     // The distance between two sample positions in the source:
                     double sampleOffsetBetweenNeighbours = (double(audioBlockEndPositionInclDelay) + audioBlockEndPositionRemainder - (double(audioBlockStartPositionInclDelay) + audioBlockStartPositionRemainder))/double(info.numSamples);
                     
-                    // Take care of the remaining samples.
-                    for (int i = 1; i != info.numSamples; i++)
-                    {
-                        // Go to the next sample in the destination.
-                        sampleOfDestination++;
-                        
-                        // Figure out the fraction of samples we have to move in 
-                        // the source.
-                        interSampleRemainder += sampleOffsetBetweenNeighbours;
-                        int sampleOffset = floor(interSampleRemainder);
-                        // Be aware that e.g. floor(-1.5) = -2
-                        interSampleRemainder = interSampleRemainder - double(sampleOffset);
-                        
-                        // Go to the next sample in the source.
-                        sampleOfSource += sampleOffset;
-                        
-                        // THE ACTUAL INTERPOLATION
-                        // \/  \/  \/  \/  \/  \/  \/
-                        *sampleOfDestination = interpolate(sampleOfSource, interSampleRemainder);
-                    }
+                    // THE ACTUAL INTERPOLATION
+                    // \/  \/  \/  \/  \/  \/  \/
+                    interpolator->interpolateSegment(sampleOfSource,
+                                                     interSampleRemainder,
+                                                     sampleOffsetBetweenNeighbours,
+                                                     sampleOfDestination,
+                                                     info.numSamples);
                 }
             }
             
@@ -591,98 +465,56 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
                 
                 while (true)
                 {    
-                    if (nextSpacialPoint->getPosition() >= audioBlockEndPosition )
+                    if (envelope.getPosition(spacialEnvelopeCursor.getNextIndex()) >= audioBlockEndPosition )
                     {
-                        // Take care of the first sample.
-                        // THE ACTUAL INTERPOLATION
-                        // \/  \/  \/  \/  \/  \/  \/
-                        *sampleOfDestination = interpolate(sampleOfSource, interSampleRemainder);
-                        
-                        // Take care of the remaining samples.
-                        
                         // The distance between two sample positions in the source:
                         int numberOfSamplesBetweenPoints = audioBlockEndPosition - currentPosition;
                         double sampleOffsetBetweenNeighbours = (double(audioBlockEndPositionInclDelay) + audioBlockEndPositionRemainder - (double(currentPositionInclDelay) + currentPositionRemainder))/double(numberOfSamplesBetweenPoints);
                         
-                        currentPosition++;
-                        // Go to the next sample in the destination.
-                        sampleOfDestination++;
-                        while (currentPosition != audioBlockEndPosition)
-                        {
-                            // Figure out the fraction of samples we have to move in 
-                            // the source.
-                            interSampleRemainder += sampleOffsetBetweenNeighbours;
-                            int sampleOffset = floor(interSampleRemainder);
-                            // Be aware that e.g. floor(-1.5) = -2
-                            interSampleRemainder = interSampleRemainder - double(sampleOffset);
-                            
-                            // Go to the next sample in the source.
-                            sampleOfSource += sampleOffset;
-                            
-                            // THE ACTUAL INTERPOLATION
-                            // \/  \/  \/  \/  \/  \/  \/
-                            *sampleOfDestination = interpolate(sampleOfSource, interSampleRemainder);
-                            
-                            currentPosition++;
-                            // Go to the next sample in the destination.
-                            sampleOfDestination++;
-                        }                        
+                        // THE ACTUAL INTERPOLATION
+                        // \/  \/  \/  \/  \/  \/  \/
+                        interpolator->interpolateSegment(sampleOfSource,
+                                                         interSampleRemainder,
+                                                         sampleOffsetBetweenNeighbours,
+                                                         sampleOfDestination,
+                                                         numberOfSamplesBetweenPoints);
                         break;
                     }
                     else
                     {
-                        // Take care of the first sample.
-                        // ------------------------------
-                        // THE ACTUAL INTERPOLATION
-                        // \/  \/  \/  \/  \/  \/  \/
-                        *sampleOfDestination = interpolate(sampleOfSource, interSampleRemainder);
-                        
-                        // Preparations for the upcoming loop.
+                        // Preparations for the interpolation.
                         // -----------------------------------
                         // Figure out
                         // - nextSpacialPointPositionInclDelay and
                         // - nextSpacialPointPositionRemainder
-                        SpacialPosition nextSpacialPointPosition(*nextSpacialPoint);
+                        const int next = spacialEnvelopeCursor.getNextIndex();
+                        const int positionOfNextSpacialPoint = envelope.getPosition(next);
+                        SpacialPosition nextSpacialPointPosition(envelope.getX(next),
+                                                                 envelope.getY(next),
+                                                                 envelope.getZ(next));
                         sampleOffsetCausedByDelay = ceil(nextSpacialPointPosition.getDelay()*sampleRate);
-                        int nextSpacialPointPositionInclDelay = nextSpacialPoint->getPosition() - sampleOffsetCausedByDelay;
+                        int nextSpacialPointPositionInclDelay = positionOfNextSpacialPoint - sampleOffsetCausedByDelay;
                         double nextSpacialPointPositionRemainder = double(sampleOffsetCausedByDelay) - nextSpacialPointPosition.getDelay()*sampleRate;
-                        int numberOfSamplesBetweenPoints = nextSpacialPoint->getPosition() - currentPosition;                        
+                        int numberOfSamplesBetweenPoints = positionOfNextSpacialPoint - currentPosition;                        
                         // The distance between two sample positions in the source:
                         double sampleOffsetBetweenNeighbours = (double(nextSpacialPointPositionInclDelay) + nextSpacialPointPositionRemainder - (double(currentPositionInclDelay) + currentPositionRemainder))/double(numberOfSamplesBetweenPoints);
                         
-                        // Take care of the remaining samples.
-                        // -----------------------------------
-                        currentPosition++;
-                        // Go to the next sample in the destination.
-                        sampleOfDestination++;
-                        while (currentPosition != nextSpacialPoint->getPosition())
-                        {
-                            // Figure out the fraction of samples we have to move in 
-                            // the source.
-                            interSampleRemainder += sampleOffsetBetweenNeighbours;
-                            int sampleOffset = floor(interSampleRemainder);
-                            // Be aware that e.g. floor(-1.5) = -2
-                            interSampleRemainder = interSampleRemainder - double(sampleOffset);
-                            
-                            // Go to the next sample in the source.
-                            sampleOfSource += sampleOffset;
-                            
-                            // THE ACTUAL INTERPOLATION
-                            // \/  \/  \/  \/  \/  \/  \/
-                            *sampleOfDestination = interpolate(sampleOfSource, interSampleRemainder);
-                            
-                            currentPosition++;
-                            // Go to the next sample in the destination.
-                            sampleOfDestination++;
-                        }
+                        // Take care of the samples up to the next spacial point.
+                        // -------------------------------------------------------
+                        // THE ACTUAL INTERPOLATION
+                        // \/  \/  \/  \/  \/  \/  \/
+                        interpolator->interpolateSegment(sampleOfSource,
+                                                         interSampleRemainder,
+                                                         sampleOffsetBetweenNeighbours,
+                                                         sampleOfDestination,
+                                                         numberOfSamplesBetweenPoints);
+                        sampleOfDestination += numberOfSamplesBetweenPoints;
+                        currentPosition = positionOfNextSpacialPoint;
                         
                         // Now we are at the position currentPosition = next spacial point.
                         
                         // Get the parameters of the current position (= next spacial point).
-                        prepareForNewPosition(nextSpacialPoint->getPosition(),
-                                              &nextSpacialPointIndex,
-                                              &previousSpacialPoint,
-                                              &nextSpacialPoint,
+                        prepareForNewPosition(positionOfNextSpacialPoint,
                                               &currentSpacialPosition);
                         // This will set the nextSpacialPoint to
                         // the previousSpacialPoint!
@@ -690,7 +522,7 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
                         // It will also set currentSpacialPosition which
                         // corresponds to the (newly set) previousSpacialPoint.
                         sampleOffsetCausedByDelay = ceil(currentSpacialPosition.getDelay()*sampleRate);
-                        currentPositionInclDelay = previousSpacialPoint->getPosition() - sampleOffsetCausedByDelay;
+                        currentPositionInclDelay = envelope.getPosition(spacialEnvelopeCursor.getPreviousIndex()) - sampleOffsetCausedByDelay;
                         currentPositionRemainder = double(sampleOffsetCausedByDelay) - currentSpacialPosition.getDelay()*sampleRate;
                     }
                 }
@@ -699,6 +531,138 @@ void AudioSourceDopplerEffect::getNextAudioBlock (const AudioSourceChannelInfo&
     }
 }
 
+void AudioSourceDopplerEffect::renderDelayRamp (const AudioSourceChannelInfo& info,
+                                                int audioBlockStartPositionInclDelay,
+                                                double audioBlockStartPositionRemainder,
+                                                int audioBlockEndPositionInclDelay,
+                                                double audioBlockEndPositionRemainder)
+{
+    // Figure out the lowest and highest sample positions needed.
+    // ----------------------------------------------------------
+    // (such that we can request a corresponding audio block from the
+    //  audioSourceGainEnvelope.)
+    // These values are absolute ones (according to the corresponding
+    // audio file)
+    int lowestPositionToRequest = jmin (audioBlockStartPositionInclDelay, audioBlockEndPositionInclDelay);
+    int highestPositionToRequest = jmax (audioBlockStartPositionInclDelay, audioBlockEndPositionInclDelay);
+    
+    // Remark: The reason why not everything is calculated in seconds:
+    // Precision issues which resulted in crackles (samples in between
+    // blocks with a value of 0).
+    
+    // We have to add 1 to the highestPositionToRequest since the
+    // exact value in seconds will be a little higher than 
+    // highestPositionToRequest*oneOverSampleRate and we would like
+    // to have this position in the audioblock we will request.
+    highestPositionToRequest++;
+    
+    
+    // Fill the sourceBuffer with samples
+    // ----------------------------------
+    
+    int numberOfSamplesForAudioBlock = highestPositionToRequest - lowestPositionToRequest + 1;
+    // Why "+1"?
+    // Example: h=2, l=0  =>  numberOfSamples must be 3 (0,1 and 2).
+    
+    // We also need to take into account some additional samples on both
+    // sides to be able to do interpolation.
+    numberOfSamplesForAudioBlock = numberOfSamplesForAudioBlock + 2*interpolator->getHalfTheNumberOfTaps();
+    
+    // The sourceInfo.buffer needs to be big enough.
+    // This has been ensured in the method setSpacialEnvelope (or in
+    // prepareForLivePositions).
+    // But if the info.numSamples is much bigger than
+    // the samplesPerBlockExpected, we need to allocate more memory.
+    // Remark: Memory allocation is something we don't like in the
+    // audio thread. But this one here seems necessary.
+    if (sourceInfo.buffer->getNumSamples() < numberOfSamplesForAudioBlock)
+    {
+        DEB("AudioSourceDopplerEffect: Crap, MEMORY ALLOCATION in the "
+            "getNextAudioBlock during a delay ramp!!!"
+            "sourceInfo.buffer->getNumSamples() = " 
+            + String(sourceInfo.buffer->getNumSamples()))
+        
+        bool keepExistingContent = false;
+        sourceInfo.buffer->setSize(1, 
+                                   numberOfSamplesForAudioBlock, 
+                                   keepExistingContent);
+    }
+    
+    // Request the audio block from audioSourceGainEnvelope
+    audioSourceGainEnvelope.setNextReadPosition(lowestPositionToRequest - interpolator->getHalfTheNumberOfTaps());
+    sourceInfo.startSample = 0;
+    sourceInfo.numSamples = numberOfSamplesForAudioBlock;
+    audioSourceGainEnvelope.getNextAudioBlock(sourceInfo);
+    
+    
+    // Do the actual work (fill that info buffer)
+    // ==========================================
+    // For every sample in the AudioSampleBuffer info, figure out the
+    // (delayed) position in the audio file.
+    
+    const float * sampleOfSource = sourceInfo.buffer->getSampleData(0);
+    // Since we have requested some additional samples on both borders
+    // for the sake of interpolation, we need to set the pointer
+    // to the first requested sample.
+    sampleOfSource += interpolator->getHalfTheNumberOfTaps();
+    
+    float * sampleOfDestination = info.buffer->getSampleData(0);
+    // Maybe there is an offset for the source buffer, so take care
+    // of that:
+    sampleOfDestination += info.startSample;        
+    
+    // It can happen that 0 samples are requested.
+    if (info.numSamples != 0)
+    {
+        // Take care of the first sample of the block
+        int startSampleInSource = audioBlockStartPositionInclDelay - lowestPositionToRequest;
+        sampleOfSource += startSampleInSource;
+        double interSampleRemainder = audioBlockStartPositionRemainder; // In [0, 1[. Unit: Samples.
+        
+        // The distance between two sample positions in the source:
+        double sampleOffsetBetweenNeighbours = (double(audioBlockEndPositionInclDelay) + audioBlockEndPositionRemainder - (double(audioBlockStartPositionInclDelay) + audioBlockStartPositionRemainder))/double(info.numSamples);
+        
+        // THE ACTUAL INTERPOLATION
+        // \/  \/  \/  \/  \/  \/  \/
+        interpolator->interpolateSegment(sampleOfSource,
+                                         interSampleRemainder,
+                                         sampleOffsetBetweenNeighbours,
+                                         sampleOfDestination,
+                                         info.numSamples);
+    }
+}
+
+void AudioSourceDopplerEffect::prepareForLivePositions ()
+{
+    // The delay changes by at most maximumLiveDelaySlope samples per
+    // sample, see setLivePosition.
+    const int maxSamplesPerBlockForSource = std::ceil(samplesPerBlockExpected * (1.0 + maximumLiveDelaySlope) * 1.5)
+                                            + 2 + 2*interpolator->getHalfTheNumberOfTaps();
+    if (sourceInfo.buffer->getNumSamples() < maxSamplesPerBlockForSource)
+    {
+        bool keepExistingContent = true;
+        sourceInfo.buffer->setSize(1, 
+                                   maxSamplesPerBlockForSource, 
+                                   keepExistingContent);
+    }
+}
+
+void AudioSourceDopplerEffect::setLivePosition (const SpacialPosition& position)
+{
+    livePosition = position;
+    livePositionEnabled = true;
+}
+
+void AudioSourceDopplerEffect::endLivePositions ()
+{
+    if (livePositionEnabled)
+    {
+        livePositionEnabled = false;
+        // Fades back to the spacial envelope within the next block.
+        newSpacialEnvelopeSet = true;
+    }
+}
+
 /** Implements the PositionableAudioSource method. */
 int64 AudioSourceDopplerEffect::getNextReadPosition () const
 {
@@ -718,20 +682,47 @@ bool AudioSourceDopplerEffect::isLooping () const
 	return audioSourceGainEnvelope.isLooping();
 }
 
-void AudioSourceDopplerEffect::setSpacialEnvelope (const Array<SpacialEnvelopePoint>& newSpacialEnvelope_)
+void AudioSourceDopplerEffect::setSpacialEnvelope (const SpacialEnvelope::Ptr& newSpacialEnvelope_,
+                                                   const SpacialEnvelope::Patch* patch)
 {
     // DEB("AudioSourceDopplerEffect: setSpacialEnvelope called")
 	
-	if (newSpacialEnvelope_.size() != 0)
+	if (newSpacialEnvelope_ != nullptr)
 	{
-        // STEP 1: Copy the envelope
-        // -------------------------
-        // Copy the elements over from the Array newSpacialEnvelope_ to the
-        // OwnedArray newSpacialEnvelope.
-        newSpacialEnvelope.clear();
-        for (int i=0; i!=newSpacialEnvelope_.size(); ++i)
+        prepareSpacialEnvelope (newSpacialEnvelope_, patch);
+        postSpacialEnvelope();
+    }
+    else
+    {
+		DEB("AudioSourceDopplerEffect: The newSpacialEnvelope is empty! The spacial envelope hasn't been changed.")
+	}
+}
+
+void AudioSourceDopplerEffect::prepareSpacialEnvelope (const SpacialEnvelope::Ptr& newSpacialEnvelope_,
+                                                       const SpacialEnvelope::Patch* patch)
+{
+	if (newSpacialEnvelope_ != nullptr)
+	{
+        // STEP 1: The envelope
+        // --------------------
+        // The envelope is immutable and therefore isn't copied. A new one is
+        // only created in STEP 3, if points have to be added.
+        const SpacialEnvelope& envelope = *newSpacialEnvelope_;
+        
+        // A patch can only be applied to the envelope it has been made for.
+        const bool patchIsApplicable = patch != nullptr
+            && sourceSpacialEnvelope != nullptr
+            && patch->startIndex + patch->numberOfRemovedPoints <= sourceSpacialEnvelope->size()
+            && envelope.size() == sourceSpacialEnvelope->size() - patch->numberOfRemovedPoints + patch->numberOfInsertedPoints
+            && newSpacialEnvelope->size() == sourceSpacialEnvelope->size() + closestPointPositions.size();
+        
+        // The changed segments (all of them, if there is no patch).
+        int firstSegment = 0;
+        int endSegment = envelope.size() - 1;
+        if (patchIsApplicable)
         {
-            newSpacialEnvelope.add(new SpacialEnvelopePoint(newSpacialEnvelope_[i]));
+            firstSegment = jmax (0, patch->startIndex - 1);
+            endSegment = jmin (endSegment, patch->startIndex + patch->numberOfInsertedPoints);
         }
         
         // STEP 2: Set the buffer size
@@ -742,41 +733,15 @@ void AudioSourceDopplerEffect::setSpacialEnvelope (const Array<SpacialEnvelopePo
         // if the distance to the origin is closer than on the other two points.
         // The change in distance (per sample) is bigger on the 2 original
         // points. Thats why this step comes first (to save some calculations).
-        
-        double highestSlope = 0.0; // seconds / sample
-        double lowestSlope = 0.0; // seconds / sample
-        // if newSpacialEnvelope.size() == 1, highestSlope = lowestSlope = 0
-        if (newSpacialEnvelope.size() > 1)
+        // After a patch, only the changed segments are looked at (the
+        // buffer never shrinks anyway).
+        if (! patchIsApplicable)
         {
-            for (int k=1; k<newSpacialEnvelope.size(); k++)
-            {
-                SpacialEnvelopePoint * previousEnvPoint = newSpacialEnvelope[k-1];
-                SpacialEnvelopePoint * nextEnvPoint = newSpacialEnvelope[k];
-                
-                if (previousEnvPoint != nextEnvPoint)
-                {
-                    // Figure out the highest and lowest change of [distance
-                    // to origin] between two adjecent samples on this segment
-                    // of the envelope.
-                    
-                    // The time distance in samples between the two
-                    // spacial envelope points
-                    double distance = double (nextEnvPoint->getPosition() - previousEnvPoint->getPosition());
-                    
-                    SpacialPosition previousPoint (*previousEnvPoint);
-                    SpacialPosition nextPoint (*nextEnvPoint);
-                    SpacialPosition spacialDelta = (nextPoint - previousPoint) * (1./distance);
-                    SpacialPosition previousPointPlusOne = previousPoint + spacialDelta;
-                    SpacialPosition nextPointMinusOne = nextPoint - spacialDelta;
-                    
-                    double slope1 = previousPointPlusOne.getDelay() - previousPoint.getDelay(); // seconds / sample
-                    double slope2 = nextPoint.getDelay() - nextPointMinusOne.getDelay(); // seconds / sample
-                    
-                    highestSlope = jmax(jmax(highestSlope, slope1), slope2); // will be >= 0
-                    lowestSlope = jmin(jmin(lowestSlope, slope1), slope2); // will be <= 0
-                }
-            }
+            highestSlope = 0.0; // seconds / sample
+            lowestSlope = 0.0; // seconds / sample
         }
+        calculateSlopes (envelope, firstSegment, endSegment);
+        
         // The highest and lowest time difference between two adjacent
         // (output) samples.
         double regularDifference = oneOverSampleRate;
@@ -822,266 +787,318 @@ void AudioSourceDopplerEffect::setSpacialEnvelope (const Array<SpacialEnvelopePo
         // If so, add this point to the envelope.
         // At the end of this procedure, the points closest and farest away
         // from the origin are explicit points of the envelope.
-        OwnedArray<SpacialEnvelopePoint> closestPointsInBetween;
-        if (newSpacialEnvelope.size()>1)
+        if (! patchIsApplicable || ! patchSpacialEnvelope (envelope, *patch))
         {
-            for (int i=1; i!=newSpacialEnvelope.size(); ++i)
+            // The points are found segment by segment and are therefore sorted.
+            Array<SpacialEnvelopePoint> closestPointsInBetween;
+            closestPointPositions.clearQuick();
+            for (int i = 0; i < envelope.size() - 1; ++i)
             {
-                SpacialPosition a = SpacialPosition(newSpacialEnvelope[i-1]->getX(),
-                                                    newSpacialEnvelope[i-1]->getY(),
-                                                    newSpacialEnvelope[i-1]->getZ());
-                SpacialPosition b = SpacialPosition(newSpacialEnvelope[i]->getX(),
-                                                    newSpacialEnvelope[i]->getY(),
-                                                    newSpacialEnvelope[i]->getZ());
-                // a and b are positions in space without a 4rd time argument
-                // like SpacialEnvelopePoints.
-                
-                // If a == b they are at the same position in space and
-                // all points in between are equally close to the origin.
-                if (a != b)
+                SpacialEnvelopePoint closestPoint;
+                if (findClosestPoint (envelope, i, closestPoint))
                 {
-                    // See my notes 120123_doppler_fx_closest_point.tif for
-                    // more details of the upcoming calculation.
-                    
-                    // n is a vector that specifies the direction of the line
-                    // defined by a and b.
-                    SpacialPosition n = b - a;
-                    
-                    // With the scalar product, we can specify a plane
-                    // that is perpendicular to the line and intersects with
-                    // the origin:
-                    //  {r in Reals^3 ; <r,n> = 0}
-                    //
-                    // The line can be parametrised:
-                    //  {a + t*n ; t in Reals}
-                    //
-                    // The intersection of the line and the plane will result
-                    // in the point (p) on the line closest to the origin.
-                    // So lets intersect!
-                    // I.e. put the parametrised line into the equation of
-                    // the plane and solve for t...
-                    //  <a + tn, n> = 0
-                    //  <a,n> + t <n,n> = 0
-                    //  t = - <a,n>/<n,n>
-                    // ... and put this t into the parametrisation of the line:
-                    //  p = a - <a,n>/<n,n> * n
-                    
-                    // The point closest to the origin
-                    SpacialPosition p = a - ((a*n)/(n*n))*n;
-                    
-                    // Does this point lie in between a and b?
-                    // It is sufficient to look at one coordinate.
-                    double * smallerX = a.x < b.x ? &a.x : &b.x;
-                    double * biggerX =  a.x < b.x ? &b.x : &a.x;
-                    if (p.x > *smallerX && p.x < *biggerX)
-                    {
-                        // If the point lies in between a and b,
-                        // add it to the closestPointsInBetween array.
-                        // (Otherwise don't)
-                        
-                        // Figure out the time position for this new point
-                        double positionOfA = double (newSpacialEnvelope[i-1]->getPosition());
-                        double positionOfB = double (newSpacialEnvelope[i]->getPosition());
-                        
-                        // (posOfP-posOfA)/(posOfB-posOfA) = (p.x-a.x)/(b.x-a.x)
-                        double positionOfP = positionOfA + (p.x - a.x)/(b.x - a.x) * (positionOfB - positionOfA);
-                        
-                        SpacialEnvelopePoint* newSpacialEnvPoint = 
-                            new SpacialEnvelopePoint(p.x, p.y, p.z,
-                                                     floor(positionOfP + 0.5));
-                            // positionOfP is positive
-                            // => floor(positionOfP + 0.5) == round(positionOfP)
-                        closestPointsInBetween.add(newSpacialEnvPoint);
-                    }
+                    closestPointsInBetween.add(closestPoint);
+                    closestPointPositions.add(closestPoint.getPosition());
                 }
             }
+            
+            // Add the points from closestPointsInBetween to the newSpacialEnvelope.
+            if (closestPointsInBetween.size() > 0)
+            {
+                // Merge the newly found points into a new envelope.
+                newSpacialEnvelope = SpacialEnvelope::createMerged(envelope, closestPointsInBetween);
+            }
+            else
+            {
+                // Share the given envelope.
+                newSpacialEnvelope = newSpacialEnvelope_;
+            }
         }
+        sourceSpacialEnvelope = newSpacialEnvelope_;
+    }
+}
+
+void AudioSourceDopplerEffect::postSpacialEnvelope ()
+{
+    // STEP 4
+    // ------
+    // Hand it over to the audio thread. The spacial value is faded from
+    // the old spacial envelope to the new one, in the interval of one
+    // audio block in the upcoming call of getNextAudioBlock(..).
+    spacialEnvelopeHandoff.post(newSpacialEnvelope.getObject());
+}
+
+void AudioSourceDopplerEffect::calculateSlopes (const SpacialEnvelope& envelope,
+                                                int firstSegment,
+                                                int endSegment)
+{
+    for (int k = firstSegment + 1; k <= endSegment; k++)
+    {
+        // The time distance in samples between the two
+        // spacial envelope points
+        double distance = double (envelope.getPosition(k) - envelope.getPosition(k-1));
         
-        // Add the points from closestPointsInBetween to the newSpacialEnvelope.
-        if (closestPointsInBetween.size() > 0)
+        if (distance > 0.0)
         {
-//            // start debugging
-//            for (int i=0; i!=closestPointsInBetween.size(); ++i)
-//            {
-//                DEB("AudioSourceDopplerEffect: setSpacialEnvelope:")
-//                DEB("closestPointsInBetween[" + String(i) + "]->getPosition() ="
-//                    + String(closestPointsInBetween[i]->getPosition()))
-//            }
-//            // end debugging
-            
-            // Add the newly found points to the newSpacialEnvelope.
-            newSpacialEnvelope.addCopiesOf(closestPointsInBetween);
+            // Figure out the highest and lowest change of [distance
+            // to origin] between two adjecent samples on this segment
+            // of the envelope.
             
-            // Sort the newSpacialEnvelope
-            newSpacialEnvelope.sort(spacialEnvelopePointPointerComparator);
+            SpacialPosition previousPoint (envelope.getX(k-1),
+                                           envelope.getY(k-1),
+                                           envelope.getZ(k-1));
+            SpacialPosition nextPoint (envelope.getX(k),
+                                       envelope.getY(k),
+                                       envelope.getZ(k));
+            SpacialPosition spacialDelta = (nextPoint - previousPoint) * (1./distance);
+            SpacialPosition previousPointPlusOne = previousPoint + spacialDelta;
+            SpacialPosition nextPointMinusOne = nextPoint - spacialDelta;
             
-            // start debugging
-//            for (int i=0; i!=newSpacialEnvelope.size(); ++i)
-//            {
-//                DEB("AudioSourceDopplerEffect: setSpacialEnvelope:")
-//                DEB("newSpacialEnvelope[" + String(i) + "]->getPosition() ="
-//                    + String(newSpacialEnvelope[i]->getPosition()))
-//            }
-            // end debugging
+            double slope1 = previousPointPlusOne.getDelay() - previousPoint.getDelay(); // seconds / sample
+            double slope2 = nextPoint.getDelay() - nextPointMinusOne.getDelay(); // seconds / sample
             
+            highestSlope = jmax(jmax(highestSlope, slope1), slope2); // will be >= 0
+            lowestSlope = jmin(jmin(lowestSlope, slope1), slope2); // will be <= 0
         }
-        
-        // STEP 4
-        // ------
-        newSpacialEnvelopeSet = true; // when set, the spacial value 
-        // is faded from the old spacial envelope to the new one, in 
-        // the interval of one audio block in the upcoming call of
-        // getNextAudioBlock(..).
     }
-    else
-    {
-		DEB("AudioSourceDopplerEffect: The newSpacialEnvelope is empty! The spacial envelope hasn't been changed.")
-	}
 }
 
-inline void AudioSourceDopplerEffect::prepareForNewPosition (int newPosition,
-                                   int * nextSpacialPointIndex_,
-                                   SpacialEnvelopePoint ** previousSpacialPoint_,
-                                   SpacialEnvelopePoint ** nextSpacialPoint_,
-                                   SpacialPosition * currentSpacialPosition_)
-{    
-    // Figure out between which audioEnvelopePoints we are right now
-	// and set up
-    // - nextSpacialPointIndex_
-    // - previousSpacialPoint_
-    // - nextSpacialPoint_
-	while (spacialEnvelope[nextSpacialPointIndex]->getPosition() <= newPosition)
-	{
-		(*nextSpacialPointIndex_)++;
-	}
-	*previousSpacialPoint_ = spacialEnvelope[*nextSpacialPointIndex_ - 1];
-	*nextSpacialPoint_ = spacialEnvelope[*nextSpacialPointIndex_];
-
-	// Figure out the *currentSpacialPosition_
-    // ---------------------------------------
+bool AudioSourceDopplerEffect::findClosestPoint (const SpacialEnvelope& envelope,
+                                                 int segment,
+                                                 SpacialEnvelopePoint& closestPoint)
+{
+    const int i = segment + 1;
+    SpacialPosition a = SpacialPosition(envelope.getX(i-1),
+                                        envelope.getY(i-1),
+                                        envelope.getZ(i-1));
+    SpacialPosition b = SpacialPosition(envelope.getX(i),
+                                        envelope.getY(i),
+                                        envelope.getZ(i));
+    // a and b are positions in space without a 4rd time argument
+    // like SpacialEnvelopePoints.
     
-    // The distance in time. In samples.
-	double distance = double ((*nextSpacialPoint_)->getPosition() 
-                              - (*previousSpacialPoint_)->getPosition());
-    // In samples.
-	double distanceFromPreviousSpacialPointPosToCurrentPos = double(newPosition 
-    - (*previousSpacialPoint_)->getPosition());
+    // If a == b they are at the same position in space and
+    // all points in between are equally close to the origin.
+    // On an arc, the distance changes linearly, so the closest
+    // point is one of the ends. The closest point of a curve
+    // isn't made explicit, the delay follows it at control
+    // rate anyway.
+    if (a == b || ! envelope.isLinear(i-1))
+    {
+        return false;
+    }
     
-    double factor = distanceFromPreviousSpacialPointPosToCurrentPos / distance;
+    // See my notes 120123_doppler_fx_closest_point.tif for
+    // more details of the upcoming calculation.
     
-    currentSpacialPosition_->x = (*previousSpacialPoint_)->getX() + factor * ((*nextSpacialPoint_)->getX() - (*previousSpacialPoint_)->getX());
-    currentSpacialPosition_->y = (*previousSpacialPoint_)->getY() + factor * ((*nextSpacialPoint_)->getY() - (*previousSpacialPoint_)->getY());
-    currentSpacialPosition_->z = (*previousSpacialPoint_)->getZ() + factor * ((*nextSpacialPoint_)->getZ() - (*previousSpacialPoint_)->getZ());
-}
-
-float AudioSourceDopplerEffect::interpolate (float * sampleRightBefore, double remainder)
-{
-    /*
-     y(sampleRightBefore + remainder)
-     = y(t_n) 
-     = \sum_{k \in \mathbb{Z}} x[k]h(t_n - k)
-     = \sum_{k' \in \mathbb{Z}} x[sampleRightBefore + k']h(remainder - k)
-     
-     \approx \sum_{k' = -halfTheInterpolationOrder}^{halfTheInterpolationOrder}
-        x[sampleRightBefore + k']h(remainder - k)
-     */
+    // n is a vector that specifies the direction of the line
+    // defined by a and b.
+    SpacialPosition n = b - a;
+    
+    // With the scalar product, we can specify a plane
+    // that is perpendicular to the line and intersects with
+    // the origin:
+    //  {r in Reals^3 ; <r,n> = 0}
+    //
+    // The line can be parametrised:
+    //  {a + t*n ; t in Reals}
+    //
+    // The intersection of the line and the plane will result
+    // in the point (p) on the line closest to the origin.
+    // So lets intersect!
+    // I.e. put the parametrised line into the equation of
+    // the plane and solve for t...
+    //  <a + tn, n> = 0
+    //  <a,n> + t <n,n> = 0
+    //  t = - <a,n>/<n,n>
+    // ... and put this t into the parametrisation of the line:
+    //  p = a - <a,n>/<n,n> * n
+    
+    // The point closest to the origin
+    SpacialPosition p = a - ((a*n)/(n*n))*n;
     
-    double result = 0.0;
-    for (int k = -halfTheInterpolationOrder+1; k <= halfTheInterpolationOrder; k++)
+    // Does this point lie in between a and b?
+    // It is sufficient to look at one coordinate.
+    double * smallerX = a.x < b.x ? &a.x : &b.x;
+    double * biggerX =  a.x < b.x ? &b.x : &a.x;
+    if (p.x > *smallerX && p.x < *biggerX)
     {
-        result += *(sampleRightBefore+k) * h(remainder - k);
+        // Figure out the time position for this new point
+        double positionOfA = double (envelope.getPosition(i-1));
+        double positionOfB = double (envelope.getPosition(i));
+        
+        // (posOfP-posOfA)/(posOfB-posOfA) = (p.x-a.x)/(b.x-a.x)
+        double positionOfP = positionOfA + (p.x - a.x)/(b.x - a.x) * (positionOfB - positionOfA);
+        
+        const int roundedPositionOfP = floor(positionOfP + 0.5);
+            // positionOfP is positive
+            // => floor(positionOfP + 0.5) == round(positionOfP)
+        
+        // A point that coincides with a or b (in time) isn't needed.
+        // This also keeps the closest points in the order of their
+        // segments, see closestPointPositions.
+        if (roundedPositionOfP > envelope.getPosition(i-1)
+            && roundedPositionOfP < envelope.getPosition(i))
+        {
+            closestPoint = SpacialEnvelopePoint (roundedPositionOfP, p.x, p.y, p.z);
+            return true;
+        }
     }
-    
-    // Temp
-    // result = *sampleRightBefore;
-    return result;
+    return false;
 }
 
-double AudioSourceDopplerEffect::h(double t)
+int AudioSourceDopplerEffect::getNumberOfClosestPointsBefore (int position) const
 {
-    // Since h is symmetric (h(t) = h(-t) for all t)
-    // only values of h for t >=0 are stored in the array valuesOfH.
-    
-    int positionInArray = t*double(interpolationStepsPerUnit);
-    
-    // Calculate
-    // positionInArray = abs(positionInArray)
-    if (positionInArray < 0)
+    int lowerBound = 0;
+    int upperBound = closestPointPositions.size();
+    while (lowerBound < upperBound)
     {
-        positionInArray = -positionInArray;
+        const int middle = lowerBound + (upperBound - lowerBound) / 2;
+        if (closestPointPositions.getUnchecked(middle) < position)
+        {
+            lowerBound = middle + 1;
+        }
+        else
+        {
+            upperBound = middle;
+        }
     }
-    // TODO
-    // Is there a more elegant way to calculate abs(integer)?
-    
-    return valuesOfH[positionInArray];
+    return lowerBound;
 }
 
-bool AudioSourceDopplerEffect::recalculateH(double samplerate)
+bool AudioSourceDopplerEffect::patchSpacialEnvelope (const SpacialEnvelope& newSourceEnvelope,
+                                                     const SpacialEnvelope::Patch& patch)
 {
-    int numberOfElements = (halfTheInterpolationOrder + 1) * interpolationStepsPerUnit;
-    valuesOfH.ensureStorageAllocated(numberOfElements);
+    const SpacialEnvelope& oldSourceEnvelope = *sourceSpacialEnvelope;
+    
+    // The unchanged neighbours of the patch. The closest points in between
+    // (strictly, see findClosestPoint) belong to the changed segments.
+    const int left = patch.startIndex - 1;
+    const int rightInTheOldEnvelope = patch.startIndex + patch.numberOfRemovedPoints;
+    const int rightInTheNewEnvelope = patch.startIndex + patch.numberOfInsertedPoints;
+    const bool hasRight = rightInTheOldEnvelope < oldSourceEnvelope.size();
     
-    // The normalized cutoff frequency
-    double fcn = cutoffFrequencyOfInterpolationLPF/samplerate;
+    const int firstClosestPoint = left >= 0
+                                  ? getNumberOfClosestPointsBefore (oldSourceEnvelope.getPosition(left))
+                                  : 0;
+    const int endClosestPoint = hasRight
+                                ? getNumberOfClosestPointsBefore (oldSourceEnvelope.getPosition(rightInTheOldEnvelope))
+                                : closestPointPositions.size();
     
-    double stepSize = 1.0/double(interpolationStepsPerUnit);
+    // The same range in the newSpacialEnvelope.
+    const int startIndex = left >= 0 ? left + firstClosestPoint + 1 : 0;
+    const int endIndex = hasRight ? rightInTheOldEnvelope + endClosestPoint : newSpacialEnvelope->size();
     
-    // Calculate values of the impulse response of the ideal filter between
-    // 0 and halfTheInterpolationOrder in steps of stepSize.
-    for (int i = 0; i<halfTheInterpolationOrder; i++)
+    // The inserted points and the closest points of the changed segments.
+    Array<int> positions;
+    Array<double> xs, ys, zs;
+    Array<int> interpolationModes;
+    Array<double> controlPoints;
+    Array<int> newClosestPointPositions;
+    for (int k = jmax (0, left); k < rightInTheNewEnvelope; ++k)
     {
-        
-        // Take care of the integer argument: h(i)=...
-        if (i == 0)
+        if (k >= patch.startIndex)
         {
-            // h(0) = 1. Here we have to provide the value of sinc(0)=1.
-            // Otherwise we would have a division by zero.
-            double value = 1.0;
-            valuesOfH.set(0, value);
-        }
-        else
-        {
-            double argument = 2.0*pi*fcn*double(i);
-            double value = sin(argument)/argument;
-            valuesOfH.set(i*interpolationStepsPerUnit, value);
+            positions.add(newSourceEnvelope.getPosition(k));
+            xs.add(newSourceEnvelope.getX(k));
+            ys.add(newSourceEnvelope.getY(k));
+            zs.add(newSourceEnvelope.getZ(k));
+            interpolationModes.add(newSourceEnvelope.getInterpolationMode(k));
+            const double* controlPointsOfTheSegment = newSourceEnvelope.getControlPoints(k);
+            for (int j = 0; j < 6; ++j)
+            {
+                controlPoints.add(controlPointsOfTheSegment != nullptr ? controlPointsOfTheSegment[j] : 0.0);
+            }
         }
         
-        // Take care of the remaining arguments between i and i+1.
-        for (int k=1; k<interpolationStepsPerUnit; k++)
+        SpacialEnvelopePoint closestPoint;
+        if (k + 1 < newSourceEnvelope.size()
+            && findClosestPoint (newSourceEnvelope, k, closestPoint))
         {
-            double argument = 2.0*pi*fcn*(double(i) + k*stepSize);
-            double value = sin(argument)/argument;
-            valuesOfH.set(i*interpolationStepsPerUnit + k, value);
+            positions.add(closestPoint.getPosition());
+            xs.add(closestPoint.getX());
+            ys.add(closestPoint.getY());
+            zs.add(closestPoint.getZ());
+            // It splits a linear segment.
+            interpolationModes.add(SpacialEnvelope::interpolationModeLinear);
+            for (int j = 0; j < 6; ++j)
+            {
+                controlPoints.add(0.0);
+            }
+            newClosestPointPositions.add(closestPoint.getPosition());
         }
     }
     
-    // Apply a raised-cosine window.
-    for (int i = 0; i<halfTheInterpolationOrder; i++)
+    SpacialEnvelope* patchedEnvelope = SpacialEnvelope::createPatched(*newSpacialEnvelope,
+                                                                      startIndex,
+                                                                      endIndex - startIndex,
+                                                                      positions.getRawDataPointer(),
+                                                                      xs.getRawDataPointer(),
+                                                                      ys.getRawDataPointer(),
+                                                                      zs.getRawDataPointer(),
+                                                                      positions.size(),
+                                                                      interpolationModes.getRawDataPointer(),
+                                                                      controlPoints.getRawDataPointer());
+    if (patchedEnvelope == nullptr)
     {
-        for (int k=0; k<interpolationStepsPerUnit; k++)
-        {
-            int positionInArray = i*interpolationStepsPerUnit + k;
-            double originalValue = valuesOfH[positionInArray];
-            double raisedCosineValue = 0.5 * (1.0 + cos((2*pi*(double(i)+k*stepSize))/(2.*double(halfTheInterpolationOrder) +2)));
-            valuesOfH.set(positionInArray, originalValue*raisedCosineValue);
-        }
+        return false;
     }
+    newSpacialEnvelope = patchedEnvelope;
     
-    
+    closestPointPositions.removeRange(firstClosestPoint, endClosestPoint - firstClosestPoint);
+    closestPointPositions.insertArray(firstClosestPoint,
+                                      newClosestPointPositions.getRawDataPointer(),
+                                      newClosestPointPositions.size());
     return true;
 }
 
+inline void AudioSourceDopplerEffect::prepareForNewPosition (int newPosition,
+                                   SpacialPosition * currentSpacialPosition_)
+{    
+    const SpacialEnvelope& envelope = *spacialEnvelope;
+    
+    // Figure out between which audioEnvelopePoints we are right now
+	// and set up
+    // - spacialEnvelopeCursor
+	spacialEnvelopeCursor.advance(envelope, newPosition);
+	const int previous = spacialEnvelopeCursor.getPreviousIndex();
 
+	// Figure out the *currentSpacialPosition_ (on the line, the arc or the
+    // curve of the segment).
+    // ---------------------------------------
+    envelope.getCoordinatesAt(previous, newPosition,
+                              currentSpacialPosition_->x,
+                              currentSpacialPosition_->y,
+                              currentSpacialPosition_->z);
+}
 
-// Initialisation (and memory allocation) of the static variables
-int AudioSourceDopplerEffect::halfTheInterpolationOrder = 5;
-int AudioSourceDopplerEffect::interpolationStepsPerUnit = 128;
-double AudioSourceDopplerEffect::cutoffFrequencyOfInterpolationLPF = 20000.0; // Hz
-double AudioSourceDopplerEffect::pi = 4.0 * atan(1.0);
-Array<double> AudioSourceDopplerEffect::valuesOfH;
+void AudioSourceDopplerEffect::setInterpolationQuality (FractionalDelayInterpolator::Quality quality)
+{
+    if (quality != interpolationQuality)
+    {
+        interpolationQuality = quality;
+        updateInterpolator();
+    }
+}
+
+void AudioSourceDopplerEffect::updateInterpolator ()
+{
+    const int oldHalfTheNumberOfTaps = interpolator != nullptr ? interpolator->getHalfTheNumberOfTaps() : 0;
+    
+    interpolator = FractionalDelayInterpolatorCache::getInstance()->getInterpolator (interpolationQuality,
+                                                                                     sampleRate);
+    
+    // The blocks requested from the audioSourceGainEnvelope get longer by
+    // the additional samples on both sides.
+    const int additionalSamples = 2*(interpolator->getHalfTheNumberOfTaps() - oldHalfTheNumberOfTaps);
+    if (additionalSamples > 0 && sourceInfo.buffer->getNumSamples() > 0)
+    {
+        bool keepExistingContent = true;
+        sourceInfo.buffer->setSize(1, 
+                                   sourceInfo.buffer->getNumSamples() + additionalSamples, 
+                                   keepExistingContent);
+    }
+}
 
-// All we would have liked to do is to call AudioSourceDopplerEffect::recalculateH(). 
-// Sadly, the C++ compiler doesn't allow this directly. Thats why the dummy 
-// variable __recalculateH exists.
-bool AudioSourceDopplerEffect::__recalculateH = AudioSourceDopplerEffect::recalculateH(44100);
-    // recalculateH will be called again in the constructor with the correct sampleRate
+// Initialisation (and memory allocation) of the static variables
+const double AudioSourceDopplerEffect::maximumLiveDelaySlope = 0.5;
@@ -12,8 +12,12 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "SpacialEnvelopePoint.h"
+#include "SpacialEnvelope.h"
+#include "EnvelopeCursor.h"
 #include "SpacialPosition.h"
 #include "AudioSourceGainEnvelope.h"
+#include "EnvelopeHandoff.h"
+#include "FractionalDelayInterpolator.h"
 
 //==============================================================================
 /**
@@ -60,129 +64,198 @@ public:
 	 Sets a new spacial envelope which determines the location in space of the
      sound source in relation to the time. It also contains the distance delay
      for each point of the envelope, which is used here.
-     This class makes a copy of the newSpacialEnvelope.
+     The newSpacialEnvelope is shared. It is only copied, if points have to
+     be added to it (the points closest to the origin).
+     
+     If the patch (how the newSpacialEnvelope differs from the one set
+     before) is given, only the changed segments are analysed, and the
+     envelope used here is patched accordingly.
 	 */
-	void setSpacialEnvelope (const Array<SpacialEnvelopePoint>& newSpacialEnvelope);
+	void setSpacialEnvelope (const SpacialEnvelope::Ptr& newSpacialEnvelope,
+	                         const SpacialEnvelope::Patch* patch = nullptr);
+    
+    /**
+     setSpacialEnvelope, split in two: This does all the work (the
+     analysis, the closest points and the growth of the buffer), but
+     doesn't hand the envelope over to the audio thread yet.
+     */
+    void prepareSpacialEnvelope (const SpacialEnvelope::Ptr& newSpacialEnvelope,
+                                 const SpacialEnvelope::Patch* patch = nullptr);
+    
+    /**
+     The second half of setSpacialEnvelope: Hands the envelope prepared
+     last over to the audio thread. Only takes the time of an atomic
+     exchange.
+     */
+    void postSpacialEnvelope ();
+    
+    /**
+     Makes sure that the buffer is big enough for the delay ramps of the
+     live positions, such that setLivePosition doesn't lead to memory
+     allocation. Don't call it on the audio thread.
+     */
+    void prepareForLivePositions ();
+    
+    /**
+     Sets the position of the source at the end of the next audio block
+     (the first sample of the block after it). Called by the
+     AudioSourceAmbipanning on the audio thread, right before
+     getNextAudioBlock, as long as the source follows a live input.
+     
+     The delay is ramped linearly over the block, from the last live
+     position (or the spacial envelope) to this one. It changes by at most
+     maximumLiveDelaySlope samples per sample (the source moves slower than
+     half the speed of sound), such that a jump of the live input doesn't
+     make the pitch stop or shoot up.
+     */
+    void setLivePosition (const SpacialPosition& position);
+    
+    /**
+     Returns to the spacial envelope, with a fade over the next audio
+     block. Called on the audio thread.
+     */
+    void endLivePositions ();
+    
+    /**
+     Sets how the source is read in between its samples, see
+     FractionalDelayInterpolator::Quality for what each level costs. The
+     default is FractionalDelayInterpolator::qualityDefault.
+     
+     Don't call it on the audio thread, and not while getNextAudioBlock
+     is running.
+     */
+    void setInterpolationQuality (FractionalDelayInterpolator::Quality quality);
+    
+    /** Returns the interpolation quality. */
+    FractionalDelayInterpolator::Quality getInterpolationQuality () const   { return interpolationQuality; }
+    
+    /** The largest change of the delay (in samples per sample) between
+     two live positions. */
+    static const double maximumLiveDelaySlope;
 	
 private:
 	/**
 	 It figures out the other parameters given the newPosition.
-     Either the *nextSpacialPointIndex_ is really the next one seen from the
-     newPosition, or in needs to be set to 1 before calling this.
+     The spacialEnvelopeCursor is moved forward to the newPosition (after a
+     jump, it has to be placed with EnvelopeCursor::seek before calling this).
      
      @param newPosition             The position in time (in samples) of interest.
-     @param nextSpacialPointIndex_  Will be modified.
-                                    This must be lower or equal to the index of
-                                    the next spacial point in the envelope.
-                                    If the value is lower, then it will be
-                                    increased until it is this index.
-     @param previousSpacialPoint_   Will be modified.
-                                    The envelope point that comes before (or at
-                                    the same time as the)
-                                    point at the newPosition (in time).
-     @param nextSpacialPoint_       Will be modified.
-                                    The envelope point that comes after the
-                                    point at the newPosition (in time).
      @param currentSpacialPosition_ Will be modified.
                                     The position in space of the point at the
                                     time position newPosition.
-     @param deltaSpacialPosition_   Will be modified.
-                                    The difference in space of two adjecent
-                                    samples between the previousSpacialPoint_
-                                    and the nextSpacialPoint_.
 	 */
 	inline void prepareForNewPosition (int newPosition,
-                                       int * nextSpacialPointIndex_,
-                                       SpacialEnvelopePoint ** previousSpacialPoint_,
-                                       SpacialEnvelopePoint ** nextSpacialPoint_,
                                        SpacialPosition * currentSpacialPosition_);
     
     /**
-     Calculates the value of the continuous signal at an arbitrary position,
-     using the formula
-     
-     \f[ y(t) = \sum_{k \in \mathbb{Z}} x[k]h(t-kT) \f]
-     
-     where \f$h(.)\f$ is the impulse response of a LTI filter and \f$T\f$ is a
-     real number. (This is equation (2.16) in the lecture note by Hans-Andrea
-     Loeliger ZSSV 2011)
-     We choose T = 1/samplerate and \f$h(.)\f$ the impulse response of the
-     ideal lowpass filter with cutoff frequency f_c = 20kHz.
-     
-     We normalize the parameters and h
-     (see 120327_ambipanning_interpolation.tif) and get
-     
-     \f[ y(t_n) = \sum_{k \in \mathbb{Z}} x[k]h(t_n - k) \f]
-     
-     \f[ h(t_n) = \frac{sin(2 \pi f_{cn} t_n)}{2 \pi f_{cn} t_n}
-                = \sinc(2 f_{cn} t_n) \f]
-     
-     where:
-     - \f$t_n\f$ is measured in samples. E.g. \f$t_n = 30.5\f$ means the time
-       exactly between samples 30 and 31.
-     - \f$f_{cn} = f_c / SR \f$ is the normalized cutoff frequency.
-
-     Remark: By de l'Hopital: h(0) = 1.
-     
-     @param sampleRightBefore   The sample that comes right before the position
-                                t_n we are looking for.
-     @param remainder           Together with the sampleRightBefore, this
-                                specifies t_n.
-                                t_n = (position of sampleRightBefore) + remainder.
+     Updates the highestSlope and the lowestSlope with the segments
+     [firstSegment, endSegment) of the envelope. A segment is identified by
+     the index of the point it starts at.
      */
-    float interpolate (float * sampleRightBefore, double remainder);
+    void calculateSlopes (const SpacialEnvelope& envelope, int firstSegment, int endSegment);
     
     /**
-     Returns the windowed impulse response of the ideal
-     low pass filter (approximated, using a lookup table).
-     
-     Impulse response of the ideal low pass filter:
-     
-     \f[ h(t) = \frac{sin(2 \pi f_{cn} t)}{2 \pi f_{cn} t}
-     = \sinc(2 f_{cn} t) \f]
+     Finds the point of a segment of the envelope that is closest to the
+     origin, if it lies strictly in between the two points of the segment
+     (in space and in time).
      
-     The raised-cosine windowing is done according to equation (2.77) in the
-     lecture notes of Hans-Andrea Loeliger ZSSV 2011.
-     
-     \f[ w(t) = 0.5 + \left( 1 + \cos\left( \frac{2 \pi t)}{interpolationOrder + 2} \f]
+     @return    false, if there is no such point.
+     */
+    static bool findClosestPoint (const SpacialEnvelope& envelope, int segment,
+                                  SpacialEnvelopePoint& closestPoint);
+    
+    /** Returns the number of closestPointPositions before the position. */
+    int getNumberOfClosestPointsBefore (int position) const;
+    
+    /**
+     Patches the newSpacialEnvelope (the one used here, including the
+     closest points) like the sourceSpacialEnvelope has been patched to
+     become the newSourceEnvelope. Only the closest points of the changed
+     segments are searched.
      
-     for -halfTheInterpolationOrder < t < halfTheInterpolationOrder.
-     Outside of this interval w(t_n) = 0.
+     @return    false, if this isn't possible.
+     */
+    bool patchSpacialEnvelope (const SpacialEnvelope& newSourceEnvelope,
+                               const SpacialEnvelope::Patch& patch);
+    
+    /**
+     Fills info with the source, delayed by a delay that is ramped linearly
+     from the first sample of the block to the first sample of the next
+     block. Used for the fade to a new spacial envelope and for the live
+     positions.
      
-     This interpolate method looks up the requested values in the array
-     valuesOfH.
-     This interpolate method is used exclusively by the interpolate method.
+     @param audioBlockStartPositionInclDelay    The position in the source
+                                                at the first sample
+                                                (rounded down).
+     @param audioBlockStartPositionRemainder    In [0, 1[, in samples.
+     @param audioBlockEndPositionInclDelay      The same for the first
+                                                sample of the next block.
+     @param audioBlockEndPositionRemainder      In [0, 1[, in samples.
+     */
+    void renderDelayRamp (const AudioSourceChannelInfo& info,
+                          int audioBlockStartPositionInclDelay,
+                          double audioBlockStartPositionRemainder,
+                          int audioBlockEndPositionInclDelay,
+                          double audioBlockEndPositionRemainder);
+    
+    /**
+     Gets the interpolator for the interpolationQuality and the sampleRate.
+     It calculates the value of the continuous signal at an arbitrary
+     position, using the formula
      
+     \f[ y(t) = \sum_{k \in \mathbb{Z}} x[k]h(t-kT) \f]
      
-     @param     t   abs(t) must be <= halfTheInterpolationOrder.
-                    h does not check this condition!
+     where \f$h(.)\f$ is e.g. the impulse response of the ideal lowpass
+     filter with cutoff frequency f_c = 20kHz (windowed, see
+     FractionalDelayInterpolator). (This is equation (2.16) in the lecture
+     note by Hans-Andrea Loeliger ZSSV 2011)
      
-     @return    approximation of h(t)*w(t)
+     The sourceBuffer grows by the additional samples a longer interpolator
+     needs on both sides. Don't call it on the audio thread.
      */
-    double h(double t);
+    void updateInterpolator ();
     
     double sampleRate;
     double oneOverSampleRate;
     double samplesPerBlockExpected;
     
-    /** Holds the SpacialEnvelopePoints which define the
-     position / movement of the audio source in space over time.
-     It is assumed by the code that the SpacialEnvelopePoints are
-     ordered in this array according to their position in time.
+    /** Hands the newSpacialEnvelope over to the audio thread. */
+    EnvelopeHandoff<SpacialEnvelope> spacialEnvelopeHandoff;
+    /** Defines the position / movement of the audio source in space over
+     time, including the points closest to the origin. Never nullptr. Only
+     used by the audio thread, it is the one in the spacialEnvelopeHandoff.
      */
-	OwnedArray<SpacialEnvelopePoint> spacialEnvelope;
+	SpacialEnvelope* spacialEnvelope;
     
-	/** This is used by AudioSourceAmbipanning::setSpacialEnvelope and
-	 by AudioSourceAmbipanning::getNextAudioBlock when a new envelope is engaged.
+	/** The latest envelope set with AudioSourceDopplerEffect::setSpacialEnvelope
+	 (including the points closest to the origin). Only used by the thread
+	 that sets the envelopes.
 	 */
-	OwnedArray<SpacialEnvelopePoint> newSpacialEnvelope;
-    SpacialEnvelopePointPointerComparator spacialEnvelopePointPointerComparator;
+	SpacialEnvelope::Ptr newSpacialEnvelope;
+    /** The envelope the newSpacialEnvelope has been derived from, as given
+     to setSpacialEnvelope. */
+    SpacialEnvelope::Ptr sourceSpacialEnvelope;
+    /** The positions of the points added to the sourceSpacialEnvelope (the
+     points closest to the origin), sorted. Each one lies strictly inside
+     its segment, such that the point k of the sourceSpacialEnvelope is the
+     point k + getNumberOfClosestPointsBefore (its position) of the
+     newSpacialEnvelope. */
+    Array<int> closestPointPositions;
+    /** The highest and the lowest change of the delay (in seconds per
+     sample) in the envelope. After a patch, they only grow, like the
+     sourceBuffer. */
+    double highestSlope;
+    double lowestSlope;
+    /** Set on the audio thread if the next block fades to the
+     spacialEnvelope. */
     bool newSpacialEnvelopeSet;
+    /** See setLivePosition. */
+    bool livePositionEnabled;
+    SpacialPosition livePosition;
     bool constantSpacialPosition;
     int constantSpacialPositionDelayTimeInSamples;
-    SpacialEnvelopePoint * previousSpacialPoint;
-    SpacialEnvelopePoint * nextSpacialPoint;
-    int nextSpacialPointIndex;
+    /** Points to the segment of the spacialEnvelope the stage is in. */
+    EnvelopeCursor spacialEnvelopeCursor;
     
     /** 
      */
@@ -213,44 +286,10 @@ private:
     // Interpolation
     // -------------
     
-    /** Half the value of the interpolation order. */
-    static int halfTheInterpolationOrder;
-    
-    static int interpolationStepsPerUnit;
-    
-    /** Cutoff frequency for the (close to) ideal low pass filter
-     used for the interpolation.
-     
-     Please choose its value below the nyquist frequency
-     sampleRate/2.
-     */
-    static double cutoffFrequencyOfInterpolationLPF;
-    
-    static double pi;
-
-    /** Holds the values of the impulse response h. */
-    static Array<double> valuesOfH;
-    
-    /** This will calculate (2*halfTheInterpolationOrder+1)*interpolationStepsPerUnit values of the impulse response h.
-     
-     You have to set the desired values for halfTheInterpolationOrder and 
-     interpolationStepsPerUnit before calling this.
-     
-     @return    always true. See __recalculateH.
-     */
-    static bool recalculateH(double sampleRate);
-    
-    /** A dummy variable which enables us to call recalculateH()
-     at the end of the cpp file.
-     
-     All we would have liked to do is to call AudioSourceDopplerEffect::recalculateH(). 
-     Sadly, the C++ compiler doesn't allow this directly. Thats why the dummy 
-     variable __recalculateH exists. Thanks to this we can call
-     bool AudioSourceDopplerEffect::__recalculateH = AudioSourceDopplerEffect::recalculateH();
-     
-     source: http://www.codeproject.com/Articles/18314/Static-Initialization-Function-in-Classes
-     */
-    static bool __recalculateH;
+    FractionalDelayInterpolator::Quality interpolationQuality;
+    /** Shared by all sources with the same interpolationQuality and
+     sampleRate. */
+    FractionalDelayInterpolator::Ptr interpolator;
 		
 	JUCE_LEAK_DETECTOR (AudioSourceDopplerEffect);
 };
@@ -9,27 +9,28 @@
  */
 
 #include "AudioSourceGainEnvelope.h"
+#include "GainRampKernels.h"
 
 AudioSourceGainEnvelope::AudioSourceGainEnvelope (AudioFormatReader* const audioFormatReader, 
 												  double sampleRateOfTheAudioDevice,
                                                   bool enableBuffering_)
-    : nextPlayPosition (-1),         // such that the values in setNextReadPosition(..) will be set.
-      audioBlockEndPosition (-2),
-      previousGainPoint (0),
-      nextGainPoint (0),
-      nextGainPointIndex (0),
-      gainValue (1.0f),
-      gainDelta (0.0f),
-      audioFormatReaderSource (audioFormatReader, true),
+    : audioFormatReaderSource (audioFormatReader, true),
             // second argument: deleteSourceWhenDeleted
-      bufferingAudioSource (&audioFormatReaderSource, false, 32768)
+      bufferingAudioSource (&audioFormatReaderSource, false, 32768),
             // second argument: deleteSourceWhenDeleted
+      gainEnvelope (nullptr),
+      nextPlayPosition (-1),         // such that the values in setNextReadPosition(..) will be set.
+      audioBlockEndPosition (-2),
+      segmentStartPosition (0),
+      segmentEndPosition (0),
+      segmentStartValue (1.0f),
+      gainDelta (0.0f),
+      gainValue (1.0f)
 {
 	DEB("AudioSourceGainEnvelope: constructor called.")
 	
     enableBuffering(enableBuffering_);
 
-	newGainEnvelopeSet = false;
 	constantGain = true;
 }
 
@@ -39,12 +40,7 @@ AudioSourceGainEnvelope::~AudioSourceGainEnvelope()
 //	delete bufferingAudioSource;  // this also deletes the positionableResamplingAudioSource
 								  // and the audioFormatReaderSource.
 	
-	// delete the gain envelope
-	for (int i = gainEnvelope.size(); --i >= 0;)
-	{
-		AudioEnvelopePoint* audioEnvelopePointToDelete = (AudioEnvelopePoint*)gainEnvelope[i];
-		delete audioEnvelopePointToDelete;
-	}
+	// The gain envelope is released by the gainEnvelopeHandoff.
 }
 
 /** Implementation of the AudioSource method. */
@@ -99,28 +95,30 @@ void AudioSourceGainEnvelope::getNextAudioBlock (const AudioSourceChannelInfo& i
 		// the current audio block.
 	bufferOrReaderAudioSource->getNextAudioBlock(info);
 	
+	// Points to the first sample in the audio block.
+	float* sample = info.buffer->getSampleData(0, info.startSample); 
+	// First argument: channelNumber = 0, since this class is made
+	// for mono signals only.
+	// Second argument: sampleOffset = info.startSample
+	
 	// This will be executed when a new gain envelope has been set with setGainEnvelope(..).
-	if (newGainEnvelopeSet)
+	// The old envelope isn't deleted here, but by the EnvelopeReclaimer.
+	if (gainEnvelopeHandoff.update())
 	{
-		Array<void*> oldGainEnvelope = gainEnvelope;
-		gainEnvelope = newGainEnvelope;
-		previousGainValue = gainValue; // This is used in the info.buffer->applyGainRamp(..)
-		// a couple of lines below to generate a smooth gain transition from the current to 
-		// the gain value of the new envelope.
+		// The gain on the first sample, from the old envelope. This is used
+		// for the ramp a couple of lines below to generate a smooth gain
+		// transition from the current to the gain value of the new envelope.
+		const float previousGainValue = constantGain ? gainValue : getGainAt(nextPlayPosition);
 		
-		// delete content of the old gain envelope
-		for (int i = oldGainEnvelope.size(); --i >= 0;)
-		{
-			AudioEnvelopePoint* audioEnvelopePointToDelete = (AudioEnvelopePoint*)oldGainEnvelope[i];
-			delete audioEnvelopePointToDelete;
-		}
+		gainEnvelope = gainEnvelopeHandoff.get();
 		
-		if (gainEnvelope.size() == 1) // by the way: size() == 0 can't be, this was
-								      // checked in setGainEnvelope(..)
+		float gainAtTheEnd;
+		if (gainEnvelope->size() == 1) // by the way: size() == 0 can't be, this was
+								       // checked in setGainEnvelope(..)
 		{
 			constantGain = true;
-			nextGainPoint = (AudioEnvelopePoint*)gainEnvelope[0];
-			gainValue = nextGainPoint->getValue();
+			gainValue = gainEnvelope->getValue(0);
+			gainAtTheEnd = gainValue;
 		}
 		
 		// if the envelope contains more than 1 point
@@ -129,11 +127,14 @@ void AudioSourceGainEnvelope::getNextAudioBlock (const AudioSourceChannelInfo& i
 			constantGain = false;
 			prepareForNewPosition(audioBlockEndPosition); // The variables are set up for the
 			  // next call of getNextAudioBlock(..)
+			gainAtTheEnd = getGainAt(audioBlockEndPosition);
 		}
 		
-		
-		info.buffer->applyGainRamp(0, info.startSample, info.numSamples, previousGainValue, gainValue);
-		newGainEnvelopeSet = false;
+		if (info.numSamples > 0)
+		{
+			GainRampKernels::multiplyWithRamp(sample, info.numSamples, previousGainValue,
+			                                  (gainAtTheEnd - previousGainValue) / info.numSamples);
+		}
 	}
 	
 	// This is the regular case
@@ -153,58 +154,36 @@ void AudioSourceGainEnvelope::getNextAudioBlock (const AudioSourceChannelInfo& i
 		// If there are multiple points in the gain envelope
 		else
 		{		
-			currentPosition = nextPlayPosition;
-			
-			// Points to the first sample in the audio block.
-			float* sample = info.buffer->getSampleData(0, info.startSample); 
-	    	// First argument: channelNumber = 0, since this class is made
-		    //     for mono signals only.
-		    // Second argument: sampleOffset = info.startSample
-			while (true)
+			// The gain is applied segment by segment, each one as a whole
+			// with a vectorised ramp. Usually, the segment spans the whole
+			// block and there is only one pass.
+			int currentPosition = nextPlayPosition;
+			while (currentPosition < audioBlockEndPosition)
 			{
-				// if the next gain point is outside of the current audio block
-				// (audioBlockEndPosition is the position of to the first sample
-				//  after the current block)
-				if (nextGainPoint->getPosition() >= audioBlockEndPosition )
+				// The next point has been reached (or the playhead has
+				// jumped without setNextReadPosition(..)).
+				if (currentPosition >= segmentEndPosition
+				    || currentPosition < segmentStartPosition)
 				{
-					numberOfRemainingSamples = audioBlockEndPosition - currentPosition;
-					while (--numberOfRemainingSamples >= 0)
-					{
-						*sample++ *= gainValue;
-						gainValue += gainDelta;
-					}
-					break;
+					gainEnvelopeCursor.advance(*gainEnvelope, currentPosition);
+					prepareSegmentAt(currentPosition);
 				}
 				
-				// if the next gain point is inside the current audio block
+				const int numberOfSamples = jmin(segmentEndPosition, audioBlockEndPosition)
+				                            - currentPosition;
+				if (gainDelta == 0.0f)
+				{
+					info.buffer->applyGain(0, info.startSample + (currentPosition - nextPlayPosition),
+					                       numberOfSamples, segmentStartValue);
+				}
 				else
 				{
-					// apply the gain envelope up to the sample before the nextGainPoint
-					numberOfRemainingSamples = nextGainPoint->getPosition() - currentPosition;
-					while (--numberOfRemainingSamples >= 0)
-					{
-						*sample++ *= gainValue;
-						gainValue += gainDelta;
-					}
-					
-					// apply the gain to the sample at the nextGainPoint position
-					gainValue = nextGainPoint->getValue();
-					*sample++ *= gainValue;
-					
-					currentPosition = nextGainPoint->getPosition() + 1;
-				    // currentPosition tells you the next sample to apply the gain
-					
-					previousGainPoint = nextGainPoint;
-					nextGainPointIndex++;
-					nextGainPoint = (AudioEnvelopePoint*)gainEnvelope[nextGainPointIndex];
-					
-					// figure out gainDelta
-					int distance = nextGainPoint->getPosition() - previousGainPoint->getPosition();
-					gainDelta = (nextGainPoint->getValue() - previousGainPoint->getValue()) / (float)distance;
-					
-					gainValue += gainDelta;
+					GainRampKernels::multiplyWithRamp(sample, numberOfSamples,
+					                                  getGainAt(currentPosition), gainDelta);
 				}
-			}			
+				sample += numberOfSamples;
+				currentPosition += numberOfSamples;
+			}
 		}
 	}
 }
@@ -232,25 +211,14 @@ void AudioSourceGainEnvelope::enableBuffering(bool enable)
     }
 }
 
-void AudioSourceGainEnvelope::setGainEnvelope(Array<void*> newGainEnvelope_)
+void AudioSourceGainEnvelope::setGainEnvelope(const Array<AudioEnvelopePoint>& newGainEnvelope_)
 {
 	DEB("AudioSourceGainEnvelope: setGainEnvelope called.")
 	
-	if (newGainEnvelope_.size() != 0)
+	GainEnvelope* newGainEnvelope = createGainEnvelope(newGainEnvelope_);
+	if (newGainEnvelope != nullptr)
 	{
-		// this Array must be sorted for the code in getNextAudioLoop(..)
-		// to work.
-		newGainEnvelope_.sort(audioEnvelopePointComparator);
-		
-		{
-			const ScopedLock sl (callbackLock);
-			
-			newGainEnvelope = newGainEnvelope_;
-			newGainEnvelopeSet = true; // when set, the gain is faded from the
-			  // old gain envelope to the new one, in the interval
-			  // of one audio block in the getNextAudioBlock(..).
-			  // This avoids audible clicks.
-		}
+		setGainEnvelope(newGainEnvelope);
 	}
 	else
 	{
@@ -259,22 +227,78 @@ void AudioSourceGainEnvelope::setGainEnvelope(Array<void*> newGainEnvelope_)
 	}
 }
 
+void AudioSourceGainEnvelope::setGainEnvelope(GainEnvelope* newGainEnvelope)
+{
+	jassert (newGainEnvelope != nullptr);
+	
+	// The audio thread picks it up at the start of its next block and
+	// fades the gain from the old gain envelope to the new one, in the
+	// interval of one audio block in the getNextAudioBlock(..).
+	// This avoids audible clicks.
+	gainEnvelopeHandoff.post(newGainEnvelope);
+}
+
+GainEnvelope* AudioSourceGainEnvelope::createGainEnvelope(const Array<AudioEnvelopePoint>& points)
+{
+	if (points.size() == 0)
+	{
+		return nullptr;
+	}
+	
+	// this Array must be sorted for the code in getNextAudioLoop(..)
+	// to work.
+	Array<AudioEnvelopePoint> sortedPoints (points);
+	AudioEnvelopePointComparator comparator;
+	sortedPoints.sort(comparator, true);
+	  // second argument: retainOrderOfEquivalentItems
+	
+	return new GainEnvelope(sortedPoints);
+}
+
 inline void AudioSourceGainEnvelope::prepareForNewPosition(int newPosition)
 {
-	// figure out between which audioEnvelopePoints we are right now
+	// figure out between which points we are right now
 	// and set up all variables needed by getNextAudioBlock(..)
-	nextGainPointIndex = 1; // since the first audioEnvelopePoint has to be at position 0 
-	while (((AudioEnvelopePoint*)gainEnvelope[nextGainPointIndex])->getPosition() <= newPosition)
+	gainEnvelopeCursor.seek(*gainEnvelope, newPosition);
+	prepareSegmentAt(newPosition);
+}
+
+inline void AudioSourceGainEnvelope::prepareSegmentAt(int position)
+{
+	const GainEnvelope& envelope = *gainEnvelope;
+	const int previous = gainEnvelopeCursor.getPreviousIndex();
+	const int next = gainEnvelopeCursor.getNextIndex();
+	
+	// Before the first point
+	if (position < envelope.getPosition(previous))
 	{
-		nextGainPointIndex++;
+		segmentStartPosition = position;
+		segmentEndPosition = envelope.getPosition(previous);
+		segmentStartValue = envelope.getValue(previous);
+		gainDelta = 0.0f;
 	}
-	previousGainPoint = (AudioEnvelopePoint*)gainEnvelope[nextGainPointIndex - 1];
-	nextGainPoint = (AudioEnvelopePoint*)gainEnvelope[nextGainPointIndex];
-	int distance = nextGainPoint->getPosition() - previousGainPoint->getPosition();
-	gainDelta = (nextGainPoint->getValue() - previousGainPoint->getValue()) / (float)distance;
 	
-	int distanceFromPreviousGainPointPosToCurrentPos = newPosition - previousGainPoint->getPosition();
-	gainValue = previousGainPoint->getValue()
-	+ gainDelta*(float)(distanceFromPreviousGainPointPosToCurrentPos);
-	// this is the gainValue for the sample at position newPosition
-}
\ No newline at end of file
+	// After the last point
+	else if (position >= envelope.getPosition(next))
+	{
+		segmentStartPosition = position;
+		segmentEndPosition = std::numeric_limits<int>::max();
+		segmentStartValue = envelope.getValue(next);
+		gainDelta = 0.0f;
+	}
+	
+	// The regular case, in between the previous and the next point.
+	else
+	{
+		segmentStartPosition = envelope.getPosition(previous);
+		segmentEndPosition = envelope.getPosition(next);
+		segmentStartValue = envelope.getValue(previous);
+		const int distance = segmentEndPosition - segmentStartPosition;
+		gainDelta = (envelope.getValue(next) - segmentStartValue) / (float)distance;
+	}
+}
+
+inline float AudioSourceGainEnvelope::getGainAt(int position) const
+{
+	return segmentStartValue + gainDelta * (float)(position - segmentStartPosition);
+}
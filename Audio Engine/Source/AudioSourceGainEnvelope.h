@@ -11,6 +11,8 @@
 #define __AUDIOSOURCEGAINENVELOPE_HEADER__
 
 #include "../JuceLibraryCode/JuceHeader.h"
+#include "EnvelopeCursor.h"
+#include "EnvelopeHandoff.h"
 // #include "modified Juce Classes/juce_PositionableResamplingAudioSource.h"
 
 //==============================================================================
@@ -53,12 +55,12 @@ public:
 		value = value_;
 	}
 	
-	int getPosition()
+	int getPosition() const
 	{
 		return position;
 	}
 	
-	float getValue()
+	float getValue() const
 	{
 		return value;
 	}
@@ -102,10 +104,79 @@ public:
 		}
 	}
 	
+	int compareElements (const AudioEnvelopePoint& first, const AudioEnvelopePoint& second) const
+	{
+		if (first.getPosition() < second.getPosition())
+		{
+			return -1;
+		}
+		else if (first.getPosition() > second.getPosition())
+		{
+			return 1;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+	
 private:
 	JUCE_LEAK_DETECTOR (AudioEnvelopePointComparator)
 };
 
+//==============================================================================
+/**
+ The points of a gain envelope, as they are handed over to the audio thread
+ by an AudioSourceGainEnvelope. Isn't changed anymore once it has been
+ handed over.
+ 
+ The positions and the values are stored in two contiguous arrays, such
+ that the audio thread doesn't have to chase a pointer per point. It can be
+ used by an EnvelopeCursor directly.
+ */
+class JUCE_API GainEnvelope  : public ReferenceCountedObject
+{
+public:
+	/** @param sortedPoints		Sorted by their position and not empty. They
+								are copied.
+	 */
+	GainEnvelope (const Array<AudioEnvelopePoint>& sortedPoints)
+	  : positions (sortedPoints.size()),
+	    values (sortedPoints.size()),
+	    numberOfPoints (sortedPoints.size())
+	{
+		for (int i = 0; i < numberOfPoints; ++i)
+		{
+			const AudioEnvelopePoint& point = sortedPoints.getReference(i);
+			positions[i] = point.getPosition();
+			values[i] = point.getValue();
+		}
+	}
+	
+	int size () const
+	{
+		return numberOfPoints;
+	}
+	
+	/** The position of a point, in samples. */
+	int getPosition (int index) const
+	{
+		return positions[index];
+	}
+	
+	float getValue (int index) const
+	{
+		return values[index];
+	}
+	
+private:
+	HeapBlock<int> positions;
+	HeapBlock<float> values;
+	const int numberOfPoints;
+	
+	JUCE_LEAK_DETECTOR (GainEnvelope);
+};
+
 //==============================================================================
 //==============================================================================
 /**
@@ -163,37 +234,70 @@ public:
     void enableBuffering (bool enable);
     
 	/** 
-	 @param newGainEnvelope			it will be deleted in the setGainEnvelope(..)
-									or in the destructor, so you don't have to
-									care about.
+	 Hands a new gain envelope over to the audio thread, without locking it.
+	 The gain is faded to the new envelope during the next audio block.
+	 
+	 @param newGainEnvelope			The points are copied (and sorted). The
+									copy is released by the EnvelopeReclaimer
+									once the audio thread doesn't need it
+									anymore.
+	 */
+	void setGainEnvelope (const Array<AudioEnvelopePoint>& newGainEnvelope);
+	
+	/**
+	 Hands a gain envelope created with createGainEnvelope over to the
+	 audio thread. Only takes the time of an atomic exchange.
+	 
+	 @param newGainEnvelope			Not nullptr. It is released by the
+									EnvelopeReclaimer once the audio thread
+									doesn't need it anymore.
 	 */
-	void setGainEnvelope (Array<void*> newGainEnvelope);
+	void setGainEnvelope (GainEnvelope* newGainEnvelope);
+	
+	/**
+	 Copies and sorts the points for setGainEnvelope, such that this can be
+	 done before the envelope is handed over.
+	 
+	 @return	nullptr, if there are no points.
+	 */
+	static GainEnvelope* createGainEnvelope (const Array<AudioEnvelopePoint>& points);
 	
 
 private:
+	/** Places the gainEnvelopeCursor at the newPosition (after a jump) and
+	 sets up the segment. */
 	inline void prepareForNewPosition(int newPosition);
 	
-	BufferingAudioSource bufferingAudioSource;
-    
-//	PositionableResamplingAudioSource* positionableResamplingAudioSource;
-    
+	/** Sets up the segment variables (segmentStartPosition, ...) for the
+	 segment the gainEnvelopeCursor points to, starting at the position.
+	 Before the first point and after the last point, the gain is
+	 constant. */
+	inline void prepareSegmentAt(int position);
+	
+	/** The gain at a position in the current segment. */
+	inline float getGainAt(int position) const;
+	
     /** Responsible for reading the audio file from the harddisk and
-     decoding it.
+     decoding it. Declared before the bufferingAudioSource, which reads
+     from it (and therefore has to be deleted first).
      */
 	AudioFormatReaderSource audioFormatReaderSource;
     
+	BufferingAudioSource bufferingAudioSource;
+    
+//	PositionableResamplingAudioSource* positionableResamplingAudioSource;
+    
     PositionableAudioSource* bufferOrReaderAudioSource;
 	
-	Array<void*> gainEnvelope;
-	Array<void*> newGainEnvelope; 
-      // This is used by setGainEnvelope(..) and
-	  // by getNextAudioBlock(..) when a new envelope is engaged.
-	AudioEnvelopePointComparator audioEnvelopePointComparator;
-	bool newGainEnvelopeSet;
+	/** Hands the envelopes set with setGainEnvelope(..) over to
+	 getNextAudioBlock(..). Holds nullptr until the first one arrives. */
+	EnvelopeHandoff<GainEnvelope> gainEnvelopeHandoff;
+	/** The envelope in use by the audio thread, nullptr until the first
+	 one arrives. */
+	const GainEnvelope* gainEnvelope;
 	bool constantGain;
 	
     int volatile nextPlayPosition;
-	int currentPosition; // used in getNextAudioBlock(..) if the envelope contains more than one point.
 	int audioBlockEndPosition;  // Used in setNextReadPosition(..) and set in
 								// getNextAudioBlock(..) to determine if
 								// the playhead is at an unpredictable position
@@ -203,16 +307,15 @@ private:
 								// in the previously processed audio block) + 1
 								// in samples, relative to the start of the audio
 								// file.
-	AudioEnvelopePoint* previousGainPoint;
-	AudioEnvelopePoint* nextGainPoint;
-	int nextGainPointIndex;
-	float gainValue;
-	float previousGainValue; // used in getNextAudioBlock(..) if there is a
-	  // transition to a new envelope is going on.
+	EnvelopeCursor gainEnvelopeCursor;
+	/** The linear segment of the envelope the playhead is in: From the
+	 segmentStartPosition (inclusive) to the segmentEndPosition (exclusive),
+	 the gain is segmentStartValue + (position - segmentStartPosition) * gainDelta. */
+	int segmentStartPosition;
+	int segmentEndPosition;
+	float segmentStartValue;
 	float gainDelta;
-	int numberOfRemainingSamples;
-	
-	CriticalSection callbackLock;
+	float gainValue; // The gain if constantGain is set.
 	
 	JUCE_LEAK_DETECTOR (AudioSourceGainEnvelope);
 };
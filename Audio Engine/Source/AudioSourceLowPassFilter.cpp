@@ -15,21 +15,18 @@ AudioSourceLowPassFilter::AudioSourceLowPassFilter (PositionableAudioSource * po
   : positionableAudioSource (positionableAudioSource_),
     sampleRate (sampleRate_),
     constantSpacialPosition (true),
-    previousSpacialPoint (),
-    nextSpacialPoint (),
-    nextSpacialPointIndex (1),
+    livePositionEnabled (false),
     currentSpacialPosition (),
     iirFilter()
 {
 	// DEB("AudioSourceLowPassFilter: constructor called.");
   
     // Define an initial spacial envelope.
-    Array<SpacialEnvelopePoint> initialSpacialEnvelope;
-	initialSpacialEnvelope.add(SpacialEnvelopePoint(0,      // time (in samples)
-                                                    0,      // x
-                                                    0,      // y
-                                                    0));	// z);
-    setSpacialEnvelope(initialSpacialEnvelope);
+    setSpacialEnvelope(new SpacialEnvelope(0.0,      // x
+                                           0.0,      // y
+                                           0.0));    // z
+    spacialEnvelopeHandoff.update();
+    engageSpacialEnvelope();
 }
 
 AudioSourceLowPassFilter::~AudioSourceLowPassFilter()
@@ -65,13 +62,9 @@ void AudioSourceLowPassFilter::setNextReadPosition (int64 newPosition)
         
         if (!constantSpacialPosition)
         {
-            // Ensure that the nextSpacialPointIndex, the previousSpacialPoint
-            // and the nextSpacialPoint are set correctly.
-            nextSpacialPointIndex = 1;
+            // Ensure that the spacialEnvelopeCursor is set correctly.
+            spacialEnvelopeCursor.seek(*spacialEnvelope, newPosition);
             prepareForNewPosition(newPosition,
-                                  &nextSpacialPointIndex,
-                                  &previousSpacialPoint,
-                                  &nextSpacialPoint,
                                   &currentSpacialPosition);
         }
     }
@@ -92,22 +85,26 @@ void AudioSourceLowPassFilter::getNextAudioBlock (const AudioSourceChannelInfo&
     // -----------------------
     positionableAudioSource->getNextAudioBlock(info);
     
+    // A new spacial envelope has been set with setSpacialEnvelope(..).
+    if (spacialEnvelopeHandoff.update())
+    {
+        engageSpacialEnvelope();
+    }
+    
     // Step 2: Filter them
     // -------------------
     
     // Determine the cutoffFrequency
-    if (!constantSpacialPosition)
+    if (livePositionEnabled)
+    {
+        makeLowPassFor (livePosition);
+    }
+    else if (!constantSpacialPosition)
     {
         prepareForNewPosition(nextPlayPosition,
-                              &nextSpacialPointIndex,
-                              &previousSpacialPoint,
-                              &nextSpacialPoint,
                               &currentSpacialPosition);
         // Determine the cutoff frequency and set the filter coefficients.
-        const double cutoffAtOrigin = 21000.0;
-        double cutoffFrequency = cutoffAtOrigin * exp(-lambda * currentSpacialPosition.getDistance());
-        // Set the filter with this cutoffFrequency
-        iirFilter.makeLowPass(sampleRate, cutoffFrequency);
+        makeLowPassFor (currentSpacialPosition);
     }
     
     // Filter this block
@@ -134,50 +131,71 @@ bool AudioSourceLowPassFilter::isLooping () const
 	return positionableAudioSource->isLooping();
 }
 
-void AudioSourceLowPassFilter::setSpacialEnvelope (const Array<SpacialEnvelopePoint>& newSpacialEnvelope_)
+void AudioSourceLowPassFilter::setSpacialEnvelope (const SpacialEnvelope::Ptr& newSpacialEnvelope_)
 {
     //DEB("AudioSourceLowPassFilter::setSpacialEnvelope called.\n"
-    //    "AudioSourceLowPassFilter: newSpacialEnvelope.size() = " + String(newSpacialEnvelope_.size()))
+    //    "AudioSourceLowPassFilter: newSpacialEnvelope.size() = " + String(newSpacialEnvelope_->size()))
     
-	if (newSpacialEnvelope_.size() != 0)
+	if (newSpacialEnvelope_ != nullptr)
 	{
-        const ScopedLock sl (lock);
-        
-        // To ensure that the filter doesn't start oscillating.
-        iirFilter.reset();
-        
-        // Reset the nextSpacialPointIndex.
-        nextSpacialPointIndex = 1;
+        // Share the envelope. The audio thread picks it up in the next
+        // getNextAudioBlock(..).
+        spacialEnvelopeHandoff.post(newSpacialEnvelope_.getObject());
+    }
+    else
+    {
+		DEB("AudioSourceLowPassFilter: The newSpacialEnvelope is empty! The spacial envelope hasn't been changed.")
+	}
+}
+
+inline void AudioSourceLowPassFilter::engageSpacialEnvelope ()
+{
+    // To ensure that the filter doesn't start oscillating.
+    iirFilter.reset();
+    
+    // Reset the spacialEnvelopeCursor.
+    spacialEnvelopeCursor.reset();
+    
+    spacialEnvelope = spacialEnvelopeHandoff.get();
+    
+    if (spacialEnvelope->size() == 1)
+    {
+        constantSpacialPosition = true;
         
-        // Copy the elements over from the Array newSpacialEnvelope_ to the
-        // OwnedArray newSpacialEnvelope.
-        spacialEnvelope.clear();
-        for (int i=0; i!=newSpacialEnvelope_.size(); ++i)
-        {
-            spacialEnvelope.add(new SpacialEnvelopePoint(newSpacialEnvelope_[i]));
-        }
+        currentSpacialPosition = SpacialPosition(spacialEnvelope->getX(0),
+                                                 spacialEnvelope->getY(0),
+                                                 spacialEnvelope->getZ(0));
         
-        if (spacialEnvelope.size() == 1)
-        {
-            constantSpacialPosition = true;
-            
-            currentSpacialPosition = SpacialPosition(*(spacialEnvelope[0]));
-            
-            // Determine the cutoff frequency and set the filter coefficients.
-            double cutoffAtOrigin = 21000.0;
-            double cutoffFrequency = cutoffAtOrigin * exp(-lambda * currentSpacialPosition.getDistance());
-            // DEB("cutoffFreq = " + String(cutoffFrequency))
-            iirFilter.makeLowPass(sampleRate, cutoffFrequency);
-        }
-        else
+        // Determine the cutoff frequency and set the filter coefficients.
+        if (!livePositionEnabled)
         {
-            constantSpacialPosition = false;
+            makeLowPassFor (currentSpacialPosition);
         }
     }
     else
     {
-		DEB("AudioSourceLowPassFilter: The newSpacialEnvelope is empty! The spacial envelope hasn't been changed.")
-	}
+        constantSpacialPosition = false;
+    }
+}
+
+void AudioSourceLowPassFilter::setLivePosition (const SpacialPosition& position)
+{
+    livePosition = position;
+    livePositionEnabled = true;
+}
+
+void AudioSourceLowPassFilter::endLivePositions ()
+{
+    if (livePositionEnabled)
+    {
+        livePositionEnabled = false;
+        // The filter of a moving source is set in the next
+        // getNextAudioBlock anyway.
+        if (constantSpacialPosition)
+        {
+            makeLowPassFor (currentSpacialPosition);
+        }
+    }
 }
 
 void AudioSourceLowPassFilter::setSource (PositionableAudioSource * positionableAudioSource_)
@@ -196,41 +214,34 @@ void AudioSourceLowPassFilter::setDistanceWithHalfTheOpenCutoffFrequency(double
 
 
 
+inline void AudioSourceLowPassFilter::makeLowPassFor (SpacialPosition position)
+{
+    const double cutoffAtOrigin = 21000.0;
+    double cutoffFrequency = cutoffAtOrigin * exp(-lambda * position.getDistance());
+    // DEB("cutoffFreq = " + String(cutoffFrequency))
+    iirFilter.makeLowPass(sampleRate, cutoffFrequency);
+}
+
 inline void AudioSourceLowPassFilter::prepareForNewPosition (int newPosition,
-                                   int * nextSpacialPointIndex_,
-                                   SpacialEnvelopePoint ** previousSpacialPoint_,
-                                   SpacialEnvelopePoint ** nextSpacialPoint_,
                                    SpacialPosition * currentSpacialPosition_)
 {    
     // Figure out between which audioEnvelopePoints we are right now
 	// and set up
-    // - nextSpacialPointIndex_
-    // - previousSpacialPoint_
-    // - nextSpacialPoint_
+    // - spacialEnvelopeCursor
     if (!constantSpacialPosition)
     { 
-        while (spacialEnvelope[nextSpacialPointIndex]->getPosition() <= newPosition)
-        {
-            (*nextSpacialPointIndex_)++;
-        }
-        *previousSpacialPoint_ = spacialEnvelope[*nextSpacialPointIndex_ - 1];
-        *nextSpacialPoint_ = spacialEnvelope[*nextSpacialPointIndex_];
-        
-        // Figure out the *currentSpacialPosition_
-        // ---------------------------------------
+        const SpacialEnvelope& envelope = *spacialEnvelope;
         
-        // The distance in time. In samples.
-        double distance = double ((*nextSpacialPoint_)->getPosition() 
-                                  - (*previousSpacialPoint_)->getPosition());
-        // In samples.
-        double distanceFromPreviousSpacialPointPosToCurrentPos = double(newPosition 
-                                                                        - (*previousSpacialPoint_)->getPosition());
+        spacialEnvelopeCursor.advance(envelope, newPosition);
+        const int previous = spacialEnvelopeCursor.getPreviousIndex();
         
-        double factor = distanceFromPreviousSpacialPointPosToCurrentPos / distance;
-        
-        currentSpacialPosition_->x = (*previousSpacialPoint_)->getX() + factor * ((*nextSpacialPoint_)->getX() - (*previousSpacialPoint_)->getX());
-        currentSpacialPosition_->y = (*previousSpacialPoint_)->getY() + factor * ((*nextSpacialPoint_)->getY() - (*previousSpacialPoint_)->getY());
-        currentSpacialPosition_->z = (*previousSpacialPoint_)->getZ() + factor * ((*nextSpacialPoint_)->getZ() - (*previousSpacialPoint_)->getZ());
+        // Figure out the *currentSpacialPosition_ (on the line, the arc or
+        // the curve of the segment).
+        // ---------------------------------------
+        envelope.getCoordinatesAt(previous, newPosition,
+                                  currentSpacialPosition_->x,
+                                  currentSpacialPosition_->y,
+                                  currentSpacialPosition_->z);
     }
 }
 
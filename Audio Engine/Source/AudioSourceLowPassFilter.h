@@ -12,8 +12,11 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "SpacialEnvelopePoint.h"
+#include "SpacialEnvelope.h"
+#include "EnvelopeCursor.h"
 #include "SpacialPosition.h"
 #include "AudioSourceGainEnvelope.h"
+#include "EnvelopeHandoff.h"
 
 //==============================================================================
 /**
@@ -60,9 +63,23 @@ public:
 	 Sets a new spacial envelope which determines the location in space of the
      sound source in relation to the time. It also contains the distance delay
      for each point of the envelope, which is used here.
-     This class makes a copy of the newSpacialEnvelope.
+     The newSpacialEnvelope is shared, not copied. It is handed over to the
+     audio thread without locking, the filter switches to it at the start
+     of the next audio block.
 	 */
-	void setSpacialEnvelope (const Array<SpacialEnvelopePoint>& newSpacialEnvelope);
+	void setSpacialEnvelope (const SpacialEnvelope::Ptr& newSpacialEnvelope);
+    
+    /**
+     Sets the position of the source at the end of the next audio block.
+     Called by the AudioSourceAmbipanning on the audio thread, right before
+     getNextAudioBlock, as long as the source follows a live input. The
+     cutoff frequency of the block is determined by this position instead
+     of the spacial envelope.
+     */
+    void setLivePosition (const SpacialPosition& position);
+    
+    /** Returns to the spacial envelope. Called on the audio thread. */
+    void endLivePositions ();
     
     void setSource (PositionableAudioSource * positionableAudioSource_);
     
@@ -79,46 +96,42 @@ public:
 private:
 	/**
 	 It figures out the other parameters given the newPosition.
-     Ensure the *nextSpacialPointIndex_ is really the next one seen from the
-     newPosition, or set it to 1 if there is doubt.
+     The spacialEnvelopeCursor is moved forward to the newPosition (after a
+     jump, it has to be placed with EnvelopeCursor::seek before calling this).
      
      @param newPosition             The position in time (in samples) of interest.
-     @param nextSpacialPointIndex_  Will be modified.
-                                    This must be lower or equal to the index of
-                                    the next spacial point in the envelope.
-                                    If the value is lower, then it will be
-                                    increased until it is this index.
-     @param previousSpacialPoint_   Will be modified.
-                                    The envelope point that comes before (or at
-                                    the same time as the)
-                                    point at the newPosition (in time).
-     @param nextSpacialPoint_       Will be modified.
-                                    The envelope point that comes after the
-                                    point at the newPosition (in time).
      @param currentSpacialPosition_ Will be modified.
                                     The position in space of the point at the
                                     time position newPosition.
 	 */
 	inline void prepareForNewPosition (int newPosition,
-                                       int * nextSpacialPointIndex_,
-                                       SpacialEnvelopePoint ** previousSpacialPoint_,
-                                       SpacialEnvelopePoint ** nextSpacialPoint_,
                                        SpacialPosition * currentSpacialPosition_);
     
+    /** Switches to the envelope that has been picked up from the
+     spacialEnvelopeHandoff. Called on the audio thread. */
+    inline void engageSpacialEnvelope ();
+    
+    /** Sets the filter coefficients for a source at the position. */
+    inline void makeLowPassFor (SpacialPosition position);
+    
     double sampleRate;
     double samplesPerBlockExpected;
     
-    /** Holds the SpacialEnvelopePoints which define the
-     position / movement of the audio source in space over time.
-     It is assumed by the code that the SpacialEnvelopePoints are
-     ordered in this array according to their position in time.
+    /** Hands the envelopes set with setSpacialEnvelope over to the audio
+     thread. */
+    EnvelopeHandoff<SpacialEnvelope> spacialEnvelopeHandoff;
+    /** Defines the position / movement of the audio source in space over
+     time. Never nullptr. Only used by the audio thread, it is the one in
+     the spacialEnvelopeHandoff.
      */
-	OwnedArray<SpacialEnvelopePoint> spacialEnvelope;
+	SpacialEnvelope* spacialEnvelope;
     bool constantSpacialPosition;
+    /** See setLivePosition. */
+    bool livePositionEnabled;
+    SpacialPosition livePosition;
     
-    SpacialEnvelopePoint * previousSpacialPoint;
-    SpacialEnvelopePoint * nextSpacialPoint;
-    int nextSpacialPointIndex;
+    /** Points to the segment of the spacialEnvelope the stage is in. */
+    EnvelopeCursor spacialEnvelopeCursor;
     
     /** The source that provides the samples to filter.
      */
@@ -132,9 +145,6 @@ private:
 
     /** The actual filter. */
     IIRFilter iirFilter;
-    
-    /** Used to lock the section in setSpacialEnvelope. */
-    CriticalSection lock;
     		
 	JUCE_LEAK_DETECTOR (AudioSourceLowPassFilter);
 };
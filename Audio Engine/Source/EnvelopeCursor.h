@@ -0,0 +1,144 @@
+/*
+ *  EnvelopeCursor.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120901.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __ENVELOPECURSOR_HEADER__
+#define __ENVELOPECURSOR_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+ Keeps track of the segment of an envelope a stage is in: The index of the
+ next point, i.e. the first point after the current position (in time). The
+ point before it is the previous point.
+
+ The envelope can be of any type with the methods
+    int size () const;
+    int getPosition (int index) const;
+ and it has to contain at least two points, sorted by their position. The
+ cursor never leaves the range [1, size() - 1].
+
+ After a jump (a seek, a loop or a new envelope) the cursor is placed with a
+ binary search, i.e. in O(log(number of points)). Moving forward with
+ advance is amortized O(1): It only gallops (and then searches), if the
+ new position is further away than the next point.
+ */
+class JUCE_API  EnvelopeCursor
+{
+public:
+	/** Constructor. The next point is the second one. */
+	EnvelopeCursor ()
+	  : nextIndex (1)
+	{
+	}
+
+	/** Moves the cursor back to the first segment. */
+	void reset ()
+	{
+		nextIndex = 1;
+	}
+
+	/** Returns the index of the next point. */
+	int getNextIndex () const
+	{
+		return nextIndex;
+	}
+
+	/** Returns the index of the previous point. */
+	int getPreviousIndex () const
+	{
+		return nextIndex - 1;
+	}
+
+	/** Places the cursor anywhere in the envelope with a binary search.
+	 Afterwards, the next point is the first one after the newPosition or
+	 the last point of the envelope. */
+	template <class EnvelopeType>
+	void seek (const EnvelopeType& envelope, int newPosition)
+	{
+		jassert (envelope.size() > 1);
+
+		nextIndex = findNextIndex (envelope, newPosition, 1, envelope.size() - 1);
+	}
+
+	/** Moves the cursor forward to the newPosition. If the newPosition lies
+	 before the previous point, it seeks instead. */
+	template <class EnvelopeType>
+	void advance (const EnvelopeType& envelope, int newPosition)
+	{
+		jassert (envelope.size() > 1);
+
+		const int lastIndex = envelope.size() - 1;
+		if (nextIndex > lastIndex || envelope.getPosition (nextIndex - 1) > newPosition)
+		{
+			seek (envelope, newPosition);
+			return;
+		}
+
+		// The usual case: The newPosition still lies in the current segment.
+		if (envelope.getPosition (nextIndex) > newPosition)
+		{
+			return;
+		}
+
+		// Gallop forward until a point after the newPosition is found, then
+		// search the last stride.
+		int lowerBound = nextIndex + 1;
+		int stride = 1;
+		while (nextIndex + stride < lastIndex
+		       && envelope.getPosition (nextIndex + stride) <= newPosition)
+		{
+			lowerBound = nextIndex + stride + 1;
+			stride *= 2;
+		}
+		nextIndex = findNextIndex (envelope, newPosition,
+		                           jmin (lowerBound, lastIndex),
+		                           jmin (nextIndex + stride, lastIndex));
+	}
+
+	/** Moves the cursor to the next segment, e.g. when the current position
+	 reaches the next point. Doesn't go beyond the last point. */
+	template <class EnvelopeType>
+	void moveToNextPoint (const EnvelopeType& envelope)
+	{
+		jassert (nextIndex < envelope.size() - 1);
+
+		if (nextIndex < envelope.size() - 1)
+		{
+			++nextIndex;
+		}
+	}
+
+private:
+	/** Returns the first index in [lowerBound, upperBound] of a point after
+	 the position, or upperBound if there is none. */
+	template <class EnvelopeType>
+	static int findNextIndex (const EnvelopeType& envelope, int position,
+	                          int lowerBound, int upperBound)
+	{
+		while (lowerBound < upperBound)
+		{
+			const int middle = lowerBound + (upperBound - lowerBound) / 2;
+			if (envelope.getPosition (middle) <= position)
+			{
+				lowerBound = middle + 1;
+			}
+			else
+			{
+				upperBound = middle;
+			}
+		}
+		return lowerBound;
+	}
+
+	int nextIndex;
+};
+
+
+#endif   // __ENVELOPECURSOR_HEADER__
@@ -0,0 +1,122 @@
+/*
+ *  EnvelopeHandoff.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120912.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __ENVELOPEHANDOFF_HEADER__
+#define __ENVELOPEHANDOFF_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "EnvelopeReclaimer.h"
+
+//==============================================================================
+/**
+ Hands envelopes from the thread that sets them (the producer) to the audio
+ thread (the consumer), without locks and without freeing memory on the
+ audio thread.
+
+ The envelope type has to be a ReferenceCountedObject whose content isn't
+ changed anymore once it has been posted. The producer posts a new envelope
+ with a single atomic exchange. If the consumer hasn't picked up the one
+ posted before, that one is released right away (on the producer's
+ thread, the audio thread never saw it). The consumer picks the latest
+ envelope up with another atomic exchange in update, at the start of a
+ block. The envelope it used before is pushed to a RetiredEnvelopeQueue and
+ released later by the EnvelopeReclaimer.
+
+ There must only be one producer and one consumer at a time.
+ */
+template <class EnvelopeType>
+class EnvelopeHandoff
+{
+public:
+    /** Constructor. Don't create it on the audio thread.
+
+     @param initialEnvelope     The envelope get returns until the first
+                                update, may be nullptr.
+     */
+    explicit EnvelopeHandoff (EnvelopeType* initialEnvelope = nullptr)
+      : currentEnvelope (initialEnvelope)
+    {
+        if (currentEnvelope != nullptr)
+        {
+            currentEnvelope->incReferenceCount();
+        }
+    }
+
+    /** Destructor. The consumer must not use the envelope anymore. */
+    ~EnvelopeHandoff ()
+    {
+        EnvelopeType* pendingEnvelope = nextEnvelope.exchange (nullptr);
+        if (pendingEnvelope != nullptr)
+        {
+            pendingEnvelope->decReferenceCount();
+        }
+        if (currentEnvelope != nullptr)
+        {
+            currentEnvelope->decReferenceCount();
+        }
+    }
+
+    /** Hands a new envelope to the consumer. Called by the producer. */
+    void post (EnvelopeType* newEnvelope)
+    {
+        jassert (newEnvelope != nullptr);
+
+        newEnvelope->incReferenceCount();
+        EnvelopeType* envelopeNotPickedUp = nextEnvelope.exchange (newEnvelope);
+        if (envelopeNotPickedUp != nullptr)
+        {
+            envelopeNotPickedUp->decReferenceCount();
+        }
+    }
+
+    /**
+     Picks up the envelope posted last, if there is one. Called by the
+     consumer.
+
+     @return    true, if get returns a new envelope now. If the retired
+                envelopes haven't been released for a while, the new
+                envelope stays pending until the next call.
+     */
+    bool update ()
+    {
+        if (nextEnvelope.get() == nullptr || retiredEnvelopes.isFull())
+        {
+            return false;
+        }
+
+        // Only the consumer takes it out, so it's still there.
+        EnvelopeType* newEnvelope = nextEnvelope.exchange (nullptr);
+        if (currentEnvelope != nullptr)
+        {
+            retiredEnvelopes.push (currentEnvelope);
+        }
+        currentEnvelope = newEnvelope;
+        return true;
+    }
+
+    /** Returns true if an envelope has been posted that the consumer
+     hasn't picked up yet. */
+    bool hasNewEnvelope () const                { return nextEnvelope.get() != nullptr; }
+
+    /** Returns the envelope picked up by the last update. Only to be used
+     by the consumer. */
+    EnvelopeType* get () const                  { return currentEnvelope; }
+
+private:
+    /** Posted, but not picked up yet. */
+    Atomic<EnvelopeType*> nextEnvelope;
+    /** Only used by the consumer. */
+    EnvelopeType* currentEnvelope;
+    RetiredEnvelopeQueue retiredEnvelopes;
+
+    JUCE_DECLARE_NON_COPYABLE (EnvelopeHandoff);
+};
+
+
+#endif   // __ENVELOPEHANDOFF_HEADER__
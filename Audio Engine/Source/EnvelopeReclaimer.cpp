@@ -0,0 +1,105 @@
+/*
+ *  EnvelopeReclaimer.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120912.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "EnvelopeReclaimer.h"
+
+
+EnvelopeReclaimer::EnvelopeReclaimer ()
+:   Thread ("EnvelopeReclaimer")
+{
+    startThread (3);
+}
+
+EnvelopeReclaimer::~EnvelopeReclaimer ()
+{
+    stopThread (2000);
+
+    // The remaining queues release their envelopes themselves.
+    releaseRetiredEnvelopes();
+    clearSingletonInstance();
+}
+
+juce_ImplementSingleton (EnvelopeReclaimer)
+
+void EnvelopeReclaimer::run ()
+{
+    while (! threadShouldExit())
+    {
+        wait (50);
+        releaseRetiredEnvelopes();
+    }
+}
+
+void EnvelopeReclaimer::addQueue (RetiredEnvelopeQueue* queue)
+{
+    const ScopedLock sl (queuesLock);
+    queues.add (queue);
+}
+
+void EnvelopeReclaimer::removeQueue (RetiredEnvelopeQueue* queue)
+{
+    // Waits if the queue is being emptied right now.
+    const ScopedLock sl (queuesLock);
+    queues.removeValue (queue);
+}
+
+void EnvelopeReclaimer::releaseRetiredEnvelopes ()
+{
+    const ScopedLock sl (queuesLock);
+    for (int i = 0; i < queues.size(); ++i)
+    {
+        queues.getUnchecked (i)->releaseAll();
+    }
+}
+
+//==============================================================================
+RetiredEnvelopeQueue::RetiredEnvelopeQueue ()
+:   fifo (capacity)
+{
+    EnvelopeReclaimer::getInstance()->addQueue (this);
+}
+
+RetiredEnvelopeQueue::~RetiredEnvelopeQueue ()
+{
+    // At shutdown, the reclaimer might be gone already.
+    EnvelopeReclaimer* reclaimer = EnvelopeReclaimer::getInstanceWithoutCreating();
+    if (reclaimer != nullptr)
+    {
+        reclaimer->removeQueue (this);
+    }
+    releaseAll();
+}
+
+bool RetiredEnvelopeQueue::push (ReferenceCountedObject* envelope)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite (1, start1, size1, start2, size2);
+    if (size1 == 0)
+    {
+        return false;
+    }
+    envelopes[start1] = envelope;
+    fifo.finishedWrite (1);
+    return true;
+}
+
+void RetiredEnvelopeQueue::releaseAll ()
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead (fifo.getNumReady(), start1, size1, start2, size2);
+    for (int i = 0; i < size1; ++i)
+    {
+        envelopes[start1 + i]->decReferenceCount();
+    }
+    for (int i = 0; i < size2; ++i)
+    {
+        envelopes[start2 + i]->decReferenceCount();
+    }
+    fifo.finishedRead (size1 + size2);
+}
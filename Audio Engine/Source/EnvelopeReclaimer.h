@@ -0,0 +1,110 @@
+/*
+ *  EnvelopeReclaimer.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120912.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __ENVELOPERECLAIMER_HEADER__
+#define __ENVELOPERECLAIMER_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class RetiredEnvelopeQueue;
+
+//==============================================================================
+/**
+ Releases the envelopes the audio thread doesn't need anymore (see
+ EnvelopeHandoff), on a background thread, such that the audio thread never
+ frees memory.
+
+ Every EnvelopeHandoff has a RetiredEnvelopeQueue, which registers itself
+ here. The background thread empties all of them every 50 ms. The audio
+ thread never waits for it and never wakes it up.
+ */
+class JUCE_API  EnvelopeReclaimer  : public Thread,
+                                     public DeletedAtShutdown
+{
+public:
+    /** Constructor. Use getInstance() instead. Starts the background
+     thread. */
+    EnvelopeReclaimer ();
+
+    /** Destructor. Stops the background thread and releases everything that
+     is still queued. */
+    ~EnvelopeReclaimer ();
+
+    juce_DeclareSingleton (EnvelopeReclaimer, false)
+
+    /** Implements the Thread method. */
+    void run ();
+
+private:
+    friend class RetiredEnvelopeQueue;
+
+    void addQueue (RetiredEnvelopeQueue* queue);
+    void removeQueue (RetiredEnvelopeQueue* queue);
+
+    /** Releases the envelopes of all queues. */
+    void releaseRetiredEnvelopes ();
+
+    Array<RetiredEnvelopeQueue*> queues;
+    /** Never held by the audio thread. */
+    CriticalSection queuesLock;
+
+	JUCE_LEAK_DETECTOR (EnvelopeReclaimer);
+};
+
+//==============================================================================
+/**
+ A single producer, single consumer queue of envelopes the audio thread has
+ retired. The audio thread pushes them (without waiting and without
+ allocating), the EnvelopeReclaimer releases them.
+
+ The envelopes are ReferenceCountedObject s whose reference has been handed
+ over to the queue. Releasing means decReferenceCount, which deletes an
+ envelope that isn't shared anymore.
+ */
+class JUCE_API  RetiredEnvelopeQueue
+{
+public:
+    /** Registers the queue with the EnvelopeReclaimer. Don't create it on
+     the audio thread. */
+    RetiredEnvelopeQueue ();
+
+    /** Unregisters the queue and releases what's left in it. */
+    ~RetiredEnvelopeQueue ();
+
+    /**
+     Hands over an envelope (and a reference to it). Called by the audio
+     thread.
+
+     @return    false, if the queue is full. The envelope stays with the
+                caller then.
+     */
+    bool push (ReferenceCountedObject* envelope);
+
+    /** Returns true if push would fail. */
+    bool isFull () const                        { return fifo.getFreeSpace() == 0; }
+
+private:
+    friend class EnvelopeReclaimer;
+
+    /** Releases all envelopes in the queue. Called by the
+     EnvelopeReclaimer (or the destructor). */
+    void releaseAll ();
+
+    /** A handful is enough: The audio thread retires at most one envelope
+     per handoff and block. */
+    enum { capacity = 16 };
+
+    AbstractFifo fifo;
+    ReferenceCountedObject* envelopes[capacity];
+
+	JUCE_DECLARE_NON_COPYABLE (RetiredEnvelopeQueue);
+};
+
+
+#endif   // __ENVELOPERECLAIMER_HEADER__
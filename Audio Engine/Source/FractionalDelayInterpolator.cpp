@@ -0,0 +1,568 @@
+/*
+ *  FractionalDelayInterpolator.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120913.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "FractionalDelayInterpolator.h"
+
+#if defined (__SSE__) || defined (__amd64__) || defined (__x86_64__)
+ #include <xmmintrin.h>
+ #define FRACTIONALDELAYINTERPOLATOR_USE_SSE 1
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+ #include <arm_neon.h>
+ #define FRACTIONALDELAYINTERPOLATOR_USE_NEON 1
+#endif
+
+namespace
+{
+    /* The sum of the products of numberOfTaps samples and coefficients.
+     
+     Since numberOfTaps is a template argument, the loops are unrolled by the
+     compiler. Two partial sums hide the latency of the additions for the
+     longer filters.
+     */
+    template <int numberOfTaps>
+    inline float dotProduct (const float* samples, const float* coefficients)
+    {
+    #if FRACTIONALDELAYINTERPOLATOR_USE_SSE
+        if (numberOfTaps >= 4)
+        {
+            __m128 sum1 = _mm_mul_ps (_mm_loadu_ps (samples), _mm_loadu_ps (coefficients));
+            __m128 sum2 = _mm_setzero_ps();
+            for (int j = 4; j + 8 <= numberOfTaps; j += 8)
+            {
+                sum2 = _mm_add_ps (sum2, _mm_mul_ps (_mm_loadu_ps (samples + j),
+                                                     _mm_loadu_ps (coefficients + j)));
+                sum1 = _mm_add_ps (sum1, _mm_mul_ps (_mm_loadu_ps (samples + j + 4),
+                                                     _mm_loadu_ps (coefficients + j + 4)));
+            }
+            if ((numberOfTaps - 4) % 8 != 0)
+            {
+                const int j = numberOfTaps - 4;
+                sum2 = _mm_add_ps (sum2, _mm_mul_ps (_mm_loadu_ps (samples + j),
+                                                     _mm_loadu_ps (coefficients + j)));
+            }
+            // Add the partial sums.
+            __m128 sum = _mm_add_ps (sum1, sum2);
+            sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+            sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 1));
+            return _mm_cvtss_f32 (sum);
+        }
+
+    #elif FRACTIONALDELAYINTERPOLATOR_USE_NEON
+        if (numberOfTaps >= 4)
+        {
+            float32x4_t sum1 = vmulq_f32 (vld1q_f32 (samples), vld1q_f32 (coefficients));
+            float32x4_t sum2 = vdupq_n_f32 (0.0f);
+            for (int j = 4; j + 8 <= numberOfTaps; j += 8)
+            {
+                sum2 = vmlaq_f32 (sum2, vld1q_f32 (samples + j), vld1q_f32 (coefficients + j));
+                sum1 = vmlaq_f32 (sum1, vld1q_f32 (samples + j + 4), vld1q_f32 (coefficients + j + 4));
+            }
+            if ((numberOfTaps - 4) % 8 != 0)
+            {
+                const int j = numberOfTaps - 4;
+                sum2 = vmlaq_f32 (sum2, vld1q_f32 (samples + j), vld1q_f32 (coefficients + j));
+            }
+            // Add the partial sums.
+            const float32x4_t sum = vaddq_f32 (sum1, sum2);
+            const float32x2_t pairs = vadd_f32 (vget_low_f32 (sum), vget_high_f32 (sum));
+            return vget_lane_f32 (vpadd_f32 (pairs, pairs), 0);
+        }
+    #endif
+
+        // The linear interpolation (or all of them, if no vector unit is
+        // available).
+        float result = 0.0f;
+        for (int j = 0; j < numberOfTaps; ++j)
+        {
+            result += samples[j] * coefficients[j];
+        }
+        return result;
+    }
+
+    /* The common implementation of interpolateSegment, see there.
+     
+     The coefficients of the remainder r are the ones of the phase
+     int (r * numberOfPhases + 0.5).
+     */
+    template <int numberOfTaps>
+    void interpolateSegment (const float*& sampleRightBefore,
+                             double& remainder,
+                             double sampleOffsetBetweenNeighbours,
+                             float* destination,
+                             int numSamples,
+                             const float* coefficients,
+                             int numberOfPhases)
+    {
+        const int offsetToTheFirstTap = numberOfTaps / 2 - 1;
+
+        // The delay doesn't change: The same phase for all samples.
+        if (sampleOffsetBetweenNeighbours == 1.0)
+        {
+            const float* coefficientsOfPhase = coefficients + numberOfTaps * (int) (remainder * numberOfPhases + 0.5);
+            const float* samples = sampleRightBefore - offsetToTheFirstTap;
+            for (int i = 0; i < numSamples; ++i)
+            {
+                destination[i] = dotProduct<numberOfTaps> (samples + i, coefficientsOfPhase);
+            }
+            sampleRightBefore += numSamples - 1;
+            return;
+        }
+
+        // The positions are calculated from the first one (and not from their
+        // predecessor), such that the samples don't wait for each other.
+        const float* firstTapAtTheStart = sampleRightBefore - offsetToTheFirstTap;
+        const double startRemainder = remainder;
+        int sampleOffset = 0;
+        double currentRemainder = startRemainder;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const double positionRelativeToTheStart = startRemainder + i * sampleOffsetBetweenNeighbours;
+            // floor, without the function call. Be aware that e.g.
+            // floor(-1.5) = -2
+            sampleOffset = (int) positionRelativeToTheStart;
+            if (double (sampleOffset) > positionRelativeToTheStart)
+            {
+                --sampleOffset;
+            }
+            currentRemainder = positionRelativeToTheStart - double (sampleOffset);
+
+            destination[i] = dotProduct<numberOfTaps> (firstTapAtTheStart + sampleOffset,
+                                                       coefficients + numberOfTaps * (int) (currentRemainder * numberOfPhases + 0.5));
+        }
+        sampleRightBefore += sampleOffset;
+        remainder = currentRemainder;
+    }
+}
+
+
+FractionalDelayInterpolator::FractionalDelayInterpolator (Quality quality_,
+                                                          double sampleRate_)
+:   quality (quality_),
+    sampleRate (sampleRate_)
+{
+    switch (quality)
+    {
+        case qualityLinear:
+            numberOfTaps = 2;
+            numberOfPhases = 128;
+            break;
+        case qualityCubic:
+            numberOfTaps = 4;
+            numberOfPhases = 128;
+            break;
+        case qualitySinc16:
+            numberOfTaps = 16;
+            numberOfPhases = 512;
+            break;
+        case qualitySinc32:
+            numberOfTaps = 32;
+            numberOfPhases = 1024;
+            break;
+        default:
+            jassert (quality == qualitySinc8);
+            numberOfTaps = 8;
+            numberOfPhases = 256;
+            break;
+    }
+    jassert (numberOfTaps / 2 <= maximumHalfTheNumberOfTaps);
+
+    coefficients.malloc ((numberOfPhases + 1) * numberOfTaps);
+
+    if (quality == qualityLinear || quality == qualityCubic)
+    {
+        calculateLagrange();
+    }
+    else
+    {
+        // The cutoff frequency has to stay below the Nyquist frequency, also
+        // for low sample rates.
+        calculateWindowedSinc (jmin (20000.0 / sampleRate, 0.45));
+    }
+}
+
+void FractionalDelayInterpolator::calculateWindowedSinc (double normalizedCutoffFrequency)
+{
+    jassert (normalizedCutoffFrequency > 0.0 && normalizedCutoffFrequency < 0.5);
+
+    const double pi = double_Pi;
+    const int halfTheNumberOfTaps = numberOfTaps / 2;
+    HeapBlock<double> values (numberOfTaps);
+
+    for (int phase = 0; phase <= numberOfPhases; ++phase)
+    {
+        const double remainder = double (phase) / double (numberOfPhases);
+        float* coefficientsOfPhase = coefficients + numberOfTaps * phase;
+
+        // The tap j is applied to the sample k = j - halfTheNumberOfTaps + 1
+        // (relative to the sample right before the position).
+        double sum = 0.0;
+        for (int j = 0; j < numberOfTaps; ++j)
+        {
+            const double t = remainder - double (j - halfTheNumberOfTaps + 1);
+            const double argument = 2.0 * pi * normalizedCutoffFrequency * t;
+            // By de l'Hopital: sinc(0) = 1.
+            const double sinc = argument == 0.0 ? 1.0 : sin (argument) / argument;
+            const double window = std::abs (t) < halfTheNumberOfTaps + 1
+                                  ? 0.5 * (1.0 + cos (2.0 * pi * t / (numberOfTaps + 2)))
+                                  : 0.0;
+            values[j] = 2.0 * normalizedCutoffFrequency * sinc * window;
+            sum += values[j];
+        }
+
+        // A gain of 1 at DC for every phase, such that the remainder doesn't
+        // modulate the gain.
+        for (int j = 0; j < numberOfTaps; ++j)
+        {
+            coefficientsOfPhase[j] = (float) (values[j] / sum);
+        }
+    }
+}
+
+void FractionalDelayInterpolator::calculateLagrange ()
+{
+    const int halfTheNumberOfTaps = numberOfTaps / 2;
+
+    for (int phase = 0; phase <= numberOfPhases; ++phase)
+    {
+        const double remainder = double (phase) / double (numberOfPhases);
+        float* coefficientsOfPhase = coefficients + numberOfTaps * phase;
+
+        // The polynomial through the samples k = -halfTheNumberOfTaps + 1 ..
+        // halfTheNumberOfTaps, which is 1 at the sample of the tap j and 0
+        // at the others (their sum is 1 anyway).
+        for (int j = 0; j < numberOfTaps; ++j)
+        {
+            const int k = j - halfTheNumberOfTaps + 1;
+            double value = 1.0;
+            for (int m = 0; m < numberOfTaps; ++m)
+            {
+                const int otherK = m - halfTheNumberOfTaps + 1;
+                if (otherK != k)
+                {
+                    value *= (remainder - otherK) / double (k - otherK);
+                }
+            }
+            coefficientsOfPhase[j] = (float) value;
+        }
+    }
+}
+
+FractionalDelayInterpolator::~FractionalDelayInterpolator ()
+{
+}
+
+float FractionalDelayInterpolator::interpolate (const float* sampleRightBefore,
+                                                double remainder) const
+{
+    float result;
+    interpolateSegment (sampleRightBefore, remainder, 0.0, &result, 1);
+    return result;
+}
+
+float FractionalDelayInterpolator::interpolateScalar (const float* sampleRightBefore,
+                                                      double remainder) const
+{
+    const float* samples = sampleRightBefore - numberOfTaps / 2 + 1;
+    const float* coefficientsOfPhase = getCoefficients (remainder);
+
+    float result = 0.0f;
+    for (int j = 0; j < numberOfTaps; ++j)
+    {
+        result += samples[j] * coefficientsOfPhase[j];
+    }
+    return result;
+}
+
+void FractionalDelayInterpolator::interpolateSegment (const float*& sampleRightBefore,
+                                                      double& remainder,
+                                                      double sampleOffsetBetweenNeighbours,
+                                                      float* destination,
+                                                      int numSamples) const
+{
+    if (numSamples <= 0)
+    {
+        return;
+    }
+
+    switch (numberOfTaps)
+    {
+        case 2:
+            ::interpolateSegment<2> (sampleRightBefore, remainder, sampleOffsetBetweenNeighbours,
+                                     destination, numSamples, coefficients, numberOfPhases);
+            break;
+        case 4:
+            ::interpolateSegment<4> (sampleRightBefore, remainder, sampleOffsetBetweenNeighbours,
+                                     destination, numSamples, coefficients, numberOfPhases);
+            break;
+        case 8:
+            ::interpolateSegment<8> (sampleRightBefore, remainder, sampleOffsetBetweenNeighbours,
+                                     destination, numSamples, coefficients, numberOfPhases);
+            break;
+        case 16:
+            ::interpolateSegment<16> (sampleRightBefore, remainder, sampleOffsetBetweenNeighbours,
+                                      destination, numSamples, coefficients, numberOfPhases);
+            break;
+        default:
+            jassert (numberOfTaps == 32);
+            ::interpolateSegment<32> (sampleRightBefore, remainder, sampleOffsetBetweenNeighbours,
+                                      destination, numSamples, coefficients, numberOfPhases);
+            break;
+    }
+}
+
+//==============================================================================
+FractionalDelayInterpolatorCache::FractionalDelayInterpolatorCache ()
+{
+}
+
+FractionalDelayInterpolatorCache::~FractionalDelayInterpolatorCache ()
+{
+    clearSingletonInstance();
+}
+
+juce_ImplementSingleton (FractionalDelayInterpolatorCache)
+
+FractionalDelayInterpolator::Ptr FractionalDelayInterpolatorCache::getInterpolator (FractionalDelayInterpolator::Quality quality,
+                                                                                    double sampleRate)
+{
+    const ScopedLock sl (interpolatorsLock);
+
+    for (int i = 0; i < interpolators.size(); ++i)
+    {
+        FractionalDelayInterpolator* interpolator = interpolators.getUnchecked (i);
+        if (interpolator->getQuality() == quality
+            && interpolator->getSampleRate() == sampleRate)
+        {
+            return interpolator;
+        }
+    }
+
+    FractionalDelayInterpolator* interpolator = new FractionalDelayInterpolator (quality, sampleRate);
+    interpolators.add (interpolator);
+    return interpolator;
+}
+
+#if AUDIO_ENGINE_UNIT_TESTS
+//==============================================================================
+/**
+ For each Quality: Compares interpolate and interpolateSegment with the
+ scalar reference implementation and checks the response (the gain at DC
+ and the error for a sine).
+ */
+class FractionalDelayInterpolatorTest  : public UnitTest
+{
+public:
+    FractionalDelayInterpolatorTest ()  : UnitTest ("FractionalDelayInterpolator") {}
+
+    void runTest ()
+    {
+        for (int i = 0; i < FractionalDelayInterpolator::numberOfQualities; ++i)
+        {
+            const FractionalDelayInterpolator interpolator ((FractionalDelayInterpolator::Quality) i, 44100.0);
+
+            beginTest (getName (interpolator) + ": interpolate vs. scalar");
+            testInterpolate (interpolator);
+
+            beginTest (getName (interpolator) + ": interpolateSegment vs. scalar");
+            testInterpolateSegment (interpolator, 1.0);
+            testInterpolateSegment (interpolator, 1.02);
+            testInterpolateSegment (interpolator, 0.97);
+
+            beginTest (getName (interpolator) + ": response");
+            testResponse (interpolator);
+        }
+    }
+
+private:
+    enum { signalLength = 4096 };
+
+    static String getName (const FractionalDelayInterpolator& interpolator)
+    {
+        return String (interpolator.getNumberOfTaps()) + " taps";
+    }
+
+    /** Noise, such that every tap matters. */
+    static void fillWithNoise (float* signal, int numSamples, int seed)
+    {
+        Random random (seed);
+        for (int i = 0; i < numSamples; ++i)
+            signal[i] = 2.0f * random.nextFloat() - 1.0f;
+    }
+
+    void testInterpolate (const FractionalDelayInterpolator& interpolator)
+    {
+        HeapBlock<float> signal (signalLength);
+        fillWithNoise (signal, signalLength, 120913);
+
+        // The vectorised dot product adds in a different order.
+        float largestDifference = 0.0f;
+        Random random (1);
+        const int margin = FractionalDelayInterpolator::maximumHalfTheNumberOfTaps;
+        for (int n = margin; n < signalLength - margin; ++n)
+        {
+            const double remainder = random.nextDouble();
+            largestDifference = jmax (largestDifference,
+                                      fabsf (interpolator.interpolate (signal + n, remainder)
+                                             - interpolator.interpolateScalar (signal + n, remainder)));
+        }
+        expect (largestDifference < 1.0e-5f, "largest difference " + String (largestDifference));
+    }
+
+    /** The samples of a segment have to be the ones of interpolateScalar
+     at the positions start + i * sampleOffsetBetweenNeighbours. */
+    void testInterpolateSegment (const FractionalDelayInterpolator& interpolator,
+                                 double sampleOffsetBetweenNeighbours)
+    {
+        HeapBlock<float> signal (signalLength);
+        fillWithNoise (signal, signalLength, 1209);
+
+        const int numSamples = 1000;
+        HeapBlock<float> destination (numSamples);
+        const int startSample = 2 * FractionalDelayInterpolator::maximumHalfTheNumberOfTaps;
+        const double startRemainder = 0.3;
+
+        const float* sampleRightBefore = signal + startSample;
+        double remainder = startRemainder;
+        interpolator.interpolateSegment (sampleRightBefore, remainder, sampleOffsetBetweenNeighbours,
+                                         destination, numSamples);
+
+        float largestDifference = 0.0f;
+        int lastSample = startSample;
+        double lastRemainder = startRemainder;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const double position = startSample + startRemainder + i * sampleOffsetBetweenNeighbours;
+            lastSample = (int) std::floor (position);
+            lastRemainder = position - lastSample;
+            largestDifference = jmax (largestDifference,
+                                      fabsf (destination[i] - interpolator.interpolateScalar (signal + lastSample, lastRemainder)));
+        }
+        const String ratio (" (" + String (sampleOffsetBetweenNeighbours, 2) + ")");
+        expect (largestDifference < 1.0e-5f, "largest difference " + String (largestDifference) + ratio);
+        expect (sampleRightBefore == signal + lastSample, "sampleRightBefore" + ratio);
+        expect (std::abs (remainder - lastRemainder) < 1.0e-9, "remainder" + ratio);
+    }
+
+    void testResponse (const FractionalDelayInterpolator& interpolator)
+    {
+        // DC: Every phase has a gain of 1.
+        HeapBlock<float> signal (signalLength);
+        for (int i = 0; i < signalLength; ++i)
+            signal[i] = 1.0f;
+        float largestDcError = 0.0f;
+        for (int phase = 0; phase <= 1000; ++phase)
+        {
+            largestDcError = jmax (largestDcError,
+                                   fabsf (interpolator.interpolateScalar (signal + signalLength / 2, phase / 1000.0) - 1.0f));
+        }
+        expect (largestDcError < 1.0e-5f, "DC error " + String (largestDcError));
+
+        // At the samples, the Lagrange polynomials are exact.
+        if (interpolator.getQuality() == FractionalDelayInterpolator::qualityLinear
+            || interpolator.getQuality() == FractionalDelayInterpolator::qualityCubic)
+        {
+            fillWithNoise (signal, signalLength, 7);
+            expect (interpolator.interpolateScalar (signal + 100, 0.0) == signal[100], "phase 0");
+        }
+
+        // A sine of 1 kHz and one of 10 kHz, between the samples. The bounds
+        // of the peak error are about 1.5 times the measured ones: The
+        // Lagrange ones are only good for low frequencies.
+        const double bound1kHz[] = { 4.0e-3, 1.0e-3, 6.0e-3, 1.5e-3, 5.0e-4 };
+        const double bound10kHz[] = { 0.4, 0.12, 1.2e-2, 3.0e-3, 1.3e-3 };
+        const int quality = (int) interpolator.getQuality();
+        const double error1kHz = getLargestSineError (interpolator, 1000.0);
+        const double error10kHz = getLargestSineError (interpolator, 10000.0);
+        expect (error1kHz < bound1kHz[quality], "1 kHz: error " + String (error1kHz));
+        expect (error10kHz < bound10kHz[quality], "10 kHz: error " + String (error10kHz));
+        // The sinc ones are better than the Lagrange ones at 10 kHz.
+        if (quality >= (int) FractionalDelayInterpolator::qualitySinc8)
+            expect (error10kHz < bound10kHz[FractionalDelayInterpolator::qualityCubic] / 10.0, "10 kHz: sinc vs. cubic");
+    }
+
+    /** The largest difference to the exact sine, relative to its amplitude. */
+    static double getLargestSineError (const FractionalDelayInterpolator& interpolator, double frequency)
+    {
+        HeapBlock<float> signal (signalLength);
+        const double angularFrequency = 2.0 * double_Pi * frequency / 44100.0;
+        for (int i = 0; i < signalLength; ++i)
+            signal[i] = (float) sin (angularFrequency * i);
+
+        double largestError = 0.0;
+        Random random (3);
+        const int margin = FractionalDelayInterpolator::maximumHalfTheNumberOfTaps;
+        for (int n = margin; n < signalLength - margin; ++n)
+        {
+            const double remainder = random.nextDouble();
+            const double error = interpolator.interpolateScalar (signal + n, remainder)
+                                 - sin (angularFrequency * (n + remainder));
+            largestError = jmax (largestError, std::abs (error));
+        }
+        return largestError;
+    }
+};
+
+static FractionalDelayInterpolatorTest fractionalDelayInterpolatorTest;
+
+#if AUDIO_ENGINE_BENCHMARKS
+//==============================================================================
+/**
+ The cost of each Quality, in nanoseconds per output sample, while the
+ delay changes (the ratio 1.02) and while it doesn't (see the table in the
+ header).
+ */
+class FractionalDelayInterpolatorBenchmark  : public UnitTest
+{
+public:
+    FractionalDelayInterpolatorBenchmark ()  : UnitTest ("FractionalDelayInterpolator benchmark") {}
+
+    void runTest ()
+    {
+        beginTest ("cost per quality");
+
+        enum { numSamples = 512, numberOfBlocks = 2000 };
+        const int signalLength = 2 * numSamples;
+        HeapBlock<float> signal (signalLength);
+        Random random (120913);
+        for (int i = 0; i < signalLength; ++i)
+            signal[i] = 2.0f * random.nextFloat() - 1.0f;
+        HeapBlock<float> destination (numSamples);
+
+        for (int i = 0; i < FractionalDelayInterpolator::numberOfQualities; ++i)
+        {
+            const FractionalDelayInterpolator interpolator ((FractionalDelayInterpolator::Quality) i, 44100.0);
+            const double ratios[] = { 1.02, 1.0 };
+            String costs;
+            float sum = 0.0f;
+            for (int r = 0; r < 2; ++r)
+            {
+                const int64 start = Time::getHighResolutionTicks();
+                for (int block = 0; block < numberOfBlocks; ++block)
+                {
+                    const float* sampleRightBefore = signal + FractionalDelayInterpolator::maximumHalfTheNumberOfTaps;
+                    double remainder = 0.25;
+                    interpolator.interpolateSegment (sampleRightBefore, remainder, ratios[r],
+                                                     destination, numSamples);
+                    sum += destination[block % numSamples];
+                }
+                const int64 end = Time::getHighResolutionTicks();
+                costs += (r == 0 ? "" : " / ")
+                         + String (1.0e9 * Time::highResolutionTicksToSeconds (end - start) / (numberOfBlocks * numSamples), 1);
+            }
+            // The sum keeps the compiler from dropping the work.
+            expect (sum == sum);
+            logMessage (String (interpolator.getNumberOfTaps()) + " taps: " + costs + " ns per sample");
+        }
+    }
+};
+
+static FractionalDelayInterpolatorBenchmark fractionalDelayInterpolatorBenchmark;
+#endif
+
+#endif
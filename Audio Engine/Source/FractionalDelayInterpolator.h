@@ -0,0 +1,202 @@
+/*
+ *  FractionalDelayInterpolator.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120913.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __FRACTIONALDELAYINTERPOLATOR_HEADER__
+#define __FRACTIONALDELAYINTERPOLATOR_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+ Reads a signal in between its samples, in the polyphase form of an FIR
+ filter. Used by the AudioSourceDopplerEffect.
+
+ The value at the position n + remainder (n is an integer, the remainder
+ in [0, 1]) is
+ \f[ y(n + remainder) = \sum_{k = -N/2 + 1}^{N/2} x[n + k] h(remainder - k) \f]
+ with N taps. Depending on the Quality, h is the Lagrange polynomial
+ through the N samples (linear and cubic) or the impulse response of the
+ ideal low pass filter with the normalized cutoff frequency \f$f_{cn}\f$,
+ \f[ h(t) = 2 f_{cn} \sinc(2 f_{cn} t), \f]
+ multiplied by the raised-cosine window
+ \f[ w(t) = 0.5 \left( 1 + \cos\left( \frac{2 \pi t}{N + 2} \right) \right). \f]
+
+ The remainder is rounded to one of numberOfPhases steps. For each of them
+ (the phases), the N coefficients are calculated once, normalized to a gain
+ of 1 at DC and stored contiguously as floats. Interpolating a sample is a
+ single dot product of N floats, which is done with SSE or NEON
+ instructions (4 taps at a time), if available. The ...Scalar version is
+ the plain C++ reference implementation.
+
+ An interpolator doesn't change once it has been created and can therefore
+ be shared by any number of sources and threads, see
+ FractionalDelayInterpolatorCache.
+ */
+class JUCE_API  FractionalDelayInterpolator  : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<FractionalDelayInterpolator> Ptr;
+
+    /**
+     The interpolation quality levels. Measured at 44.1 kHz on one core of
+     a Xeon (x86-64, SSE):
+     - cost: nanoseconds per output sample, while the delay changes (the
+       ratio 1.02, like a source passing by at 25 km/h) / while it doesn't.
+     - aliasing: the level of everything but the expected tone (aliasing,
+       imaging, interpolation noise), relative to the tone, for a full
+       scale sine of 1 kHz and one of 10 kHz, resampled with ratios
+       drifting around 1.02.
+
+     <pre>
+                      taps  phases   cost (ns)    aliasing (dB)
+                                                  1 kHz   10 kHz
+     qualityLinear      2     128    5.8 / 1.5     -62     -20
+     qualityCubic       4     128    6.3 / 1.9     -70     -31
+     qualitySinc8       8     256    7.6 / 2.5     -53     -53
+     qualitySinc16     16     512    9.5 / 3.7     -65     -60
+     qualitySinc32     32    1024   13.8 / 6.3     -80     -67
+     </pre>
+
+     The Lagrange ones (linear and cubic) are accurate for low frequencies
+     only and suit distant, quiet or dull sources. The sinc ones keep the
+     aliasing low up to 20 kHz. Most of the cost of the cheap levels is the
+     bookkeeping of the position, not the taps.
+     */
+    enum Quality
+    {
+        qualityLinear = 0,
+        qualityCubic,
+        qualitySinc8,
+        qualitySinc16,
+        qualitySinc32,
+        numberOfQualities,
+        /** The one used unless it is set otherwise. */
+        qualityDefault = qualitySinc8
+    };
+
+    /**
+     Calculates the coefficients. Use the FractionalDelayInterpolatorCache
+     instead, to share them.
+     
+     @param sampleRate  Only used by the sinc ones: The cutoff frequency is
+                        20 kHz (at most 0.45 times the sampleRate).
+     */
+    FractionalDelayInterpolator (Quality quality, double sampleRate);
+
+    /** Destructor. */
+    ~FractionalDelayInterpolator ();
+
+    /** Returns the quality it has been created for. */
+    Quality getQuality () const                 { return quality; }
+
+    /** Returns the sample rate it has been created for. */
+    double getSampleRate () const               { return sampleRate; }
+
+    /** Returns the number of taps. */
+    int getNumberOfTaps () const                { return numberOfTaps; }
+
+    /** Returns the number of samples (half the taps) that have to be
+     readable after the sampleRightBefore. The ones before it are one less. */
+    int getHalfTheNumberOfTaps () const         { return numberOfTaps / 2; }
+
+    /** The largest getHalfTheNumberOfTaps of all qualities. */
+    static const int maximumHalfTheNumberOfTaps = 16;
+
+    /**
+     Returns the value of the signal at the position of the
+     sampleRightBefore plus the remainder.
+
+     @param sampleRightBefore   The sample that comes right before the
+                                position.
+     @param remainder           In [0, 1].
+     */
+    float interpolate (const float* sampleRightBefore, double remainder) const;
+
+    /**
+     The scalar reference implementation of interpolate.
+     */
+    float interpolateScalar (const float* sampleRightBefore, double remainder) const;
+
+    /**
+     Interpolates numSamples samples along a straight line through the
+     signal: The first one at the sampleRightBefore plus the remainder,
+     every further one sampleOffsetBetweenNeighbours samples further.
+
+     If the sampleOffsetBetweenNeighbours is exactly 1 (the delay doesn't
+     change), the remainder doesn't change either and the coefficients are
+     only looked up once.
+
+     @param sampleRightBefore   Moved to the sample right before the
+                                position of the last interpolated sample.
+     @param remainder           In [0, 1[. Set to the remainder of the last
+                                interpolated sample.
+     */
+    void interpolateSegment (const float*& sampleRightBefore,
+                             double& remainder,
+                             double sampleOffsetBetweenNeighbours,
+                             float* destination,
+                             int numSamples) const;
+
+private:
+    /** Fills the coefficients with the windowed sinc. */
+    void calculateWindowedSinc (double normalizedCutoffFrequency);
+
+    /** Fills the coefficients with the Lagrange polynomials. */
+    void calculateLagrange ();
+
+    /** Returns the coefficients of the phase closest to the remainder. */
+    const float* getCoefficients (double remainder) const
+    {
+        return coefficients + numberOfTaps * (int) (remainder * numberOfPhases + 0.5);
+    }
+
+    const Quality quality;
+    const double sampleRate;
+    int numberOfTaps;
+    int numberOfPhases;
+    /** numberOfPhases + 1 phases (the last one is for a remainder of 1),
+     numberOfTaps coefficients each. */
+    HeapBlock<float> coefficients;
+
+	JUCE_LEAK_DETECTOR (FractionalDelayInterpolator);
+};
+
+//==============================================================================
+/**
+ Holds one FractionalDelayInterpolator per Quality and sample rate, such
+ that all sources using the same one share the coefficients (and the
+ cache lines they occupy).
+ */
+class JUCE_API  FractionalDelayInterpolatorCache  : public DeletedAtShutdown
+{
+public:
+    /** Constructor. Use getInstance() instead. */
+    FractionalDelayInterpolatorCache ();
+
+    /** Destructor. */
+    ~FractionalDelayInterpolatorCache ();
+
+    juce_DeclareSingleton (FractionalDelayInterpolatorCache, false)
+
+    /**
+     Returns the interpolator for the quality and the sampleRate, creates
+     it, if it doesn't exist yet. Don't call it on the audio thread.
+     */
+    FractionalDelayInterpolator::Ptr getInterpolator (FractionalDelayInterpolator::Quality quality,
+                                                      double sampleRate);
+
+private:
+    ReferenceCountedArray<FractionalDelayInterpolator> interpolators;
+    CriticalSection interpolatorsLock;
+
+	JUCE_LEAK_DETECTOR (FractionalDelayInterpolatorCache);
+};
+
+
+#endif   // __FRACTIONALDELAYINTERPOLATOR_HEADER__
@@ -0,0 +1,262 @@
+/*
+ *  GainRampKernels.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120812.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "GainRampKernels.h"
+
+#if defined (__AVX__)
+ #include <immintrin.h>
+ #define GAINRAMPKERNELS_USE_AVX 1
+#elif defined (__SSE__) || defined (__amd64__) || defined (__x86_64__)
+ #include <xmmintrin.h>
+ #define GAINRAMPKERNELS_USE_SSE 1
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON)
+ #include <arm_neon.h>
+ #define GAINRAMPKERNELS_USE_NEON 1
+#endif
+
+
+namespace
+{
+    /* The common implementation of all kernels.
+     
+     If addToDestination is false:  destination[i]  = source[i] * gain_i
+     If addToDestination is true:   destination[i] += source[i] * gain_i
+     
+     source and destination may point to the same samples.
+     Since addToDestination is a template argument, the branches inside of
+     the loops are resolved by the compiler.
+     */
+    template <bool addToDestination>
+    inline void applyRamp (float* destination,
+                           const float* source,
+                           int numSamples,
+                           float startGain,
+                           float gainDelta)
+    {
+        int i = 0;
+
+    #if GAINRAMPKERNELS_USE_AVX
+        const __m256 start = _mm256_set1_ps (startGain);
+        const __m256 delta = _mm256_set1_ps (gainDelta);
+        const __m256 eight = _mm256_set1_ps (8.0f);
+        __m256 index = _mm256_setr_ps (0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            const __m256 gain = _mm256_add_ps (start, _mm256_mul_ps (index, delta));
+            __m256 result = _mm256_mul_ps (_mm256_loadu_ps (source + i), gain);
+            if (addToDestination)
+                result = _mm256_add_ps (_mm256_loadu_ps (destination + i), result);
+            _mm256_storeu_ps (destination + i, result);
+            index = _mm256_add_ps (index, eight);
+        }
+
+    #elif GAINRAMPKERNELS_USE_SSE
+        const __m128 start = _mm_set1_ps (startGain);
+        const __m128 delta = _mm_set1_ps (gainDelta);
+        const __m128 four = _mm_set1_ps (4.0f);
+        __m128 index = _mm_setr_ps (0.0f, 1.0f, 2.0f, 3.0f);
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            const __m128 gain = _mm_add_ps (start, _mm_mul_ps (index, delta));
+            __m128 result = _mm_mul_ps (_mm_loadu_ps (source + i), gain);
+            if (addToDestination)
+                result = _mm_add_ps (_mm_loadu_ps (destination + i), result);
+            _mm_storeu_ps (destination + i, result);
+            index = _mm_add_ps (index, four);
+        }
+
+    #elif GAINRAMPKERNELS_USE_NEON
+        const float32x4_t start = vdupq_n_f32 (startGain);
+        const float32x4_t delta = vdupq_n_f32 (gainDelta);
+        const float32x4_t four = vdupq_n_f32 (4.0f);
+        const float initialIndex[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+        float32x4_t index = vld1q_f32 (initialIndex);
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            const float32x4_t gain = vaddq_f32 (start, vmulq_f32 (index, delta));
+            float32x4_t result = vmulq_f32 (vld1q_f32 (source + i), gain);
+            if (addToDestination)
+                result = vaddq_f32 (vld1q_f32 (destination + i), result);
+            vst1q_f32 (destination + i, result);
+            index = vaddq_f32 (index, four);
+        }
+    #endif
+
+        // The remaining samples (or all of them, if no vector unit is available).
+        for (; i < numSamples; ++i)
+        {
+            const float result = source[i] * (startGain + float(i) * gainDelta);
+            if (addToDestination)
+                destination[i] += result;
+            else
+                destination[i] = result;
+        }
+    }
+    
+    template <bool addToDestination>
+    inline void applyRampScalar (float* destination,
+                                 const float* source,
+                                 int numSamples,
+                                 float startGain,
+                                 float gainDelta)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float result = source[i] * (startGain + float(i) * gainDelta);
+            if (addToDestination)
+                destination[i] += result;
+            else
+                destination[i] = result;
+        }
+    }
+}
+
+
+void GainRampKernels::multiplyWithRamp (float* samples,
+                                        int numSamples,
+                                        float startGain,
+                                        float gainDelta)
+{
+    applyRamp<false> (samples, samples, numSamples, startGain, gainDelta);
+}
+
+void GainRampKernels::copyWithRamp (float* destination,
+                                    const float* source,
+                                    int numSamples,
+                                    float startGain,
+                                    float gainDelta)
+{
+    applyRamp<false> (destination, source, numSamples, startGain, gainDelta);
+}
+
+void GainRampKernels::addWithRamp (float* destination,
+                                   const float* source,
+                                   int numSamples,
+                                   float startGain,
+                                   float gainDelta)
+{
+    applyRamp<true> (destination, source, numSamples, startGain, gainDelta);
+}
+
+void GainRampKernels::multiplyWithRampScalar (float* samples,
+                                              int numSamples,
+                                              float startGain,
+                                              float gainDelta)
+{
+    applyRampScalar<false> (samples, samples, numSamples, startGain, gainDelta);
+}
+
+void GainRampKernels::copyWithRampScalar (float* destination,
+                                          const float* source,
+                                          int numSamples,
+                                          float startGain,
+                                          float gainDelta)
+{
+    applyRampScalar<false> (destination, source, numSamples, startGain, gainDelta);
+}
+
+void GainRampKernels::addWithRampScalar (float* destination,
+                                         const float* source,
+                                         int numSamples,
+                                         float startGain,
+                                         float gainDelta)
+{
+    applyRampScalar<true> (destination, source, numSamples, startGain, gainDelta);
+}
+
+
+#if AUDIO_ENGINE_UNIT_TESTS
+//==============================================================================
+/**
+ Compares the vectorised kernels with the scalar reference implementations,
+ for all lengths from 0 to 67 samples (to cover the remainders of the
+ vector loops) and for source and destination at unaligned positions.
+ */
+class GainRampKernelsTest  : public UnitTest
+{
+public:
+    GainRampKernelsTest ()  : UnitTest ("GainRampKernels") {}
+
+    void runTest ()
+    {
+        const int maxNumSamples = 67;
+        const int offset = 1;   // Unaligned.
+        HeapBlock<float> source (maxNumSamples + offset);
+        HeapBlock<float> destination (maxNumSamples + offset);
+        HeapBlock<float> reference (maxNumSamples + offset);
+
+        Random random (120812);
+        for (int i = 0; i < maxNumSamples + offset; ++i)
+            source[i] = 2.0f * random.nextFloat() - 1.0f;
+
+        beginTest ("multiplyWithRamp");
+        for (int numSamples = 0; numSamples <= maxNumSamples; ++numSamples)
+        {
+            memcpy (destination + offset, source + offset, numSamples * sizeof (float));
+            memcpy (reference + offset, source + offset, numSamples * sizeof (float));
+            GainRampKernels::multiplyWithRamp (destination + offset, numSamples, 0.25f, 0.01f);
+            GainRampKernels::multiplyWithRampScalar (reference + offset, numSamples, 0.25f, 0.01f);
+            expect (isEqual (destination + offset, reference + offset, numSamples),
+                    "numSamples = " + String (numSamples));
+        }
+
+        beginTest ("copyWithRamp");
+        for (int numSamples = 0; numSamples <= maxNumSamples; ++numSamples)
+        {
+            GainRampKernels::copyWithRamp (destination + offset, source + offset, numSamples, 1.0f, -0.015f);
+            GainRampKernels::copyWithRampScalar (reference + offset, source + offset, numSamples, 1.0f, -0.015f);
+            expect (isEqual (destination + offset, reference + offset, numSamples),
+                    "numSamples = " + String (numSamples));
+        }
+
+        beginTest ("addWithRamp");
+        for (int numSamples = 0; numSamples <= maxNumSamples; ++numSamples)
+        {
+            for (int i = 0; i < numSamples; ++i)
+                destination[offset + i] = reference[offset + i] = 0.5f - 0.01f * i;
+            GainRampKernels::addWithRamp (destination + offset, source + offset, numSamples, 0.7f, 0.003f);
+            GainRampKernels::addWithRampScalar (reference + offset, source + offset, numSamples, 0.7f, 0.003f);
+            expect (isEqual (destination + offset, reference + offset, numSamples),
+                    "numSamples = " + String (numSamples));
+        }
+
+        beginTest ("gain evaluated from the sample index");
+        {
+            // Without accumulation, the last sample of a long ramp gets
+            // exactly the gain of the formula.
+            const int numSamples = 4096;
+            HeapBlock<float> ones (numSamples);
+            for (int i = 0; i < numSamples; ++i)
+                ones[i] = 1.0f;
+            GainRampKernels::multiplyWithRamp (ones, numSamples, 0.0f, 1.0f / numSamples);
+            expect (ones[numSamples - 1] == float(numSamples - 1) * (1.0f / numSamples));
+        }
+    }
+
+private:
+    /** The vectorised kernels evaluate the same formula as the scalar ones,
+     but the compiler might contract the scalar one to a fused multiply-add.
+     Hence the tiny tolerance. */
+    static bool isEqual (const float* a, const float* b, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            if (fabsf (a[i] - b[i]) > 1.0e-6f)
+                return false;
+        }
+        return true;
+    }
+};
+
+static GainRampKernelsTest gainRampKernelsTest;
+
+#endif
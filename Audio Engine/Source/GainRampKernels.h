@@ -0,0 +1,116 @@
+/*
+ *  GainRampKernels.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120812.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __GAINRAMPKERNELS_HEADER__
+#define __GAINRAMPKERNELS_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+ A collection of the inner loops that apply a linear gain ramp to a
+ contiguous block of samples.
+
+ The gain applied to the i-th sample is
+ \f[ \textrm{gain}_i = \textrm{startGain} + i \cdot \textrm{gainDelta}. \f]
+ It is evaluated from the sample index (and not accumulated from sample to
+ sample), such that the vectorised and the scalar implementations deliver
+ the same values and such that no rounding errors pile up over long segments.
+
+ Depending on the target, the work is done with AVX, SSE or NEON
+ instructions. The ...Scalar versions are the plain C++ reference
+ implementations. They are used for the remaining samples at the end of a
+ block and on targets without vector instructions.
+
+ Used by AudioSourceAmbipanning::getNextAudioBlock and
+ AudioSourceAmbipanning::addNextAudioBlockTo, with the gains of a
+ speaker stored contiguously (channel-outer, sample-inner).
+ */
+class JUCE_API  GainRampKernels
+{
+public:
+    /**
+     Multiplies the samples in place with a linear gain ramp.
+
+     @param samples         Points to the first sample to process.
+     @param numSamples      The number of samples to process.
+     @param startGain       The gain applied to samples[0].
+     @param gainDelta       The gain increment from one sample to the next.
+     */
+    static void multiplyWithRamp (float* samples,
+                                  int numSamples,
+                                  float startGain,
+                                  float gainDelta);
+
+    /**
+     Writes the source samples, multiplied with a linear gain ramp, to the
+     destination.
+     
+     source and destination may point to the same samples.
+     
+     @param destination     Points to the first sample to write to.
+     @param source          Points to the first sample to read from.
+     @param numSamples      The number of samples to process.
+     @param startGain       The gain applied to source[0].
+     @param gainDelta       The gain increment from one sample to the next.
+     */
+    static void copyWithRamp (float* destination,
+                              const float* source,
+                              int numSamples,
+                              float startGain,
+                              float gainDelta);
+    
+    /**
+     Adds the source samples, multiplied with a linear gain ramp, to the
+     destination.
+     
+     @param destination     Points to the first sample to add to.
+     @param source          Points to the first sample to read from.
+     @param numSamples      The number of samples to process.
+     @param startGain       The gain applied to source[0].
+     @param gainDelta       The gain increment from one sample to the next.
+     */
+    static void addWithRamp (float* destination,
+                             const float* source,
+                             int numSamples,
+                             float startGain,
+                             float gainDelta);
+
+    /**
+     The scalar reference implementation of GainRampKernels::multiplyWithRamp.
+     */
+    static void multiplyWithRampScalar (float* samples,
+                                        int numSamples,
+                                        float startGain,
+                                        float gainDelta);
+    
+    /**
+     The scalar reference implementation of GainRampKernels::copyWithRamp.
+     */
+    static void copyWithRampScalar (float* destination,
+                                    const float* source,
+                                    int numSamples,
+                                    float startGain,
+                                    float gainDelta);
+    
+    /**
+     The scalar reference implementation of GainRampKernels::addWithRamp.
+     */
+    static void addWithRampScalar (float* destination,
+                                   const float* source,
+                                   int numSamples,
+                                   float startGain,
+                                   float gainDelta);
+
+private:
+    GainRampKernels();
+};
+
+
+#endif   // __GAINRAMPKERNELS_HEADER__
@@ -0,0 +1,132 @@
+/*
+ *  HOADecoder.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120820.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "HOADecoder.h"
+
+
+HOADecoder::HOADecoder ()
+:   order (1),
+    maxREEnabled (true),
+    numberOfSpeakers (0),
+    numberOfBusChannels (SphericalHarmonics::getNumberOfChannels (1))
+{
+    calculateMatrix();
+}
+
+HOADecoder::~HOADecoder ()
+{
+}
+
+void HOADecoder::setSpeakerPositions (const Array<SpeakerPosition>& positionOfSpeaker_)
+{
+    positionOfSpeaker = positionOfSpeaker_;
+    calculateMatrix();
+}
+
+void HOADecoder::setOrder (int order_)
+{
+    order = jlimit (0, (int) SphericalHarmonics::maximumOrder, order_);
+    calculateMatrix();
+}
+
+int HOADecoder::getOrder () const
+{
+    return order;
+}
+
+int HOADecoder::getNumberOfBusChannels () const
+{
+    return numberOfBusChannels;
+}
+
+void HOADecoder::enableMaxRE (bool enable)
+{
+    maxREEnabled = enable;
+    calculateMatrix();
+}
+
+void HOADecoder::decode (const AudioSampleBuffer& bus,
+                         int busStartSample,
+                         const AudioSourceChannelInfo& info) const
+{
+    const int numberOfChannels = jmin (info.buffer->getNumChannels(), numberOfSpeakers);
+    const int numberOfUsedBusChannels = jmin (bus.getNumChannels(), numberOfBusChannels);
+
+    for (int speaker = 0; speaker < numberOfChannels; ++speaker)
+    {
+        float* destination = info.buffer->getSampleData (speaker, info.startSample);
+        const float* const row = decoderMatrix + speaker * numberOfBusChannels;
+
+        for (int busChannel = 0; busChannel < numberOfUsedBusChannels; ++busChannel)
+        {
+            if (row[busChannel] != 0.0f)
+            {
+                GainRampKernels::addWithRamp (destination,
+                                              bus.getSampleData (busChannel, busStartSample),
+                                              info.numSamples,
+                                              row[busChannel],
+                                              0.0f);
+            }
+        }
+    }
+}
+
+void HOADecoder::calculateMatrix ()
+{
+    numberOfSpeakers = positionOfSpeaker.size();
+    numberOfBusChannels = SphericalHarmonics::getNumberOfChannels (order);
+    decoderMatrix.allocate (jmax (1, numberOfSpeakers * numberOfBusChannels), true);
+
+    // The weight of each degree, including the factor (2k+1) of the
+    // addition theorem and the normalisation.
+    double weight[SphericalHarmonics::maximumOrder + 1];
+    double sumOfWeights = 0.0;
+    const double cosineForMaxRE = cos (double_Pi * 137.9 / 180.0 / (order + 1.51));
+    for (int k = 0; k <= order; ++k)
+    {
+        const double maxREWeight = maxREEnabled ? SphericalHarmonics::legendrePolynomial (k, cosineForMaxRE) : 1.0;
+        weight[k] = maxREWeight * (2*k + 1);
+        sumOfWeights += weight[k];
+    }
+    for (int k = 0; k <= order; ++k)
+    {
+        weight[k] /= sumOfWeights;
+    }
+
+    float coefficients[(SphericalHarmonics::maximumOrder + 1) * (SphericalHarmonics::maximumOrder + 1)];
+    for (int speaker = 0; speaker < numberOfSpeakers; ++speaker)
+    {
+        SpeakerPosition& posOfSpeaker = positionOfSpeaker.getReference (speaker);
+        double x = posOfSpeaker.getX();
+        double y = posOfSpeaker.getY();
+        double z = posOfSpeaker.getZ();
+        const double r = sqrt (x*x + y*y + z*z);
+        if (r > 0.0)
+        {
+            x /= r;
+            y /= r;
+            z /= r;
+        }
+
+        SphericalHarmonics::calculate (order, x, y, z, coefficients);
+
+        float* const row = decoderMatrix + speaker * numberOfBusChannels;
+        for (int k = 0; k <= order; ++k)
+        {
+            for (int m = -k; m <= k; ++m)
+            {
+                const int acn = k*k + k + m;
+                row[acn] = (float) (weight[k] * coefficients[acn]);
+            }
+        }
+    }
+
+    DEB("HOADecoder: Matrix for " + String(numberOfSpeakers) + " speakers and order "
+        + String(order) + " calculated.")
+}
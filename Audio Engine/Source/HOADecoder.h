@@ -0,0 +1,95 @@
+/*
+ *  HOADecoder.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120820.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __HOADECODER_HEADER__
+#define __HOADECODER_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AudioSourceAmbipanning.h"
+#include "SphericalHarmonics.h"
+
+//==============================================================================
+/**
+ Renders a Higher Order Ambisonics (HOA) bus to the speakers.
+
+ The decoder is a sampling decoder: The signal of a speaker is the bus,
+ weighted with the spherical harmonics in the direction of that speaker.
+ With the addition theorem (see SphericalHarmonics), the resulting panning
+ function of a source is
+ \f[ \textrm{gain}_{n} = \frac{1}{c} \sum_{k=0}^{N} w_k (2k+1) P_k(\cos \gamma_n), \f]
+ where \f$\gamma_n\f$ is the angle between the source and the n-th speaker.
+ c is chosen such that a speaker in the direction of the source receives
+ the gain 1, like with the AEP panning of AudioSourceAmbipanning.
+ The weights \f$w_k\f$ are 1 (basic decoding) or, if max-rE is enabled,
+ \f$ w_k = P_k(\cos(137.9^\circ / (N + 1.51))) \f$, which reduces the side
+ lobes.
+
+ The sampling decoder doesn't need a matrix inversion and is therefore
+ robust against irregular speaker layouts. It is the right choice for
+ layouts that cover the sphere (or the half sphere) more or less evenly.
+
+ The decoder matrix is recalculated whenever the speakers, the order or
+ the max-rE setting change. Used by the AudioRegionMixer.
+ */
+class JUCE_API  HOADecoder
+{
+public:
+    /** Constructor. */
+    HOADecoder ();
+
+    /** Destructor. */
+    ~HOADecoder ();
+
+    /** Sets the positions of the speakers and recalculates the matrix. */
+    void setSpeakerPositions (const Array<SpeakerPosition>& positionOfSpeaker);
+
+    /** Sets the order of the bus and recalculates the matrix. */
+    void setOrder (int order);
+
+    /** Returns the order of the bus. */
+    int getOrder () const;
+
+    /** Returns the number of channels of the bus, (order+1)^2. */
+    int getNumberOfBusChannels () const;
+
+    /** Enables or disables the max-rE weighting. It is enabled by default. */
+    void enableMaxRE (bool enable);
+
+    /**
+     Decodes numSamples samples of the bus to the speakers.
+
+     @param bus                 The HOA bus, at least getNumberOfBusChannels()
+                                channels.
+     @param busStartSample      The first sample of the bus to decode.
+     @param info                The destination. The signals of the speakers
+                                are added to info.buffer, one channel per
+                                speaker.
+     */
+    void decode (const AudioSampleBuffer& bus,
+                 int busStartSample,
+                 const AudioSourceChannelInfo& info) const;
+
+private:
+    /** Recalculates the decoderMatrix. */
+    void calculateMatrix ();
+
+    Array<SpeakerPosition> positionOfSpeaker;
+    int order;
+    bool maxREEnabled;
+
+    /** One row per speaker, one column per bus channel. */
+    HeapBlock<float> decoderMatrix;
+    int numberOfSpeakers;
+    int numberOfBusChannels;
+
+	JUCE_LEAK_DETECTOR (HOADecoder);
+};
+
+
+#endif   // __HOADECODER_HEADER__
@@ -0,0 +1,391 @@
+/*
+ *  ParallelRegionRenderer.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120827.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "ParallelRegionRenderer.h"
+
+#if JUCE_LINUX
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+
+//==============================================================================
+ParallelRegionRenderer::Worker::Worker (ParallelRegionRenderer& owner_, bool realtimePriority_)
+:   Thread ("ParallelRegionRenderer worker"),
+    owner (owner_),
+    realtimePriority (realtimePriority_)
+{
+}
+
+ParallelRegionRenderer::Worker::~Worker ()
+{
+    signalThreadShouldExit();
+    startEvent.signal();
+    stopThread (2000);
+}
+
+void ParallelRegionRenderer::Worker::run ()
+{
+   #if JUCE_LINUX
+    if (realtimePriority)
+    {
+        // Thread::setPriority doesn't switch to a realtime scheduling policy here.
+        sched_param parameters;
+        parameters.sched_priority = sched_get_priority_max (SCHED_FIFO) - 1;
+        if (pthread_setschedparam (pthread_self(), SCHED_FIFO, &parameters) != 0)
+        {
+            DEB("ParallelRegionRenderer: SCHED_FIFO couldn't be set (missing privileges?).")
+        }
+    }
+   #endif
+
+    while (! threadShouldExit())
+    {
+        startEvent.wait (-1);
+        if (threadShouldExit())
+        {
+            break;
+        }
+
+        owner.processItems();
+
+        if (--owner.numberOfBusyWorkers == 0)
+        {
+            owner.phaseFinished.signal();
+        }
+    }
+}
+
+//==============================================================================
+ParallelRegionRenderer::ParallelRegionRenderer ()
+:   currentRegions (nullptr),
+    currentDestination (nullptr),
+    numberOfChannelGroups (0),
+    currentPhase (prepareRegions),
+    numberOfItemsInPhase (0)
+{
+}
+
+ParallelRegionRenderer::~ParallelRegionRenderer ()
+{
+    workers.clear(); // Stops the threads.
+}
+
+void ParallelRegionRenderer::setNumberOfThreads (int numberOfThreads,
+                                                 bool pinThreadsToCores,
+                                                 bool realtimePriority)
+{
+    numberOfThreads = jlimit (1, 32, numberOfThreads);
+
+    // The worker threads are always started anew, such that the affinity
+    // and the priority are applied.
+    workers.clear();
+
+    const int numberOfCpus = jmax (1, SystemStats::getNumCpus());
+    for (int i = 0; i < numberOfThreads - 1; ++i)
+    {
+        Worker* worker = new Worker (*this, realtimePriority);
+        if (pinThreadsToCores)
+        {
+            worker->setAffinityMask ((uint32) 1 << ((i + 1) % jmin (32, numberOfCpus)));
+        }
+        worker->startThread (realtimePriority ? 10 : 5);
+        workers.add (worker);
+    }
+
+    DEB("ParallelRegionRenderer: " + String(numberOfThreads) + " threads.")
+}
+
+int ParallelRegionRenderer::getNumberOfThreads () const
+{
+    return workers.size() + 1;
+}
+
+void ParallelRegionRenderer::renderRegions (const Array<RegionToRender>& regions,
+                                            AudioSampleBuffer& destination)
+{
+    currentRegions = &regions;
+    currentDestination = &destination;
+
+    runPhase (prepareRegions, regions.size());
+
+    // A few more channel groups than threads, to balance the load.
+    const int numberOfChannels = destination.getNumChannels();
+    numberOfChannelGroups = jmin (numberOfChannels, 2 * getNumberOfThreads());
+    runPhase (addRegionsToChannels, numberOfChannelGroups);
+
+    currentRegions = nullptr;
+    currentDestination = nullptr;
+}
+
+//==============================================================================
+void ParallelRegionRenderer::runPhase (Phase phase, int numberOfItems)
+{
+    currentPhase = phase;
+    numberOfItemsInPhase = numberOfItems;
+    nextItem.set (0);
+
+    if (workers.size() == 0 || numberOfItems <= 1)
+    {
+        processItems();
+        return;
+    }
+
+    // Exactly one worker (the last one) signals phaseFinished.
+    numberOfBusyWorkers.set (workers.size());
+    for (int i = 0; i < workers.size(); ++i)
+    {
+        workers.getUnchecked (i)->startEvent.signal();
+    }
+
+    processItems();
+
+    phaseFinished.wait (-1);
+}
+
+void ParallelRegionRenderer::processItems ()
+{
+    while (true)
+    {
+        const int itemIndex = (++nextItem) - 1;
+        if (itemIndex >= numberOfItemsInPhase)
+        {
+            break;
+        }
+        processItem (itemIndex);
+    }
+}
+
+void ParallelRegionRenderer::processItem (int itemIndex)
+{
+    AudioSourceChannelInfo info;
+    info.buffer = currentDestination;
+
+    if (currentPhase == prepareRegions)
+    {
+        const RegionToRender& region = currentRegions->getReference (itemIndex);
+        info.startSample = region.startSample;
+        info.numSamples = region.numSamples;
+        region.audioSourceAmbipanning->prepareNextAudioBlock (info);
+    }
+    else
+    {
+        const int numberOfChannels = currentDestination->getNumChannels();
+        const int firstChannel = itemIndex * numberOfChannels / numberOfChannelGroups;
+        const int endChannel = (itemIndex + 1) * numberOfChannels / numberOfChannelGroups;
+
+        // The regions are added in the given order.
+        for (int i = 0; i < currentRegions->size(); ++i)
+        {
+            const RegionToRender& region = currentRegions->getReference (i);
+            info.startSample = region.startSample;
+            info.numSamples = region.numSamples;
+            region.audioSourceAmbipanning->addPreparedAudioBlockTo (info, firstChannel, endChannel);
+        }
+    }
+}
+
+#if AUDIO_ENGINE_UNIT_TESTS
+//==============================================================================
+/**
+ An AudioFormatReader without a file, that delivers white noise in one
+ channel: The sample at a position is always the same, wherever the
+ reading starts. Used by the ParallelRegionRendererTest.
+ */
+class NoiseAudioFormatReader  : public AudioFormatReader
+{
+public:
+    NoiseAudioFormatReader (double sampleRate_, int64 lengthInSamples_, int seed_)
+        : AudioFormatReader (nullptr, "Noise"),
+          seed (seed_)
+    {
+        sampleRate = sampleRate_;
+        bitsPerSample = 32;
+        lengthInSamples = lengthInSamples_;
+        numChannels = 1;
+        usesFloatingPointData = true;
+    }
+
+    bool readSamples (int** destSamples, int numDestChannels, int startOffsetInDestBuffer,
+                      int64 startSampleInFile, int numSamples)
+    {
+        for (int channel = 0; channel < numDestChannels; ++channel)
+        {
+            if (destSamples[channel] != nullptr)
+            {
+                float* destination = reinterpret_cast<float*> (destSamples[channel]) + startOffsetInDestBuffer;
+                for (int i = 0; i < numSamples; ++i)
+                    destination[i] = getSample (startSampleInFile + i);
+            }
+        }
+        return true;
+    }
+
+private:
+    /** A hash of the position, scaled to [-1, 1[. */
+    float getSample (int64 position) const
+    {
+        uint32 hash = (uint32) position * 2654435761u + (uint32) seed * 40503u;
+        hash ^= hash >> 15;
+        hash *= 2246822519u;
+        hash ^= hash >> 13;
+        return (float) (hash >> 8) / (float) (1 << 23) - 1.0f;
+    }
+
+    const int seed;
+};
+
+//==============================================================================
+/**
+ Renders the same regions with the ParallelRegionRenderer (on 4 threads)
+ and one after the other with AudioSourceAmbipanning::addNextAudioBlockTo.
+ The results have to be bit-identical.
+
+ The regions have constant, moving and dense envelopes (a point every
+ other sample, more segments per block than the gain segment storage
+ holds at first), start within the block and get a new envelope half-way
+ (a fade).
+ */
+class ParallelRegionRendererTest  : public UnitTest
+{
+public:
+    ParallelRegionRendererTest ()  : UnitTest ("ParallelRegionRenderer") {}
+
+    void runTest ()
+    {
+        Array<SpeakerPosition> speakers;
+        for (int i = 0; i < numberOfSpeakers; ++i)
+        {
+            const double angle = 2.0 * double_Pi * i / numberOfSpeakers;
+            speakers.add (SpeakerPosition (cos (angle), sin (angle), 0.0));
+        }
+        AudioSourceAmbipanning::setPositionOfSpeakers (speakers);
+
+        beginTest ("parallel rendering is bit-identical to the serial one");
+
+        OwnedArray<AudioSourceAmbipanning> serialRegions;
+        OwnedArray<AudioSourceAmbipanning> parallelRegions;
+        for (int i = 0; i < numberOfRegions; ++i)
+        {
+            serialRegions.add (createRegion (i));
+            parallelRegions.add (createRegion (i));
+        }
+
+        ParallelRegionRenderer renderer;
+        renderer.setNumberOfThreads (4, false, false);
+
+        AudioSampleBuffer serialOutput (numberOfSpeakers, blockSize);
+        AudioSampleBuffer parallelOutput (numberOfSpeakers, blockSize);
+        AudioSampleBuffer monoScratchBuffer (1, blockSize);
+        Array<ParallelRegionRenderer::RegionToRender> regionsToRender;
+
+        for (int block = 0; block < numberOfBlocks; ++block)
+        {
+            if (block == numberOfBlocks / 2)
+            {
+                for (int i = 0; i < numberOfRegions; i += 2)
+                {
+                    serialRegions[i]->setSpacialEnvelope (createEnvelope (i + 1));
+                    parallelRegions[i]->setSpacialEnvelope (createEnvelope (i + 1));
+                }
+            }
+
+            serialOutput.clear();
+            parallelOutput.clear();
+            regionsToRender.clearQuick();
+            for (int i = 0; i < numberOfRegions; ++i)
+            {
+                AudioSourceChannelInfo info;
+                info.buffer = &serialOutput;
+                info.startSample = getStartSample (i);
+                info.numSamples = blockSize - info.startSample;
+
+                serialRegions[i]->setNextReadPosition (block * blockSize);
+                serialRegions[i]->addNextAudioBlockTo (info, monoScratchBuffer);
+
+                parallelRegions[i]->setNextReadPosition (block * blockSize);
+                ParallelRegionRenderer::RegionToRender region;
+                region.audioSourceAmbipanning = parallelRegions[i];
+                region.startSample = info.startSample;
+                region.numSamples = info.numSamples;
+                regionsToRender.add (region);
+            }
+            renderer.renderRegions (regionsToRender, parallelOutput);
+
+            bool isIdentical = true;
+            for (int channel = 0; channel < numberOfSpeakers; ++channel)
+            {
+                isIdentical = isIdentical
+                    && memcmp (serialOutput.getSampleData (channel), parallelOutput.getSampleData (channel),
+                               sizeof (float) * blockSize) == 0;
+            }
+            expect (isIdentical, "block " + String (block));
+        }
+
+        AudioSourceAmbipanning::setPositionOfSpeakers (Array<SpeakerPosition>());
+    }
+
+private:
+    enum
+    {
+        numberOfSpeakers = 8,
+        numberOfRegions = 12,
+        blockSize = 64,
+        numberOfBlocks = 40
+    };
+
+    static int getStartSample (int regionIndex)
+    {
+        return 8 * (regionIndex % 3);
+    }
+
+    static AudioSourceAmbipanning* createRegion (int regionIndex)
+    {
+        AudioSourceAmbipanning* region
+            = new AudioSourceAmbipanning (new NoiseAudioFormatReader (44100.0, numberOfBlocks * blockSize, regionIndex),
+                                          44100.0, false);
+        region->prepareToPlay (blockSize, 44100.0);
+        region->setSpacialEnvelope (createEnvelope (regionIndex));
+        return region;
+    }
+
+    /** Constant, moving or dense, depending on the variant. Like the ones
+     of the AudioRegionMixer, the envelopes end after the last sample. */
+    static SpacialEnvelope* createEnvelope (int variant)
+    {
+        const int endPosition = numberOfBlocks * blockSize + 1;
+        const double angle = 0.7 * variant;
+        if (variant % 3 == 0)
+        {
+            return new SpacialEnvelope (2.0 * cos (angle), 2.0 * sin (angle), 0.3);
+        }
+
+        Array<SpacialEnvelopePoint> points;
+        if (variant % 3 == 1)
+        {
+            points.add (SpacialEnvelopePoint (0, cos (angle), sin (angle), 0.0));
+            points.add (SpacialEnvelopePoint (300, -cos (angle), -sin (angle), 0.5));
+            points.add (SpacialEnvelopePoint (700, 0.1, 0.2, 0.0));
+        }
+        else
+        {
+            for (int position = 0; position < endPosition; position += 2)
+            {
+                const double phase = angle + 0.01 * position;
+                points.add (SpacialEnvelopePoint (position, 1.5 * cos (phase), 1.5 * sin (phase), 0.0));
+            }
+        }
+        points.add (SpacialEnvelopePoint (endPosition, 1.0, 0.0, 0.0));
+        return new SpacialEnvelope (points);
+    }
+};
+
+static ParallelRegionRendererTest parallelRegionRendererTest;
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ *  ParallelRegionRenderer.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120827.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __PARALLELREGIONRENDERER_HEADER__
+#define __PARALLELREGIONRENDERER_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AudioSourceAmbipanning.h"
+
+//==============================================================================
+/**
+ Renders the regions of an audio block on several threads. Used by the
+ AudioRegionMixer.
+
+ The work is done in two phases:
+ <ol>
+ <li> The regions are distributed over the threads. Each region renders
+      its mono signal (gain envelope, doppler effect, low pass filter) and
+      records its gain ramps (see
+      AudioSourceAmbipanning::prepareNextAudioBlock). This is where almost
+      all the time is spent.
+ <li> The channels of the destination are distributed over the threads.
+      For its channels, each thread adds the signals of all regions, one
+      region after the other, in the order given (see
+      AudioSourceAmbipanning::addPreparedAudioBlockTo).
+ </ol>
+ Each sample of the destination therefore receives the same additions in
+ the same order as if the regions were added one after the other on a
+ single thread - the result is bit-identical to the serial rendering and
+ doesn't depend on which thread has processed what.
+
+ The items of a phase are not assigned to the threads in advance. Each
+ thread takes the next unprocessed item until there are none left, so a
+ thread that is done with a cheap region helps with the others.
+ The calling thread (the audio thread) takes part in the work.
+ */
+class JUCE_API  ParallelRegionRenderer
+{
+public:
+    //==============================================================================
+    /** A region to render, see renderRegions. */
+    struct RegionToRender
+    {
+        AudioSourceAmbipanning* audioSourceAmbipanning;
+        /** The first sample in the destination. */
+        int startSample;
+        int numSamples;
+    };
+
+    /** Constructor. No additional threads are started. */
+    ParallelRegionRenderer ();
+
+    /** Destructor. Stops the threads. */
+    ~ParallelRegionRenderer ();
+
+    //==============================================================================
+    /**
+     Sets the number of threads, including the calling thread. With 1 (the
+     default), the regions are rendered by the calling thread only.
+
+     Must not be called while renderRegions is running.
+
+     @param numberOfThreads     The number of threads, 1 to 32.
+     @param pinThreadsToCores   If true, the additional thread i only runs
+                                on the CPU core i+1 (modulo the number of
+                                cores). Core 0 is left to the audio thread.
+     @param realtimePriority    If true, the additional threads run with the
+                                highest priority (SCHED_FIFO on Linux).
+     */
+    void setNumberOfThreads (int numberOfThreads,
+                             bool pinThreadsToCores,
+                             bool realtimePriority);
+
+    /** Returns the number of threads, including the calling thread. */
+    int getNumberOfThreads () const;
+
+    //==============================================================================
+    /**
+     Adds the signals of the regions to the destination.
+
+     Bit-identical to
+     @code
+     for (int i = 0; i < regions.size(); ++i)
+         regions[i].audioSourceAmbipanning->addNextAudioBlockTo (info_i, scratchBuffer);
+     @endcode
+     with info_i referring to the destination, regions[i].startSample and
+     regions[i].numSamples.
+     */
+    void renderRegions (const Array<RegionToRender>& regions,
+                        AudioSampleBuffer& destination);
+
+private:
+    //==============================================================================
+    class Worker  : public Thread
+    {
+    public:
+        Worker (ParallelRegionRenderer& owner, bool realtimePriority);
+        ~Worker ();
+        void run ();
+
+        /** Signalled by the ParallelRegionRenderer to start the processing. */
+        WaitableEvent startEvent;
+
+    private:
+        ParallelRegionRenderer& owner;
+        bool realtimePriority;
+    };
+
+    enum Phase
+    {
+        prepareRegions = 0,
+        addRegionsToChannels
+    };
+
+    /** Runs the current phase on all threads. Returns when all items are
+     processed. */
+    void runPhase (Phase phase, int numberOfItems);
+
+    /** Processes items of the current phase until there are none left.
+     Called by all threads. */
+    void processItems ();
+
+    void processItem (int itemIndex);
+
+    OwnedArray<Worker> workers;
+
+    // The current job, set by renderRegions.
+    const Array<RegionToRender>* currentRegions;
+    AudioSampleBuffer* currentDestination;
+    int numberOfChannelGroups;
+
+    // The current phase, set by runPhase.
+    Phase currentPhase;
+    int numberOfItemsInPhase;
+    Atomic<int> nextItem;
+    Atomic<int> numberOfBusyWorkers;
+    /** Signalled by the last worker that finishes a phase. */
+    WaitableEvent phaseFinished;
+
+	JUCE_LEAK_DETECTOR (ParallelRegionRenderer);
+};
+
+
+#endif   // __PARALLELREGIONRENDERER_HEADER__
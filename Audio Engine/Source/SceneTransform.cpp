@@ -0,0 +1,124 @@
+/*
+ *  SceneTransform.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120822.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "SceneTransform.h"
+
+
+SceneTransform::SceneTransform ()
+:   identity (true)
+{
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            matrix[row][column] = row == column ? 1.0 : 0.0;
+        }
+        translation[row] = 0.0;
+    }
+}
+
+SceneTransform::SceneTransform (double yawInDegrees,
+                                double pitchInDegrees,
+                                double rollInDegrees,
+                                double translationX,
+                                double translationY,
+                                double translationZ,
+                                double scale)
+{
+    const double degreesToRadians = double_Pi / 180.0;
+    const double cosYaw = cos (yawInDegrees * degreesToRadians);
+    const double sinYaw = sin (yawInDegrees * degreesToRadians);
+    const double cosPitch = cos (pitchInDegrees * degreesToRadians);
+    const double sinPitch = sin (pitchInDegrees * degreesToRadians);
+    const double cosRoll = cos (rollInDegrees * degreesToRadians);
+    const double sinRoll = sin (rollInDegrees * degreesToRadians);
+
+    // R_z(yaw)
+    const double yawMatrix[3][3] = {{cosYaw, -sinYaw, 0.0},
+                                    {sinYaw,  cosYaw, 0.0},
+                                    {0.0,     0.0,    1.0}};
+    // R_x(pitch)
+    const double pitchMatrix[3][3] = {{1.0, 0.0,       0.0},
+                                      {0.0, cosPitch, -sinPitch},
+                                      {0.0, sinPitch,  cosPitch}};
+    // R_y(roll), such that a positive roll lifts the right side (+x).
+    const double rollMatrix[3][3] = {{cosRoll,  0.0, -sinRoll},
+                                     {0.0,      1.0,  0.0},
+                                     {sinRoll,  0.0,  cosRoll}};
+
+    double yawPitchMatrix[3][3];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            yawPitchMatrix[row][column] = 0.0;
+            for (int k = 0; k < 3; ++k)
+            {
+                yawPitchMatrix[row][column] += yawMatrix[row][k] * pitchMatrix[k][column];
+            }
+        }
+    }
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            matrix[row][column] = 0.0;
+            for (int k = 0; k < 3; ++k)
+            {
+                matrix[row][column] += yawPitchMatrix[row][k] * rollMatrix[k][column];
+            }
+            matrix[row][column] *= scale;
+        }
+    }
+
+    translation[0] = translationX;
+    translation[1] = translationY;
+    translation[2] = translationZ;
+
+    identity = yawInDegrees == 0.0 && pitchInDegrees == 0.0 && rollInDegrees == 0.0
+               && translationX == 0.0 && translationY == 0.0 && translationZ == 0.0
+               && scale == 1.0;
+}
+
+SceneTransform::SceneTransform (const SceneTransform& other)
+:   identity (other.identity)
+{
+    memcpy (matrix, other.matrix, sizeof (matrix));
+    memcpy (translation, other.translation, sizeof (translation));
+}
+
+SceneTransform::~SceneTransform ()
+{
+}
+
+const SceneTransform& SceneTransform::operator= (const SceneTransform& other)
+{
+    memcpy (matrix, other.matrix, sizeof (matrix));
+    memcpy (translation, other.translation, sizeof (translation));
+    identity = other.identity;
+
+    return *this;
+}
+
+bool SceneTransform::operator== (const SceneTransform& other) const
+{
+    return identity == other.identity
+           && memcmp (matrix, other.matrix, sizeof (matrix)) == 0
+           && memcmp (translation, other.translation, sizeof (translation)) == 0;
+}
+
+bool SceneTransform::operator!= (const SceneTransform& other) const
+{
+    return ! operator== (other);
+}
+
+bool SceneTransform::isIdentity () const
+{
+    return identity;
+}
@@ -0,0 +1,109 @@
+/*
+ *  SceneTransform.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120822.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __SCENETRANSFORM_HEADER__
+#define __SCENETRANSFORM_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+ A transformation of the whole scene: Scaling, followed by a rotation,
+ followed by a translation.
+
+ The rotation is given as yaw, pitch and roll (in degrees), applied in this
+ order to the source (i.e. the rotation matrix is
+ \f$ R = R_z(\textrm{yaw}) R_x(\textrm{pitch}) R_y(\textrm{roll}) \f$).
+ With the coordinate system of the engine (y to the front, x to the right,
+ z up):
+ <ul>
+ <li> yaw turns the scene around the z axis, positive values to the left
+      (counterclockwise, seen from above; the direction of the azimuth in
+      SphericalHarmonics).
+ <li> pitch turns the scene around the x axis, positive values lift the
+      front.
+ <li> roll turns the scene around the y axis, positive values lift the
+      right side.
+ </ul>
+
+ The transformation is stored as a 3x3 matrix and a translation vector,
+ such that applying it costs 9 multiplications and 12 additions.
+
+ Used by AudioSourceAmbipanning, which applies it to each position of a
+ spacial envelope before the panning is calculated, and to a transformed
+ copy of the envelope for the doppler effect and the low pass filter (see
+ SpacialEnvelope::createTransformed).
+ */
+class JUCE_API  SceneTransform
+{
+public:
+    /** Constructor. Creates the identity. */
+    SceneTransform ();
+
+    /** Constructor.
+
+     @param yawInDegrees, pitchInDegrees, rollInDegrees	The rotation.
+     @param translationX, translationY, translationZ	The translation,
+														applied after
+														the rotation.
+     @param scale	The scale factor, applied before the rotation.
+     */
+    SceneTransform (double yawInDegrees,
+                    double pitchInDegrees,
+                    double rollInDegrees,
+                    double translationX,
+                    double translationY,
+                    double translationZ,
+                    double scale);
+
+    /** Copy constructor. */
+    SceneTransform (const SceneTransform& other);
+
+    /** Destructor. */
+    ~SceneTransform ();
+
+    /** Copy assignment operator. */
+    const SceneTransform& operator= (const SceneTransform& other);
+
+    /** Returns true if both transformations are exactly the same. */
+    bool operator== (const SceneTransform& other) const;
+
+    /** Returns true if the transformations differ. */
+    bool operator!= (const SceneTransform& other) const;
+
+    /** Returns true if the transformation doesn't change any point. */
+    bool isIdentity () const;
+
+    /** Transforms the point (x, y, z) in place. */
+    inline void apply (double& x, double& y, double& z) const;
+
+private:
+    double matrix[3][3];
+    double translation[3];
+    bool identity;
+
+	JUCE_LEAK_DETECTOR (SceneTransform);
+};
+
+//==============================================================================
+inline void SceneTransform::apply (double& x, double& y, double& z) const
+{
+    if (identity)
+        return;
+
+    const double newX = matrix[0][0] * x + matrix[0][1] * y + matrix[0][2] * z + translation[0];
+    const double newY = matrix[1][0] * x + matrix[1][1] * y + matrix[1][2] * z + translation[1];
+    const double newZ = matrix[2][0] * x + matrix[2][1] * y + matrix[2][2] * z + translation[2];
+    x = newX;
+    y = newY;
+    z = newZ;
+}
+
+
+#endif   // __SCENETRANSFORM_HEADER__
@@ -0,0 +1,662 @@
+/*
+ *  SpacialEnvelope.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120831.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "SpacialEnvelope.h"
+
+//==============================================================================
+/** Sorts the indices of points by the positions of the points. */
+class SpacialEnvelopeIndexComparator
+{
+public:
+    SpacialEnvelopeIndexComparator (const int* positions_)
+    :   positions (positions_)
+    {
+    }
+
+    int compareElements (int first, int second) const
+    {
+        if (positions[first] < positions[second])
+        {
+            return -1;
+        }
+        else if (positions[first] > positions[second])
+        {
+            return 1;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+private:
+    const int* positions;
+};
+
+//==============================================================================
+SpacialEnvelope::SpacialEnvelope (double x, double y, double z)
+{
+    allocate (1);
+    positions[0] = 0;
+    xs[0] = x;
+    ys[0] = y;
+    zs[0] = z;
+}
+
+SpacialEnvelope::SpacialEnvelope (const Array<SpacialEnvelopePoint>& points)
+{
+    jassert (points.size() != 0);
+
+    allocate (points.size());
+    for (int i = 0; i < numberOfPoints; ++i)
+    {
+        SpacialEnvelopePoint point (points.getUnchecked (i));
+        positions[i] = point.getPosition();
+        xs[i] = point.getX();
+        ys[i] = point.getY();
+        zs[i] = point.getZ();
+    }
+}
+
+SpacialEnvelope::SpacialEnvelope (int numberOfPoints_)
+{
+    allocate (numberOfPoints_);
+}
+
+SpacialEnvelope::~SpacialEnvelope ()
+{
+}
+
+SpacialEnvelope* SpacialEnvelope::createExtended (const int* positions_,
+                                                  const double* x,
+                                                  const double* y,
+                                                  const double* z,
+                                                  int numberOfPoints_,
+                                                  int firstPosition,
+                                                  int lastPosition,
+                                                  const int* interpolationModes_,
+                                                  const double* controlPoints_)
+{
+    if (numberOfPoints_ <= 0)
+    {
+        return nullptr;
+    }
+
+    // The order in which the points are copied. Only sorted, if the points
+    // aren't in order already (which they usually are).
+    HeapBlock<int> order (numberOfPoints_);
+    bool sorted = true;
+    for (int i = 0; i < numberOfPoints_; ++i)
+    {
+        order[i] = i;
+        if (i > 0 && positions_[i] < positions_[i - 1])
+        {
+            sorted = false;
+        }
+    }
+    if (! sorted)
+    {
+        SpacialEnvelopeIndexComparator comparator (positions_);
+        sortArray (comparator, order.getData(), 0, numberOfPoints_ - 1, true);
+    }
+
+    const int first = order[0];
+    const int last = order[numberOfPoints_ - 1];
+    const bool extendAtTheStart = numberOfPoints_ > 1 && positions_[first] > firstPosition;
+    const bool extendAtTheEnd = numberOfPoints_ > 1 && positions_[last] < lastPosition;
+
+    SpacialEnvelope* envelope = new SpacialEnvelope (numberOfPoints_
+                                                     + (extendAtTheStart ? 1 : 0)
+                                                     + (extendAtTheEnd ? 1 : 0));
+
+    // The modes are only stored, if a segment isn't linear.
+    bool allLinear = true;
+    bool withBezierCurves = false;
+    if (interpolationModes_ != nullptr)
+    {
+        for (int i = 0; i < numberOfPoints_; ++i)
+        {
+            allLinear = allLinear && interpolationModes_[i] == interpolationModeLinear;
+            withBezierCurves = withBezierCurves || interpolationModes_[i] == interpolationModeBezier;
+        }
+    }
+    jassert (! withBezierCurves || controlPoints_ != nullptr);
+    withBezierCurves = withBezierCurves && controlPoints_ != nullptr;
+    if (! allLinear)
+    {
+        envelope->allocateInterpolationModes (withBezierCurves);
+    }
+
+    int j = 0;
+    if (extendAtTheStart)
+    {
+        envelope->positions[j] = firstPosition;
+        envelope->xs[j] = x[first];
+        envelope->ys[j] = y[first];
+        envelope->zs[j] = z[first];
+        ++j;
+    }
+    for (int i = 0; i < numberOfPoints_; ++i)
+    {
+        const int k = order[i];
+        envelope->positions[j] = positions_[k];
+        envelope->xs[j] = x[k];
+        envelope->ys[j] = y[k];
+        envelope->zs[j] = z[k];
+        // The last point has no segment (but an extension).
+        if (! allLinear && i + 1 < numberOfPoints_)
+        {
+            int mode = interpolationModes_[k];
+            if (mode == interpolationModeBezier && ! withBezierCurves)
+            {
+                mode = interpolationModeLinear;
+            }
+            envelope->interpolationModes[j] = (uint8) mode;
+            if (mode == interpolationModeBezier)
+            {
+                memcpy (envelope->controlPoints + 6 * j, controlPoints_ + 6 * k, 6 * sizeof (double));
+            }
+        }
+        ++j;
+    }
+    if (extendAtTheEnd)
+    {
+        envelope->positions[j] = lastPosition;
+        envelope->xs[j] = x[last];
+        envelope->ys[j] = y[last];
+        envelope->zs[j] = z[last];
+    }
+
+    return envelope;
+}
+
+SpacialEnvelope* SpacialEnvelope::createMerged (const SpacialEnvelope& envelope,
+                                                const Array<SpacialEnvelopePoint>& additionalPoints)
+{
+    SpacialEnvelope* merged = new SpacialEnvelope (envelope.size() + additionalPoints.size());
+    if (! envelope.isLinear())
+    {
+        merged->allocateInterpolationModes (envelope.controlPoints.getData() != nullptr);
+    }
+
+    int i = 0; // in the envelope
+    int k = 0; // in the additionalPoints
+    for (int j = 0; j < merged->numberOfPoints; ++j)
+    {
+        SpacialEnvelopePoint additionalPoint;
+        if (k < additionalPoints.size())
+        {
+            additionalPoint = additionalPoints.getUnchecked (k);
+        }
+
+        if (k == additionalPoints.size()
+            || (i < envelope.size() && envelope.positions[i] <= additionalPoint.getPosition()))
+        {
+            merged->positions[j] = envelope.positions[i];
+            merged->xs[j] = envelope.xs[i];
+            merged->ys[j] = envelope.ys[i];
+            merged->zs[j] = envelope.zs[i];
+            if (! envelope.isLinear())
+            {
+                merged->interpolationModes[j] = envelope.interpolationModes[i];
+                if (envelope.controlPoints.getData() != nullptr)
+                {
+                    memcpy (merged->controlPoints + 6 * j, envelope.controlPoints + 6 * i, 6 * sizeof (double));
+                }
+            }
+            ++i;
+        }
+        else
+        {
+            merged->positions[j] = additionalPoint.getPosition();
+            merged->xs[j] = additionalPoint.getX();
+            merged->ys[j] = additionalPoint.getY();
+            merged->zs[j] = additionalPoint.getZ();
+            // The rest of the segment it splits.
+            if (! envelope.isLinear() && i > 0)
+            {
+                jassert (envelope.interpolationModes[i - 1] != interpolationModeBezier);
+                merged->interpolationModes[j] = envelope.interpolationModes[i - 1] == interpolationModeArc
+                                                ? (uint8) interpolationModeArc
+                                                : (uint8) interpolationModeLinear;
+            }
+            ++k;
+        }
+    }
+
+    return merged;
+}
+
+SpacialEnvelope* SpacialEnvelope::createSimplified (const SpacialEnvelope& envelope,
+                                                    double tolerance,
+                                                    int firstPointToKeep,
+                                                    int lastPointToKeep)
+{
+    const int numberOfPoints_ = envelope.size();
+    if (numberOfPoints_ < 3 || tolerance <= 0.0)
+    {
+        return nullptr;
+    }
+
+    // The first and the last point and the ends of the arcs and curves have
+    // to stay. In between two of them, all segments are linear.
+    HeapBlock<bool> keep;
+    keep.calloc (numberOfPoints_);
+    keep[0] = true;
+    keep[numberOfPoints_ - 1] = true;
+    keep[jlimit (0, numberOfPoints_ - 1, firstPointToKeep)] = true;
+    keep[jlimit (0, numberOfPoints_ - 1, lastPointToKeep)] = true;
+    for (int i = 0; i < numberOfPoints_ - 1; ++i)
+    {
+        if (! envelope.isLinear (i))
+        {
+            keep[i] = true;
+            keep[i + 1] = true;
+        }
+    }
+
+    // The ranges still to look at, as pairs of the first and the last
+    // point. The squared tolerance avoids the square roots.
+    const double squaredTolerance = tolerance * tolerance;
+    Array<int> ranges;
+    int first = 0;
+    for (int last = 1; last < numberOfPoints_; ++last)
+    {
+        if (keep[last])
+        {
+            if (last - first > 1)
+            {
+                ranges.add (first);
+                ranges.add (last);
+            }
+            first = last;
+        }
+    }
+
+    while (ranges.size() > 0)
+    {
+        const int last = ranges.getLast();
+        ranges.removeLast();
+        first = ranges.getLast();
+        ranges.removeLast();
+
+        // Find the point that is furthest away from the segment between
+        // first and last, at its position in time.
+        const double duration = envelope.positions[last] - envelope.positions[first];
+        int furthestPoint = -1;
+        double highestSquaredError = squaredTolerance;
+        for (int i = first + 1; i < last; ++i)
+        {
+            const double t = duration > 0.0 ? (envelope.positions[i] - envelope.positions[first]) / duration : 0.0;
+            const double dx = envelope.xs[first] + t * (envelope.xs[last] - envelope.xs[first]) - envelope.xs[i];
+            const double dy = envelope.ys[first] + t * (envelope.ys[last] - envelope.ys[first]) - envelope.ys[i];
+            const double dz = envelope.zs[first] + t * (envelope.zs[last] - envelope.zs[first]) - envelope.zs[i];
+            const double squaredError = dx * dx + dy * dy + dz * dz;
+            if (squaredError > highestSquaredError)
+            {
+                highestSquaredError = squaredError;
+                furthestPoint = i;
+            }
+        }
+
+        // Keep it and look at both halves.
+        if (furthestPoint >= 0)
+        {
+            keep[furthestPoint] = true;
+            if (furthestPoint - first > 1)
+            {
+                ranges.add (first);
+                ranges.add (furthestPoint);
+            }
+            if (last - furthestPoint > 1)
+            {
+                ranges.add (furthestPoint);
+                ranges.add (last);
+            }
+        }
+    }
+
+    int numberOfKeptPoints = 0;
+    for (int i = 0; i < numberOfPoints_; ++i)
+    {
+        if (keep[i])
+        {
+            ++numberOfKeptPoints;
+        }
+    }
+    if (numberOfKeptPoints == numberOfPoints_)
+    {
+        return nullptr;
+    }
+
+    // The segment of a kept point either is the same as before or it is
+    // linear (and spans the dropped points).
+    SpacialEnvelope* simplified = new SpacialEnvelope (numberOfKeptPoints);
+    if (! envelope.isLinear())
+    {
+        simplified->allocateInterpolationModes (envelope.controlPoints.getData() != nullptr);
+    }
+    int j = 0;
+    for (int i = 0; i < numberOfPoints_; ++i)
+    {
+        if (keep[i])
+        {
+            simplified->copyPoints (envelope, i, j, 1);
+            ++j;
+        }
+    }
+
+    return simplified;
+}
+
+SpacialEnvelope* SpacialEnvelope::createPatched (const SpacialEnvelope& envelope,
+                                                 int startIndex,
+                                                 int numberOfPointsToRemove,
+                                                 const int* positions_,
+                                                 const double* x,
+                                                 const double* y,
+                                                 const double* z,
+                                                 int numberOfPointsToInsert,
+                                                 const int* interpolationModes_,
+                                                 const double* controlPoints_)
+{
+    const int endIndex = startIndex + numberOfPointsToRemove;
+    const int numberOfPoints_ = envelope.size() - numberOfPointsToRemove + numberOfPointsToInsert;
+    if (startIndex < 0 || numberOfPointsToRemove < 0 || numberOfPointsToInsert < 0
+        || endIndex > envelope.size() || numberOfPoints_ <= 0)
+    {
+        return nullptr;
+    }
+
+    // The points have to stay sorted, at the seams too.
+    int previousPosition = startIndex > 0 ? envelope.positions[startIndex - 1] : INT_MIN;
+    for (int i = 0; i < numberOfPointsToInsert; ++i)
+    {
+        if (positions_[i] < previousPosition)
+        {
+            return nullptr;
+        }
+        previousPosition = positions_[i];
+    }
+    if (endIndex < envelope.size() && envelope.positions[endIndex] < previousPosition)
+    {
+        return nullptr;
+    }
+
+    bool allLinear = envelope.isLinear();
+    bool withBezierCurves = envelope.controlPoints.getData() != nullptr;
+    if (interpolationModes_ != nullptr)
+    {
+        for (int i = 0; i < numberOfPointsToInsert; ++i)
+        {
+            allLinear = allLinear && interpolationModes_[i] == interpolationModeLinear;
+            withBezierCurves = withBezierCurves
+                               || (interpolationModes_[i] == interpolationModeBezier && controlPoints_ != nullptr);
+        }
+    }
+
+    SpacialEnvelope* patched = new SpacialEnvelope (numberOfPoints_);
+    if (! allLinear)
+    {
+        patched->allocateInterpolationModes (withBezierCurves);
+    }
+
+    patched->copyPoints (envelope, 0, 0, startIndex);
+    for (int i = 0; i < numberOfPointsToInsert; ++i)
+    {
+        const int j = startIndex + i;
+        patched->positions[j] = positions_[i];
+        patched->xs[j] = x[i];
+        patched->ys[j] = y[i];
+        patched->zs[j] = z[i];
+        if (! allLinear && interpolationModes_ != nullptr)
+        {
+            int mode = interpolationModes_[i];
+            if (mode == interpolationModeBezier && controlPoints_ == nullptr)
+            {
+                mode = interpolationModeLinear;
+            }
+            patched->interpolationModes[j] = (uint8) mode;
+            if (mode == interpolationModeBezier)
+            {
+                memcpy (patched->controlPoints + 6 * j, controlPoints_ + 6 * i, 6 * sizeof (double));
+            }
+        }
+    }
+    patched->copyPoints (envelope, endIndex, startIndex + numberOfPointsToInsert,
+                         envelope.size() - endIndex);
+
+    return patched;
+}
+
+SpacialEnvelope* SpacialEnvelope::createTransformed (const SpacialEnvelope& envelope,
+                                                     const SceneTransform& sceneTransform)
+{
+    SpacialEnvelope* transformed = new SpacialEnvelope (envelope.size());
+    if (! envelope.isLinear())
+    {
+        transformed->allocateInterpolationModes (envelope.controlPoints.getData() != nullptr);
+    }
+
+    transformed->copyPoints (envelope, 0, 0, envelope.size());
+    transformed->transformPoints (sceneTransform, 0, envelope.size());
+
+    return transformed;
+}
+
+SpacialEnvelope* SpacialEnvelope::createTransformed (const SpacialEnvelope& envelope,
+                                                     const SceneTransform& sceneTransform,
+                                                     const SpacialEnvelope& transformedOldEnvelope,
+                                                     const Patch& patch)
+{
+    const int endIndex = patch.startIndex + patch.numberOfInsertedPoints;
+    const int oldEndIndex = patch.startIndex + patch.numberOfRemovedPoints;
+    if (patch.startIndex < 0 || endIndex > envelope.size() || oldEndIndex > transformedOldEnvelope.size()
+        || envelope.size() - endIndex != transformedOldEnvelope.size() - oldEndIndex)
+    {
+        return nullptr;
+    }
+
+    SpacialEnvelope* transformed = new SpacialEnvelope (envelope.size());
+    if (! envelope.isLinear())
+    {
+        transformed->allocateInterpolationModes (envelope.controlPoints.getData() != nullptr);
+    }
+
+    // The modes of the unchanged points are the same in both envelopes
+    // (copyPoints leaves them linear, if the old one doesn't store them).
+    transformed->copyPoints (transformedOldEnvelope, 0, 0, patch.startIndex);
+    transformed->copyPoints (envelope, patch.startIndex, patch.startIndex, patch.numberOfInsertedPoints);
+    transformed->transformPoints (sceneTransform, patch.startIndex, patch.numberOfInsertedPoints);
+    transformed->copyPoints (transformedOldEnvelope, oldEndIndex, endIndex, envelope.size() - endIndex);
+
+    return transformed;
+}
+
+SpacialEnvelope::Patch SpacialEnvelope::findPatch (const SpacialEnvelope& oldEnvelope,
+                                                   const SpacialEnvelope& newEnvelope)
+{
+    const int smallerSize = jmin (oldEnvelope.size(), newEnvelope.size());
+
+    int start = 0;
+    while (start < smallerSize && pointsAreEqual (oldEnvelope, start, newEnvelope, start))
+    {
+        ++start;
+    }
+    int numberOfEqualPointsAtTheEnd = 0;
+    while (numberOfEqualPointsAtTheEnd < smallerSize - start
+           && pointsAreEqual (oldEnvelope, oldEnvelope.size() - 1 - numberOfEqualPointsAtTheEnd,
+                              newEnvelope, newEnvelope.size() - 1 - numberOfEqualPointsAtTheEnd))
+    {
+        ++numberOfEqualPointsAtTheEnd;
+    }
+
+    Patch patch;
+    patch.startIndex = start;
+    patch.numberOfRemovedPoints = oldEnvelope.size() - start - numberOfEqualPointsAtTheEnd;
+    patch.numberOfInsertedPoints = newEnvelope.size() - start - numberOfEqualPointsAtTheEnd;
+    return patch;
+}
+
+void SpacialEnvelope::getCoordinatesAt (int index, int position, double& x, double& y, double& z) const
+{
+    const int next = index + 1;
+    if (next >= numberOfPoints || position >= positions[next])
+    {
+        const int i = jmin (next, numberOfPoints - 1);
+        x = xs[i];
+        y = ys[i];
+        z = zs[i];
+        return;
+    }
+
+    const int distance = positions[next] - positions[index];
+    const double t = distance > 0 ? double (position - positions[index]) / double (distance) : 0.0;
+
+    switch (getInterpolationMode (index))
+    {
+        case interpolationModeArc:
+        {
+            const double r0 = sqrt (xs[index] * xs[index] + ys[index] * ys[index] + zs[index] * zs[index]);
+            const double r1 = sqrt (xs[next] * xs[next] + ys[next] * ys[next] + zs[next] * zs[next]);
+            if (r0 > 0.0 && r1 > 0.0)
+            {
+                // The azimuth is measured clockwise from the y-axis, like in
+                // the GUI.
+                const double azimuth0 = atan2 (xs[index], ys[index]);
+                const double elevation0 = asin (jlimit (-1.0, 1.0, zs[index] / r0));
+                double deltaAzimuth = atan2 (xs[next], ys[next]) - azimuth0;
+                if (deltaAzimuth > double_Pi)
+                {
+                    deltaAzimuth -= 2.0 * double_Pi;
+                }
+                else if (deltaAzimuth < -double_Pi)
+                {
+                    deltaAzimuth += 2.0 * double_Pi;
+                }
+                const double deltaElevation = asin (jlimit (-1.0, 1.0, zs[next] / r1)) - elevation0;
+
+                const double azimuth = azimuth0 + t * deltaAzimuth;
+                const double elevation = elevation0 + t * deltaElevation;
+                const double r = r0 + t * (r1 - r0);
+                x = r * cos (elevation) * sin (azimuth);
+                y = r * cos (elevation) * cos (azimuth);
+                z = r * sin (elevation);
+                return;
+            }
+            // An arc through the origin is a line.
+            break;
+        }
+
+        case interpolationModeBezier:
+        {
+            const double* c = controlPoints + 6 * index;
+            const double s = 1.0 - t;
+            const double b0 = s * s * s;
+            const double b1 = 3.0 * s * s * t;
+            const double b2 = 3.0 * s * t * t;
+            const double b3 = t * t * t;
+            x = b0 * xs[index] + b1 * c[0] + b2 * c[3] + b3 * xs[next];
+            y = b0 * ys[index] + b1 * c[1] + b2 * c[4] + b3 * ys[next];
+            z = b0 * zs[index] + b1 * c[2] + b2 * c[5] + b3 * zs[next];
+            return;
+        }
+
+        default:
+            break;
+    }
+
+    x = xs[index] + t * (xs[next] - xs[index]);
+    y = ys[index] + t * (ys[next] - ys[index]);
+    z = zs[index] + t * (zs[next] - zs[index]);
+}
+
+SpacialEnvelopePoint SpacialEnvelope::getPoint (int index) const
+{
+    return SpacialEnvelopePoint (positions[index], xs[index], ys[index], zs[index]);
+}
+
+void SpacialEnvelope::allocate (int numberOfPoints_)
+{
+    numberOfPoints = numberOfPoints_;
+
+    // Three doubles for the coordinates and (rounded up) half a double for
+    // the position of each point.
+    data.malloc (3 * numberOfPoints + (numberOfPoints + 1) / 2);
+    xs = data;
+    ys = xs + numberOfPoints;
+    zs = ys + numberOfPoints;
+    positions = reinterpret_cast<int*> (zs + numberOfPoints);
+}
+
+void SpacialEnvelope::allocateInterpolationModes (bool withControlPoints)
+{
+    interpolationModes.calloc (numberOfPoints);
+    if (withControlPoints)
+    {
+        controlPoints.calloc (6 * numberOfPoints);
+    }
+}
+
+void SpacialEnvelope::copyPoints (const SpacialEnvelope& source, int sourceIndex,
+                                  int destinationIndex, int numberOfPointsToCopy)
+{
+    if (numberOfPointsToCopy <= 0)
+    {
+        return;
+    }
+
+    memcpy (positions + destinationIndex, source.positions + sourceIndex, numberOfPointsToCopy * sizeof (int));
+    memcpy (xs + destinationIndex, source.xs + sourceIndex, numberOfPointsToCopy * sizeof (double));
+    memcpy (ys + destinationIndex, source.ys + sourceIndex, numberOfPointsToCopy * sizeof (double));
+    memcpy (zs + destinationIndex, source.zs + sourceIndex, numberOfPointsToCopy * sizeof (double));
+    if (interpolationModes.getData() != nullptr && source.interpolationModes.getData() != nullptr)
+    {
+        memcpy (interpolationModes + destinationIndex, source.interpolationModes + sourceIndex,
+                numberOfPointsToCopy * sizeof (uint8));
+    }
+    if (controlPoints.getData() != nullptr && source.controlPoints.getData() != nullptr)
+    {
+        memcpy (controlPoints + 6 * destinationIndex, source.controlPoints + 6 * sourceIndex,
+                6 * numberOfPointsToCopy * sizeof (double));
+    }
+}
+
+void SpacialEnvelope::transformPoints (const SceneTransform& sceneTransform,
+                                       int startIndex, int numberOfPointsToTransform)
+{
+    for (int i = startIndex; i < startIndex + numberOfPointsToTransform; ++i)
+    {
+        sceneTransform.apply (xs[i], ys[i], zs[i]);
+        if (getInterpolationMode (i) == interpolationModeBezier)
+        {
+            double* controlPointsOfSegment = controlPoints + 6 * i;
+            sceneTransform.apply (controlPointsOfSegment[0], controlPointsOfSegment[1], controlPointsOfSegment[2]);
+            sceneTransform.apply (controlPointsOfSegment[3], controlPointsOfSegment[4], controlPointsOfSegment[5]);
+        }
+    }
+}
+
+bool SpacialEnvelope::pointsAreEqual (const SpacialEnvelope& a, int i,
+                                      const SpacialEnvelope& b, int j)
+{
+    if (a.positions[i] != b.positions[j]
+        || a.xs[i] != b.xs[j]
+        || a.ys[i] != b.ys[j]
+        || a.zs[i] != b.zs[j]
+        || a.getInterpolationMode (i) != b.getInterpolationMode (j))
+    {
+        return false;
+    }
+    if (a.getInterpolationMode (i) == interpolationModeBezier)
+    {
+        return memcmp (a.controlPoints + 6 * i, b.controlPoints + 6 * j, 6 * sizeof (double)) == 0;
+    }
+    return true;
+}
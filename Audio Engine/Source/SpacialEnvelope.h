@@ -0,0 +1,310 @@
+/*
+ *  SpacialEnvelope.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120831.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __SPACIALENVELOPE_HEADER__
+#define __SPACIALENVELOPE_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SpacialEnvelopePoint.h"
+#include "SceneTransform.h"
+
+//==============================================================================
+/**
+ The movement of a sound source in space over time: A list of points, each
+ one a position in time (in samples, relative to the start of the audio
+ file) and x, y and z coordinates, sorted by their position in time.
+
+ An envelope can't be changed once it has been created. It is reference
+ counted and shared by the AudioRegionMixer and all stages of the
+ AudioSourceAmbipanning of a region (the panning, the doppler effect and
+ the low pass filter). Setting a new envelope therefore only hands a
+ pointer around.
+
+ The positions and the coordinates are stored in separate contiguous
+ arrays (all of them in one allocation).
+
+ Every segment (from a point to the next one) has an InterpolationMode. An
+ arc or a curve needs far fewer points than its linear approximation. The
+ stages evaluate the segments with getCoordinatesAt at the points and at
+ the ends of the audio blocks, i.e. at control rate. An envelope whose
+ segments are all linear doesn't store the modes at all.
+
+ An edit (like moving a single point) is expressed as a Patch: A new
+ envelope is created with createPatched, which copies the unchanged ranges
+ of points in blocks, and everything derived from an envelope (like the
+ SpacialGainTable) is only recalculated for the points of the Patch.
+ */
+class JUCE_API  SpacialEnvelope  : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<SpacialEnvelope> Ptr;
+
+    /** How the coordinates are interpolated from a point to the next one. */
+    enum InterpolationMode
+    {
+        /** Linearly in x, y and z. */
+        interpolationModeLinear = 0,
+        /** Linearly in azimuth (the shorter way), elevation and distance,
+         as seen from the origin. The distance stays constant, if it's the
+         same at both points, and so does the angular velocity. */
+        interpolationModeArc,
+        /** A cubic Bezier curve with two control points. */
+        interpolationModeBezier
+    };
+
+    /**
+     Describes how an envelope differs from the one it has been derived
+     from: The points [startIndex, startIndex + numberOfRemovedPoints) of the
+     old envelope have been replaced by the points [startIndex, startIndex +
+     numberOfInsertedPoints) of the new one. All other points (and the
+     segments starting at them, except the one starting at startIndex - 1)
+     are the same.
+     */
+    struct Patch
+    {
+        int startIndex;
+        int numberOfRemovedPoints;
+        int numberOfInsertedPoints;
+
+        /** Returns true, if the envelopes are the same. */
+        bool isEmpty () const   { return numberOfRemovedPoints == 0 && numberOfInsertedPoints == 0; }
+    };
+
+    //==============================================================================
+    /** Creates an envelope with a single point at the position 0. */
+    SpacialEnvelope (double x, double y, double z);
+
+    /** Copies the points, which have to be sorted by their position. */
+    explicit SpacialEnvelope (const Array<SpacialEnvelopePoint>& points);
+
+    /** Destructor. */
+    ~SpacialEnvelope ();
+
+    //==============================================================================
+    /**
+     Creates an envelope from flat arrays of numberOfPoints points.
+
+     The points are sorted by their position, if they aren't already. If
+     there is more than one point, the envelope is extended such that it
+     covers the interval [firstPosition, lastPosition]: A copy of the first
+     point is put at firstPosition, if the first point comes later, and a
+     copy of the last point at lastPosition, if the last point comes
+     earlier.
+
+     @param interpolationModes  The InterpolationMode of the segment that
+                                starts at each point, or nullptr if all
+                                segments are linear. The segments added by
+                                the extension are linear.
+     @param controlPoints       For each point, the two control points
+                                (x, y and z of the first one, then of the
+                                second one) of its segment, if it is a
+                                Bezier curve. nullptr if there are none.
+     @return    A new envelope, or nullptr if numberOfPoints is 0.
+     */
+    static SpacialEnvelope* createExtended (const int* positions,
+                                            const double* x,
+                                            const double* y,
+                                            const double* z,
+                                            int numberOfPoints,
+                                            int firstPosition,
+                                            int lastPosition,
+                                            const int* interpolationModes = nullptr,
+                                            const double* controlPoints = nullptr);
+
+    /**
+     Creates an envelope with the points of the given one and the
+     additionalPoints, which have to be sorted by their position, too. A
+     point of the envelope comes before an additional point at the same
+     position.
+
+     An additional point splits a segment into two of the same mode. It
+     must therefore lie on the segment, and not in a Bezier curve (whose
+     control points would have to change).
+     */
+    static SpacialEnvelope* createMerged (const SpacialEnvelope& envelope,
+                                          const Array<SpacialEnvelopePoint>& additionalPoints);
+
+    /**
+     Creates an envelope without the points that aren't needed to stay
+     within the tolerance (Ramer-Douglas-Peucker): At every position, the
+     coordinates of the new envelope differ by at most the tolerance (in
+     the unit of the coordinates) from the ones of the given envelope.
+
+     Since the segments are compared at the same position in time (and not
+     just as curves in space), the speed of a source is kept as well. Only
+     points in between linear segments are dropped, the first and the last
+     point and the ones at the ends of arcs and curves are always kept.
+
+     @param firstPointToKeep    Two more points that are kept, e.g. the
+     @param lastPointToKeep     first and the last point that have been set,
+                                if the envelope has been extended (see
+                                createExtended).
+     @return    A new envelope, or nullptr if no point can be dropped.
+     */
+    static SpacialEnvelope* createSimplified (const SpacialEnvelope& envelope,
+                                              double tolerance,
+                                              int firstPointToKeep = 0,
+                                              int lastPointToKeep = 0);
+
+    /**
+     Creates an envelope with the points of the given one, in which
+     numberOfPointsToRemove points from the startIndex on are replaced by
+     numberOfPointsToInsert points given as flat arrays (see
+     createExtended for the interpolationModes and the controlPoints). A
+     point is inserted with numberOfPointsToRemove = 0, removed with
+     numberOfPointsToInsert = 0 and moved by replacing it (or the range it
+     has been moved across).
+
+     The other points are copied in (at most two) blocks, nothing is
+     sorted: The points to insert have to be sorted by their position and
+     fit in between their neighbours.
+
+     @return    A new envelope, or nullptr if the range doesn't exist, no
+                point would be left or the points wouldn't be sorted.
+     */
+    static SpacialEnvelope* createPatched (const SpacialEnvelope& envelope,
+                                           int startIndex,
+                                           int numberOfPointsToRemove,
+                                           const int* positions,
+                                           const double* x,
+                                           const double* y,
+                                           const double* z,
+                                           int numberOfPointsToInsert,
+                                           const int* interpolationModes = nullptr,
+                                           const double* controlPoints = nullptr);
+
+    /**
+     Creates an envelope with the points (and the control points of the
+     Bezier curves) of the given one, transformed with the
+     sceneTransform. The positions and the modes stay the same.
+
+     An arc is still evaluated around the origin, i.e. around the origin
+     of the transformed scene: Its distance course stays the same under a
+     rotation and a scaling, but not under a translation.
+     */
+    static SpacialEnvelope* createTransformed (const SpacialEnvelope& envelope,
+                                               const SceneTransform& sceneTransform);
+
+    /**
+     Like createTransformed above, but only the points inserted by the
+     patch are transformed. The other ones are copied from the
+     transformedOldEnvelope, the envelope the patch has been applied to,
+     transformed with the same sceneTransform.
+
+     @return    A new envelope, or nullptr if the patch doesn't fit the
+                envelopes.
+     */
+    static SpacialEnvelope* createTransformed (const SpacialEnvelope& envelope,
+                                               const SceneTransform& sceneTransform,
+                                               const SpacialEnvelope& transformedOldEnvelope,
+                                               const Patch& patch);
+
+    /**
+     Finds the smallest Patch that turns the oldEnvelope into the
+     newEnvelope, by comparing their points from the start and from the
+     end. Used to find out which part of a newly uploaded envelope has
+     actually changed.
+     */
+    static Patch findPatch (const SpacialEnvelope& oldEnvelope,
+                            const SpacialEnvelope& newEnvelope);
+
+    //==============================================================================
+    /** Returns the number of points, at least 1. */
+    int size () const                       { return numberOfPoints; }
+
+    /** Returns the position in time (in samples) of a point. */
+    int getPosition (int index) const       { return positions[index]; }
+
+    /** Returns the x-coordinate of a point. */
+    double getX (int index) const           { return xs[index]; }
+
+    /** Returns the y-coordinate of a point. */
+    double getY (int index) const           { return ys[index]; }
+
+    /** Returns the z-coordinate of a point. */
+    double getZ (int index) const           { return zs[index]; }
+
+    /** Returns a copy of a point. */
+    SpacialEnvelopePoint getPoint (int index) const;
+
+    /** The positions of all points, size() elements. */
+    const int* getPositions () const        { return positions; }
+
+    /** Returns the InterpolationMode of the segment from a point to the
+     next one. */
+    InterpolationMode getInterpolationMode (int index) const
+    {
+        return interpolationModes.getData() == nullptr ? interpolationModeLinear
+                                             : (InterpolationMode) interpolationModes[index];
+    }
+
+    /** Returns true, if the segment from a point to the next one is linear. */
+    bool isLinear (int index) const         { return getInterpolationMode (index) == interpolationModeLinear; }
+
+    /** Returns true, if all segments are linear. */
+    bool isLinear () const                  { return interpolationModes.getData() == nullptr; }
+
+    /** Returns the two control points (six coordinates) of the segment
+     from a point to the next one, nullptr if it isn't a Bezier curve. */
+    const double* getControlPoints (int index) const
+    {
+        return getInterpolationMode (index) == interpolationModeBezier ? controlPoints + 6 * index : nullptr;
+    }
+
+    /**
+     Calculates the coordinates at a position in the segment from the point
+     index to the next one, according to its InterpolationMode. At or
+     after the last point, the coordinates of the last point.
+     */
+    void getCoordinatesAt (int index, int position, double& x, double& y, double& z) const;
+
+private:
+    /** Used by the create methods. */
+    explicit SpacialEnvelope (int numberOfPoints);
+
+    /** Allocates the arrays for numberOfPoints points. */
+    void allocate (int numberOfPoints);
+
+    /** Allocates the interpolationModes (all linear) and, if needed, the
+     controlPoints. */
+    void allocateInterpolationModes (bool withControlPoints);
+
+    /** Copies numberOfPointsToCopy points (with their modes and control
+     points, as far as both envelopes store them) from the source. */
+    void copyPoints (const SpacialEnvelope& source, int sourceIndex,
+                     int destinationIndex, int numberOfPointsToCopy);
+
+    /** Transforms numberOfPointsToTransform points (and their control
+     points) in place. */
+    void transformPoints (const SceneTransform& sceneTransform,
+                          int startIndex, int numberOfPointsToTransform);
+
+    /** Returns true, if the point i of the envelope a and the point j of
+     the envelope b are the same (including their segments). */
+    static bool pointsAreEqual (const SpacialEnvelope& a, int i,
+                                const SpacialEnvelope& b, int j);
+
+    /** The x, y and z arrays and the positions, in this order. */
+    HeapBlock<double> data;
+    int numberOfPoints;
+    double* xs;
+    double* ys;
+    double* zs;
+    int* positions;
+    /** nullptr, if all segments are linear. */
+    HeapBlock<uint8> interpolationModes;
+    /** Six per point, nullptr if there is no Bezier curve. */
+    HeapBlock<double> controlPoints;
+
+    JUCE_DECLARE_NON_COPYABLE (SpacialEnvelope);
+	JUCE_LEAK_DETECTOR (SpacialEnvelope);
+};
+
+
+#endif   // __SPACIALENVELOPE_HEADER__
@@ -0,0 +1,84 @@
+/*
+ *  SpacialGainTable.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120902.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "SpacialGainTable.h"
+
+//==============================================================================
+SpacialGainTable::SpacialGainTable (const SpacialEnvelope::Ptr& envelope_,
+                                    int numberOfChannels_,
+                                    int settingsVersion_)
+:   envelope (envelope_),
+    numberOfChannels (numberOfChannels_),
+    settingsVersion (settingsVersion_)
+{
+    jassert (envelope != nullptr);
+
+    const int numberOfGains = envelope->size() * numberOfChannels;
+    data.calloc (jmax (1, 2 * numberOfGains));
+    gains = data;
+    deltas = gains + numberOfGains;
+}
+
+SpacialGainTable::~SpacialGainTable ()
+{
+}
+
+void SpacialGainTable::calculateDeltas ()
+{
+    calculateDeltas (0, envelope->size());
+}
+
+void SpacialGainTable::calculateDeltas (int firstPointIndex, int numberOfPoints)
+{
+    const int lastPoint = envelope->size() - 1;
+    const int endPoint = jmin (lastPoint, firstPointIndex + numberOfPoints);
+    for (int i = jmax (0, firstPointIndex); i < endPoint; ++i)
+    {
+        const int distance = envelope->getPosition (i + 1) - envelope->getPosition (i);
+        // Two points at the same position: The gains jump.
+        const float oneOverDistance = distance > 0 ? 1.0f / distance : 0.0f;
+
+        const float* gainsAtThisPoint = getGains (i);
+        const float* gainsAtNextPoint = getGains (i + 1);
+        float* deltasOfThisSegment = deltas + i * numberOfChannels;
+        for (int channel = 0; channel < numberOfChannels; ++channel)
+        {
+            deltasOfThisSegment[channel] = (gainsAtNextPoint[channel] - gainsAtThisPoint[channel]) * oneOverDistance;
+        }
+    }
+    // The deltas of the last point stay 0.
+    if (endPoint == lastPoint && lastPoint >= 0)
+    {
+        zeromem (deltas + lastPoint * numberOfChannels, numberOfChannels * sizeof (float));
+    }
+}
+
+void SpacialGainTable::copyPoints (const SpacialGainTable& source, int sourceIndex,
+                                   int destinationIndex, int numberOfPoints)
+{
+    jassert (source.numberOfChannels == numberOfChannels);
+
+    if (numberOfPoints > 0)
+    {
+        const size_t numberOfBytes = numberOfPoints * numberOfChannels * sizeof (float);
+        memcpy (getGains (destinationIndex), source.getGains (sourceIndex), numberOfBytes);
+        memcpy (deltas + destinationIndex * numberOfChannels, source.getDeltas (sourceIndex), numberOfBytes);
+    }
+}
+
+void SpacialGainTable::interpolateGains (int pointIndex, int position, float* result) const
+{
+    const float offset = (float) (position - envelope->getPosition (pointIndex));
+    const float* gainsAtThePoint = getGains (pointIndex);
+    const float* deltasOfTheSegment = getDeltas (pointIndex);
+    for (int channel = 0; channel < numberOfChannels; ++channel)
+    {
+        result[channel] = gainsAtThePoint[channel] + offset * deltasOfTheSegment[channel];
+    }
+}
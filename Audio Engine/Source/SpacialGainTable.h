@@ -0,0 +1,104 @@
+/*
+ *  SpacialGainTable.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120902.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __SPACIALGAINTABLE_HEADER__
+#define __SPACIALGAINTABLE_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SpacialEnvelope.h"
+
+//==============================================================================
+/**
+ The gain factors of all channels at every point of a SpacialEnvelope, and
+ their increments per sample up to the next point.
+
+ It is calculated off the audio thread (see
+ AudioSourceAmbipanning::createSpacialGainTable), for the settings of the
+ panning (the speakers, the order, the distance mode, ...) at that time,
+ which are identified by the settingsVersion. The audio thread then only
+ reads the gains at the points and ramps between them.
+
+ The gains of a point are stored contiguously, one float per channel. A
+ table can't be changed, once it has been handed to an
+ AudioSourceAmbipanning.
+ */
+class JUCE_API  SpacialGainTable  : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<SpacialGainTable> Ptr;
+
+    //==============================================================================
+    /** Creates a table for the envelope, with all gains set to 0. */
+    SpacialGainTable (const SpacialEnvelope::Ptr& envelope,
+                      int numberOfChannels,
+                      int settingsVersion);
+
+    /** Destructor. */
+    ~SpacialGainTable ();
+
+    //==============================================================================
+    /** The envelope this table has been calculated for. */
+    const SpacialEnvelope* getEnvelope () const     { return envelope; }
+
+    /** The number of gains per point. */
+    int getNumberOfChannels () const                { return numberOfChannels; }
+
+    /** The version of the settings of the panning the gains have been
+     calculated with. */
+    int getSettingsVersion () const                 { return settingsVersion; }
+
+    /** The gains of all channels at a point. */
+    float* getGains (int pointIndex)                { return gains + pointIndex * numberOfChannels; }
+    const float* getGains (int pointIndex) const    { return gains + pointIndex * numberOfChannels; }
+
+    /** The increments per sample of the gains of all channels, from a point
+     to the next one. 0 for the last point. */
+    const float* getDeltas (int pointIndex) const   { return deltas + pointIndex * numberOfChannels; }
+
+    /** Calculates the deltas, after all gains have been set. */
+    void calculateDeltas ();
+
+    /** Calculates the deltas of the segments starting at the points
+     [firstPointIndex, firstPointIndex + numberOfPoints). The gains of these
+     points and of the points following them have to be set. */
+    void calculateDeltas (int firstPointIndex, int numberOfPoints);
+
+    /**
+     Copies the gains and the deltas of numberOfPoints points from another
+     table with the same number of channels. Used to create the table of a
+     patched envelope (see SpacialEnvelope::Patch), whose unchanged points
+     keep their gains.
+     */
+    void copyPoints (const SpacialGainTable& source, int sourceIndex,
+                     int destinationIndex, int numberOfPoints);
+
+    /**
+     Calculates the gains at a position between the point pointIndex and
+     the next one.
+
+     @param result  Receives getNumberOfChannels() gains.
+     */
+    void interpolateGains (int pointIndex, int position, float* result) const;
+
+private:
+    SpacialEnvelope::Ptr envelope;
+    const int numberOfChannels;
+    const int settingsVersion;
+
+    /** The gains, followed by the deltas. */
+    HeapBlock<float> data;
+    float* gains;
+    float* deltas;
+
+    JUCE_DECLARE_NON_COPYABLE (SpacialGainTable);
+	JUCE_LEAK_DETECTOR (SpacialGainTable);
+};
+
+
+#endif   // __SPACIALGAINTABLE_HEADER__
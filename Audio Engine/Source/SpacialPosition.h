@@ -67,6 +67,12 @@ struct SpacialPosition
         unitScaleFactor = unitScaleFactor_;
     }
     
+    /** The length of a unit of the coordinates in meters. */
+    static double getUnitScaleFactor()
+    {
+        return unitScaleFactor;
+    }
+    
     /** Comparison operator to check for equality. */    
     bool operator== (const SpacialPosition & other) const
     {
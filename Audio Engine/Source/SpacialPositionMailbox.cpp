@@ -0,0 +1,67 @@
+/*
+ *  SpacialPositionMailbox.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120911.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "SpacialPositionMailbox.h"
+
+
+SpacialPositionMailbox::SpacialPositionMailbox ()
+:   writeSlot (0),
+    readSlot (1),
+    hasPosition (false),
+    middleSlot (2)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        slots[i].x = 0.0;
+        slots[i].y = 0.0;
+        slots[i].z = 0.0;
+    }
+}
+
+SpacialPositionMailbox::~SpacialPositionMailbox ()
+{
+}
+
+void SpacialPositionMailbox::post (double x, double y, double z)
+{
+    Slot& slot = slots[writeSlot];
+    slot.x = x;
+    slot.y = y;
+    slot.z = z;
+
+    // The position has to be written before the slot is handed over.
+    Atomic<int>::memoryBarrier();
+    writeSlot = middleSlot.exchange (writeSlot | newPositionFlag) & 3;
+}
+
+bool SpacialPositionMailbox::read (double& x, double& y, double& z)
+{
+    if ((middleSlot.get() & newPositionFlag) != 0)
+    {
+        readSlot = middleSlot.exchange (readSlot) & 3;
+        Atomic<int>::memoryBarrier();
+        hasPosition = true;
+    }
+
+    if (! hasPosition)
+    {
+        return false;
+    }
+
+    const Slot& slot = slots[readSlot];
+    x = slot.x;
+    y = slot.y;
+    z = slot.z;
+    return true;
+}
+
+bool SpacialPositionMailbox::hasNewPosition () const
+{
+    return (middleSlot.get() & newPositionFlag) != 0;
+}
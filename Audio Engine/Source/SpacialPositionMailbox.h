@@ -0,0 +1,87 @@
+/*
+ *  SpacialPositionMailbox.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120911.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __SPACIALPOSITIONMAILBOX_HEADER__
+#define __SPACIALPOSITIONMAILBOX_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+ Hands the latest position of a source from a live input (e.g. a tracker)
+ to the audio thread, without locks and without memory allocation.
+
+ Only the latest position counts, older ones are overwritten. Three slots
+ are used (a triple buffer): The writer fills its own slot and swaps it
+ with the slot in the middle, the reader swaps its own slot with the
+ middle one if a new position has arrived there. Both swaps are a single
+ atomic exchange, so neither side ever waits for the other.
+
+ There must only be one thread that calls post and one thread (the audio
+ thread) that calls read at a time.
+
+ The mailbox of a region is shared by the AudioRegionMixer and the
+ AudioSourceAmbipanning of the region, see
+ AudioRegionMixer::enableLivePositionForRegion.
+ */
+class JUCE_API  SpacialPositionMailbox  : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<SpacialPositionMailbox> Ptr;
+
+    /** Creates an empty mailbox. */
+    SpacialPositionMailbox ();
+
+    /** Destructor. */
+    ~SpacialPositionMailbox ();
+
+    /**
+     Replaces the position in the mailbox. Never blocks and never
+     allocates. Called by the writer.
+     */
+    void post (double x, double y, double z);
+
+    /**
+     Gets the latest position that has been posted. Never blocks and never
+     allocates. Called by the reader.
+
+     @return    false, if no position has been posted yet. x, y and z are
+                left untouched then.
+     */
+    bool read (double& x, double& y, double& z);
+
+    /** Returns true if a position has been posted since the last call of
+     read. */
+    bool hasNewPosition () const;
+
+private:
+    struct Slot
+    {
+        double x;
+        double y;
+        double z;
+    };
+
+    /** Set in the middleSlot if the writer has put a new position there. */
+    enum { newPositionFlag = 4 };
+
+    Slot slots[3];
+    /** Only used by the writer. */
+    int writeSlot;
+    /** Only used by the reader. */
+    int readSlot;
+    bool hasPosition;
+    /** The index of the slot in between, maybe with the newPositionFlag. */
+    Atomic<int> middleSlot;
+
+	JUCE_LEAK_DETECTOR (SpacialPositionMailbox);
+};
+
+
+#endif   // __SPACIALPOSITIONMAILBOX_HEADER__
@@ -0,0 +1,549 @@
+/*
+ *  SpacialTrajectory.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120903.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "SpacialTrajectory.h"
+
+//==============================================================================
+/** Folds a coordinate back into [lowerBound, upperBound], as if it had
+ bounced off the bounds. */
+static double reflectIntoInterval (double value, double lowerBound, double upperBound)
+{
+    const double length = upperBound - lowerBound;
+    if (length <= 0.0)
+    {
+        return lowerBound;
+    }
+
+    double offset = fmod (value - lowerBound, 2.0 * length);
+    if (offset < 0.0)
+    {
+        offset += 2.0 * length;
+    }
+    return lowerBound + (offset <= length ? offset : 2.0 * length - offset);
+}
+
+/** Adds the times (relative to the start of the motion, before the
+ duration) at which a coordinate moving with the velocity (in units per ms)
+ bounces off the bounds. */
+static void addTimesOfReflections (double start, double velocity,
+                                   double lowerBound, double upperBound,
+                                   double duration,
+                                   Array<double>& times)
+{
+    const double length = upperBound - lowerBound;
+    if (length <= 0.0 || velocity == 0.0)
+    {
+        return;
+    }
+
+    const double timeBetweenReflections = length / fabs (velocity);
+    if (timeBetweenReflections < SpacialTrajectory::minimumTimeStep)
+    {
+        // It only jitters, the points wouldn't add anything.
+        return;
+    }
+
+    // The first wall the (unfolded) coordinate reaches.
+    const double relativeStart = (start - lowerBound) / length;
+    const double wall = velocity > 0.0
+                        ? lowerBound + (floor (relativeStart) + 1.0) * length
+                        : lowerBound + (ceil (relativeStart) - 1.0) * length;
+
+    for (double time = (wall - start) / velocity; time < duration; time += timeBetweenReflections)
+    {
+        times.addUsingDefaultSort (time);
+    }
+}
+
+/** The azimuth (in degrees, clockwise from the y axis) and the distance to
+ the centre in the horizontal plane. */
+static void getAzimuthAndRadius (double x, double y, double centreX, double centreY,
+                                 double& azimuth, double& radius)
+{
+    const double dx = x - centreX;
+    const double dy = y - centreY;
+    azimuth = atan2 (dx, dy) / double_Pi * 180.0;
+    radius = sqrt (dx * dx + dy * dy);
+}
+
+//==============================================================================
+TrajectoryParameter::TrajectoryParameter ()
+{
+}
+
+TrajectoryParameter::TrajectoryParameter (double value)
+{
+    addValue (0.0, value);
+}
+
+TrajectoryParameter::~TrajectoryParameter ()
+{
+}
+
+void TrajectoryParameter::addValue (double timeInMs, double value)
+{
+    addPosition (timeInMs, value, 0.0, 0.0);
+}
+
+void TrajectoryParameter::addPosition (double timeInMs, double x, double y, double z)
+{
+    jassert (times.size() == 0 || times.getLast() <= timeInMs);
+
+    times.add (timeInMs);
+    xs.add (x);
+    ys.add (y);
+    zs.add (z);
+}
+
+int TrajectoryParameter::findPointBefore (double timeInMs) const
+{
+    // There are only a handful of points.
+    int index = -1;
+    while (index + 1 < times.size() && times.getUnchecked (index + 1) <= timeInMs)
+    {
+        ++index;
+    }
+    return index;
+}
+
+double TrajectoryParameter::getValueAt (double timeInMs) const
+{
+    double x, y, z;
+    getPositionAt (timeInMs, x, y, z);
+    return x;
+}
+
+void TrajectoryParameter::getPositionAt (double timeInMs, double& x, double& y, double& z) const
+{
+    if (times.size() == 0)
+    {
+        x = y = z = 0.0;
+        return;
+    }
+
+    const int index = findPointBefore (timeInMs);
+    if (index < 0 || index == times.size() - 1)
+    {
+        const int i = jmax (0, index);
+        x = xs.getUnchecked (i);
+        y = ys.getUnchecked (i);
+        z = zs.getUnchecked (i);
+        return;
+    }
+
+    const double interval = times.getUnchecked (index + 1) - times.getUnchecked (index);
+    const double factor = interval > 0.0 ? (timeInMs - times.getUnchecked (index)) / interval : 0.0;
+    x = xs.getUnchecked (index) + factor * (xs.getUnchecked (index + 1) - xs.getUnchecked (index));
+    y = ys.getUnchecked (index) + factor * (ys.getUnchecked (index + 1) - ys.getUnchecked (index));
+    z = zs.getUnchecked (index) + factor * (zs.getUnchecked (index + 1) - zs.getUnchecked (index));
+}
+
+double TrajectoryParameter::getIntegral (double timeInMs) const
+{
+    // The value is linear in between the points (and constant before the
+    // first and after the last one), so the trapezoids are exact.
+    double integral = 0.0;
+    double lowerBound = 0.0;
+    for (int i = 0; i < times.size() && lowerBound < timeInMs; ++i)
+    {
+        const double upperBound = jmin (times.getUnchecked (i), timeInMs);
+        if (upperBound > lowerBound)
+        {
+            integral += 0.5 * (getValueAt (lowerBound) + getValueAt (upperBound)) * (upperBound - lowerBound);
+            lowerBound = upperBound;
+        }
+    }
+    if (timeInMs > lowerBound)
+    {
+        integral += 0.5 * (getValueAt (lowerBound) + getValueAt (timeInMs)) * (timeInMs - lowerBound);
+    }
+    return integral;
+}
+
+double TrajectoryParameter::getMaximumMagnitude () const
+{
+    double maximum = 0.0;
+    for (int i = 0; i < xs.size(); ++i)
+    {
+        maximum = jmax (maximum, fabs (xs.getUnchecked (i)));
+    }
+    return maximum;
+}
+
+double TrajectoryParameter::getMaximumSlope () const
+{
+    double maximum = 0.0;
+    for (int i = 1; i < times.size(); ++i)
+    {
+        const double interval = times.getUnchecked (i) - times.getUnchecked (i - 1);
+        if (interval > 0.0)
+        {
+            maximum = jmax (maximum, fabs (xs.getUnchecked (i) - xs.getUnchecked (i - 1)) / interval);
+        }
+    }
+    return maximum;
+}
+
+//==============================================================================
+const double SpacialTrajectory::maximumAngleStep = 1.0;
+const double SpacialTrajectory::minimumTimeStep = 5.0;
+const double SpacialTrajectory::maximumArcAngle = 90.0;
+
+void SpacialTrajectory::Points::add (double timeInMs, double x, double y, double z,
+                                     SpacialEnvelope::InterpolationMode interpolationMode)
+{
+    times.add (timeInMs);
+    xs.add (x);
+    ys.add (y);
+    zs.add (z);
+    interpolationModes.add (interpolationMode);
+}
+
+SpacialTrajectory::SpacialTrajectory (double originalDurationInMs_, DurationMode durationMode_)
+:   originalDurationInMs (originalDurationInMs_),
+    durationMode (durationMode_)
+{
+}
+
+SpacialTrajectory::~SpacialTrajectory ()
+{
+}
+
+SpacialEnvelope* SpacialTrajectory::createSpacialEnvelope (int firstPosition,
+                                                           int lastPosition,
+                                                           double sampleRate) const
+{
+    jassert (sampleRate > 0.0);
+
+    // lastPosition lies one sample after the end of the region.
+    const double durationInMs = jmax (0, lastPosition - 1 - firstPosition) * 1000.0 / sampleRate;
+
+    Points points;
+    calculatePoints (durationInMs, points);
+    jassert (points.times.size() != 0);
+
+    const int numberOfPoints = points.times.size();
+    HeapBlock<int> positions (numberOfPoints);
+    for (int i = 0; i < numberOfPoints; ++i)
+    {
+        positions[i] = firstPosition + roundToInt (points.times.getUnchecked (i) * 0.001 * sampleRate);
+    }
+
+    return SpacialEnvelope::createExtended (positions,
+                                            points.xs.getRawDataPointer(),
+                                            points.ys.getRawDataPointer(),
+                                            points.zs.getRawDataPointer(),
+                                            numberOfPoints,
+                                            firstPosition,
+                                            lastPosition,
+                                            points.interpolationModes.getRawDataPointer());
+}
+
+double SpacialTrajectory::getDurationOfTheMotion (double durationInMs) const
+{
+    if (durationMode == durationModeOriginal)
+    {
+        return jmin (originalDurationInMs, durationInMs);
+    }
+    return durationInMs;
+}
+
+void SpacialTrajectory::calculateSegmentStarts (const TrajectoryParameter& stability,
+                                                double durationInMs,
+                                                Array<double>& segmentStarts)
+{
+    const int timeIncrement = 100;
+    int timeSegment = 0;
+    segmentStarts.add (0.0);
+
+    for (int time = timeIncrement; time < durationInMs; time += timeIncrement)
+    {
+        timeSegment += timeIncrement;
+        const int stabilityInMs = (int) (stability.getValueAt (time) * 1000.0);
+        if (timeSegment >= stabilityInMs)
+        {
+            segmentStarts.add (time);
+            timeSegment = 0;
+        }
+    }
+}
+
+//==============================================================================
+SpacialRotationTrajectory::SpacialRotationTrajectory (RotationMode rotationMode_,
+                                                      double startX_, double startY_, double startZ_,
+                                                      double centreX_, double centreY_,
+                                                      const TrajectoryParameter& speedOrAngle_,
+                                                      double originalDurationInMs_,
+                                                      DurationMode durationMode_)
+:   SpacialTrajectory (originalDurationInMs_, durationMode_),
+    rotationMode (rotationMode_),
+    startX (startX_), startY (startY_), startZ (startZ_),
+    centreX (centreX_), centreY (centreY_),
+    speedOrAngle (speedOrAngle_)
+{
+}
+
+SpacialRotationTrajectory::~SpacialRotationTrajectory ()
+{
+}
+
+void SpacialRotationTrajectory::calculatePoints (double durationInMs, Points& points) const
+{
+    double startAzimuth, radius;
+    getAzimuthAndRadius (startX, startY, centreX, centreY, startAzimuth, radius);
+
+    const double duration = getDurationOfTheMotion (durationInMs);
+    if (duration <= 0.0)
+    {
+        points.add (0.0, startX, startY, startZ);
+        return;
+    }
+
+    // The scaled trajectory is played faster (or slower) by this factor.
+    double scalingFactor = 1.0;
+    if (durationMode == durationModeScaled && originalDurationInMs > 0.0)
+    {
+        scalingFactor = originalDurationInMs / duration;
+    }
+
+    // The fastest change of the angle (in degrees per ms) determines the
+    // distance between the points.
+    const double angularSpeed = rotationMode == rotationModeAngle
+                                ? speedOrAngle.getMaximumSlope() * scalingFactor
+                                : speedOrAngle.getMaximumMagnitude() * 0.001;
+    // A rotation around the origin with a constant speed consists of arcs.
+    const bool arcs = rotationMode == rotationModeSpeed
+                      && speedOrAngle.getMaximumSlope() == 0.0
+                      && centreX == 0.0 && centreY == 0.0;
+    const SpacialEnvelope::InterpolationMode interpolationMode = arcs
+                                                                 ? SpacialEnvelope::interpolationModeArc
+                                                                 : SpacialEnvelope::interpolationModeLinear;
+    const double timeStep = angularSpeed > 0.0
+                            ? jmax (minimumTimeStep, (arcs ? maximumArcAngle : maximumAngleStep) / angularSpeed)
+                            : duration;
+
+    // The loop and the palindrome are evaluated one repetition after the
+    // other. At the borders of the repetitions, there are two points at
+    // the same time, since the angle might jump.
+    const bool repeating = (durationMode == durationModeLoop || durationMode == durationModePalindrome)
+                           && originalDurationInMs >= minimumTimeStep;
+    const double lengthOfARepetition = repeating ? originalDurationInMs : duration;
+
+    double startOfTheRepetition = 0.0;
+    double offset = 0.0;
+    bool backwards = false;
+    while (true)
+    {
+        const double endOfTheRepetition = jmin (startOfTheRepetition + lengthOfARepetition, duration);
+        const double length = endOfTheRepetition - startOfTheRepetition;
+        const int numberOfSteps = jmax (1, (int) ceil (length / timeStep));
+
+        for (int i = 0; i <= numberOfSteps; ++i)
+        {
+            const double time = length * i / numberOfSteps;
+            const double azimuth = (startAzimuth + getAngle (time, backwards, offset, scalingFactor))
+                                   / 180.0 * double_Pi;
+            points.add (startOfTheRepetition + time,
+                        centreX + radius * sin (azimuth),
+                        centreY + radius * cos (azimuth),
+                        startZ,
+                        interpolationMode);
+        }
+
+        if (endOfTheRepetition >= duration)
+        {
+            break;
+        }
+
+        offset = getAngle (lengthOfARepetition, backwards, offset, scalingFactor);
+        startOfTheRepetition = endOfTheRepetition;
+        backwards = durationMode == durationModePalindrome && ! backwards;
+    }
+}
+
+double SpacialRotationTrajectory::getAngle (double timeInMs, bool backwards,
+                                            double offset, double scalingFactor) const
+{
+    if (rotationMode == rotationModeAngle)
+    {
+        // The angle is given relative to the start position.
+        return speedOrAngle.getValueAt (backwards ? originalDurationInMs - timeInMs
+                                                  : timeInMs * scalingFactor);
+    }
+    else
+    {
+        // The speed is in degrees per second. Backwards, the speed is read
+        // backwards, but the direction of the rotation stays.
+        if (backwards)
+        {
+            return offset + 0.001 * (speedOrAngle.getIntegral (originalDurationInMs)
+                                     - speedOrAngle.getIntegral (originalDurationInMs - timeInMs));
+        }
+        return offset + 0.001 * speedOrAngle.getIntegral (timeInMs * scalingFactor) / scalingFactor;
+    }
+}
+
+//==============================================================================
+SpacialRandomTrajectory::SpacialRandomTrajectory (double startX_, double startY_, double startZ_,
+                                                  const TrajectoryParameter& corner1_,
+                                                  const TrajectoryParameter& corner2_,
+                                                  const TrajectoryParameter& minimumSpeed_,
+                                                  const TrajectoryParameter& maximumSpeed_,
+                                                  const TrajectoryParameter& stability_,
+                                                  uint32 seed_,
+                                                  double originalDurationInMs_,
+                                                  DurationMode durationMode_)
+:   SpacialTrajectory (originalDurationInMs_, durationMode_),
+    startX (startX_), startY (startY_), startZ (startZ_),
+    corner1 (corner1_),
+    corner2 (corner2_),
+    minimumSpeed (minimumSpeed_),
+    maximumSpeed (maximumSpeed_),
+    stability (stability_),
+    seed (seed_)
+{
+}
+
+SpacialRandomTrajectory::~SpacialRandomTrajectory ()
+{
+}
+
+void SpacialRandomTrajectory::calculatePoints (double durationInMs, Points& points) const
+{
+    const double duration = getDurationOfTheMotion (durationInMs);
+
+    Array<double> segmentStarts;
+    calculateSegmentStarts (stability, duration, segmentStarts);
+
+    TrajectoryRandom random (seed);
+    double x = startX;
+    double y = startY;
+    double z = startZ;
+    points.add (0.0, x, y, z);
+
+    for (int i = 0; i < segmentStarts.size(); ++i)
+    {
+        const double segmentStart = segmentStarts.getUnchecked (i);
+        const double segmentEnd = i + 1 < segmentStarts.size() ? segmentStarts.getUnchecked (i + 1) : duration;
+        const double length = segmentEnd - segmentStart;
+
+        // The bounding box is taken at the start of the segment.
+        double x1, y1, z1, x2, y2, z2;
+        corner1.getPositionAt (segmentStart, x1, y1, z1);
+        corner2.getPositionAt (segmentStart, x2, y2, z2);
+        const double xMin = jmin (x1, x2), xMax = jmax (x1, x2);
+        const double yMin = jmin (y1, y2), yMax = jmax (y1, y2);
+        const double zMin = jmin (z1, z2), zMax = jmax (z1, z2);
+
+        // A new direction and speed, drawn in the same order as in the GUI.
+        const double minimum = minimumSpeed.getValueAt (segmentStart);
+        const double maximum = maximumSpeed.getValueAt (segmentStart);
+        const double speed = minimum + random.nextFloat() * (maximum - minimum);
+        const double azimuth = random.nextFloat() * 360.0 / 180.0 * double_Pi;
+        const double elevation = zMin == zMax ? 0.0 : random.nextFloat() * 360.0 / 180.0 * double_Pi;
+        // In units per ms.
+        const double vx = 0.001 * speed * sin (azimuth) * cos (elevation);
+        const double vy = 0.001 * speed * cos (azimuth) * cos (elevation);
+        const double vz = 0.001 * speed * sin (elevation);
+
+        x = reflectIntoInterval (x, xMin, xMax);
+        y = reflectIntoInterval (y, yMin, yMax);
+        z = reflectIntoInterval (z, zMin, zMax);
+        if (segmentStart > 0.0)
+        {
+            points.add (segmentStart, x, y, z);
+        }
+
+        // The motion is straight in between the reflections.
+        Array<double> reflections;
+        addTimesOfReflections (x, vx, xMin, xMax, length, reflections);
+        addTimesOfReflections (y, vy, yMin, yMax, length, reflections);
+        addTimesOfReflections (z, vz, zMin, zMax, length, reflections);
+        for (int j = 0; j < reflections.size(); ++j)
+        {
+            const double time = reflections.getUnchecked (j);
+            points.add (segmentStart + time,
+                        reflectIntoInterval (x + vx * time, xMin, xMax),
+                        reflectIntoInterval (y + vy * time, yMin, yMax),
+                        reflectIntoInterval (z + vz * time, zMin, zMax));
+        }
+
+        x = reflectIntoInterval (x + vx * length, xMin, xMax);
+        y = reflectIntoInterval (y + vy * length, yMin, yMax);
+        z = reflectIntoInterval (z + vz * length, zMin, zMax);
+    }
+
+    if (duration > 0.0)
+    {
+        points.add (duration, x, y, z);
+    }
+}
+
+//==============================================================================
+SpacialCircularRandomTrajectory::SpacialCircularRandomTrajectory (double startX_, double startY_, double startZ_,
+                                                                  const TrajectoryParameter& minimumSpeed_,
+                                                                  const TrajectoryParameter& maximumSpeed_,
+                                                                  const TrajectoryParameter& stability_,
+                                                                  uint32 seed_,
+                                                                  double originalDurationInMs_,
+                                                                  DurationMode durationMode_)
+:   SpacialTrajectory (originalDurationInMs_, durationMode_),
+    startX (startX_), startY (startY_), startZ (startZ_),
+    minimumSpeed (minimumSpeed_),
+    maximumSpeed (maximumSpeed_),
+    stability (stability_),
+    seed (seed_)
+{
+}
+
+SpacialCircularRandomTrajectory::~SpacialCircularRandomTrajectory ()
+{
+}
+
+void SpacialCircularRandomTrajectory::calculatePoints (double durationInMs, Points& points) const
+{
+    const double duration = getDurationOfTheMotion (durationInMs);
+
+    double azimuth, radius;
+    getAzimuthAndRadius (startX, startY, 0.0, 0.0, azimuth, radius);
+
+    Array<double> segmentStarts;
+    calculateSegmentStarts (stability, duration, segmentStarts);
+
+    TrajectoryRandom random (seed);
+    for (int i = 0; i < segmentStarts.size(); ++i)
+    {
+        const double segmentStart = segmentStarts.getUnchecked (i);
+        const double segmentEnd = i + 1 < segmentStarts.size() ? segmentStarts.getUnchecked (i + 1) : duration;
+        const double length = segmentEnd - segmentStart;
+
+        // In degrees per second.
+        const double minimum = minimumSpeed.getValueAt (segmentStart);
+        const double maximum = maximumSpeed.getValueAt (segmentStart);
+        const double speed = minimum + random.nextFloat() * (maximum - minimum);
+
+        // The speed is constant, so the segment consists of arcs.
+        const double angle = 0.001 * speed * length;
+        const int numberOfSteps = jmax (1, (int) ceil (fabs (angle) / maximumArcAngle));
+        // The end of the segment is the start of the next one.
+        for (int j = 0; j < numberOfSteps; ++j)
+        {
+            const double a = (azimuth + angle * j / numberOfSteps) / 180.0 * double_Pi;
+            points.add (segmentStart + length * j / numberOfSteps,
+                        radius * sin (a),
+                        radius * cos (a),
+                        startZ,
+                        SpacialEnvelope::interpolationModeArc);
+        }
+        azimuth += angle;
+    }
+
+    const double a = azimuth / 180.0 * double_Pi;
+    points.add (jmax (0.0, duration), radius * sin (a), radius * cos (a), startZ);
+}
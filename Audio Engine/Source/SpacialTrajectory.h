@@ -0,0 +1,304 @@
+/*
+ *  SpacialTrajectory.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120903.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __SPACIALTRAJECTORY_HEADER__
+#define __SPACIALTRAJECTORY_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SpacialEnvelope.h"
+
+//==============================================================================
+/**
+ A parameter of a SpacialTrajectory that changes over time: A handful of
+ points (a time in ms, relative to the start of the trajectory, and a value
+ or a position), linearly interpolated in between. Before the first point,
+ the first one is used, after the last point, the last one. This
+ corresponds to the parameter breakpoints of the trajectories in the GUI.
+ */
+class JUCE_API  TrajectoryParameter
+{
+public:
+    /** Creates a parameter without any points. Its value is 0. */
+    TrajectoryParameter ();
+
+    /** Creates a parameter with a constant value. */
+    explicit TrajectoryParameter (double value);
+
+    /** Destructor. */
+    ~TrajectoryParameter ();
+
+    /** Appends a point. The points have to be added in the order of their
+     time. */
+    void addValue (double timeInMs, double value);
+
+    /** Appends a point with a position. */
+    void addPosition (double timeInMs, double x, double y, double z);
+
+    /** Returns the number of points. */
+    int size () const                   { return times.size(); }
+
+    /** Returns the interpolated value at a time. */
+    double getValueAt (double timeInMs) const;
+
+    /** Returns the interpolated position at a time. */
+    void getPositionAt (double timeInMs, double& x, double& y, double& z) const;
+
+    /** Returns the integral of the value from 0 to timeInMs (in value * ms). */
+    double getIntegral (double timeInMs) const;
+
+    /** Returns the largest absolute value. */
+    double getMaximumMagnitude () const;
+
+    /** Returns the largest absolute change of the value per ms. */
+    double getMaximumSlope () const;
+
+private:
+    /** Returns the index of the last point at or before the time, -1 if
+     there is none. */
+    int findPointBefore (double timeInMs) const;
+
+    Array<double> times;
+    Array<double> xs;
+    Array<double> ys;
+    Array<double> zs;
+
+    JUCE_LEAK_DETECTOR (TrajectoryParameter);
+};
+
+//==============================================================================
+/**
+ A motion that is described by a few parameters (like a rotation or a
+ random walk), instead of a list of points.
+
+ The GUI hands the parameters to the engine (see
+ AmbisonicsAudioEngine::setSpacialTrajectoryForRegion) and the trajectory
+ is evaluated there, for the duration of the region. Circular motion around
+ the origin with a constant speed becomes arcs (see
+ SpacialEnvelope::interpolationModeArc) of at most maximumArcAngle, other
+ circular motion is sampled such that the direction changes by at most
+ maximumAngleStep between two points. Straight motion (the random walk)
+ only gets points where it changes its direction. This is much less than
+ the points every 100 ms the GUI would send, and smoother.
+
+ The random trajectories use a TrajectoryRandom with a seed, such that the
+ same parameters always result in the same motion.
+ */
+class JUCE_API  SpacialTrajectory
+{
+public:
+    /** How the trajectory is fitted to a region of a different duration.
+     The values are the same as the ones of the DurationMode of the GUI. */
+    enum DurationMode
+    {
+        durationModeOriginal = 0,   ///< Played once, then the source stays.
+        durationModeScaled,         ///< Stretched to the region.
+        durationModeLoop,           ///< Repeated.
+        durationModePalindrome      ///< Repeated, every other time backwards.
+    };
+
+    /** Destructor. */
+    virtual ~SpacialTrajectory ();
+
+    /**
+     Evaluates the trajectory for a region.
+
+     @param firstPosition   The start of the region, in samples relative to
+                            the start of the audio file. The time 0 of the
+                            trajectory.
+     @param lastPosition    The position after the end of the region, see
+                            SpacialEnvelope::createExtended.
+     @param sampleRate      The sample rate of the positions.
+     @return                A new envelope.
+     */
+    SpacialEnvelope* createSpacialEnvelope (int firstPosition,
+                                            int lastPosition,
+                                            double sampleRate) const;
+
+    /** The largest change of the direction (in degrees) between two points
+     of circular motion. */
+    static const double maximumAngleStep;
+
+    /** The largest angle (in degrees) of an arc. */
+    static const double maximumArcAngle;
+
+    /** The smallest distance in time (in ms) between two points of circular
+     motion, which limits the number of points of a fast rotation. */
+    static const double minimumTimeStep;
+
+protected:
+    //==============================================================================
+    /** The points of a trajectory, while it is evaluated. */
+    class Points
+    {
+    public:
+        void add (double timeInMs, double x, double y, double z,
+                  SpacialEnvelope::InterpolationMode interpolationMode = SpacialEnvelope::interpolationModeLinear);
+
+        Array<double> times;
+        Array<double> xs;
+        Array<double> ys;
+        Array<double> zs;
+        /** The mode of the segment that starts at each point. */
+        Array<int> interpolationModes;
+    };
+
+    /**
+     A linear congruential generator. The GUI uses the same one for the
+     breakpoints it displays (see RandomTrajectory and
+     CircularRandomTrajectory), such that both show the same motion.
+     */
+    class TrajectoryRandom
+    {
+    public:
+        explicit TrajectoryRandom (uint32 seed) : state (seed) {}
+
+        /** Returns a value in [0, 1). */
+        float nextFloat ()
+        {
+            state = state * 1664525 + 1013904223;
+            return (state >> 8) / 16777216.0f;
+        }
+
+    private:
+        uint32 state;
+    };
+
+    //==============================================================================
+    SpacialTrajectory (double originalDurationInMs, DurationMode durationMode);
+
+    /** Adds the points of the trajectory (in the order of their time) for a
+     region of the given duration. */
+    virtual void calculatePoints (double durationInMs, Points& points) const = 0;
+
+    /** The time the source moves in a region of the given duration: At
+     most the original duration in the durationModeOriginal. */
+    double getDurationOfTheMotion (double durationInMs) const;
+
+    /**
+     Returns the times at which the random trajectories choose a new
+     motion, exactly like the GUI: It checks the stability (in seconds)
+     every 100 ms. The first time is 0.
+     */
+    static void calculateSegmentStarts (const TrajectoryParameter& stability,
+                                        double durationInMs,
+                                        Array<double>& segmentStarts);
+
+    const double originalDurationInMs;
+    const DurationMode durationMode;
+
+private:
+    JUCE_DECLARE_NON_COPYABLE (SpacialTrajectory);
+};
+
+//==============================================================================
+/**
+ A rotation around a vertical axis through a centre (see
+ RotationTrajectory in the GUI). Either the angle (in degrees) or the speed
+ (in degrees per second) is given as a parameter.
+ */
+class JUCE_API  SpacialRotationTrajectory  : public SpacialTrajectory
+{
+public:
+    enum RotationMode
+    {
+        rotationModeSpeed = 0,
+        rotationModeAngle
+    };
+
+    SpacialRotationTrajectory (RotationMode rotationMode,
+                               double startX, double startY, double startZ,
+                               double centreX, double centreY,
+                               const TrajectoryParameter& speedOrAngle,
+                               double originalDurationInMs,
+                               DurationMode durationMode);
+
+    ~SpacialRotationTrajectory ();
+
+protected:
+    void calculatePoints (double durationInMs, Points& points) const;
+
+private:
+    /** The angle by which the source has been rotated at a time (in ms)
+     relative to the start of a repetition. The offset is the angle at
+     the start of the repetition. */
+    double getAngle (double timeInMs, bool backwards, double offset, double scalingFactor) const;
+
+    const RotationMode rotationMode;
+    const double startX, startY, startZ;
+    const double centreX, centreY;
+    const TrajectoryParameter speedOrAngle;
+};
+
+//==============================================================================
+/**
+ A straight motion in a random direction with a random speed (in units per
+ second), which bounces off the walls of a bounding box and changes
+ whenever the stability (in seconds) has passed (see RandomTrajectory in
+ the GUI). The corners of the bounding box are given as positions.
+ */
+class JUCE_API  SpacialRandomTrajectory  : public SpacialTrajectory
+{
+public:
+    SpacialRandomTrajectory (double startX, double startY, double startZ,
+                             const TrajectoryParameter& corner1,
+                             const TrajectoryParameter& corner2,
+                             const TrajectoryParameter& minimumSpeed,
+                             const TrajectoryParameter& maximumSpeed,
+                             const TrajectoryParameter& stability,
+                             uint32 seed,
+                             double originalDurationInMs,
+                             DurationMode durationMode);
+
+    ~SpacialRandomTrajectory ();
+
+protected:
+    void calculatePoints (double durationInMs, Points& points) const;
+
+private:
+    const double startX, startY, startZ;
+    const TrajectoryParameter corner1;
+    const TrajectoryParameter corner2;
+    const TrajectoryParameter minimumSpeed;
+    const TrajectoryParameter maximumSpeed;
+    const TrajectoryParameter stability;
+    const uint32 seed;
+};
+
+//==============================================================================
+/**
+ A rotation around the origin with a random speed (in degrees per second),
+ which changes whenever the stability (in seconds) has passed (see
+ CircularRandomTrajectory in the GUI).
+ */
+class JUCE_API  SpacialCircularRandomTrajectory  : public SpacialTrajectory
+{
+public:
+    SpacialCircularRandomTrajectory (double startX, double startY, double startZ,
+                                     const TrajectoryParameter& minimumSpeed,
+                                     const TrajectoryParameter& maximumSpeed,
+                                     const TrajectoryParameter& stability,
+                                     uint32 seed,
+                                     double originalDurationInMs,
+                                     DurationMode durationMode);
+
+    ~SpacialCircularRandomTrajectory ();
+
+protected:
+    void calculatePoints (double durationInMs, Points& points) const;
+
+private:
+    const double startX, startY, startZ;
+    const TrajectoryParameter minimumSpeed;
+    const TrajectoryParameter maximumSpeed;
+    const TrajectoryParameter stability;
+    const uint32 seed;
+};
+
+
+#endif   // __SPACIALTRAJECTORY_HEADER__
@@ -0,0 +1,95 @@
+/*
+ *  SphericalHarmonics.cpp
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120820.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#include "SphericalHarmonics.h"
+
+
+int SphericalHarmonics::getNumberOfChannels (int order)
+{
+    return (order + 1) * (order + 1);
+}
+
+void SphericalHarmonics::calculate (int order,
+                                    double x,
+                                    double y,
+                                    double z,
+                                    float* coefficients)
+{
+    jassert (order >= 0 && order <= maximumOrder);
+    order = jlimit (0, (int) maximumOrder, order);
+
+    // cos(elevation)^m * cos(m * azimuth) and cos(elevation)^m * sin(m * azimuth),
+    // calculated as the powers of the complex number
+    // cos(elevation) * e^(i * azimuth) = y - i*x (no trigonometric functions needed).
+    double cosineTerm[maximumOrder + 1];
+    double sineTerm[maximumOrder + 1];
+    cosineTerm[0] = 1.0;
+    sineTerm[0] = 0.0;
+    for (int m = 1; m <= order; ++m)
+    {
+        cosineTerm[m] = cosineTerm[m-1] * y + sineTerm[m-1] * x;
+        sineTerm[m] = sineTerm[m-1] * y - cosineTerm[m-1] * x;
+    }
+
+    // The associated Legendre functions P_n^m(z), without the factor
+    // cos(elevation)^m (it's part of the terms above) and without the
+    // Condon-Shortley phase. legendre[n][m].
+    double legendre[maximumOrder + 1][maximumOrder + 1];
+    double doubleFactorial = 1.0; // (2m-1)!!
+    for (int m = 0; m <= order; ++m)
+    {
+        if (m > 0)
+        {
+            doubleFactorial *= 2*m - 1;
+        }
+        legendre[m][m] = doubleFactorial;
+        if (m + 1 <= order)
+        {
+            legendre[m+1][m] = z * (2*m + 1) * legendre[m][m];
+        }
+        for (int n = m + 2; n <= order; ++n)
+        {
+            legendre[n][m] = ((2*n - 1) * z * legendre[n-1][m] - (n + m - 1) * legendre[n-2][m]) / (n - m);
+        }
+    }
+
+    for (int n = 0; n <= order; ++n)
+    {
+        coefficients[n*n + n] = (float) legendre[n][0];
+
+        // SN3D: sqrt(2 * (n-m)! / (n+m)!) for m > 0.
+        double factorialRatio = 1.0; // (n-m)! / (n+m)!
+        for (int m = 1; m <= n; ++m)
+        {
+            factorialRatio /= double(n + m) * double(n - m + 1);
+            const double normalisedLegendre = sqrt (2.0 * factorialRatio) * legendre[n][m];
+            coefficients[n*n + n + m] = (float) (normalisedLegendre * cosineTerm[m]);
+            coefficients[n*n + n - m] = (float) (normalisedLegendre * sineTerm[m]);
+        }
+    }
+}
+
+double SphericalHarmonics::legendrePolynomial (int degree, double t)
+{
+    if (degree == 0)
+    {
+        return 1.0;
+    }
+
+    // Bonnet's recursion formula.
+    double previous = 1.0;
+    double current = t;
+    for (int n = 2; n <= degree; ++n)
+    {
+        const double next = ((2*n - 1) * t * current - (n - 1) * previous) / n;
+        previous = current;
+        current = next;
+    }
+    return current;
+}
@@ -0,0 +1,69 @@
+/*
+ *  SphericalHarmonics.h
+ *  Choreographer
+ *
+ *  Created by Samuel Gaehwiler on 120820.
+ *  Copyright 2012. All rights reserved.
+ *
+ */
+
+#ifndef __SPHERICALHARMONICS_HEADER__
+#define __SPHERICALHARMONICS_HEADER__
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+/**
+ Real valued spherical harmonics, as used for the encoding to a Higher Order
+ Ambisonics (HOA) bus.
+
+ The conventions are the ones of the AmbiX format: The channels are ordered
+ according to the Ambisonics Channel Number (ACN = n*n + n + m, for the
+ degree n and the index m, -n <= m <= n) and they are normalised according
+ to SN3D (no Condon-Shortley phase).
+ The azimuth is measured from the front (the y axis) towards the left
+ (the negative x axis), the elevation from the horizontal plane towards the
+ sky (the z axis).
+
+ An N-th order bus has (N+1)^2 channels.
+ With SN3D, the addition theorem reads
+ \f[ \sum_{m=-n}^{n} Y_{n}^{m}(a) Y_{n}^{m}(b) = P_n(\cos \gamma), \f]
+ where \f$\gamma\f$ is the angle between the directions a and b and
+ \f$P_n\f$ the Legendre polynomial of degree n. This is used by the
+ HOADecoder.
+ */
+class JUCE_API  SphericalHarmonics
+{
+public:
+    /** The highest supported order. */
+    enum { maximumOrder = 10 };
+
+    /** Returns (order+1)^2, the number of channels of a bus of this order. */
+    static int getNumberOfChannels (int order);
+
+    /**
+     Calculates the values of all spherical harmonics up to the given order
+     in the direction (x, y, z).
+
+     @param order           The order, 0 <= order <= maximumOrder.
+     @param x, y, z         The direction. Has to be on the unit sphere.
+     @param coefficients    The destination, getNumberOfChannels(order)
+                            values will be written, in ACN order.
+     */
+    static void calculate (int order,
+                           double x,
+                           double y,
+                           double z,
+                           float* coefficients);
+
+    /**
+     Returns the Legendre polynomial of the given degree at t.
+     */
+    static double legendrePolynomial (int degree, double t);
+
+private:
+    SphericalHarmonics();
+};
+
+
+#endif   // __SPHERICALHARMONICS_HEADER__
@@ -95,6 +95,16 @@ typedef enum _TrajectoryDurationMode
 	durationModePalindrome
 } TrajectoryDurationMode;
 
+// Random numbers for the random trajectories
+// (the same sequence as SpacialTrajectory::TrajectoryRandom in the audio
+// engine, such that the engine plays the motion the GUI displays)
+
+static inline float CHTrajectoryRandomFloat(unsigned int *state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 8) / 16777216.0f;
+}
+
 
 //___________________________________________________________________________________________________________________________
 
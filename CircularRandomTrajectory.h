@@ -13,7 +13,10 @@
 @interface CircularRandomTrajectory : Trajectory
 {
     Breakpoint *initialPosition;
+    unsigned int randomSeed;
     Breakpoint *rotationCentre;
 }
 
+- (unsigned int)randomSeed;
+
 @end
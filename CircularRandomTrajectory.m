@@ -22,6 +22,8 @@
         [initialPosition setDescriptor:@"Init"];
         [parameterBreakpointArray addBreakpoint:initialPosition];
         
+        randomSeed = arc4random();
+        
 		rotationCentre = [[Breakpoint breakpointWithPosition:[SpatialPosition positionWithX:0.0 Y:0 Z:0]] retain];
         [rotationCentre setDescriptor:@"Center"];
         [parameterBreakpointArray addBreakpoint:rotationCentre];
@@ -60,6 +62,11 @@
             initialPosition = [bp retain];
     }
     
+    if([coder containsValueForKey:@"randomSeed"])
+        randomSeed = (unsigned int)[coder decodeInt32ForKey:@"randomSeed"];
+    else
+        randomSeed = arc4random();
+    
 	return self;
 }
 
@@ -67,6 +74,7 @@
 {
     [super encodeWithCoder:coder];
     [coder encodeObject:parameterBreakpointArray forKey:@"parameterBreakpointArray"];
+    [coder encodeInt32:(int32_t)randomSeed forKey:@"randomSeed"];
 }
 
 - (void)dealloc
@@ -75,6 +83,11 @@
 	[super dealloc];
 }
 
+- (unsigned int)randomSeed
+{
+    return randomSeed;
+}
+
 - (NSArray *)playbackBreakpointArrayWithInitialPosition:(SpatialPosition *)pos duration:(long)dur mode:(int)mode
 {
 	NSUInteger time = 0;
@@ -83,6 +96,7 @@
 	int timeIncrement = 100;
     int stability = 100;
     BOOL needsBreakpoint;
+    unsigned int randomState = randomSeed; // the same motion every time
     float minSpeed, maxSpeed, currentSpeed;
     
 	Breakpoint *bp;
@@ -118,7 +132,7 @@
             minSpeed = [minSpeedBreakpoints interpolatedValueAtTime:time];
             maxSpeed = [maxSpeedBreakpoints interpolatedValueAtTime:time];
             
-			currentSpeed = minSpeed + (float)rand() / RAND_MAX * (maxSpeed - minSpeed);
+			currentSpeed = minSpeed + CHTrajectoryRandomFloat(&randomState) * (maxSpeed - minSpeed);
             needsBreakpoint = YES;
             
             timeSegment = 0;
@@ -238,6 +238,9 @@
     [updateRegions release];
 	updateRegions = [[NSMutableSet alloc] init];
 	
+	// all changes of this notification are heard at once
+	[[AudioEngine sharedAudioEngine] beginEditTransaction];
+	
 	NSDictionary *info = [notification userInfo];
 
 	for (id key in info)
@@ -340,6 +343,7 @@
 		[[AudioEngine sharedAudioEngine] modifyAudioRegion:region];			
 	}
 	
+	[[AudioEngine sharedAudioEngine] commitEditTransaction];
 }
 
 
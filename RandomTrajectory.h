@@ -13,9 +13,11 @@
 @interface RandomTrajectory : Trajectory
 {
     Breakpoint *initialPosition;
+    unsigned int randomSeed;
 }
 
 - (SpatialPosition *)point1AtTime:(NSNumber *)time;
 - (SpatialPosition *)point2AtTime:(NSNumber *)time;
+- (unsigned int)randomSeed;
 
 @end
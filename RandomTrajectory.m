@@ -23,6 +23,8 @@
         [initialPosition setDescriptor:@"Init"];
         [parameterBreakpointArray addBreakpoint:initialPosition];
         
+        randomSeed = arc4random();
+        
         Breakpoint *bp;
 		
         // bounding volume
@@ -67,6 +69,11 @@
         if([[bp descriptor] isEqualToString:@"Init"])
             initialPosition = [bp retain];
     }
+    
+    if([coder containsValueForKey:@"randomSeed"])
+        randomSeed = (unsigned int)[coder decodeInt32ForKey:@"randomSeed"];
+    else
+        randomSeed = arc4random();
 
 	return self;
 }
@@ -75,6 +82,7 @@
 {
     [super encodeWithCoder:coder];
     [coder encodeObject:parameterBreakpointArray forKey:@"parameterBreakpointArray"];
+    [coder encodeInt32:(int32_t)randomSeed forKey:@"randomSeed"];
 }
 
 - (void)dealloc
@@ -84,6 +92,11 @@
 }
 
 
+- (unsigned int)randomSeed
+{
+    return randomSeed;
+}
+
 - (NSArray *)playbackBreakpointArrayWithInitialPosition:(SpatialPosition *)pos duration:(long)dur mode:(int)mode
 {
 	NSUInteger time = 0;
@@ -92,6 +105,7 @@
 	int timeIncrement = 100;
     int stability = 100;
     BOOL needsBreakpoint;
+    unsigned int randomState = randomSeed; // the same motion every time
     float minSpeed, maxSpeed;
     float xMin, yMin, zMin;
     float xMax, yMax, zMax;
@@ -173,9 +187,9 @@
             maxSpeed = [maxSpeedBreakpoints interpolatedValueAtTime:time];
 
 			// calculate a new vector
-            vector.d = minSpeed + (float)rand() / RAND_MAX * (maxSpeed - minSpeed);
-			vector.a = (float)rand() / RAND_MAX * 360;			            
-            vector.e = zMin == zMax ? 0 : (float)rand() / RAND_MAX * 360;
+            vector.d = minSpeed + CHTrajectoryRandomFloat(&randomState) * (maxSpeed - minSpeed);
+			vector.a = CHTrajectoryRandomFloat(&randomState) * 360;			            
+            vector.e = zMin == zMax ? 0 : CHTrajectoryRandomFloat(&randomState) * 360;
             needsBreakpoint = YES;
 
             timeSegment = 0;